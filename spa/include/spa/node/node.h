@@ -237,6 +237,11 @@ struct spa_node_callbacks {
 #define SPA_NODE_BUFFERS_FLAG_ALLOC	(1 << 0)	/**< Allocate memory for the buffers. This flag
 							  *  is ignored when the port does not have the
 							  *  SPA_PORT_FLAG_CAN_ALLOC_BUFFERS set. */
+#define SPA_NODE_BUFFERS_FLAG_LOCAL	(1 << 1)	/**< The buffers are shared with a node in
+							  *  the same process that accesses the data
+							  *  through the data pointers in each cycle.
+							  *  The port can point dynamic data to other
+							  *  memory while it owns the buffer. */
 
 
 #define SPA_NODE_METHOD_ADD_LISTENER		0
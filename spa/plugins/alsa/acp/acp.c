@@ -5,6 +5,9 @@
 #include "acp.h"
 #include "alsa-mixer.h"
 #include "alsa-ucm.h"
+#include "probe-cache.h"
+
+#include <time.h>
 
 #include <spa/utils/string.h>
 #include <spa/utils/json.h>
@@ -17,6 +20,13 @@ struct spa_i18n *acp_i18n;
 
 #define DEFAULT_RATE	48000
 
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
 #define VOLUME_ACCURACY (PA_VOLUME_NORM/100)  /* don't require volume adjustments to be perfectly correct. don't necessarily extend granularity in software unless the differences get greater than this level */
 
 static const uint32_t channel_table[PA_CHANNEL_POSITION_MAX] = {
@@ -1639,9 +1649,12 @@ struct acp_card *acp_card_new(uint32_t index, const struct acp_dict *props)
 {
 	pa_card *impl;
 	struct acp_card *card;
-	const char *s, *profile_set = NULL, *profile = NULL;
+	const char *s, *profile_set = NULL, *profile = NULL, *cache_dir = NULL;
+	struct probe_cache cache;
+	bool use_cache = true;
 	char device_id[16];
 	uint32_t profile_index;
+	uint64_t t[4];
 	int res;
 
 	impl = calloc(1, sizeof(*impl));
@@ -1649,6 +1662,7 @@ struct acp_card *acp_card_new(uint32_t index, const struct acp_dict *props)
 		return NULL;
 
 	pa_alsa_refcnt_inc();
+	pa_alsa_config_update();
 
 	snprintf(device_id, sizeof(device_id), "%d", index);
 
@@ -1684,6 +1698,10 @@ struct acp_card *acp_card_new(uint32_t index, const struct acp_dict *props)
 			impl->rate = atoi(s);
 		if ((s = acp_dict_lookup(props, "api.acp.pro-channels")) != NULL)
 			impl->pro_channels = atoi(s);
+		if ((s = acp_dict_lookup(props, "api.acp.probe-cache")) != NULL)
+			use_cache = spa_atob(s);
+		if ((s = acp_dict_lookup(props, "api.acp.probe-cache-dir")) != NULL)
+			cache_dir = s;
 	}
 
 	impl->ucm.default_sample_spec.format = PA_SAMPLE_S16NE;
@@ -1704,7 +1722,7 @@ struct acp_card *acp_card_new(uint32_t index, const struct acp_dict *props)
 			pa_idxset_string_compare_func, NULL,
 			(pa_free_cb_t) port_free);
 
-	snd_config_update_free_global();
+	t[0] = get_time_ns();
 
 	res = impl->use_ucm ? pa_alsa_ucm_query_profiles(&impl->ucm, card->index) : -1;
 	if (res == -PA_ALSA_ERR_UCM_LINKED) {
@@ -1725,12 +1743,28 @@ struct acp_card *acp_card_new(uint32_t index, const struct acp_dict *props)
 
 	impl->profile_set->ignore_dB = impl->ignore_dB;
 
+	/* UCM profiles are not probed by opening the PCMs */
+	use_cache = use_cache && !impl->use_ucm &&
+		probe_cache_init(&cache, cache_dir, card->index,
+				impl->proplist, impl->profile_set, impl->rate) == 0;
+	if (use_cache)
+		probe_cache_load(&cache, impl->profile_set);
+
+	t[1] = get_time_ns();
+
 	pa_alsa_profile_set_probe(impl->profile_set, impl->ucm.mixers,
 			device_id,
 			&impl->ucm.default_sample_spec,
 			impl->ucm.default_n_fragments,
 			impl->ucm.default_fragment_size_msec);
 
+	if (use_cache) {
+		probe_cache_save(&cache, impl->profile_set);
+		probe_cache_clear(&cache);
+	}
+
+	t[2] = get_time_ns();
+
 	pa_alsa_init_proplist_card(NULL, impl->proplist, impl->card.index);
 	pa_proplist_sets(impl->proplist, PA_PROP_DEVICE_STRING, device_id);
 	pa_alsa_init_description(impl->proplist, NULL);
@@ -1759,6 +1793,13 @@ struct acp_card *acp_card_new(uint32_t index, const struct acp_dict *props)
 
 	init_eld_ctls(impl);
 
+	t[3] = get_time_ns();
+	pa_log_info("card %d: %s config %.3fms, probe %.3fms, profiles %.3fms, "
+			"%u profiles %u ports %u devices", card->index,
+			impl->use_ucm ? "UCM" : "profile set",
+			(t[1] - t[0]) / 1e6, (t[2] - t[1]) / 1e6, (t[3] - t[2]) / 1e6,
+			card->n_profiles, card->n_ports, card->n_devices);
+
 	return &impl->card;
 error:
 	pa_alsa_refcnt_dec();
@@ -2087,3 +2128,18 @@ void acp_set_log_level(int level)
 {
 	_acp_log_level = level;
 }
+
+void acp_config_update(void)
+{
+	pa_alsa_config_update();
+}
+
+void acp_probe_begin(void)
+{
+	pa_alsa_probe_begin();
+}
+
+void acp_probe_end(void)
+{
+	pa_alsa_probe_end();
+}
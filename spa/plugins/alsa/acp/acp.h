@@ -284,6 +284,14 @@ typedef void (*acp_log_func) (void *data,
 void acp_set_log_func(acp_log_func, void *data);
 void acp_set_log_level(int level);
 
+/* Reload the global ALSA configuration. Nothing is done while cards are
+ * probed in other threads. */
+void acp_config_update(void);
+/* Call before a card is probed in another thread and after the probe is
+ * done. The first probe reloads the global ALSA configuration. */
+void acp_probe_begin(void);
+void acp_probe_end(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -3834,6 +3834,7 @@ void pa_alsa_profile_set_free(pa_alsa_profile_set *ps) {
     if (ps->decibel_fixes)
         pa_hashmap_free(ps->decibel_fixes);
 
+    pa_xfree(ps->fname);
     pa_xfree(ps);
 }
 
@@ -4821,7 +4822,8 @@ pa_alsa_profile_set* pa_alsa_profile_set_new(const char *fname, const pa_channel
     int r;
     void *state;
 
-    static pa_config_item items[] = {
+    /* not static, cards can be probed from several threads */
+    pa_config_item items[] = {
         /* [General] */
         { "auto-profiles",          pa_config_parse_bool,         NULL, "General" },
 
@@ -4876,7 +4878,7 @@ pa_alsa_profile_set* pa_alsa_profile_set_new(const char *fname, const pa_channel
 	}
     }
     r = pa_config_parse(fn, NULL, items, NULL, false, ps);
-    pa_xfree(fn);
+    ps->fname = fn;
 
     if (r < 0)
         goto fail;
@@ -4982,6 +4984,23 @@ static snd_pcm_t* mapping_open_pcm(pa_alsa_mapping *m,
     return handle;
 }
 
+/* Only errors that will not go away by themselves make a profile
+ * unsupported for the probe cache, a busy device can be opened later.
+ * Returns true when the error is definitive. */
+static bool profile_probe_failed(pa_alsa_profile_set *ps, pa_alsa_profile *p, int err) {
+    char *n;
+
+    if (err == ENOENT || err == EINVAL)
+        return true;
+
+    if (ps->probe_transient) {
+        n = pa_xstrdup(p->name);
+        if (pa_hashmap_put(ps->probe_transient, n, n) < 0)
+            pa_xfree(n);
+    }
+    return false;
+}
+
 static void paths_drop_unused(pa_hashmap* h, pa_hashmap *keep) {
 
     void* state = NULL;
@@ -5087,6 +5106,12 @@ void pa_alsa_profile_set_probe(
         /* Skip if this is already marked that it is supported (i.e. from the config file) */
         if (!p->supported) {
 
+            /* Skip profiles that were found unsupported before */
+            if (ps->probe_skip && pa_hashmap_get(ps->probe_skip, p->name)) {
+                pa_log_debug("Skipping profile %s, cached as unsupported", p->name);
+                continue;
+            }
+
             profile_finalize_probing(last, p);
             p->supported = true;
 
@@ -5126,7 +5151,8 @@ void pa_alsa_profile_set_probe(
                                                            default_n_fragments,
                                                            default_fragment_size_msec))) {
                         p->supported = false;
-                        if (pa_idxset_size(p->output_mappings) == 1 &&
+                        if (profile_probe_failed(ps, p, errno) &&
+                            pa_idxset_size(p->output_mappings) == 1 &&
                             ((!p->input_mappings) || pa_idxset_size(p->input_mappings) == 0)) {
                             pa_log_debug("Caching failure to open output:%s", m->name);
                             pa_hashmap_put(broken_outputs, m, m);
@@ -5150,7 +5176,8 @@ void pa_alsa_profile_set_probe(
                                                           default_n_fragments,
                                                           default_fragment_size_msec))) {
                         p->supported = false;
-                        if (pa_idxset_size(p->input_mappings) == 1 &&
+                        if (profile_probe_failed(ps, p, errno) &&
+                            pa_idxset_size(p->input_mappings) == 1 &&
                             ((!p->output_mappings) || pa_idxset_size(p->output_mappings) == 0)) {
                             pa_log_debug("Caching failure to open input:%s", m->name);
                             pa_hashmap_put(broken_inputs, m, m);
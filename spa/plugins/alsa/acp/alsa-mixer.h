@@ -415,6 +415,14 @@ struct pa_alsa_profile_set {
     pa_hashmap *input_paths;
     pa_hashmap *output_paths;
 
+    /* The profile set file that was loaded */
+    char *fname;
+    /* Profiles known to be unsupported, they are not probed. Not owned. */
+    pa_hashmap *probe_skip;
+    /* Names of the profiles that failed to probe with an error that can go
+     * away, like a busy device. Not owned. */
+    pa_hashmap *probe_transient;
+
     bool auto_profiles;
     bool ignore_dB:1;
     bool probed:1;
@@ -20,6 +20,8 @@
 
 #include "config.h"
 
+#include <errno.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <alsa/asoundlib.h>
 
@@ -769,6 +771,7 @@ snd_pcm_t *pa_alsa_open_by_device_string(
             pa_log("Device %s has %u channels, but PulseAudio supports only %u channels. Unable to use the device.",
                    d, ss->channels, PA_CHANNELS_MAX);
             pa_alsa_close(&pcm_handle);
+            err = -EINVAL;
             goto fail;
         }
 
@@ -786,6 +789,8 @@ snd_pcm_t *pa_alsa_open_by_device_string(
 fail:
     pa_xfree(d);
 
+    /* the probe cache needs to know why the device could not be used */
+    errno = -err;
     return NULL;
 }
 
@@ -807,6 +812,7 @@ snd_pcm_t *pa_alsa_open_by_template(
 
     snd_pcm_t *pcm_handle;
     char **i;
+    int err = ENOENT;
 
     for (i = template; *i; i++) {
         char *d;
@@ -828,12 +834,18 @@ snd_pcm_t *pa_alsa_open_by_template(
                 query_supported_rates,
                 require_exact_channel_number);
 
-        pa_xfree(d);
-
-        if (pcm_handle)
+        if (pcm_handle) {
+            pa_xfree(d);
             return pcm_handle;
+        }
+        /* report a busy device over the other errors */
+        if (err != EBUSY && err != EAGAIN)
+            err = errno;
+
+        pa_xfree(d);
     }
 
+    errno = err;
     return NULL;
 }
 
@@ -910,6 +922,33 @@ static PA_PRINTF_FUNC(5,6) void alsa_error_handler(const char *file, int line, c
 //    pa_xfree(alsa_file);
 }
 
+/* The global configuration is shared by all cards and PCMs of the process.
+ * It is not reloaded while cards are probed in other threads, the probes use
+ * the configuration that was loaded when the first of them started. */
+static pthread_mutex_t config_lock = PTHREAD_MUTEX_INITIALIZER;
+static int n_probing = 0;
+
+void pa_alsa_config_update(void) {
+    pthread_mutex_lock(&config_lock);
+    if (n_probing == 0)
+        snd_config_update_free_global();
+    pthread_mutex_unlock(&config_lock);
+}
+
+void pa_alsa_probe_begin(void) {
+    pthread_mutex_lock(&config_lock);
+    if (n_probing++ == 0)
+        snd_config_update_free_global();
+    pthread_mutex_unlock(&config_lock);
+}
+
+void pa_alsa_probe_end(void) {
+    pthread_mutex_lock(&config_lock);
+    pa_assert_se(n_probing-- >= 1);
+    pthread_mutex_unlock(&config_lock);
+}
+
+static pthread_mutex_t refcnt_lock = PTHREAD_MUTEX_INITIALIZER;
 static int n_error_handler_installed = 0;
 
 typedef void (*snd_lib2_error_handler_t)(const char *file, int line, const char *function, int err, const char *fmt, ...) PA_PRINTF_FUNC(5,6) /* __attribute__ ((format (printf, 5, 6))) */;
@@ -919,23 +958,27 @@ extern int snd_lib_error_set_handler(snd_lib2_error_handler_t handler);
 extern snd_local_error_handler_t snd_lib_error_set_local(snd_lib2_local_handler_t handler);
 
 void pa_alsa_refcnt_inc(void) {
-    /* This is not really thread safe, but we do our best */
-   if (n_error_handler_installed++ == 0) {
+    /* cards can be created and destroyed from several threads */
+    pthread_mutex_lock(&refcnt_lock);
+    if (n_error_handler_installed++ == 0) {
         snd_lib_error_set_handler(alsa_error_handler);
         snd_lib_error_set_local(alsa_local_handler);
-   }
+    }
+    pthread_mutex_unlock(&refcnt_lock);
 }
 
 void pa_alsa_refcnt_dec(void) {
     int r;
 
+    pthread_mutex_lock(&refcnt_lock);
     pa_assert_se((r = n_error_handler_installed--) >= 1);
 
     if (r == 1) {
         snd_lib_error_set_handler(NULL);
         snd_lib_error_set_local(NULL);
-        snd_config_update_free_global();
+        pa_alsa_config_update();
     }
+    pthread_mutex_unlock(&refcnt_lock);
 }
 
 bool pa_alsa_init_description(pa_proplist *p, pa_card *card) {
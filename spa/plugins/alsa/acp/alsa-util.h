@@ -128,6 +128,10 @@ int pa_alsa_close(snd_pcm_t **pcm);
 void pa_alsa_refcnt_inc(void);
 void pa_alsa_refcnt_dec(void);
 
+void pa_alsa_config_update(void);
+void pa_alsa_probe_begin(void);
+void pa_alsa_probe_end(void);
+
 void pa_alsa_init_proplist_pcm_info(pa_core *c, pa_proplist *p, snd_pcm_info_t *pcm_info);
 void pa_alsa_init_proplist_card(pa_core *c, pa_proplist *p, int card);
 void pa_alsa_init_proplist_pcm(pa_core *c, pa_proplist *p, snd_pcm_t *pcm);
@@ -0,0 +1,304 @@
+/* ALSA Card Profile */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "probe-cache.h"
+
+#define CACHE_HEADER	"# ACP probe cache, do not edit"
+#define CACHE_VERSION	1
+
+static uint64_t hash_fnv1a(const char *str)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	while (*str) {
+		h ^= (uint8_t)*str++;
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static const char *get_str(const char *str)
+{
+	return str ? str : "";
+}
+
+/* The key identifies the card and everything that influences the result
+ * of probing the profiles: the hardware, the driver and its firmware as
+ * reported in the card info, the profile set and the probe parameters. */
+static char *make_key(uint32_t card_index, pa_proplist *props,
+		pa_alsa_profile_set *ps, uint32_t rate)
+{
+	snd_ctl_t *ctl;
+	snd_ctl_card_info_t *info;
+	struct stat st;
+	char name[16], *key, *p;
+	int err;
+
+	if (ps->fname == NULL || stat(ps->fname, &st) < 0)
+		return NULL;
+
+	snd_ctl_card_info_alloca(&info);
+
+	snprintf(name, sizeof(name), "hw:%u", card_index);
+	if ((err = snd_ctl_open(&ctl, name, 0)) < 0) {
+		pa_log_warn("Error opening control device '%s': %s", name, snd_strerror(err));
+		return NULL;
+	}
+	if ((err = snd_ctl_card_info(ctl, info)) < 0) {
+		pa_log_warn("Control device %s card info: %s", name, snd_strerror(err));
+		snd_ctl_close(ctl);
+		return NULL;
+	}
+
+	key = pa_sprintf_malloc("version=%d alsa=%s driver=%s name=%s longname=%s "
+			"mixer=%s components=%s vendor=%s product=%s "
+			"profile-set=%s:%lld:%lld rate=%u",
+			CACHE_VERSION, snd_asoundlib_version(),
+			get_str(snd_ctl_card_info_get_driver(info)),
+			get_str(snd_ctl_card_info_get_name(info)),
+			get_str(snd_ctl_card_info_get_longname(info)),
+			get_str(snd_ctl_card_info_get_mixername(info)),
+			get_str(snd_ctl_card_info_get_components(info)),
+			get_str(pa_proplist_gets(props, "device.vendor.id")),
+			get_str(pa_proplist_gets(props, "device.product.id")),
+			ps->fname, (long long)st.st_mtime, (long long)st.st_size,
+			rate);
+
+	snd_ctl_close(ctl);
+
+	/* the key is stored on one line */
+	if (key != NULL)
+		for (p = key; *p; p++)
+			if (*p == '\n' || *p == '\r')
+				*p = ' ';
+	return key;
+}
+
+static char *default_dir(void)
+{
+	const char *dir;
+
+	if ((dir = getenv("XDG_CACHE_HOME")) != NULL && *dir)
+		return pa_sprintf_malloc("%s/pipewire/acp", dir);
+	if ((dir = getenv("HOME")) != NULL && *dir)
+		return pa_sprintf_malloc("%s/.cache/pipewire/acp", dir);
+	return NULL;
+}
+
+static int ensure_dir(const char *dir)
+{
+	char *path, *p;
+	int res = 0;
+
+	path = pa_xstrdup(dir);
+	for (p = path + 1; res == 0; p++) {
+		bool last = *p == '\0';
+		if (*p != '/' && !last)
+			continue;
+		*p = '\0';
+		if (mkdir(path, 0700) < 0 && errno != EEXIST)
+			res = -errno;
+		if (last)
+			break;
+		*p = '/';
+	}
+	pa_xfree(path);
+	return res;
+}
+
+int probe_cache_init(struct probe_cache *c, const char *dir, uint32_t card_index,
+		pa_proplist *props, pa_alsa_profile_set *ps, uint32_t rate)
+{
+	char *d;
+
+	spa_zero(*c);
+	c->card_index = card_index;
+
+	if ((c->key = make_key(card_index, props, ps, rate)) == NULL)
+		return -ENOENT;
+
+	d = dir ? pa_xstrdup(dir) : default_dir();
+	if (d == NULL) {
+		probe_cache_clear(c);
+		return -ENOENT;
+	}
+	c->path = pa_sprintf_malloc("%s/%016"PRIx64".cache", d, hash_fnv1a(c->key));
+	pa_xfree(d);
+
+	c->unsupported = pa_hashmap_new_full(pa_idxset_string_hash_func,
+			pa_idxset_string_compare_func, pa_xfree, NULL);
+	c->probed = pa_hashmap_new_full(pa_idxset_string_hash_func,
+			pa_idxset_string_compare_func, pa_xfree, NULL);
+	c->transient = pa_hashmap_new_full(pa_idxset_string_hash_func,
+			pa_idxset_string_compare_func, pa_xfree, NULL);
+	return 0;
+}
+
+void probe_cache_clear(struct probe_cache *c)
+{
+	if (c->unsupported)
+		pa_hashmap_free(c->unsupported);
+	if (c->probed)
+		pa_hashmap_free(c->probed);
+	if (c->transient)
+		pa_hashmap_free(c->transient);
+	pa_xfree(c->path);
+	pa_xfree(c->key);
+	spa_zero(*c);
+}
+
+static void add_name(pa_hashmap *h, const char *name)
+{
+	char *n = pa_xstrdup(name);
+	if (pa_hashmap_put(h, n, n) < 0)
+		pa_xfree(n);
+}
+
+/* fallback profiles are only probed when nothing else was found, their
+ * result depends on the other profiles and can't be cached */
+static bool cacheable(pa_alsa_profile *p)
+{
+	return !p->fallback_input && !p->fallback_output;
+}
+
+int probe_cache_load(struct probe_cache *c, pa_alsa_profile_set *ps)
+{
+	pa_alsa_profile *p;
+	void *state;
+	FILE *f;
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t len;
+	int res = 0, n_line = 0;
+
+	PA_HASHMAP_FOREACH(p, ps->profiles, state)
+		if (!p->supported && cacheable(p))
+			add_name(c->probed, p->name);
+
+	/* also without a cache file, the next save needs to know */
+	ps->probe_transient = c->transient;
+
+	if ((f = pa_fopen_cloexec(c->path, "r")) == NULL)
+		return -errno;
+
+	while ((len = getline(&line, &size, f)) > 0) {
+		const char *val;
+
+		if (line[len-1] == '\n')
+			line[--len] = '\0';
+
+		n_line++;
+		if (n_line == 1) {
+			if (!spa_streq(line, CACHE_HEADER)) {
+				res = -EINVAL;
+				break;
+			}
+		} else if (n_line == 2) {
+			/* hash collision or something changed */
+			if (!spa_strstartswith(line, "key=") ||
+			    !spa_streq(line + 4, c->key)) {
+				res = -ESTALE;
+				break;
+			}
+		} else if (spa_strstartswith(line, "unsupported=")) {
+			val = line + strlen("unsupported=");
+			if (pa_hashmap_get(c->probed, val))
+				add_name(c->unsupported, val);
+		}
+	}
+	free(line);
+	fclose(f);
+
+	if (res == 0 && n_line < 2)
+		res = -EINVAL;
+	if (res < 0) {
+		pa_hashmap_remove_all(c->unsupported);
+		return res;
+	}
+
+	pa_log_info("%s: skipping %u cached unsupported profiles", c->path,
+			pa_hashmap_size(c->unsupported));
+	ps->probe_skip = c->unsupported;
+	return 0;
+}
+
+int probe_cache_save(struct probe_cache *c, pa_alsa_profile_set *ps)
+{
+	pa_hashmap *unsupported;
+	const char *name;
+	void *state;
+	char *dir, *tmp = NULL;
+	FILE *f = NULL;
+	bool changed;
+	int res;
+
+	ps->probe_skip = NULL;
+	ps->probe_transient = NULL;
+
+	/* everything that was probed and did not survive is unsupported,
+	 * unless it failed with an error that can go away */
+	unsupported = pa_hashmap_new_full(pa_idxset_string_hash_func,
+			pa_idxset_string_compare_func, pa_xfree, NULL);
+	PA_HASHMAP_FOREACH(name, c->probed, state)
+		if (pa_hashmap_get(ps->profiles, name) == NULL &&
+		    pa_hashmap_get(c->transient, name) == NULL)
+			add_name(unsupported, name);
+	if (pa_hashmap_size(c->transient) > 0)
+		pa_log_info("%s: %u profiles failed with a transient error, not cached",
+				c->path, pa_hashmap_size(c->transient));
+
+	/* no profile at all, the card was probably busy */
+	if (pa_hashmap_size(unsupported) == pa_hashmap_size(c->probed)) {
+		res = -EBUSY;
+		goto done;
+	}
+
+	changed = pa_hashmap_size(unsupported) != pa_hashmap_size(c->unsupported);
+	PA_HASHMAP_FOREACH(name, unsupported, state)
+		if (!changed && pa_hashmap_get(c->unsupported, name) == NULL)
+			changed = true;
+	if (!changed && access(c->path, F_OK) == 0) {
+		res = 0;
+		goto done;
+	}
+
+	dir = pa_xstrdup(c->path);
+	*strrchr(dir, '/') = '\0';
+	res = ensure_dir(dir);
+	pa_xfree(dir);
+	if (res < 0)
+		goto done;
+
+	/* write to a temporary file and move it in place so that concurrent
+	 * readers never see a partial file */
+	tmp = pa_sprintf_malloc("%s.%d.%u.tmp", c->path, (int)getpid(), c->card_index);
+	if ((f = pa_fopen_cloexec(tmp, "w")) == NULL) {
+		res = -errno;
+		goto done;
+	}
+	fprintf(f, "%s\nkey=%s\n", CACHE_HEADER, c->key);
+	PA_HASHMAP_FOREACH(name, unsupported, state)
+		fprintf(f, "unsupported=%s\n", name);
+
+	if (fclose(f) != 0 || rename(tmp, c->path) < 0) {
+		res = -errno;
+		unlink(tmp);
+		goto done;
+	}
+	pa_log_info("%s: saved %u unsupported profiles", c->path,
+			pa_hashmap_size(unsupported));
+	res = 0;
+done:
+	if (res < 0)
+		pa_log_debug("%s: not saved: %s", c->path, strerror(-res));
+	pa_xfree(tmp);
+	pa_hashmap_free(unsupported);
+	return res;
+}
@@ -0,0 +1,46 @@
+/* ALSA Card Profile */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#ifndef ACP_PROBE_CACHE_H
+#define ACP_PROBE_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "compat.h"
+#include "alsa-mixer.h"
+
+/* The probe cache remembers the profiles of a profile set that failed
+ * to probe on a card so that they can be skipped the next time. Only
+ * definitive failures are cached: the device does not exist or does not
+ * accept the parameters. Profiles that failed because a device was busy
+ * are probed again. Supported profiles are always probed again, which
+ * validates the cache against the hardware.
+ *
+ * The cache file of a card is ignored when its key changes, see
+ * make_key(). Removing the file forces a full probe. */
+struct probe_cache {
+	uint32_t card_index;
+	char *path;
+	char *key;
+	pa_hashmap *unsupported;	/* names of unsupported profiles */
+	pa_hashmap *probed;		/* names of all profiles before probing */
+	pa_hashmap *transient;		/* names of profiles with transient errors */
+};
+
+int probe_cache_init(struct probe_cache *c, const char *dir, uint32_t card_index,
+		pa_proplist *props, pa_alsa_profile_set *ps, uint32_t rate);
+void probe_cache_clear(struct probe_cache *c);
+
+/* load the cache and configure the profile set to skip the cached profiles */
+int probe_cache_load(struct probe_cache *c, pa_alsa_profile_set *ps);
+/* update the cache with the result of pa_alsa_profile_set_probe() */
+int probe_cache_save(struct probe_cache *c, pa_alsa_profile_set *ps);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ACP_PROBE_CACHE_H */
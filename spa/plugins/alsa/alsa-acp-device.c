@@ -4,6 +4,9 @@
 
 #include <stddef.h>
 #include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -15,6 +18,7 @@
 #include <spa/utils/type.h>
 #include <spa/utils/keys.h>
 #include <spa/utils/names.h>
+#include <spa/utils/result.h>
 #include <spa/utils/string.h>
 #include <spa/support/log.h>
 #include <spa/support/loop.h>
@@ -41,11 +45,15 @@ extern struct spa_i18n *acp_i18n;
 #define DEFAULT_DEVICE		"hw:0"
 #define DEFAULT_AUTO_PROFILE	true
 #define DEFAULT_AUTO_PORT	true
+#define DEFAULT_PROBE_ASYNC	true
+
+#define MAX_PROBES	8
 
 struct props {
 	char device[64];
 	bool auto_profile;
 	bool auto_port;
+	bool probe_async;
 };
 
 static void reset_props(struct props *props)
@@ -53,14 +61,22 @@ static void reset_props(struct props *props)
 	strncpy(props->device, DEFAULT_DEVICE, 64);
 	props->auto_profile = DEFAULT_AUTO_PROFILE;
 	props->auto_port = DEFAULT_AUTO_PORT;
+	props->probe_async = DEFAULT_PROBE_ASYNC;
 }
 
+/* the cards of all devices are probed in their own thread, with
+ * at most one probe per CPU running at the same time */
+static pthread_mutex_t probe_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t probe_cond = PTHREAD_COND_INITIALIZER;
+static uint32_t n_probes;
+
 struct impl {
 	struct spa_handle handle;
 	struct spa_device device;
 
 	struct spa_log *log;
 	struct spa_loop *loop;
+	struct spa_loop_utils *loop_utils;
 
 	uint32_t info_all;
 	struct spa_device_info info;
@@ -76,7 +92,20 @@ struct impl {
 
 	uint32_t profile;
 
+	uint32_t card_index;
 	struct acp_card *card;
+
+	struct acp_dict probe_props;
+	struct acp_card *probe_card;
+	int probe_res;
+	pthread_t probe_thread;
+	struct spa_source *probe_event;
+	uint64_t probe_time[3];		/**< queued, started and finished */
+	char probe_usec[32];
+	char probe_wait_usec[32];
+	char probe_error[64];
+	unsigned int probing:1;
+
 	struct pollfd pfds[MAX_POLL];
 	int n_pfds;
 	struct spa_source sources[MAX_POLL];
@@ -84,6 +113,13 @@ struct impl {
 
 static int emit_info(struct impl *this, bool full);
 
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
 static void handle_acp_poll(struct spa_source *source)
 {
 	struct impl *this = source->data;
@@ -208,18 +244,24 @@ static int emit_info(struct impl *this, bool full)
 	if (full)
 		this->info.change_mask = this->info_all;
 	if (this->info.change_mask) {
-		n_items = card->props.n_items + 4;
+		n_items = (card ? card->props.n_items : 0) + 6;
 		items = alloca(n_items * sizeof(*items));
 
 		n_items = 0;
 #define ADD_ITEM(key, value) items[n_items++] = SPA_DICT_ITEM_INIT(key, value)
-		snprintf(path, sizeof(path), "alsa:pcm:%d", card->index);
+		snprintf(path, sizeof(path), "alsa:pcm:%d", this->card_index);
 		ADD_ITEM(SPA_KEY_OBJECT_PATH, path);
 		ADD_ITEM(SPA_KEY_DEVICE_API, "alsa:pcm");
 		ADD_ITEM(SPA_KEY_MEDIA_CLASS, "Audio/Device");
 		ADD_ITEM(SPA_KEY_API_ALSA_PATH,	(char *)this->props.device);
-		acp_dict_for_each(it, &card->props)
-			ADD_ITEM(it->key, it->value);
+		if (card) {
+			ADD_ITEM("api.acp.probe-usec", this->probe_usec);
+			ADD_ITEM("api.acp.probe-wait-usec", this->probe_wait_usec);
+			acp_dict_for_each(it, &card->props)
+				ADD_ITEM(it->key, it->value);
+		} else if (this->probe_error[0]) {
+			ADD_ITEM("api.acp.probe-error", this->probe_error);
+		}
 		this->info.props = &SPA_DICT_INIT(items, n_items);
 #undef ADD_ITEM
 
@@ -252,7 +294,7 @@ static int impl_add_listener(void *object,
 	spa_return_val_if_fail(events != NULL, -EINVAL);
 
 	card = this->card;
-	if (card->active_profile_index < card->n_profiles)
+	if (card && card->active_profile_index < card->n_profiles)
 		profile = card->profiles[card->active_profile_index];
 	else
 		profile = NULL;
@@ -498,11 +540,13 @@ static int impl_enum_params(void *object, int seq,
 	spa_return_val_if_fail(this != NULL, -EINVAL);
 	spa_return_val_if_fail(num != 0, -EINVAL);
 
+	/* still probing */
+	if ((card = this->card) == NULL)
+		return 0;
+
 	spa_pod_dynamic_builder_init(&b, buffer, sizeof(buffer), 4096);
 	spa_pod_builder_get_state(&b.b, &state);
 
-	card = this->card;
-
 	result.id = id;
 	result.next = start;
       next:
@@ -737,6 +781,9 @@ static int impl_set_param(void *object,
 
 	spa_return_val_if_fail(this != NULL, -EINVAL);
 
+	if (this->card == NULL)
+		return -EIO;
+
 	switch (id) {
 	case SPA_PARAM_Profile:
 	{
@@ -1016,6 +1063,198 @@ static const struct acp_card_events card_events = {
 	.mute_changed = on_mute_changed,
 };
 
+static void card_ready(struct impl *this, struct acp_card *card)
+{
+	struct acp_card_profile *profile;
+	uint32_t i;
+
+	this->card = card;
+
+	spa_log_info(this->log, "card %s: probed in %.3fms after waiting %.3fms",
+			this->props.device,
+			(this->probe_time[2] - this->probe_time[1]) / 1e6,
+			(this->probe_time[1] - this->probe_time[0]) / 1e6);
+	snprintf(this->probe_usec, sizeof(this->probe_usec), "%"PRIu64,
+			(uint64_t)((this->probe_time[2] - this->probe_time[1]) / SPA_NSEC_PER_USEC));
+	snprintf(this->probe_wait_usec, sizeof(this->probe_wait_usec), "%"PRIu64,
+			(uint64_t)((this->probe_time[1] - this->probe_time[0]) / SPA_NSEC_PER_USEC));
+
+	setup_sources(this);
+
+	acp_card_add_listener(card, &card_events, this);
+
+	this->params[IDX_EnumProfile].flags = SPA_PARAM_INFO_READ;
+	this->params[IDX_Profile].flags = SPA_PARAM_INFO_READWRITE;
+	this->params[IDX_EnumRoute].flags = SPA_PARAM_INFO_READ;
+	this->params[IDX_Route].flags = SPA_PARAM_INFO_READWRITE;
+
+	if (this->probe_event == NULL)
+		return;
+
+	/* the listeners only saw the device without card so far */
+	emit_info(this, true);
+
+	if (card->active_profile_index < card->n_profiles) {
+		profile = card->profiles[card->active_profile_index];
+		for (i = 0; i < profile->n_devices; i++)
+			emit_node(this, profile->devices[i]);
+	}
+}
+
+/* the device stays without profiles and routes, let the listeners know
+ * that the probe is over and why */
+static void probe_failed(struct impl *this)
+{
+	snprintf(this->probe_error, sizeof(this->probe_error), "%s",
+			spa_strerror(this->probe_res));
+
+	this->params[IDX_EnumProfile].flags = SPA_PARAM_INFO_READ;
+	this->params[IDX_Profile].flags = SPA_PARAM_INFO_READ;
+	this->params[IDX_EnumRoute].flags = SPA_PARAM_INFO_READ;
+	this->params[IDX_Route].flags = SPA_PARAM_INFO_READ;
+
+	emit_info(this, true);
+}
+
+static uint32_t max_probes(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return SPA_CLAMP(n, 1, MAX_PROBES);
+}
+
+static void *probe_thread(void *data)
+{
+	struct impl *this = data;
+
+	pthread_mutex_lock(&probe_lock);
+	while (n_probes >= max_probes())
+		pthread_cond_wait(&probe_cond, &probe_lock);
+	n_probes++;
+	pthread_mutex_unlock(&probe_lock);
+
+	this->probe_time[1] = get_time_ns();
+	this->probe_card = acp_card_new(this->card_index, &this->probe_props);
+	this->probe_res = this->probe_card ? 0 : -errno;
+	this->probe_time[2] = get_time_ns();
+
+	acp_probe_end();
+
+	pthread_mutex_lock(&probe_lock);
+	n_probes--;
+	pthread_cond_signal(&probe_cond);
+	pthread_mutex_unlock(&probe_lock);
+
+	spa_loop_utils_signal_event(this->loop_utils, this->probe_event);
+
+	return NULL;
+}
+
+static void probe_join(struct impl *this)
+{
+	if (!this->probing)
+		return;
+
+	pthread_join(this->probe_thread, NULL);
+	this->probing = false;
+
+	free((void*)this->probe_props.items);
+	this->probe_props.items = NULL;
+}
+
+static void on_probe_done(void *data, uint64_t count)
+{
+	struct impl *this = data;
+	struct acp_card *card;
+
+	if (!this->probing)
+		return;
+
+	probe_join(this);
+
+	card = this->probe_card;
+	this->probe_card = NULL;
+
+	if (card == NULL) {
+		spa_log_error(this->log, "can't probe card %s: %s",
+				this->props.device, spa_strerror(this->probe_res));
+		probe_failed(this);
+		return;
+	}
+	card_ready(this, card);
+}
+
+/* keep a copy of the properties for the probe thread */
+static int copy_probe_props(struct impl *this, const struct acp_dict *props)
+{
+	const struct acp_dict_item *it;
+	struct acp_dict_item *items;
+	size_t size = props->n_items * sizeof(*items);
+	char *p;
+	uint32_t n_items = 0;
+
+	acp_dict_for_each(it, props)
+		size += strlen(it->key) + 1 + (it->value ? strlen(it->value) + 1 : 0);
+
+	if ((items = malloc(size)) == NULL)
+		return -errno;
+
+	p = SPA_PTROFF(items, props->n_items * sizeof(*items), char);
+	acp_dict_for_each(it, props) {
+		items[n_items].key = p;
+		p = stpcpy(p, it->key) + 1;
+		if (it->value) {
+			items[n_items].value = p;
+			p = stpcpy(p, it->value) + 1;
+		} else {
+			items[n_items].value = NULL;
+		}
+		n_items++;
+	}
+	this->probe_props = ACP_DICT_INIT(items, n_items);
+	return 0;
+}
+
+static int probe_card(struct impl *this, const struct acp_dict *props)
+{
+	struct acp_card *card;
+	int res;
+
+	this->probe_time[0] = get_time_ns();
+
+	if (this->props.probe_async && this->loop_utils != NULL) {
+		this->probe_event = spa_loop_utils_add_event(this->loop_utils,
+				on_probe_done, this);
+		if (this->probe_event == NULL)
+			return -errno;
+		if ((res = copy_probe_props(this, props)) < 0)
+			return res;
+
+		/* the configuration is loaded here, on the main thread, and not
+		 * reloaded until all the probe threads are done */
+		acp_probe_begin();
+		if ((res = pthread_create(&this->probe_thread, NULL, probe_thread, this)) == 0) {
+			this->probing = true;
+			return 0;
+		}
+		acp_probe_end();
+		spa_log_warn(this->log, "can't create probe thread: %s", spa_strerror(res));
+
+		free((void*)this->probe_props.items);
+		this->probe_props.items = NULL;
+		spa_loop_utils_destroy_source(this->loop_utils, this->probe_event);
+		this->probe_event = NULL;
+	}
+
+	this->probe_time[1] = get_time_ns();
+	card = acp_card_new(this->card_index, props);
+	if (card == NULL)
+		return -errno;
+	this->probe_time[2] = get_time_ns();
+
+	card_ready(this, card);
+	return 0;
+}
+
 static int impl_get_interface(struct spa_handle *handle, const char *type, void **interface)
 {
 	struct impl *this;
@@ -1044,6 +1283,15 @@ static SPA_PRINTF_FUNC(6,0) void impl_acp_log_func(void *data,
 static int impl_clear(struct spa_handle *handle)
 {
 	struct impl *this = (struct impl *) handle;
+	probe_join(this);
+	if (this->probe_card) {
+		acp_card_destroy(this->probe_card);
+		this->probe_card = NULL;
+	}
+	if (this->probe_event) {
+		spa_loop_utils_destroy_source(this->loop_utils, this->probe_event);
+		this->probe_event = NULL;
+	}
 	remove_sources(this);
 	if (this->card) {
 		acp_card_destroy(this->card);
@@ -1071,6 +1319,7 @@ impl_init(const struct spa_handle_factory *factory,
 	struct acp_dict_item *items = NULL;
 	const struct spa_dict_item *it;
 	uint32_t n_items = 0;
+	int res;
 
 	spa_return_val_if_fail(factory != NULL, -EINVAL);
 	spa_return_val_if_fail(handle != NULL, -EINVAL);
@@ -1084,6 +1333,7 @@ impl_init(const struct spa_handle_factory *factory,
 	alsa_log_topic_init(this->log);
 
 	this->loop = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_Loop);
+	this->loop_utils = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_LoopUtils);
 	acp_i18n = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_I18N);
 	if (this->loop == NULL) {
 		spa_log_error(this->log, "a Loop interface is needed");
@@ -1108,6 +1358,8 @@ impl_init(const struct spa_handle_factory *factory,
 			this->props.auto_port = spa_atob(str);
 		if ((str = spa_dict_lookup(info, "api.acp.auto-profile")) != NULL)
 			this->props.auto_profile = spa_atob(str);
+		if ((str = spa_dict_lookup(info, "api.acp.probe-async")) != NULL)
+			this->props.probe_async = spa_atob(str);
 
 		items = alloca((info->n_items) * sizeof(*items));
 		spa_dict_for_each(it, info)
@@ -1118,25 +1370,24 @@ impl_init(const struct spa_handle_factory *factory,
 	if ((str = strchr(this->props.device, ':')) == NULL)
 		return -EINVAL;
 
-	this->card = acp_card_new(atoi(str+1), &ACP_DICT_INIT(items, n_items));
-	if (this->card == NULL)
-		return -errno;
-
-	setup_sources(this);
-
-	acp_card_add_listener(this->card, &card_events, this);
+	this->card_index = atoi(str+1);
 
 	this->info = SPA_DEVICE_INFO_INIT();
 	this->info_all = SPA_DEVICE_CHANGE_MASK_PROPS |
 		SPA_DEVICE_CHANGE_MASK_PARAMS;
 
-	this->params[IDX_EnumProfile] = SPA_PARAM_INFO(SPA_PARAM_EnumProfile, SPA_PARAM_INFO_READ);
-	this->params[IDX_Profile] = SPA_PARAM_INFO(SPA_PARAM_Profile, SPA_PARAM_INFO_READWRITE);
-	this->params[IDX_EnumRoute] = SPA_PARAM_INFO(SPA_PARAM_EnumRoute, SPA_PARAM_INFO_READ);
-	this->params[IDX_Route] = SPA_PARAM_INFO(SPA_PARAM_Route, SPA_PARAM_INFO_READWRITE);
+	/* the params become available when the card is probed */
+	this->params[IDX_EnumProfile] = SPA_PARAM_INFO(SPA_PARAM_EnumProfile, 0);
+	this->params[IDX_Profile] = SPA_PARAM_INFO(SPA_PARAM_Profile, 0);
+	this->params[IDX_EnumRoute] = SPA_PARAM_INFO(SPA_PARAM_EnumRoute, 0);
+	this->params[IDX_Route] = SPA_PARAM_INFO(SPA_PARAM_Route, 0);
 	this->info.params = this->params;
 	this->info.n_params = 4;
 
+	if ((res = probe_card(this, &ACP_DICT_INIT(items, n_items))) < 0) {
+		impl_clear(handle);
+		return res;
+	}
 	return 0;
 }
 
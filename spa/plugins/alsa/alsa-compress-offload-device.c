@@ -27,6 +27,7 @@
 
 #include "compress-offload-api-util.h"
 #include "alsa.h"
+#include "acp/acp.h"
 
 static const char default_device[] = "hw:0";
 
@@ -540,7 +541,7 @@ static int impl_init(const struct spa_handle_factory *factory,
 
 	reset_props(&this->props);
 
-	snd_config_update_free_global();
+	acp_config_update();
 
 	if (info) {
 		uint32_t i;
@@ -28,6 +28,7 @@
 #include <spa/debug/log.h>
 
 #include "alsa.h"
+#include "acp/acp.h"
 
 #define MAX_DEVICES	64
 
@@ -546,7 +547,7 @@ impl_init(const struct spa_handle_factory *factory,
 
 	reset_props(&this->props);
 
-	snd_config_update_free_global();
+	acp_config_update();
 
 	if (info && (str = spa_dict_lookup(info, SPA_KEY_API_ALSA_PATH)))
 		snprintf(this->props.device, 64, "%s", str);
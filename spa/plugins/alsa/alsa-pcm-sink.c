@@ -713,9 +713,15 @@ impl_node_port_use_buffers(void *object,
 	if (n_buffers > MAX_BUFFERS)
 		return -ENOSPC;
 
+	/* with dynamic data from a local producer, like the converter of the
+	 * adapter, the producer can write into the mmap area */
+	this->direct = !this->disable_direct && n_buffers > 0 &&
+		SPA_FLAG_IS_SET(flags, SPA_NODE_BUFFERS_FLAG_LOCAL);
+
 	for (i = 0; i < n_buffers; i++) {
 		struct buffer *b = &this->buffers[i];
 		struct spa_data *d = buffers[i]->datas;
+		uint32_t j;
 
 		b->buf = buffers[i];
 		b->id = i;
@@ -727,10 +733,22 @@ impl_node_port_use_buffers(void *object,
 			spa_log_error(this->log, "%p: need mapped memory", this);
 			return -EINVAL;
 		}
+		if (b->buf->n_datas > SPA_N_ELEMENTS(b->data))
+			this->direct = false;
+
+		b->maxsize = d[0].maxsize;
+		for (j = 0; j < SPA_MIN(b->buf->n_datas, SPA_N_ELEMENTS(b->data)); j++) {
+			b->data[j] = d[j].data;
+			if (!SPA_FLAG_IS_SET(d[j].flags, SPA_DATA_FLAG_DYNAMIC) ||
+			    d[j].maxsize != b->maxsize)
+				this->direct = false;
+		}
 		spa_log_debug(this->log, "%p: %d %p data:%p", this, i, b->buf, d[0].data);
 	}
 	this->n_buffers = n_buffers;
 
+	spa_log_debug(this->log, "%p: direct:%d", this, this->direct);
+
 	return 0;
 }
 
@@ -17,6 +17,7 @@
 #include <spa/monitor/device.h>
 
 #include "alsa-pcm.h"
+#include "acp/acp.h"
 
 static struct spa_list cards = SPA_LIST_INIT(&cards);
 static struct spa_list states = SPA_LIST_INIT(&states);
@@ -127,6 +128,8 @@ static int alsa_set_param(struct state *state, const char *k, const char *s)
 		state->disable_batch = spa_atob(s);
 	} else if (spa_streq(k, "api.alsa.disable-tsched")) {
 		state->disable_tsched = spa_atob(s);
+	} else if (spa_streq(k, "api.alsa.disable-direct")) {
+		state->disable_direct = spa_atob(s);
 	} else if (spa_streq(k, "api.alsa.use-chmap")) {
 		state->props.use_chmap = spa_atob(s);
 	} else if (spa_streq(k, "api.alsa.multi-rate")) {
@@ -845,7 +848,7 @@ int spa_alsa_init(struct state *state, const struct spa_dict *info)
 	spa_list_init(&state->followers);
 	spa_list_init(&state->rt.followers);
 
-	snd_config_update_free_global();
+	acp_config_update();
 
 	if ((str = spa_dict_lookup(info, "device.profile.pro")) != NULL)
 		state->is_pro = spa_atob(str);
@@ -885,6 +888,23 @@ int spa_alsa_init(struct state *state, const struct spa_dict *info)
 			state->num_bind_ctls = i;
 
 			/* We'll do the actual binding after checking the card exists */
+		} else if (spa_streq(k, "api.alsa.gang")) {
+			struct spa_json it[2];
+			char v[64];
+			unsigned int i = 0;
+
+			/* Read a list of devices to drive together with ours */
+			spa_json_init(&it[0], s, strlen(s));
+			if (spa_json_enter_array(&it[0], &it[1]) <= 0)
+				spa_json_init(&it[1], s, strlen(s));
+
+			while (spa_json_get_string(&it[1], v, sizeof(v)) > 0 &&
+					i < SPA_N_ELEMENTS(state->gang)) {
+				snprintf(state->gang[i].device,
+						sizeof(state->gang[i].device), "%s", v);
+				i++;
+			}
+			state->n_gang = i;
 		} else {
 			alsa_set_param(state, k, s);
 		}
@@ -1045,6 +1065,140 @@ static int do_link(struct state *driver, struct state *state)
 	return 0;
 }
 
+static void gang_close(struct state *state)
+{
+	uint32_t i;
+	int err;
+
+	for (i = 0; i < state->n_gang; i++) {
+		struct gang *g = &state->gang[i];
+
+		if (g->hndl == NULL)
+			continue;
+		if (g->linked)
+			snd_pcm_unlink(g->hndl);
+
+		spa_log_info(state->log, "%p: ganged device '%s' closing", state, g->device);
+		if ((err = snd_pcm_close(g->hndl)) < 0)
+			spa_log_warn(state->log, "%s: close failed: %s", g->device,
+					snd_strerror(err));
+		g->hndl = NULL;
+		g->linked = false;
+	}
+	state->gang_channels = 0;
+}
+
+/* The ganged devices are opened with all their channels */
+static int gang_open(struct state *state)
+{
+	snd_pcm_hw_params_t *params;
+	unsigned int channels;
+	uint32_t i;
+	int err;
+
+	snd_pcm_hw_params_alloca(&params);
+
+	state->gang_channels = 0;
+	for (i = 0; i < state->n_gang; i++) {
+		struct gang *g = &state->gang[i];
+
+		spa_log_info(state->log, "%p: ALSA ganged device open '%s'", state, g->device);
+		if ((err = snd_pcm_open(&g->hndl, g->device, state->stream,
+				SND_PCM_NONBLOCK |
+				SND_PCM_NO_AUTO_RESAMPLE |
+				SND_PCM_NO_AUTO_CHANNELS | SND_PCM_NO_AUTO_FORMAT)) < 0) {
+			spa_log_error(state->log, "'%s': ganged open failed: %s",
+					g->device, snd_strerror(err));
+			g->hndl = NULL;
+			goto error;
+		}
+		if ((err = snd_pcm_hw_params_any(g->hndl, params)) < 0 ||
+		    (err = snd_pcm_hw_params_get_channels_max(params, &channels)) < 0) {
+			spa_log_error(state->log, "'%s': can't get channels: %s",
+					g->device, snd_strerror(err));
+			goto error;
+		}
+		if (state->gang_channels + channels >= SPA_AUDIO_MAX_CHANNELS) {
+			spa_log_error(state->log, "'%s': too many channels %u",
+					g->device, channels);
+			err = -EINVAL;
+			goto error;
+		}
+		g->channels = channels;
+		g->offset = state->gang_channels;
+		state->gang_channels += channels;
+	}
+	return 0;
+
+error:
+	gang_close(state);
+	return err;
+}
+
+/* Configure the ganged devices like the main device and link them so that
+ * they are prepared, started and stopped together */
+static int gang_set_hw_params(struct state *state)
+{
+	snd_pcm_hw_params_t *params;
+	snd_pcm_uframes_t period_size, buffer_size;
+	uint32_t i;
+	int err, res;
+
+	snd_pcm_hw_params_alloca(&params);
+
+	for (i = 0; i < state->n_gang; i++) {
+		struct gang *g = &state->gang[i];
+		snd_pcm_t *hndl = g->hndl;
+
+		period_size = state->period_frames;
+		buffer_size = state->buffer_frames;
+
+		CHECK(snd_pcm_hw_params_any(hndl, params), "'%s': no configurations available", g->device);
+		CHECK(snd_pcm_hw_params_set_rate_resample(hndl, params, 0), "'%s': set_rate_resample", g->device);
+		CHECK(snd_pcm_hw_params_set_access(hndl, params,
+				state->planar ? SND_PCM_ACCESS_MMAP_NONINTERLEAVED
+				: SND_PCM_ACCESS_MMAP_INTERLEAVED), "'%s': set_access", g->device);
+		CHECK(snd_pcm_hw_params_set_format(hndl, params, state->format), "'%s': set_format", g->device);
+		CHECK(snd_pcm_hw_params_set_channels(hndl, params, g->channels), "'%s': set_channels", g->device);
+		CHECK(snd_pcm_hw_params_set_rate(hndl, params, state->rate, 0), "'%s': set_rate", g->device);
+
+		/* we never wait for the ganged devices */
+		if (snd_pcm_hw_params_can_disable_period_wakeup(params))
+			CHECK(snd_pcm_hw_params_set_period_wakeup(hndl, params, 0), "'%s': set_period_wakeup", g->device);
+
+		CHECK(snd_pcm_hw_params_set_period_size(hndl, params, period_size, 0), "'%s': set_period_size", g->device);
+		CHECK(snd_pcm_hw_params_set_buffer_size(hndl, params, buffer_size), "'%s': set_buffer_size", g->device);
+		CHECK(snd_pcm_hw_params(hndl, params), "'%s': set_hw_params", g->device);
+
+		if (!g->linked) {
+			res = snd_pcm_link(state->hndl, hndl);
+			g->linked = res >= 0 || res == -EALREADY;
+			spa_log_info(state->log, "%p: ganged device '%s' channels:%u linked:%u (%s)",
+					state, g->device, g->channels, g->linked, snd_strerror(res));
+		}
+	}
+	return 0;
+}
+
+static int gang_set_swparams(struct state *state)
+{
+	snd_pcm_sw_params_t *params;
+	uint32_t i;
+	int err;
+
+	snd_pcm_sw_params_alloca(&params);
+
+	for (i = 0; i < state->n_gang; i++) {
+		struct gang *g = &state->gang[i];
+
+		CHECK(snd_pcm_sw_params_current(g->hndl, params), "'%s': sw_params_current", g->device);
+		CHECK(snd_pcm_sw_params_set_start_threshold(g->hndl, params, LONG_MAX),
+				"'%s': set_start_threshold", g->device);
+		CHECK(snd_pcm_sw_params(g->hndl, params), "'%s': sw_params", g->device);
+	}
+	return 0;
+}
+
 int spa_alsa_open(struct state *state, const char *params)
 {
 	int err;
@@ -1069,10 +1223,13 @@ int spa_alsa_open(struct state *state, const char *params)
 			device_name,
 			state->stream == SND_PCM_STREAM_CAPTURE ? "capture" : "playback");
 
+	if ((err = gang_open(state)) < 0)
+		goto error_exit_close;
+
 	if (!state->disable_tsched) {
 		if ((err = spa_system_timerfd_create(state->data_system,
 				CLOCK_MONOTONIC, SPA_FD_CLOEXEC | SPA_FD_NONBLOCK)) < 0)
-			goto error_exit_close;
+			goto error_exit_gang;
 
 		state->timerfd = err;
 	} else {
@@ -1088,6 +1245,8 @@ int spa_alsa_open(struct state *state, const char *params)
 
 	return 0;
 
+error_exit_gang:
+	gang_close(state);
 error_exit_close:
 	spa_log_info(state->log, "%p: Device '%s' closing: %s", state, state->name,
 			spa_strerror(err));
@@ -1126,6 +1285,8 @@ int spa_alsa_close(struct state *state)
 
 	spa_alsa_pause(state);
 
+	gang_close(state);
+
 	spa_log_info(state->log, "%p: Device '%s' closing", state, state->name);
 	if ((err = snd_pcm_close(state->hndl)) < 0)
 		spa_log_warn(state->log, "%s: close failed: %s", state->name,
@@ -1426,6 +1587,10 @@ static int add_channels(struct state *state, bool all, uint32_t index, uint32_t
 
 	CHECK(snd_pcm_hw_params_get_channels_min(params, &min), "get_channels_min");
 	CHECK(snd_pcm_hw_params_get_channels_max(params, &max), "get_channels_max");
+	/* the ganged devices always use all their channels */
+	min += state->gang_channels;
+	max += state->gang_channels;
+
 	spa_log_debug(state->log, "channels (%d %d) default:%d all:%d",
 			min, max, state->default_channels, all);
 
@@ -1440,7 +1605,8 @@ static int add_channels(struct state *state, bool all, uint32_t index, uint32_t
 
 	spa_pod_builder_prop(b, SPA_FORMAT_AUDIO_channels, 0);
 
-	if (state->props.use_chmap && (maps = snd_pcm_query_chmaps(hndl)) != NULL) {
+	if (state->props.use_chmap && state->n_gang == 0 &&
+	    (maps = snd_pcm_query_chmaps(hndl)) != NULL) {
 		uint32_t channel;
 		snd_pcm_chmap_t* map;
 
@@ -1495,7 +1661,7 @@ skip_channels:
 			if (state->default_pos.channels == min) {
 				map = &state->default_pos;
 				spa_log_debug(state->log, "%p: using provided default", state);
-			} else if (min <= 8) {
+			} else if (min <= 8 && state->n_gang == 0) {
 				map = &default_map[min];
 				spa_log_debug(state->log, "%p: using default %d channel map", state, min);
 			}
@@ -1521,6 +1687,46 @@ static void debug_hw_params(struct state *state, const char *prefix, snd_pcm_hw_
 		fflush(state->log_file);
 	}
 }
+/* only keep the formats and access modes that all ganged devices support,
+ * they can only be used with mmap */
+static void gang_restrict_masks(struct state *state, snd_pcm_format_mask_t *fmask,
+		snd_pcm_access_mask_t *amask)
+{
+	snd_pcm_hw_params_t *params;
+	snd_pcm_format_mask_t *gfmask;
+	snd_pcm_access_mask_t *gamask;
+	uint32_t i;
+	int j;
+
+	if (state->n_gang == 0)
+		return;
+
+	snd_pcm_hw_params_alloca(&params);
+	snd_pcm_format_mask_alloca(&gfmask);
+	snd_pcm_access_mask_alloca(&gamask);
+
+	snd_pcm_access_mask_reset(amask, SND_PCM_ACCESS_RW_INTERLEAVED);
+	snd_pcm_access_mask_reset(amask, SND_PCM_ACCESS_RW_NONINTERLEAVED);
+
+	for (i = 0; i < state->n_gang; i++) {
+		struct gang *g = &state->gang[i];
+
+		if (snd_pcm_hw_params_any(g->hndl, params) < 0) {
+			snd_pcm_format_mask_none(fmask);
+			return;
+		}
+		snd_pcm_hw_params_get_format_mask(params, gfmask);
+		snd_pcm_hw_params_get_access_mask(params, gamask);
+
+		for (j = 0; j <= SND_PCM_FORMAT_LAST; j++)
+			if (!snd_pcm_format_mask_test(gfmask, (snd_pcm_format_t)j))
+				snd_pcm_format_mask_reset(fmask, (snd_pcm_format_t)j);
+		for (j = 0; j <= SND_PCM_ACCESS_LAST; j++)
+			if (!snd_pcm_access_mask_test(gamask, (snd_pcm_access_t)j))
+				snd_pcm_access_mask_reset(amask, (snd_pcm_access_t)j);
+	}
+}
+
 static int enum_pcm_formats(struct state *state, uint32_t index, uint32_t *next,
 		struct spa_pod **result, struct spa_pod_builder *b)
 {
@@ -1542,9 +1748,10 @@ static int enum_pcm_formats(struct state *state, uint32_t index, uint32_t *next,
 
 	CHECK(snd_pcm_hw_params_set_rate_resample(hndl, params, 0), "set_rate_resample");
 
-	if (state->default_channels != 0) {
-		rchannels = state->default_channels;
+	if (state->default_channels > state->gang_channels) {
+		rchannels = state->default_channels - state->gang_channels;
 		CHECK(snd_pcm_hw_params_set_channels_near(hndl, params, &rchannels), "set_channels");
+		rchannels += state->gang_channels;
 		if (state->default_channels != rchannels) {
 			spa_log_warn(state->log, "%s: Channels doesn't match (requested %u, got %u)",
 				state->name, state->default_channels, rchannels);
@@ -1571,6 +1778,8 @@ static int enum_pcm_formats(struct state *state, uint32_t index, uint32_t *next,
 	snd_pcm_access_mask_alloca(&amask);
 	snd_pcm_hw_params_get_access_mask(params, amask);
 
+	gang_restrict_masks(state, fmask, amask);
+
 	spa_pod_builder_prop(b, SPA_FORMAT_AUDIO_format, 0);
 
 	spa_pod_builder_push_choice(b, &f[1], SPA_CHOICE_None, 0);
@@ -1848,6 +2057,10 @@ spa_alsa_enum_format(struct state *state, int seq, uint32_t start, uint32_t num,
 			goto next;
 		}
 	}
+	else if (state->n_gang > 0) {
+		/* ganged devices only do raw PCM */
+		goto enum_end;
+	}
 	else if (result.index < 0x20000) {
 		if ((res = enum_iec958_formats(state, result.index, &result.next, &fmt, &b)) != 1) {
 			result.next = 0x20000;
@@ -1929,6 +2142,9 @@ int spa_alsa_set_format(struct state *state, struct spa_audio_info *fmt, uint32_
 	state->use_mmap = !state->disable_mmap;
 	state->force_position = false;
 
+	if (state->n_gang > 0 && fmt->media_subtype != SPA_MEDIA_SUBTYPE_raw)
+		return -ENOTSUP;
+
 	switch (fmt->media_subtype) {
 	case SPA_MEDIA_SUBTYPE_raw:
 	{
@@ -2069,6 +2285,11 @@ int spa_alsa_set_format(struct state *state, struct spa_audio_info *fmt, uint32_
 			state->use_mmap = false;
 		}
 	}
+	if (!state->use_mmap && state->n_gang > 0) {
+		spa_log_error(state->log, "%s: ganged devices need MMAP",
+				state->name);
+		return -ENOTSUP;
+	}
 	if (!state->use_mmap) {
 		if ((err = snd_pcm_hw_params_set_access(hndl, params,
 				planar ? SND_PCM_ACCESS_RW_NONINTERLEAVED
@@ -2086,9 +2307,15 @@ int spa_alsa_set_format(struct state *state, struct spa_audio_info *fmt, uint32_
 			planar ? "planar" : "interleaved", rchannels);
 	CHECK(snd_pcm_hw_params_set_format(hndl, params, rformat), "set_format");
 
-	/* set the count of channels */
-	val = rchannels;
+	/* set the count of channels, the ganged devices add their channels */
+	if (rchannels <= state->gang_channels) {
+		spa_log_error(state->log, "%s: invalid channels:%u, ganged devices have %u",
+				state->name, rchannels, state->gang_channels);
+		return -EINVAL;
+	}
+	val = rchannels - state->gang_channels;
 	CHECK(snd_pcm_hw_params_set_channels_near(hndl, params, &val), "set_channels");
+	val += state->gang_channels;
 	if (rchannels != val) {
 		spa_log_warn(state->log, "%s: Channels doesn't match (requested %u, got %u)",
 				state->name, rchannels, val);
@@ -2229,6 +2456,9 @@ int spa_alsa_set_format(struct state *state, struct spa_audio_info *fmt, uint32_
 	/* write the parameters to device */
 	CHECK(snd_pcm_hw_params(hndl, params), "set_hw_params");
 
+	if ((err = gang_set_hw_params(state)) < 0)
+		return err;
+
 	return match ? 0 : 1;
 }
 
@@ -2330,6 +2560,72 @@ static int set_timeout(struct state *state, uint64_t time)
 	return 0;
 }
 
+static int gang_mmap_begin(struct state *state, snd_pcm_uframes_t *frames)
+{
+	uint32_t i;
+	int res;
+
+	for (i = 0; i < state->n_gang; i++) {
+		struct gang *g = &state->gang[i];
+		snd_pcm_uframes_t avail = *frames;
+
+		if (SPA_UNLIKELY((res = snd_pcm_mmap_begin(g->hndl, &g->areas,
+						&g->mmap_offset, &avail)) < 0)) {
+			spa_log_error(state->log, "%s: snd_pcm_mmap_begin error: %s",
+					g->device, snd_strerror(res));
+			return res;
+		}
+		*frames = SPA_MIN(*frames, avail);
+	}
+	return 0;
+}
+
+static int gang_mmap_commit(struct state *state, snd_pcm_uframes_t frames)
+{
+	snd_pcm_sframes_t res;
+	uint32_t i;
+
+	for (i = 0; i < state->n_gang; i++) {
+		struct gang *g = &state->gang[i];
+
+		if (SPA_UNLIKELY((res = snd_pcm_mmap_commit(g->hndl, g->mmap_offset, frames)) < 0)) {
+			spa_log_error(state->log, "%s: snd_pcm_mmap_commit error: %s",
+					g->device, snd_strerror(res));
+			return res;
+		}
+	}
+	return 0;
+}
+
+static void gang_silence(struct state *state, snd_pcm_uframes_t silence)
+{
+	snd_pcm_uframes_t frames;
+	uint32_t i;
+
+	for (i = 0; i < state->n_gang; i++) {
+		struct gang *g = &state->gang[i];
+
+		frames = state->buffer_frames;
+		if (snd_pcm_mmap_begin(g->hndl, &g->areas, &g->mmap_offset, &frames) < 0)
+			continue;
+		frames = SPA_MIN(silence, frames);
+		snd_pcm_areas_silence(g->areas, g->mmap_offset, g->channels, frames, state->format);
+		snd_pcm_mmap_commit(g->hndl, g->mmap_offset, frames);
+	}
+}
+
+static void gang_move(struct state *state, snd_pcm_sframes_t frames)
+{
+	uint32_t i;
+
+	for (i = 0; i < state->n_gang; i++) {
+		if (frames < 0)
+			snd_pcm_rewind(state->gang[i].hndl, -frames);
+		else
+			snd_pcm_forward(state->gang[i].hndl, frames);
+	}
+}
+
 static int spa_alsa_silence(struct state *state, snd_pcm_uframes_t silence)
 {
 	snd_pcm_t *hndl = state->hndl;
@@ -2349,13 +2645,15 @@ static int spa_alsa_silence(struct state *state, snd_pcm_uframes_t silence)
 
 		spa_log_trace_fp(state->log, "%p: frames:%ld offset:%ld silence %ld",
 				state, frames, offset, silence);
-		snd_pcm_areas_silence(my_areas, offset, state->channels, silence, state->format);
+		snd_pcm_areas_silence(my_areas, offset, state->channels - state->gang_channels,
+				silence, state->format);
 
 		if (SPA_UNLIKELY((res = snd_pcm_mmap_commit(hndl, offset, silence)) < 0)) {
 			spa_log_error(state->log, "%s: snd_pcm_mmap_commit error: %s",
 					state->name, snd_strerror(res));
 			return res;
 		}
+		gang_silence(state, silence);
 	} else {
 		uint8_t buffer[silence * state->frame_size];
 		memset(buffer, 0, silence * state->frame_size);
@@ -2395,6 +2693,7 @@ static void reset_buffers(struct state *this)
 
 static int do_prepare(struct state *state)
 {
+	uint32_t i;
 	int err;
 
 	state->last_threshold = state->threshold;
@@ -2404,12 +2703,22 @@ static int do_prepare(struct state *state)
 			state->following, state->matching, state->resample);
 
 	CHECK(set_swparams(state), "swparams");
+	if ((err = gang_set_swparams(state)) < 0)
+		return err;
 
 	if ((!state->linked) && (err = snd_pcm_prepare(state->hndl)) < 0 && err != -EBUSY) {
 		spa_log_error(state->log, "%s: snd_pcm_prepare error: %s",
 				state->name, snd_strerror(err));
 		return err;
 	}
+	for (i = 0; i < state->n_gang; i++) {
+		struct gang *g = &state->gang[i];
+		if (!g->linked && (err = snd_pcm_prepare(g->hndl)) < 0 && err != -EBUSY) {
+			spa_log_error(state->log, "%s: snd_pcm_prepare error: %s",
+					g->device, snd_strerror(err));
+			return err;
+		}
+	}
 	if (state->stream == SND_PCM_STREAM_PLAYBACK) {
 		snd_pcm_uframes_t silence = state->start_delay + state->threshold + state->headroom;
 		if (state->disable_tsched)
@@ -2428,6 +2737,7 @@ static int do_prepare(struct state *state)
 
 static inline int do_drop(struct state *state)
 {
+	uint32_t i;
 	int res;
 	spa_log_debug(state->log, "%p: snd_pcm_drop linked:%u", state, state->linked);
 	if (!state->linked && (res = snd_pcm_drop(state->hndl)) < 0) {
@@ -2435,11 +2745,16 @@ static inline int do_drop(struct state *state)
 				state->name, snd_strerror(res));
 		return res;
 	}
+	for (i = 0; i < state->n_gang; i++) {
+		if (!state->gang[i].linked)
+			snd_pcm_drop(state->gang[i].hndl);
+	}
 	return 0;
 }
 
 static inline int do_start(struct state *state)
 {
+	uint32_t i;
 	int res;
 	if (SPA_UNLIKELY(!state->alsa_started)) {
 		spa_log_debug(state->log, "%p: snd_pcm_start linked:%u", state, state->linked);
@@ -2448,6 +2763,11 @@ static inline int do_start(struct state *state)
 					state->name, snd_strerror(res));
 			return res;
 		}
+		/* unlinked ganged devices are started right after us */
+		for (i = 0; i < state->n_gang; i++) {
+			if (!state->gang[i].linked)
+				snd_pcm_start(state->gang[i].hndl);
+		}
 		state->alsa_started = true;
 	}
 	return 0;
@@ -2848,9 +3168,10 @@ static int alsa_write_sync(struct state *state, uint64_t current_time)
 					state->name, avail, delay,
 					target, state->threshold, suppressed);
 
-			if (avail > target)
+			if (avail > target) {
 				snd_pcm_rewind(state->hndl, avail - target);
-			else if (avail < target)
+				gang_move(state, -(snd_pcm_sframes_t)(avail - target));
+			} else if (avail < target)
 				spa_alsa_silence(state, target - avail);
 			avail = target;
 			spa_dll_init(&state->dll);
@@ -2861,6 +3182,162 @@ static int alsa_write_sync(struct state *state, uint64_t current_time)
 	return 0;
 }
 
+/* point the buffers that we pointed to the mmap area back to their memory.
+ * Unless all is set, the buffers that still need to be written are kept. */
+static void direct_restore(struct state *state, bool all)
+{
+	uint32_t i, j;
+
+	if (!state->direct)
+		return;
+
+	for (i = 0; i < state->n_buffers; i++) {
+		struct buffer *b = &state->buffers[i];
+		struct spa_data *d = b->buf->datas;
+
+		if (!SPA_FLAG_IS_SET(b->flags, BUFFER_FLAG_DIRECT) ||
+		    (!all && !SPA_FLAG_IS_SET(b->flags, BUFFER_FLAG_OUT)))
+			continue;
+		for (j = 0; j < b->buf->n_datas; j++) {
+			d[j].data = b->data[j];
+			d[j].maxsize = b->maxsize;
+		}
+		SPA_FLAG_CLEAR(b->flags, BUFFER_FLAG_DIRECT);
+	}
+}
+
+static bool direct_areas_usable(struct state *state, const snd_pcm_channel_area_t *areas)
+{
+	uint32_t i, bits = snd_pcm_format_physical_width(state->format);
+
+	if (state->n_buffers == 0 ||
+	    state->buffers[0].buf->n_datas != (state->planar ? (uint32_t)state->channels : 1u))
+		return false;
+
+	for (i = 0; i < (uint32_t)state->channels; i++) {
+		if (state->planar) {
+			if (areas[i].step != bits || areas[i].first % 8 != 0)
+				return false;
+		} else {
+			if (areas[i].addr != areas[0].addr ||
+			    areas[i].first != i * bits ||
+			    areas[i].step != state->frame_size * 8)
+				return false;
+		}
+	}
+	return true;
+}
+
+/* When we are the driver, the producer of our buffers (the converter of the
+ * adapter) can write the next cycle directly into the mmap area. Our buffers
+ * have dynamic data so we point them to the area before we trigger the graph.
+ * alsa_write_frames() skips the copy when the data is in place. */
+static void direct_setup(struct state *state)
+{
+	const snd_pcm_channel_area_t *areas;
+	snd_pcm_uframes_t offset, frames;
+	uint32_t i, j, needed;
+	bool direct;
+
+	if (!state->direct)
+		return;
+
+	needed = state->threshold;
+	if (state->position)
+		needed = SPA_MAX(needed, state->position->clock.duration);
+
+	frames = state->buffer_frames;
+	direct = state->use_mmap && state->n_gang == 0 && state->frame_scale == 1 &&
+		state->alsa_started && spa_list_is_empty(&state->ready) &&
+		snd_pcm_mmap_begin(state->hndl, &areas, &offset, &frames) >= 0 &&
+		frames >= needed && direct_areas_usable(state, areas);
+
+	if (!direct) {
+		direct_restore(state, false);
+		return;
+	}
+	for (i = 0; i < state->n_buffers; i++) {
+		struct buffer *b = &state->buffers[i];
+		struct spa_data *d = b->buf->datas;
+
+		if (!SPA_FLAG_IS_SET(b->flags, BUFFER_FLAG_OUT))
+			continue;
+		for (j = 0; j < b->buf->n_datas; j++) {
+			d[j].data = channel_area_addr(&areas[j], offset);
+			d[j].maxsize = SPA_MIN(b->maxsize, frames * state->frame_size);
+		}
+		SPA_FLAG_SET(b->flags, BUFFER_FLAG_DIRECT);
+	}
+}
+
+/* describe the data of a buffer of the node as ALSA channel areas */
+static void buffer_areas(struct state *state, struct spa_data *d, uint32_t offs,
+		snd_pcm_channel_area_t *areas)
+{
+	uint32_t i, bits = snd_pcm_format_physical_width(state->format);
+
+	for (i = 0; i < (uint32_t)state->channels; i++) {
+		if (state->planar) {
+			areas[i].addr = SPA_PTROFF(d[i].data, offs, void);
+			areas[i].first = 0;
+			areas[i].step = bits;
+		} else {
+			areas[i].addr = SPA_PTROFF(d[0].data, offs, void);
+			areas[i].first = i * bits;
+			areas[i].step = bits * state->channels;
+		}
+	}
+}
+
+/* split the channels of the buffer over our device and the ganged devices,
+ * pos is the number of frames written since mmap_begin */
+static void gang_copy_out(struct state *state, const snd_pcm_channel_area_t *my_areas,
+		snd_pcm_uframes_t offset, snd_pcm_uframes_t pos, struct spa_data *d,
+		uint32_t offs, snd_pcm_uframes_t frames)
+{
+	snd_pcm_channel_area_t areas[SPA_AUDIO_MAX_CHANNELS];
+	uint32_t i, n_channels = state->channels - state->gang_channels;
+
+	buffer_areas(state, d, offs, areas);
+
+	snd_pcm_areas_copy(my_areas, offset + pos, areas, 0,
+			n_channels, frames, state->format);
+	for (i = 0; i < state->n_gang; i++) {
+		struct gang *g = &state->gang[i];
+		snd_pcm_areas_copy(g->areas, g->mmap_offset + pos,
+				&areas[n_channels + g->offset], 0,
+				g->channels, frames, state->format);
+	}
+}
+
+static void copy_in_wrap(struct state *state, const snd_pcm_channel_area_t *dst,
+		const snd_pcm_channel_area_t *src, snd_pcm_uframes_t offset,
+		uint32_t channels, snd_pcm_uframes_t frames)
+{
+	snd_pcm_uframes_t l0 = SPA_MIN(frames, state->buffer_frames - offset);
+
+	snd_pcm_areas_copy(dst, 0, src, offset, channels, l0, state->format);
+	if (SPA_UNLIKELY(l0 < frames))
+		snd_pcm_areas_copy(dst, l0, src, 0, channels, frames - l0, state->format);
+}
+
+/* merge the channels of our device and the ganged devices into the buffer */
+static void gang_copy_in(struct state *state, const snd_pcm_channel_area_t *my_areas,
+		snd_pcm_uframes_t offset, struct spa_data *d, snd_pcm_uframes_t frames)
+{
+	snd_pcm_channel_area_t areas[SPA_AUDIO_MAX_CHANNELS];
+	uint32_t i, n_channels = state->channels - state->gang_channels;
+
+	buffer_areas(state, d, 0, areas);
+
+	copy_in_wrap(state, areas, my_areas, offset, n_channels, frames);
+	for (i = 0; i < state->n_gang; i++) {
+		struct gang *g = &state->gang[i];
+		copy_in_wrap(state, &areas[n_channels + g->offset], g->areas,
+				g->mmap_offset, g->channels, frames);
+	}
+}
+
 static int alsa_write_frames(struct state *state)
 {
 	snd_pcm_t *hndl = state->hndl;
@@ -2880,6 +3357,10 @@ again:
 			alsa_recover(state);
 			return res;
 		}
+		if (SPA_UNLIKELY((res = gang_mmap_begin(state, &frames)) < 0)) {
+			alsa_recover(state);
+			return res;
+		}
 		spa_log_trace_fp(state->log, "%p: begin offset:%ld avail:%ld threshold:%d",
 				state, offset, frames, state->threshold);
 		off = offset;
@@ -2910,9 +3391,22 @@ again:
 		n_bytes = n_frames * frame_size;
 
 		if (SPA_LIKELY(state->use_mmap)) {
-			for (i = 0; i < b->buf->n_datas; i++) {
-				spa_memcpy(channel_area_addr(&my_areas[i], off),
-						SPA_PTROFF(d[i].data, offs, void), n_bytes);
+			if (state->n_gang > 0) {
+				gang_copy_out(state, my_areas, offset, off - offset,
+						d, offs, n_frames);
+			} else {
+				for (i = 0; i < b->buf->n_datas; i++) {
+					void *dst = channel_area_addr(&my_areas[i], off);
+					void *src = SPA_PTROFF(d[i].data, offs, void);
+					/* skip the copy when it was written in place, when the
+					 * area moved (after a recover) the data can overlap */
+					if (dst == src)
+						continue;
+					if (SPA_FLAG_IS_SET(b->flags, BUFFER_FLAG_DIRECT))
+						memmove(dst, src, n_bytes);
+					else
+						spa_memcpy(dst, src, n_bytes);
+				}
 			}
 		} else {
 			void *bufs[b->buf->n_datas];
@@ -2957,6 +3451,7 @@ again:
 			spa_log_warn(state->log, "%s: mmap_commit wrote %ld instead of %ld",
 				     state->name, commitres, written);
 		}
+		gang_mmap_commit(state, written);
 	}
 
 	if (!spa_list_is_empty(&state->ready) && written > 0)
@@ -2969,6 +3464,8 @@ again:
 
 	update_sources(state, true);
 
+	direct_restore(state, false);
+
 	return 0;
 }
 
@@ -3024,7 +3521,15 @@ push_frames(struct state *state,
 		total_frames = SPA_MIN(avail, frames);
 		n_bytes = total_frames * frame_size;
 
-		if (my_areas) {
+		if (my_areas && state->n_gang > 0) {
+			gang_copy_in(state, my_areas, offset, d, total_frames);
+
+			for (i = 0; i < b->buf->n_datas; i++) {
+				d[i].chunk->offset = 0;
+				d[i].chunk->size = n_bytes;
+				d[i].chunk->stride = frame_size;
+			}
+		} else if (my_areas) {
 			left = state->buffer_frames - offset;
 			l0 = SPA_MIN(n_bytes, left * frame_size);
 			l1 = n_bytes - l0;
@@ -3113,6 +3618,7 @@ static int alsa_read_sync(struct state *state, uint64_t current_time)
 				max_read = target - avail;
 			else if (avail > target) {
 				snd_pcm_forward(state->hndl, avail - target);
+				gang_move(state, avail - target);
 				avail = target;
 			}
 			state->alsa_sync = false;
@@ -3146,6 +3652,10 @@ static int alsa_read_frames(struct state *state)
 			alsa_recover(state);
 			return res;
 		}
+		if ((res = gang_mmap_begin(state, &avail)) < 0) {
+			alsa_recover(state);
+			return res;
+		}
 		spa_log_trace_fp(state->log, "%p: begin offs:%ld frames:%ld avail:%ld thres:%d", state,
 				offset, frames, avail, state->threshold);
 	} else {
@@ -3182,6 +3692,7 @@ static int alsa_read_frames(struct state *state)
 			spa_log_warn(state->log, "%s: mmap_commit read %ld instead of %ld",
 				     state->name, commitres, read);
 		}
+		gang_mmap_commit(state, read);
 	}
 
 	state->sample_count += total_read;
@@ -3240,6 +3751,9 @@ static int playback_ready(struct state *state)
 
 	update_sources(state, false);
 
+	if (!state->following)
+		direct_setup(state);
+
 	io->status = SPA_STATUS_NEED_DATA;
 	return spa_node_call_ready(&state->callbacks, SPA_STATUS_NEED_DATA);
 }
@@ -3640,6 +4154,8 @@ int spa_alsa_pause(struct state *state)
 	state->started = false;
 	spa_loop_invoke(state->data_loop, do_state_sync, 0, NULL, 0, true, state);
 
+	direct_restore(state, true);
+
 	spa_list_for_each(follower, &state->followers, driver_link)
 		spa_alsa_pause(follower);
 
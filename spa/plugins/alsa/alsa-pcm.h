@@ -54,14 +54,20 @@ struct props {
 
 #define MAX_BUFFERS 32
 #define MAX_POLL 16
+#define MAX_GANG 8
 
 struct buffer {
 	uint32_t id;
 #define BUFFER_FLAG_OUT	(1<<0)
+#define BUFFER_FLAG_DIRECT	(1<<1)
 	uint32_t flags;
 	struct spa_buffer *buf;
 	struct spa_meta_header *h;
 	struct spa_list link;
+
+	/* the memory of the buffer, the data can point to the mmap area */
+	void *data[SPA_AUDIO_MAX_CHANNELS];
+	uint32_t maxsize;
 };
 
 #define BW_MAX		0.128
@@ -93,6 +99,21 @@ struct rt_state {
 	unsigned int following:1;
 };
 
+/* A device that is driven together with the main device of the node. Its
+ * channels are appended to the channels of the node and it is assumed to
+ * run from the same hardware clock. */
+struct gang {
+	char device[64];
+	snd_pcm_t *hndl;
+	uint32_t channels;
+	uint32_t offset;		/* first channel, after the main device channels */
+	unsigned int linked:1;
+
+	/* valid between mmap_begin and mmap_commit */
+	const snd_pcm_channel_area_t *areas;
+	snd_pcm_uframes_t mmap_offset;
+};
+
 struct bound_ctl {
 	char name[256];
 	snd_ctl_elem_info_t *info;
@@ -151,6 +172,8 @@ struct state {
 	unsigned int disable_mmap:1;
 	unsigned int disable_batch:1;
 	unsigned int disable_tsched:1;
+	unsigned int disable_direct:1;
+	unsigned int direct:1;
 	char clock_name[64];
 	uint32_t quantum_limit;
 
@@ -262,6 +285,10 @@ struct state {
 	struct spa_source ctl_sources[MAX_POLL];
 	int ctl_n_fds;
 
+	struct gang gang[MAX_GANG];
+	uint32_t n_gang;
+	uint32_t gang_channels;
+
 	struct spa_list link;
 
 	struct spa_list followers;
@@ -478,9 +478,11 @@ static int negotiate_buffers(struct impl *this)
 		       this->buffers, this->n_buffers)) < 0)
 		return res;
 
+	/* the converter produces or consumes the follower buffers */
 	if ((res = spa_node_port_use_buffers(this->follower,
 		       this->direction, 0,
-		       follower_alloc ? SPA_NODE_BUFFERS_FLAG_ALLOC : 0,
+		       (follower_alloc ? SPA_NODE_BUFFERS_FLAG_ALLOC : 0) |
+		       SPA_NODE_BUFFERS_FLAG_LOCAL,
 		       this->buffers, this->n_buffers)) < 0)
 		return res;
 
@@ -14,6 +14,7 @@
 #include <spa/support/system.h>
 #include <spa/support/log.h>
 #include <spa/support/plugin.h>
+#include <spa/utils/atomic.h>
 #include <spa/utils/list.h>
 #include <spa/utils/names.h>
 #include <spa/utils/ratelimit.h>
@@ -31,15 +32,24 @@ SPA_LOG_TOPIC_DEFINE_STATIC(log_topic, "spa.loop");
 #define MAX_ALIGN	8
 #define ITEM_ALIGN	8
 #define DATAS_SIZE	(4096*8)
+#define MAX_DATAS_SIZE	(DATAS_SIZE*64)
 #define MAX_EP		32
+#define MAX_QUEUES	128
 #define DEFAULT_RETRY	(1 * SPA_USEC_PER_SEC)
 
+#define WHEEL_BITS	6
+#define WHEEL_SIZE	(1u << WHEEL_BITS)
+#define WHEEL_MASK	(WHEEL_SIZE - 1)
+#define WHEEL_LEVELS	4
+#define TICK_SHIFT	20	/* ~1ms */
+
 /** \cond */
 
 struct invoke_item {
 	size_t item_size;
 	spa_invoke_func_t func;
 	uint32_t seq;
+	uint64_t count;
 	void *data;
 	size_t size;
 	bool block;
@@ -47,6 +57,42 @@ struct invoke_item {
 	int res;
 };
 
+/* Each thread that invokes on the loop gets its own queue so that the
+ * writers never contend. When a queue is full, a larger overflow queue is
+ * chained to it. The items are flushed in the order of their count. */
+struct queue {
+	struct impl *impl;
+	struct queue *overflow;
+
+	int ack_fd;
+	bool busy;
+
+	struct spa_ringbuffer buffer;
+	uint32_t buffer_size;
+	uint8_t *buffer_data;
+	uint8_t buffer_mem[];
+};
+
+/* All the timers of the loop share one timerfd. The timers are kept in a
+ * hierarchical timing wheel: level 0 has a slot per tick, each higher level
+ * has slots that are WHEEL_SIZE times larger. Timers are moved to a lower
+ * level when the wheel reaches the start of their slot. Timers that don't
+ * fit in the wheel are kept in the far list. The timerfd is only rearmed when
+ * the earliest deadline moves forward in time. Timers can be updated and
+ * destroyed from other threads, the lock protects the wheel but is not held
+ * while the callbacks run. */
+struct timer_wheel {
+	pthread_mutex_t lock;
+	struct spa_source *source;
+	uint64_t tick;
+	uint64_t armed;
+	uint64_t pending[WHEEL_LEVELS];
+	struct spa_list slots[WHEEL_LEVELS][WHEEL_SIZE];
+	struct spa_list far;
+	uint32_t n_timers;
+	bool processing;
+};
+
 static int loop_signal_event(void *object, struct spa_source *source);
 
 struct impl {
@@ -68,12 +114,15 @@ struct impl {
 	int enter_count;
 
 	struct spa_source *wakeup;
-	int ack_fd;
 	struct spa_ratelimit rate_limit;
 
-	struct spa_ringbuffer buffer;
-	uint8_t *buffer_data;
-	uint8_t buffer_mem[DATAS_SIZE + MAX_ALIGN];
+	pthread_mutex_t queue_lock;
+	pthread_key_t queue_key;
+	struct queue *queues[MAX_QUEUES];
+	uint32_t n_queues;
+	uint64_t count;
+
+	struct timer_wheel wheel;
 
 	uint32_t flush_count;
 	unsigned int polling:1;
@@ -95,6 +144,15 @@ struct source_impl {
 
 	struct spa_source *fallback;
 
+	struct {
+		struct spa_list link;
+		uint64_t expire;
+		uint64_t interval;
+		uint32_t level;
+		uint32_t slot;
+		bool active;
+	} timer;
+
 	bool close;
 	bool enabled;
 };
@@ -159,22 +217,43 @@ static int loop_remove_source(void *object, struct spa_source *source)
 
 static void flush_items(struct impl *impl)
 {
-	uint32_t index, flush_count;
-	int32_t avail;
+	uint32_t flush_count;
 	int res;
 
 	flush_count = ++impl->flush_count;
-	avail = spa_ringbuffer_get_read_index(&impl->buffer, &index);
-	while (avail > 0) {
-		struct invoke_item *item;
-		bool block;
+	while (true) {
+		struct queue *cqueue, *queue = NULL;
+		struct invoke_item *citem, *item = NULL;
+		uint32_t i, n_queues, cindex, index = 0;
 		spa_invoke_func_t func;
+		bool block;
+
+		/* find the oldest item in all the queues */
+		n_queues = SPA_ATOMIC_LOAD(impl->n_queues);
+		for (i = 0; i < n_queues; i++) {
+			for (cqueue = impl->queues[i]; cqueue != NULL;
+			     cqueue = SPA_ATOMIC_LOAD(cqueue->overflow)) {
+				if (spa_ringbuffer_get_read_index(&cqueue->buffer, &cindex) <
+				    (int32_t)sizeof(struct invoke_item))
+					continue;
+
+				citem = SPA_PTROFF(cqueue->buffer_data,
+						cindex & (cqueue->buffer_size - 1),
+						struct invoke_item);
+				if (item == NULL || citem->count < item->count) {
+					item = citem;
+					queue = cqueue;
+					index = cindex;
+				}
+			}
+		}
+		if (item == NULL)
+			break;
 
-		item = SPA_PTROFF(impl->buffer_data, index & (DATAS_SIZE - 1), struct invoke_item);
 		block = item->block;
 		func = item->func;
 
-		spa_log_trace_fp(impl->log, "%p: flush item %p", impl, item);
+		spa_log_trace_fp(impl->log, "%p: flush item %p", queue, item);
 		/* first we remove the function from the item so that recursive
 		 * calls don't call the callback again. We can't update the
 		 * read index before we call the function because then the item
@@ -189,16 +268,147 @@ static void flush_items(struct impl *impl)
 		if (flush_count != impl->flush_count)
 			break;
 
-		index += item->item_size;
-		avail -= item->item_size;
-		spa_ringbuffer_read_update(&impl->buffer, index);
+		spa_ringbuffer_read_update(&queue->buffer, index + item->item_size);
 
 		if (block) {
-			if ((res = spa_system_eventfd_write(impl->system, impl->ack_fd, 1)) < 0)
+			if ((res = spa_system_eventfd_write(impl->system, queue->ack_fd, 1)) < 0)
 				spa_log_warn(impl->log, "%p: failed to write event fd:%d: %s",
-						impl, impl->ack_fd, spa_strerror(res));
+						queue, queue->ack_fd, spa_strerror(res));
+		}
+	}
+}
+
+static struct queue *queue_new(struct impl *impl, uint32_t size, int ack_fd)
+{
+	struct queue *queue;
+	int res;
+
+	queue = calloc(1, sizeof(struct queue) + size + MAX_ALIGN);
+	if (queue == NULL)
+		return NULL;
+
+	queue->impl = impl;
+	queue->buffer_size = size;
+	queue->buffer_data = SPA_PTR_ALIGN(queue->buffer_mem, MAX_ALIGN, uint8_t);
+	spa_ringbuffer_init(&queue->buffer);
+
+	if (ack_fd == -1) {
+		if ((res = spa_system_eventfd_create(impl->system,
+				SPA_FD_EVENT_SEMAPHORE | SPA_FD_CLOEXEC)) < 0) {
+			spa_log_error(impl->log, "%p: can't create ack event: %s",
+					impl, spa_strerror(res));
+			free(queue);
+			errno = -res;
+			return NULL;
 		}
+		ack_fd = res;
 	}
+	queue->ack_fd = ack_fd;
+
+	spa_log_debug(impl->log, "%p: new queue %p size:%u", impl, queue, size);
+	return queue;
+}
+
+static void queue_free(struct queue *queue)
+{
+	struct impl *impl = queue->impl;
+	struct queue *overflow;
+
+	spa_system_close(impl->system, queue->ack_fd);
+	while (queue) {
+		overflow = queue->overflow;
+		free(queue);
+		queue = overflow;
+	}
+}
+
+static void queue_release(void *data)
+{
+	struct queue *queue = data;
+	/* the thread exited, let another thread use the queue */
+	SPA_ATOMIC_STORE(queue->busy, false);
+}
+
+static struct queue *loop_get_queue(struct impl *impl)
+{
+	struct queue *queue;
+	uint32_t i, n_queues;
+
+	if ((queue = pthread_getspecific(impl->queue_key)) != NULL)
+		return queue;
+
+	n_queues = SPA_ATOMIC_LOAD(impl->n_queues);
+	for (i = 0; i < n_queues; i++) {
+		queue = impl->queues[i];
+		if (!SPA_ATOMIC_LOAD(queue->busy) &&
+		    SPA_ATOMIC_CAS(queue->busy, false, true))
+			goto found;
+	}
+
+	pthread_mutex_lock(&impl->queue_lock);
+	n_queues = impl->n_queues;
+	if (n_queues >= MAX_QUEUES) {
+		pthread_mutex_unlock(&impl->queue_lock);
+		errno = ENOSPC;
+		return NULL;
+	}
+	if ((queue = queue_new(impl, DATAS_SIZE, -1)) == NULL) {
+		pthread_mutex_unlock(&impl->queue_lock);
+		return NULL;
+	}
+	queue->busy = true;
+	impl->queues[n_queues] = queue;
+	SPA_ATOMIC_STORE(impl->n_queues, n_queues + 1);
+	pthread_mutex_unlock(&impl->queue_lock);
+
+found:
+	pthread_setspecific(impl->queue_key, queue);
+	return queue;
+}
+
+static struct invoke_item *queue_add_item(struct queue *queue, size_t size,
+		uint32_t *idx, size_t *need)
+{
+	struct invoke_item *item;
+	int32_t filled;
+	uint32_t avail, offset, l0, item_size;
+
+	filled = spa_ringbuffer_get_write_index(&queue->buffer, idx);
+	spa_assert_se(filled >= 0 && filled <= (int32_t)queue->buffer_size && "queue xrun");
+	avail = (uint32_t)(queue->buffer_size - filled);
+	if (avail < sizeof(struct invoke_item)) {
+		*need = sizeof(struct invoke_item);
+		return NULL;
+	}
+	offset = *idx & (queue->buffer_size - 1);
+
+	/* l0 is remaining size in ringbuffer, this should always be larger than
+	 * invoke_item, see below */
+	l0 = queue->buffer_size - offset;
+
+	item = SPA_PTROFF(queue->buffer_data, offset, struct invoke_item);
+	item_size = SPA_ROUND_UP_N(sizeof(struct invoke_item) + size, ITEM_ALIGN);
+
+	if (l0 >= item_size) {
+		/* item + size fit in current ringbuffer idx */
+		item->data = SPA_PTROFF(item, sizeof(struct invoke_item), void);
+		if (l0 < sizeof(struct invoke_item) + item_size) {
+			/* not enough space for next invoke_item, fill up till the end
+			 * so that the next item will be at the start */
+			item_size = l0;
+		}
+	} else {
+		/* item does not fit, place the invoke_item at idx and start the
+		 * data at the start of the ringbuffer */
+		item->data = queue->buffer_data;
+		item_size = SPA_ROUND_UP_N(l0 + size, ITEM_ALIGN);
+	}
+	if (avail < item_size) {
+		*need = item_size;
+		return NULL;
+	}
+	item->item_size = item_size;
+	return item;
 }
 
 static int
@@ -227,11 +437,11 @@ loop_invoke(void *object,
 	    void *user_data)
 {
 	struct impl *impl = object;
+	struct queue *queue, *q, *overflow;
 	struct invoke_item *item;
 	int res, suppressed;
-	int32_t filled;
-	uint32_t avail, idx, offset, l0;
-	size_t need;
+	uint32_t idx, size_needed;
+	size_t need = 0;
 	uint64_t nsec;
 
 	/* the ringbuffer can only be written to from one thread, if we are
@@ -240,53 +450,41 @@ loop_invoke(void *object,
 	if (impl->thread == 0 || pthread_equal(impl->thread, pthread_self()))
 		return loop_invoke_inthread(impl, func, seq, data, size, block, user_data);
 
-retry:
-	filled = spa_ringbuffer_get_write_index(&impl->buffer, &idx);
-	spa_assert_se(filled >= 0 && filled <= DATAS_SIZE && "queue xrun");
-	avail = (uint32_t)(DATAS_SIZE - filled);
-	if (avail < sizeof(struct invoke_item)) {
-		need = sizeof(struct invoke_item);
+	if ((queue = loop_get_queue(impl)) == NULL) {
+		res = -errno;
 		goto xrun;
 	}
-	offset = idx & (DATAS_SIZE - 1);
-
-	/* l0 is remaining size in ringbuffer, this should always be larger than
-	 * invoke_item, see below */
-	l0 = DATAS_SIZE - offset;
-
-	item = SPA_PTROFF(impl->buffer_data, offset, struct invoke_item);
+retry:
+	for (q = queue; ; q = q->overflow) {
+		if ((item = queue_add_item(q, size, &idx, &need)) != NULL)
+			break;
+		if (q->overflow != NULL)
+			continue;
+
+		/* all queues are full, add a bigger one. Only this thread
+		 * writes the overflow pointer, the loop reads it. */
+		size_needed = q->buffer_size * 2;
+		while (size_needed < (sizeof(struct invoke_item) + size) * 2)
+			size_needed *= 2;
+		if (size_needed > MAX_DATAS_SIZE ||
+		    (overflow = queue_new(impl, size_needed, queue->ack_fd)) == NULL)
+			goto xrun;
+		SPA_ATOMIC_STORE(q->overflow, overflow);
+	}
 	item->func = func;
 	item->seq = seq;
 	item->size = size;
 	item->block = block;
 	item->user_data = user_data;
 	item->res = 0;
-	item->item_size = SPA_ROUND_UP_N(sizeof(struct invoke_item) + size, ITEM_ALIGN);
+	item->count = SPA_ATOMIC_INC(impl->count);
 
-	spa_log_trace_fp(impl->log, "%p: add item %p filled:%d", impl, item, filled);
+	spa_log_trace_fp(impl->log, "%p: add item %p", q, item);
 
-	if (l0 >= item->item_size) {
-		/* item + size fit in current ringbuffer idx */
-		item->data = SPA_PTROFF(item, sizeof(struct invoke_item), void);
-		if (l0 < sizeof(struct invoke_item) + item->item_size) {
-			/* not enough space for next invoke_item, fill up till the end
-			 * so that the next item will be at the start */
-			item->item_size = l0;
-		}
-	} else {
-		/* item does not fit, place the invoke_item at idx and start the
-		 * data at the start of the ringbuffer */
-		item->data = impl->buffer_data;
-		item->item_size = SPA_ROUND_UP_N(l0 + size, ITEM_ALIGN);
-	}
-	if (avail < item->item_size) {
-		need = item->item_size;
-		goto xrun;
-	}
 	if (data && size > 0)
 		memcpy(item->data, data, size);
 
-	spa_ringbuffer_write_update(&impl->buffer, idx + item->item_size);
+	spa_ringbuffer_write_update(&q->buffer, idx + item->item_size);
 
 	loop_signal_event(impl, impl->wakeup);
 
@@ -295,9 +493,9 @@ retry:
 
 		spa_loop_control_hook_before(&impl->hooks_list);
 
-		if ((res = spa_system_eventfd_read(impl->system, impl->ack_fd, &count)) < 0)
+		if ((res = spa_system_eventfd_read(impl->system, queue->ack_fd, &count)) < 0)
 			spa_log_warn(impl->log, "%p: failed to read event fd:%d: %s",
-					impl, impl->ack_fd, spa_strerror(res));
+					queue, queue->ack_fd, spa_strerror(res));
 
 		spa_loop_control_hook_after(&impl->hooks_list);
 
@@ -314,12 +512,14 @@ retry:
 xrun:
 	nsec = get_time_ns(impl->system);
 	if ((suppressed = spa_ratelimit_test(&impl->rate_limit, nsec)) >= 0) {
-		spa_log_warn(impl->log, "%p: queue full %d, need %zd (%d suppressed)",
-				impl, avail, need, suppressed);
+		spa_log_warn(impl->log, "%p: queue full, need %zd (%d suppressed)",
+				impl, need, suppressed);
 	}
 	if (impl->retry_timeout == 0)
 		return -EPIPE;
 	usleep(impl->retry_timeout);
+	if (queue == NULL && (queue = loop_get_queue(impl)) == NULL)
+		goto xrun;
 	goto retry;
 }
 
@@ -725,20 +925,286 @@ static int loop_signal_event(void *object, struct spa_source *source)
 	return res;
 }
 
-static void source_timer_func(struct spa_source *source)
+static void wheel_insert(struct timer_wheel *w, struct source_impl *s)
 {
-	struct source_impl *s = SPA_CONTAINER_OF(source, struct source_impl, source);
-	uint64_t expirations = 0;
+	uint64_t t = s->timer.expire >> TICK_SHIFT;
+	uint32_t l, shift, idx;
+
+	if (t < w->tick)
+		t = w->tick;
+
+	for (l = 0; l < WHEEL_LEVELS; l++) {
+		shift = l * WHEEL_BITS;
+		if ((t >> shift) - (w->tick >> shift) < WHEEL_SIZE) {
+			idx = (t >> shift) & WHEEL_MASK;
+			spa_list_append(&w->slots[l][idx], &s->timer.link);
+			w->pending[l] |= 1ull << idx;
+			s->timer.level = l;
+			s->timer.slot = idx;
+			return;
+		}
+	}
+	spa_list_append(&w->far, &s->timer.link);
+	s->timer.level = WHEEL_LEVELS;
+}
+
+static void wheel_remove(struct timer_wheel *w, struct source_impl *s)
+{
+	uint32_t l = s->timer.level, idx = s->timer.slot;
+
+	if (!s->timer.active)
+		return;
+
+	spa_list_remove(&s->timer.link);
+	if (l < WHEEL_LEVELS && spa_list_is_empty(&w->slots[l][idx]))
+		w->pending[l] &= ~(1ull << idx);
+	s->timer.active = false;
+	w->n_timers--;
+}
+
+/* the tick of the first non-empty slot at level l, starting from the
+ * current slot */
+static inline uint64_t wheel_slot_tick(struct timer_wheel *w, uint32_t l)
+{
+	uint32_t shift = l * WHEEL_BITS, cur = (w->tick >> shift) & WHEEL_MASK;
+	uint64_t pending = w->pending[l];
+	uint64_t rot = (pending >> cur) | (pending << ((WHEEL_SIZE - cur) & WHEEL_MASK));
+
+	return ((w->tick >> shift) + __builtin_ctzll(rot)) << shift;
+}
+
+/* the next tick, not after limit, where the wheel has timers or needs to
+ * cascade */
+static inline uint64_t wheel_next_tick(struct timer_wheel *w, uint64_t limit)
+{
+	uint32_t l;
+
+	for (l = 0; l < WHEEL_LEVELS; l++)
+		if (w->pending[l])
+			limit = SPA_MIN(limit, wheel_slot_tick(w, l));
+	return limit;
+}
+
+static void wheel_cascade(struct timer_wheel *w)
+{
+	uint32_t l, shift, idx;
+	struct spa_list list;
+	struct source_impl *s;
+
+	for (l = 1; l < WHEEL_LEVELS; l++) {
+		shift = l * WHEEL_BITS;
+		if (w->tick & ((1ull << shift) - 1))
+			break;
+
+		idx = (w->tick >> shift) & WHEEL_MASK;
+		if (!(w->pending[l] & (1ull << idx)))
+			continue;
+
+		w->pending[l] &= ~(1ull << idx);
+		spa_list_init(&list);
+		spa_list_insert_list(&list, &w->slots[l][idx]);
+		spa_list_init(&w->slots[l][idx]);
+		spa_list_consume(s, &list, timer.link) {
+			spa_list_remove(&s->timer.link);
+			wheel_insert(w, s);
+		}
+	}
+}
+
+/* move the wheel to now and collect the expired timers in due */
+static void wheel_advance(struct timer_wheel *w, uint64_t now, struct spa_list *due)
+{
+	uint64_t now_tick = now >> TICK_SHIFT, next;
+	struct source_impl *s, *t;
+	uint32_t idx;
+
+	while (true) {
+		idx = w->tick & WHEEL_MASK;
+		if (w->pending[0] & (1ull << idx)) {
+			spa_list_for_each_safe(s, t, &w->slots[0][idx], timer.link) {
+				if (s->timer.expire > now)
+					continue;
+				spa_list_remove(&s->timer.link);
+				spa_list_append(due, &s->timer.link);
+				s->timer.level = WHEEL_LEVELS;
+			}
+			if (spa_list_is_empty(&w->slots[0][idx]))
+				w->pending[0] &= ~(1ull << idx);
+		}
+		if (w->tick >= now_tick)
+			break;
+
+		/* skip ahead to the next slot with timers or the next cascade */
+		next = wheel_next_tick(w, now_tick);
+		w->tick = SPA_MAX(next, w->tick + 1);
+
+		wheel_cascade(w);
+	}
+	if (SPA_UNLIKELY(!spa_list_is_empty(&w->far))) {
+		struct spa_list far;
+
+		spa_list_init(&far);
+		spa_list_insert_list(&far, &w->far);
+		spa_list_init(&w->far);
+		spa_list_consume(s, &far, timer.link) {
+			spa_list_remove(&s->timer.link);
+			if (s->timer.expire <= now)
+				spa_list_append(due, &s->timer.link);
+			else
+				wheel_insert(w, s);
+		}
+	}
+}
+
+/* move the wheel to now without passing any timer so that new timers
+ * are placed relative to the current time and not to the last dispatch */
+static void wheel_catch_up(struct timer_wheel *w, uint64_t now)
+{
+	uint64_t now_tick = now >> TICK_SHIFT, next;
+
+	while (w->tick < now_tick) {
+		next = wheel_next_tick(w, now_tick);
+		if (next <= w->tick)
+			break;
+		w->tick = next;
+		wheel_cascade(w);
+	}
+}
+
+static uint64_t wheel_next_expire(struct timer_wheel *w)
+{
+	uint64_t next = UINT64_MAX, tick;
+	struct source_impl *s;
+	uint32_t l;
+
+	if (w->pending[0]) {
+		tick = wheel_slot_tick(w, 0);
+		spa_list_for_each(s, &w->slots[0][tick & WHEEL_MASK], timer.link)
+			next = SPA_MIN(next, s->timer.expire);
+	}
+	for (l = 1; l < WHEEL_LEVELS; l++) {
+		if (w->pending[l])
+			next = SPA_MIN(next, wheel_slot_tick(w, l) << TICK_SHIFT);
+	}
+	spa_list_for_each(s, &w->far, timer.link)
+		next = SPA_MIN(next, s->timer.expire);
+
+	return next;
+}
+
+static int wheel_arm(struct impl *impl, uint64_t expire)
+{
+	struct timer_wheel *w = &impl->wheel;
+	struct itimerspec its;
 	int res;
 
-	if (SPA_UNLIKELY((res = spa_system_timerfd_read(s->impl->system,
-				source->fd, &expirations)) < 0)) {
+	if (expire == w->armed)
+		return 0;
+
+	spa_zero(its);
+	if (expire != UINT64_MAX) {
+		/* 0 would disarm the timer */
+		expire = SPA_MAX(expire, 1u);
+		its.it_value.tv_sec = expire / SPA_NSEC_PER_SEC;
+		its.it_value.tv_nsec = expire % SPA_NSEC_PER_SEC;
+	}
+	if (SPA_UNLIKELY((res = spa_system_timerfd_settime(impl->system,
+			w->source->fd, SPA_FD_TIMER_ABSTIME, &its, NULL)) < 0))
+		return res;
+
+	w->armed = expire;
+	return 0;
+}
+
+static void wheel_timer_func(void *data, int fd, uint32_t mask)
+{
+	struct impl *impl = data;
+	struct timer_wheel *w = &impl->wheel;
+	struct source_impl *s;
+	struct spa_list due;
+	spa_source_timer_func_t func;
+	void *func_data;
+	uint64_t expirations, now;
+	int res;
+
+	if (SPA_UNLIKELY((res = spa_system_timerfd_read(impl->system,
+				fd, &expirations)) < 0)) {
 		if (res != -EAGAIN)
-			spa_log_warn(s->impl->log, "%p: failed to read timer fd:%d: %s",
-					source, source->fd, spa_strerror(res));
+			spa_log_warn(impl->log, "%p: failed to read timer fd:%d: %s",
+					impl, fd, spa_strerror(res));
 		return;
 	}
-	s->func.timer(source->data, expirations);
+
+	pthread_mutex_lock(&w->lock);
+	/* the timerfd expired, it is not armed anymore */
+	w->armed = UINT64_MAX;
+	now = get_time_ns(impl->system);
+
+	spa_list_init(&due);
+	wheel_advance(w, now, &due);
+
+	/* the callbacks can update and destroy any timer, the timer is
+	 * removed from the due list before we call it. The due timers are
+	 * still active so that wheel_remove takes them out of the list. */
+	w->processing = true;
+	while (!spa_list_is_empty(&due)) {
+		s = spa_list_first(&due, struct source_impl, timer.link);
+		spa_list_remove(&s->timer.link);
+		expirations = 1;
+		if (s->timer.interval) {
+			expirations += (now - s->timer.expire) / s->timer.interval;
+			s->timer.expire += expirations * s->timer.interval;
+			wheel_insert(w, s);
+		} else {
+			s->timer.active = false;
+			w->n_timers--;
+		}
+		func = s->func.timer;
+		func_data = s->source.data;
+
+		pthread_mutex_unlock(&w->lock);
+		func(func_data, expirations);
+		pthread_mutex_lock(&w->lock);
+	}
+	w->processing = false;
+
+	if ((res = wheel_arm(impl, wheel_next_expire(w))) < 0)
+		spa_log_warn(impl->log, "%p: failed to arm timer fd:%d: %s",
+				impl, fd, spa_strerror(res));
+	pthread_mutex_unlock(&w->lock);
+}
+
+static int wheel_ensure_source(struct impl *impl)
+{
+	struct timer_wheel *w = &impl->wheel;
+	struct spa_source *source;
+	int fd, res = 0;
+
+	pthread_mutex_lock(&w->lock);
+	if (SPA_LIKELY(w->source != NULL))
+		goto done;
+
+	if ((fd = spa_system_timerfd_create(impl->system, CLOCK_MONOTONIC,
+			SPA_FD_CLOEXEC | SPA_FD_NONBLOCK)) < 0) {
+		res = fd;
+		goto done;
+	}
+	w->armed = UINT64_MAX;
+	source = loop_add_io(impl, fd, SPA_IO_IN, true, wheel_timer_func, impl);
+	if (source == NULL) {
+		res = -errno;
+		spa_system_close(impl->system, fd);
+		goto done;
+	}
+	w->source = source;
+done:
+	pthread_mutex_unlock(&w->lock);
+	return res;
+}
+
+static void source_timer_func(struct spa_source *source)
+{
+	/* timers are not polled, they are dispatched from the wheel */
 }
 
 static struct spa_source *loop_add_timer(void *object,
@@ -752,27 +1218,21 @@ static struct spa_source *loop_add_timer(void *object,
 	if (source == NULL)
 		goto error_exit;
 
-	if ((res = spa_system_timerfd_create(impl->system, CLOCK_MONOTONIC,
-			SPA_FD_CLOEXEC | SPA_FD_NONBLOCK)) < 0)
+	if ((res = wheel_ensure_source(impl)) < 0)
 		goto error_exit_free;
 
+	source->source.loop = &impl->loop;
 	source->source.func = source_timer_func;
 	source->source.data = data;
-	source->source.fd = res;
+	source->source.fd = -1;
 	source->source.mask = SPA_IO_IN;
 	source->impl = impl;
-	source->close = true;
 	source->func.timer = func;
 
-	if ((res = loop_add_source(impl, &source->source)) < 0)
-		goto error_exit_close;
-
 	spa_list_insert(&impl->source_list, &source->link);
 
 	return &source->source;
 
-error_exit_close:
-	spa_system_close(impl->system, source->source.fd);
 error_exit_free:
 	free(source);
 	errno = -res;
@@ -785,28 +1245,51 @@ loop_update_timer(void *object, struct spa_source *source,
 		  struct timespec *value, struct timespec *interval, bool absolute)
 {
 	struct source_impl *s = SPA_CONTAINER_OF(source, struct source_impl, source);
-	struct itimerspec its;
-	int flags = 0, res;
+	struct impl *impl = s->impl;
+	struct timer_wheel *w = &impl->wheel;
+	uint64_t expire = 0, now;
+	int res = 0;
 
 	spa_assert(s->impl == object);
 	spa_assert(source->func == source_timer_func);
 
-	spa_zero(its);
 	if (SPA_LIKELY(value)) {
-		its.it_value = *value;
+		expire = SPA_TIMESPEC_TO_NSEC(value);
 	} else if (interval) {
-		its.it_value = *interval;
+		expire = SPA_TIMESPEC_TO_NSEC(interval);
 		absolute = true;
 	}
-	if (SPA_UNLIKELY(interval))
-		its.it_interval = *interval;
-	if (SPA_LIKELY(absolute))
-		flags |= SPA_FD_TIMER_ABSTIME;
 
-	if (SPA_UNLIKELY((res = spa_system_timerfd_settime(s->impl->system, source->fd, flags, &its, NULL)) < 0))
-		return res;
+	now = get_time_ns(impl->system);
+	if (SPA_UNLIKELY(!absolute) && expire != 0)
+		expire += now;
 
-	return 0;
+	pthread_mutex_lock(&w->lock);
+	wheel_remove(w, s);
+
+	/* like timerfd, a 0 value disarms the timer */
+	if (expire == 0)
+		goto done;
+
+	if (!w->processing) {
+		if (w->n_timers == 0)
+			w->tick = now >> TICK_SHIFT;
+		else
+			wheel_catch_up(w, now);
+	}
+	w->n_timers++;
+
+	s->timer.expire = expire;
+	s->timer.interval = interval ? SPA_TIMESPEC_TO_NSEC(interval) : 0;
+	s->timer.active = true;
+	wheel_insert(w, s);
+
+	/* when dispatching, the timer is armed when all timers are handled */
+	if (!w->processing && expire < w->armed)
+		res = wheel_arm(impl, expire);
+done:
+	pthread_mutex_unlock(&w->lock);
+	return res;
 }
 
 static void source_signal_func(struct spa_source *source)
@@ -875,6 +1358,11 @@ static void loop_destroy_source(void *object, struct spa_source *source)
 
 	if (s->fallback)
 		loop_destroy_source(s->impl, s->fallback);
+	else if (source->func == source_timer_func) {
+		pthread_mutex_lock(&s->impl->wheel.lock);
+		wheel_remove(&s->impl->wheel, s);
+		pthread_mutex_unlock(&s->impl->wheel.lock);
+	}
 	else
 		remove_from_poll(s->impl, source);
 
@@ -883,7 +1371,9 @@ static void loop_destroy_source(void *object, struct spa_source *source)
 		source->fd = -1;
 	}
 
-	if (!s->impl->polling)
+	/* the wheel does not keep a reference to the timer when it calls
+	 * the callback so the timer can be freed from any thread */
+	if (source->func == source_timer_func || !s->impl->polling)
 		free_source(s);
 	else
 		spa_list_insert(&s->impl->destroy_list, &s->link);
@@ -968,7 +1458,12 @@ static int impl_clear(struct spa_handle *handle)
 	spa_list_consume(source, &impl->source_list, link)
 		loop_destroy_source(impl, &source->source);
 
-	spa_system_close(impl->system, impl->ack_fd);
+	pthread_key_delete(impl->queue_key);
+	for (uint32_t i = 0; i < impl->n_queues; i++)
+		queue_free(impl->queues[i]);
+	pthread_mutex_destroy(&impl->queue_lock);
+	pthread_mutex_destroy(&impl->wheel.lock);
+
 	spa_system_close(impl->system, impl->poll_fd);
 
 	return 0;
@@ -1044,29 +1539,35 @@ impl_init(const struct spa_handle_factory *factory,
 	spa_list_init(&impl->destroy_list);
 	spa_hook_list_init(&impl->hooks_list);
 
-	impl->buffer_data = SPA_PTR_ALIGN(impl->buffer_mem, MAX_ALIGN, uint8_t);
-	spa_ringbuffer_init(&impl->buffer);
+	for (uint32_t l = 0; l < WHEEL_LEVELS; l++)
+		for (uint32_t i = 0; i < WHEEL_SIZE; i++)
+			spa_list_init(&impl->wheel.slots[l][i]);
+	spa_list_init(&impl->wheel.far);
+
+	if ((res = pthread_key_create(&impl->queue_key, queue_release)) != 0) {
+		res = -res;
+		spa_log_error(impl->log, "%p: can't create queue key: %s",
+				impl, spa_strerror(res));
+		goto error_exit_free_poll;
+	}
+	pthread_mutex_init(&impl->queue_lock, NULL);
+	pthread_mutex_init(&impl->wheel.lock, NULL);
 
 	impl->wakeup = loop_add_event(impl, wakeup_func, impl);
 	if (impl->wakeup == NULL) {
 		res = -errno;
 		spa_log_error(impl->log, "%p: can't create wakeup event: %m", impl);
-		goto error_exit_free_poll;
-	}
-	if ((res = spa_system_eventfd_create(impl->system,
-			SPA_FD_EVENT_SEMAPHORE | SPA_FD_CLOEXEC)) < 0) {
-		spa_log_error(impl->log, "%p: can't create ack event: %s",
-				impl, spa_strerror(res));
-		goto error_exit_free_wakeup;
+		goto error_exit_free_key;
 	}
-	impl->ack_fd = res;
 
 	spa_log_debug(impl->log, "%p: initialized", impl);
 
 	return 0;
 
-error_exit_free_wakeup:
-	loop_destroy_source(impl, impl->wakeup);
+error_exit_free_key:
+	pthread_mutex_destroy(&impl->queue_lock);
+	pthread_mutex_destroy(&impl->wheel.lock);
+	pthread_key_delete(impl->queue_key);
 error_exit_free_poll:
 	spa_system_close(impl->system, impl->poll_fd);
 error_exit:
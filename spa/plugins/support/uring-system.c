@@ -0,0 +1,1196 @@
+/* Spa */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <poll.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+
+#include <liburing.h>
+
+#include <spa/support/log.h>
+#include <spa/support/system.h>
+#include <spa/support/plugin.h>
+#include <spa/utils/list.h>
+#include <spa/utils/type.h>
+#include <spa/utils/names.h>
+#include <spa/utils/result.h>
+#include <spa/utils/string.h>
+
+#undef SPA_LOG_TOPIC_DEFAULT
+#define SPA_LOG_TOPIC_DEFAULT &log_topic
+SPA_LOG_TOPIC_DEFINE_STATIC(log_topic, "spa.uring-system");
+
+#ifndef TFD_TIMER_CANCEL_ON_SET
+#  define TFD_TIMER_CANCEL_ON_SET (1 << 1)
+#endif
+
+#define DEFAULT_ENTRIES		256
+#define MAX_WRITES		64
+
+/* fd -> state lookup, two levels so that it can grow without locking */
+#define FD_CHUNK_SHIFT		8
+#define FD_CHUNK_SIZE		(1 << FD_CHUNK_SHIFT)
+#define FD_MAX_CHUNKS		1024
+
+/* changes queued by any thread for the thread that waits on the ring */
+#define OP_ADD			(1u << 0)
+#define OP_MOD			(1u << 1)
+#define OP_DISCARD		(1u << 2)
+#define OP_REMOVE		(1u << 3)
+
+/* the low bits of the sqe user_data tell what operation completed */
+#define TAG_POLL		0
+#define TAG_READ		1
+#define TAG_WRITE		2
+#define TAG_MASK		3
+
+#define POLL_MASK		(POLLIN | POLLOUT | POLLPRI | POLLERR | POLLHUP | POLLRDHUP)
+
+struct impl;
+struct ring;
+
+struct entry {
+	struct spa_list all_link;	/* in the ring list of entries */
+	struct spa_list link;		/* in the ring idle or ready list */
+	struct spa_list update_link;	/* in the ring update list */
+	struct ring *ring;
+	int fd;
+	uint32_t events;
+	void *data;
+
+	uint32_t ops;			/* queued OP_ flags, atomic */
+	struct entry *next_op;		/* in the ring ops stack */
+	uint32_t mod_events;		/* for OP_MOD */
+	void *mod_data;
+
+	uint32_t revents;		/* pending events to report */
+	uint64_t value;			/* value read from a counter fd */
+	int error;			/* error read from a counter fd */
+	uint32_t inflight;		/* number of sqes in flight */
+
+	unsigned int counter:1;		/* eventfd or timerfd, read along with the poll */
+	unsigned int internal:1;	/* the ring wakeup fd, never reported */
+	unsigned int added:1;		/* in the ring list of entries */
+	unsigned int removed:1;
+	unsigned int armed:1;
+	unsigned int queued:1;		/* in idle or ready list */
+	unsigned int ready:1;		/* in ready list */
+	unsigned int update:1;		/* in update list */
+	unsigned int poll_failed:1;
+	unsigned int has_value:1;
+};
+
+struct write_slot {
+	uint64_t value;
+	struct write_slot *next;
+};
+
+/* Only the thread that waits on the ring, the owner, touches the entry
+ * lists and the io_uring. Other threads queue their changes on the ops
+ * stack without locking and wake up the owner, which applies them before
+ * and after every wait. */
+struct ring {
+	struct impl *impl;
+	struct io_uring uring;
+	int fd;
+
+	pthread_t owner;		/* the thread that waits, atomic */
+	int has_owner;			/* atomic, owner is valid */
+	struct entry *ops;		/* entries with queued ops, atomic */
+
+	/* all entries, also the removed ones with operations in flight */
+	struct spa_list entries;
+	struct spa_list idle;		/* need (re)arming */
+	struct spa_list ready;		/* have events to report */
+	struct spa_list update;		/* need a poll update or cancel */
+
+	struct entry *wakeup;
+
+	struct write_slot slots[MAX_WRITES];
+	struct write_slot *free_slots;
+	uint32_t n_pending_writes;
+};
+
+struct fd_info {
+	struct ring *ring;		/* for the fd of a ring */
+	struct entry *entry;		/* for an fd added to a ring, atomic */
+	bool counter;			/* eventfd or timerfd made by us */
+};
+
+struct impl {
+	struct spa_handle handle;
+	struct spa_system system;
+
+	struct spa_log *log;
+
+	uint32_t entries;
+	unsigned int defer_writes:1;
+
+	struct fd_info *chunks[FD_MAX_CHUNKS];
+};
+
+/* the ring that the current thread is waiting on, used to batch writes */
+static __thread struct ring *current_ring;
+
+static struct fd_info *fd_info_get(struct impl *impl, int fd, bool create)
+{
+	struct fd_info *chunk, *expected = NULL;
+	uint32_t idx;
+
+	if (fd < 0 || (fd >> FD_CHUNK_SHIFT) >= FD_MAX_CHUNKS)
+		return NULL;
+
+	idx = fd >> FD_CHUNK_SHIFT;
+	chunk = __atomic_load_n(&impl->chunks[idx], __ATOMIC_ACQUIRE);
+	if (chunk == NULL) {
+		if (!create)
+			return NULL;
+		if ((chunk = calloc(FD_CHUNK_SIZE, sizeof(struct fd_info))) == NULL)
+			return NULL;
+		if (!__atomic_compare_exchange_n(&impl->chunks[idx], &expected, chunk,
+					false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			free(chunk);
+			chunk = expected;
+		}
+	}
+	return &chunk[fd & (FD_CHUNK_SIZE - 1)];
+}
+
+static struct ring *ring_find(struct impl *impl, int pfd)
+{
+	struct fd_info *info = fd_info_get(impl, pfd, false);
+	return info ? info->ring : NULL;
+}
+
+static inline struct entry *fd_info_get_entry(struct fd_info *info)
+{
+	return __atomic_load_n(&info->entry, __ATOMIC_ACQUIRE);
+}
+
+/* eventfd and timerfd deliver their value with a single 8 byte read. We
+ * only know this for the fds that we made, the flag is cleared again when
+ * the fd is closed with impl_close(). */
+static void fd_info_set_counter(struct impl *impl, int fd, bool counter)
+{
+	struct fd_info *info = fd_info_get(impl, fd, counter);
+	if (info != NULL)
+		__atomic_store_n(&info->counter, counter, __ATOMIC_RELEASE);
+}
+
+static inline bool ring_is_owner(struct ring *r)
+{
+	return __atomic_load_n(&r->has_owner, __ATOMIC_ACQUIRE) &&
+		pthread_equal(__atomic_load_n(&r->owner, __ATOMIC_RELAXED), pthread_self());
+}
+
+static void ring_wakeup(struct ring *r)
+{
+	uint64_t count = 1;
+	/* wake up the owner so that it picks up the changes */
+	if (__atomic_load_n(&r->has_owner, __ATOMIC_ACQUIRE) && !ring_is_owner(r) &&
+	    write(r->wakeup->fd, &count, sizeof(count)) != sizeof(count))
+		spa_log_warn(r->impl->log, "%p: wakeup failed: %m", r);
+}
+
+static void entry_unqueue(struct entry *e)
+{
+	if (e->queued) {
+		spa_list_remove(&e->link);
+		e->queued = e->ready = false;
+	}
+}
+
+static void entry_set_idle(struct entry *e)
+{
+	entry_unqueue(e);
+	if (!e->removed) {
+		spa_list_append(&e->ring->idle, &e->link);
+		e->queued = true;
+	}
+}
+
+static void entry_set_ready(struct entry *e)
+{
+	if (e->ready || e->removed)
+		return;
+	entry_unqueue(e);
+	spa_list_append(&e->ring->ready, &e->link);
+	e->queued = e->ready = true;
+}
+
+static void entry_set_update(struct entry *e)
+{
+	if (!e->update) {
+		spa_list_append(&e->ring->update, &e->update_link);
+		e->update = true;
+	}
+}
+
+static void entry_free(struct entry *e)
+{
+	entry_unqueue(e);
+	if (e->update)
+		spa_list_remove(&e->update_link);
+	if (e->added)
+		spa_list_remove(&e->all_link);
+	free(e);
+}
+
+/* called by the owner, the entry is freed when no operations are in flight
+ * and it is not on the ops stack anymore */
+static void entry_release(struct entry *e)
+{
+	if (e->inflight == 0 && __atomic_load_n(&e->ops, __ATOMIC_ACQUIRE) == 0)
+		entry_free(e);
+}
+
+static void entry_remove(struct entry *e)
+{
+	e->removed = true;
+	e->data = NULL;
+	entry_unqueue(e);
+	if (e->inflight == 0)
+		entry_release(e);
+	else
+		entry_set_update(e);
+}
+
+static void entry_discard(struct entry *e)
+{
+	/* setting the timer discards the pending expirations */
+	if (e->has_value) {
+		e->has_value = false;
+		e->error = 0;
+		e->revents = 0;
+		if (!e->armed)
+			entry_set_idle(e);
+		else
+			entry_unqueue(e);
+	}
+}
+
+/* queue a change for the owner, can be called from any thread */
+static void entry_queue_op(struct entry *e, uint32_t op)
+{
+	struct ring *r = e->ring;
+	struct entry *head;
+
+	if (__atomic_fetch_or(&e->ops, op, __ATOMIC_ACQ_REL) == 0) {
+		/* not on the stack yet, push it */
+		head = __atomic_load_n(&r->ops, __ATOMIC_RELAXED);
+		do {
+			e->next_op = head;
+		} while (!__atomic_compare_exchange_n(&r->ops, &head, e, true,
+					__ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	}
+	ring_wakeup(r);
+}
+
+static void entry_apply_ops(struct entry *e, uint32_t ops)
+{
+	struct ring *r = e->ring;
+
+	if (ops & OP_ADD) {
+		spa_list_append(&r->entries, &e->all_link);
+		e->added = true;
+		entry_set_idle(e);
+	}
+	if ((ops & OP_MOD) && !e->removed) {
+		e->data = e->mod_data;
+		if (e->events != e->mod_events) {
+			e->events = e->mod_events;
+			/* counters are only ever polled for input, the other
+			 * events are filtered when reporting */
+			if (!e->counter && e->armed)
+				entry_set_update(e);
+		}
+	}
+	if (ops & OP_DISCARD)
+		entry_discard(e);
+	if ((ops & OP_REMOVE) && !e->removed)
+		entry_remove(e);
+	else if (e->removed)
+		entry_release(e);
+}
+
+/* called by the owner, apply the queued changes in the order they were
+ * queued */
+static void ring_process_ops(struct ring *r)
+{
+	struct entry *e, *next, *list = NULL;
+	uint32_t ops;
+
+	if (SPA_LIKELY(__atomic_load_n(&r->ops, __ATOMIC_RELAXED) == NULL))
+		return;
+
+	e = __atomic_exchange_n(&r->ops, NULL, __ATOMIC_ACQUIRE);
+	for (; e != NULL; e = next) {
+		next = e->next_op;
+		e->next_op = list;
+		list = e;
+	}
+	for (e = list; e != NULL; e = next) {
+		/* the entry can be pushed again as soon as ops is cleared */
+		next = e->next_op;
+		ops = __atomic_exchange_n(&e->ops, 0, __ATOMIC_ACQ_REL);
+		entry_apply_ops(e, ops);
+	}
+}
+
+static struct io_uring_sqe *ring_get_sqe(struct ring *r)
+{
+	struct io_uring_sqe *sqe;
+
+	if ((sqe = io_uring_get_sqe(&r->uring)) == NULL) {
+		/* the submission queue is full, flush it and try again */
+		io_uring_submit(&r->uring);
+		r->n_pending_writes = 0;
+		sqe = io_uring_get_sqe(&r->uring);
+	}
+	return sqe;
+}
+
+static int entry_arm(struct entry *e)
+{
+	struct ring *r = e->ring;
+	struct io_uring_sqe *sqe;
+	unsigned int needed = e->counter ? 2 : 1;
+
+	if (io_uring_sq_space_left(&r->uring) < needed) {
+		io_uring_submit(&r->uring);
+		r->n_pending_writes = 0;
+		if (io_uring_sq_space_left(&r->uring) < needed)
+			return -EBUSY;
+	}
+	sqe = io_uring_get_sqe(&r->uring);
+
+	if (e->counter) {
+		/* poll and then read the counter in the same submission, this
+		 * saves the read syscall when the event is dispatched */
+		io_uring_prep_poll_add(sqe, e->fd, POLLIN);
+		io_uring_sqe_set_data64(sqe, (uint64_t)(uintptr_t)e | TAG_POLL);
+		io_uring_sqe_set_flags(sqe, IOSQE_IO_LINK);
+
+		sqe = io_uring_get_sqe(&r->uring);
+		io_uring_prep_read(sqe, e->fd, &e->value, sizeof(e->value), 0);
+		io_uring_sqe_set_data64(sqe, (uint64_t)(uintptr_t)e | TAG_READ);
+		e->inflight += 2;
+	} else {
+		io_uring_prep_poll_add(sqe, e->fd, e->events & POLL_MASK);
+		io_uring_sqe_set_data64(sqe, (uint64_t)(uintptr_t)e | TAG_POLL);
+		e->inflight++;
+	}
+	e->armed = true;
+	e->poll_failed = false;
+	entry_unqueue(e);
+	return 0;
+}
+
+static void entry_do_update(struct entry *e)
+{
+	struct ring *r = e->ring;
+	struct io_uring_sqe *sqe;
+	uint64_t poll_tag = (uint64_t)(uintptr_t)e | TAG_POLL;
+
+	if (!e->armed)
+		return;
+
+	if ((sqe = ring_get_sqe(r)) == NULL)
+		return;
+
+	if (e->removed) {
+		io_uring_prep_cancel64(sqe, poll_tag, 0);
+		io_uring_sqe_set_data64(sqe, 0);
+		if (e->counter && (sqe = ring_get_sqe(r)) != NULL) {
+			io_uring_prep_cancel64(sqe, (uint64_t)(uintptr_t)e | TAG_READ, 0);
+			io_uring_sqe_set_data64(sqe, 0);
+		}
+	} else {
+		/* when the poll already completed this fails and the entry
+		 * is armed again with the new events */
+		io_uring_prep_poll_update(sqe, poll_tag, poll_tag,
+				e->events & POLL_MASK, IORING_POLL_UPDATE_EVENTS);
+		io_uring_sqe_set_data64(sqe, 0);
+	}
+}
+
+static void handle_cqe(struct ring *r, struct io_uring_cqe *cqe)
+{
+	uint64_t data = io_uring_cqe_get_data64(cqe);
+	struct entry *e = (struct entry *)(uintptr_t)(data & ~(uint64_t)TAG_MASK);
+	int res = cqe->res;
+
+	if (data == 0)
+		return;
+
+	switch (data & TAG_MASK) {
+	case TAG_WRITE:
+	{
+		struct write_slot *s = (struct write_slot *)e;
+		if (res != sizeof(uint64_t))
+			spa_log_warn(r->impl->log, "%p: write failed: %s", r,
+					spa_strerror(res < 0 ? res : -EIO));
+		s->next = r->free_slots;
+		r->free_slots = s;
+		return;
+	}
+	case TAG_POLL:
+		e->inflight--;
+		if (e->removed)
+			break;
+		if (res < 0) {
+			/* for counters, this also cancels the linked read */
+			e->poll_failed = true;
+			e->revents |= POLLERR;
+			entry_set_ready(e);
+		} else if (!e->counter) {
+			e->revents |= res;
+			entry_set_ready(e);
+		}
+		break;
+	case TAG_READ:
+		e->inflight--;
+		if (e->removed)
+			break;
+		if (res == sizeof(uint64_t)) {
+			e->has_value = true;
+			e->revents |= POLLIN;
+			entry_set_ready(e);
+		} else if (res == -ECANCELED && !e->poll_failed) {
+			/* a TFD_TIMER_CANCEL_ON_SET timer was cancelled */
+			e->error = res;
+			e->has_value = true;
+			e->revents |= POLLIN;
+			entry_set_ready(e);
+		} else if (res != -EAGAIN && res != -ECANCELED) {
+			e->revents |= POLLERR;
+			entry_set_ready(e);
+		}
+		break;
+	}
+	if (e->inflight == 0) {
+		e->armed = false;
+		if (e->removed)
+			entry_release(e);
+		else if (!e->ready)
+			entry_set_idle(e);
+	}
+}
+
+static void flush_writes(struct impl *impl)
+{
+	struct ring *r = current_ring;
+	/* make sure pending writes are done before we block */
+	if (r != NULL && r->impl == impl && r->n_pending_writes > 0) {
+		io_uring_submit(&r->uring);
+		r->n_pending_writes = 0;
+	}
+}
+
+static ssize_t impl_read(void *object, int fd, void *buf, size_t count)
+{
+	ssize_t res;
+	flush_writes(object);
+	res = read(fd, buf, count);
+	return res < 0 ? -errno : res;
+}
+
+static ssize_t impl_write(void *object, int fd, const void *buf, size_t count)
+{
+	ssize_t res = write(fd, buf, count);
+	return res < 0 ? -errno : res;
+}
+
+static int impl_ioctl(void *object, int fd, unsigned long request, ...)
+{
+	int res;
+	va_list ap;
+	long arg;
+
+	va_start(ap, request);
+	arg = va_arg(ap, long);
+	res = ioctl(fd, request, arg);
+	va_end(ap);
+
+	return res < 0 ? -errno : res;
+}
+
+static void ring_destroy(struct ring *r)
+{
+	struct impl *impl = r->impl;
+	struct fd_info *info;
+	struct entry *e, *next;
+
+	spa_log_debug(impl->log, "%p: destroy ring fd:%d", impl, r->fd);
+
+	if ((info = fd_info_get(impl, r->fd, false)) != NULL)
+		info->ring = NULL;
+	if (current_ring == r)
+		current_ring = NULL;
+
+	/* this cancels all pending operations */
+	io_uring_queue_exit(&r->uring);
+
+	if (r->wakeup)
+		close(r->wakeup->fd);
+	/* the entries that were never added are only on the ops stack */
+	for (e = __atomic_exchange_n(&r->ops, NULL, __ATOMIC_ACQUIRE); e; e = next) {
+		next = e->next_op;
+		e->ops = 0;
+		if (!e->added)
+			entry_free(e);
+	}
+	spa_list_consume(e, &r->entries, all_link)
+		entry_free(e);
+
+	free(r);
+}
+
+static int impl_close(void *object, int fd)
+{
+	struct impl *impl = object;
+	struct fd_info *info;
+	struct entry *e;
+	int res;
+
+	if ((info = fd_info_get(impl, fd, false)) != NULL) {
+		if (info->ring != NULL) {
+			/* io_uring_queue_exit closes the fd */
+			ring_destroy(info->ring);
+			spa_log_debug(impl->log, "%p: close fd:%d", impl, fd);
+			return 0;
+		}
+		if ((e = __atomic_exchange_n(&info->entry, NULL, __ATOMIC_ACQ_REL)) != NULL)
+			entry_queue_op(e, OP_REMOVE);
+		__atomic_store_n(&info->counter, false, __ATOMIC_RELEASE);
+	}
+	res = close(fd);
+	spa_log_debug(impl->log, "%p: close fd:%d", impl, fd);
+	return res < 0 ? -errno : res;
+}
+
+/* clock */
+static int impl_clock_gettime(void *object,
+			int clockid, struct timespec *value)
+{
+	int res = clock_gettime(clockid, value);
+	return res < 0 ? -errno : res;
+}
+
+static int impl_clock_getres(void *object,
+			int clockid, struct timespec *res)
+{
+	int r = clock_getres(clockid, res);
+	return r < 0 ? -errno : r;
+}
+
+/* poll */
+static struct entry *entry_new(struct ring *r, int fd, uint32_t events, void *data,
+		bool counter)
+{
+	struct entry *e;
+
+	if ((e = calloc(1, sizeof(*e))) == NULL)
+		return NULL;
+
+	e->ring = r;
+	e->fd = fd;
+	e->events = events;
+	e->data = data;
+	/* the counter is only read along with the poll when we are
+	 * interested in reading it */
+	e->counter = (events & EPOLLIN) && counter;
+	entry_queue_op(e, OP_ADD);
+	return e;
+}
+
+static int impl_pollfd_create(void *object, int flags)
+{
+	struct impl *impl = object;
+	struct io_uring_params p;
+	struct fd_info *info;
+	struct ring *r;
+	int res, wfd;
+
+	if ((r = calloc(1, sizeof(*r))) == NULL)
+		return -errno;
+
+	r->impl = impl;
+	spa_list_init(&r->entries);
+	spa_list_init(&r->idle);
+	spa_list_init(&r->ready);
+	spa_list_init(&r->update);
+
+	for (int i = 0; i < MAX_WRITES; i++) {
+		r->slots[i].next = r->free_slots;
+		r->free_slots = &r->slots[i];
+	}
+
+	spa_zero(p);
+#ifdef IORING_SETUP_COOP_TASKRUN
+	p.flags |= IORING_SETUP_COOP_TASKRUN;
+#endif
+	res = io_uring_queue_init_params(impl->entries, &r->uring, &p);
+	if (res == -EINVAL && p.flags != 0) {
+		spa_zero(p);
+		res = io_uring_queue_init_params(impl->entries, &r->uring, &p);
+	}
+	if (res < 0) {
+		spa_log_error(impl->log, "%p: can't create io_uring: %s",
+				impl, spa_strerror(res));
+		goto error_free;
+	}
+	/* the io_uring fd is always close-on-exec */
+	r->fd = r->uring.ring_fd;
+
+	if ((wfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) {
+		res = -errno;
+		goto error_exit;
+	}
+	if ((r->wakeup = entry_new(r, wfd, EPOLLIN, NULL, true)) == NULL) {
+		res = -errno;
+		close(wfd);
+		goto error_exit;
+	}
+	r->wakeup->internal = true;
+
+	if ((info = fd_info_get(impl, r->fd, true)) == NULL) {
+		res = -EMFILE;
+		goto error_wakeup;
+	}
+	info->ring = r;
+
+	spa_log_debug(impl->log, "%p: new fd:%d entries:%u features:%08x", impl,
+			r->fd, p.sq_entries, p.features);
+	return r->fd;
+
+error_wakeup:
+	close(wfd);
+	__atomic_store_n(&r->ops, NULL, __ATOMIC_RELAXED);
+	entry_free(r->wakeup);
+error_exit:
+	io_uring_queue_exit(&r->uring);
+error_free:
+	free(r);
+	return res;
+}
+
+static int impl_pollfd_add(void *object, int pfd, int fd, uint32_t events, void *data)
+{
+	struct impl *impl = object;
+	struct ring *r;
+	struct fd_info *info;
+	struct entry *e, *old;
+
+	if ((r = ring_find(impl, pfd)) == NULL)
+		return -EBADF;
+	if ((info = fd_info_get(impl, fd, true)) == NULL)
+		return -EBADF;
+
+	if ((old = fd_info_get_entry(info)) != NULL && old->ring != r)
+		return -EEXIST;
+
+	if ((e = entry_new(r, fd, events, data,
+				__atomic_load_n(&info->counter, __ATOMIC_ACQUIRE))) == NULL)
+		return -errno;
+
+	if ((old = __atomic_exchange_n(&info->entry, e, __ATOMIC_ACQ_REL)) != NULL)
+		/* the fd was closed without removing it first */
+		entry_queue_op(old, OP_REMOVE);
+
+	return 0;
+}
+
+static int impl_pollfd_mod(void *object, int pfd, int fd, uint32_t events, void *data)
+{
+	struct impl *impl = object;
+	struct fd_info *info;
+	struct entry *e;
+	struct ring *r;
+
+	if ((r = ring_find(impl, pfd)) == NULL)
+		return -EBADF;
+	if ((info = fd_info_get(impl, fd, false)) == NULL ||
+	    (e = fd_info_get_entry(info)) == NULL || e->ring != r)
+		return -ENOENT;
+
+	e->mod_events = events;
+	e->mod_data = data;
+	entry_queue_op(e, OP_MOD);
+	return 0;
+}
+
+static int impl_pollfd_del(void *object, int pfd, int fd)
+{
+	struct impl *impl = object;
+	struct fd_info *info;
+	struct entry *e;
+	struct ring *r;
+
+	if ((r = ring_find(impl, pfd)) == NULL)
+		return -EBADF;
+	if ((info = fd_info_get(impl, fd, false)) == NULL ||
+	    (e = fd_info_get_entry(info)) == NULL || e->ring != r)
+		return -ENOENT;
+	if (!__atomic_compare_exchange_n(&info->entry, &e, NULL, false,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		return -ENOENT;
+
+	entry_queue_op(e, OP_REMOVE);
+	return 0;
+}
+
+static int collect_events(struct ring *r, struct spa_poll_event *ev, int n_ev)
+{
+	struct entry *e, *t;
+	struct spa_list keep;
+	int n = 0;
+
+	spa_list_init(&keep);
+
+	spa_list_for_each_safe(e, t, &r->ready, link) {
+		uint32_t mask;
+
+		if (n >= n_ev)
+			break;
+
+		if (e->internal) {
+			/* the value of the wakeup fd is not interesting */
+			e->has_value = false;
+			e->revents = 0;
+			if (e->armed)
+				entry_unqueue(e);
+			else
+				entry_set_idle(e);
+			continue;
+		}
+
+		mask = e->revents & (e->events | POLLERR | POLLHUP);
+		if (e->counter && e->has_value) {
+			/* level triggered, keep reporting until it is read */
+			spa_list_remove(&e->link);
+			spa_list_append(&keep, &e->link);
+		} else {
+			e->revents = 0;
+			if (e->armed)
+				entry_unqueue(e);
+			else
+				entry_set_idle(e);
+		}
+		if (mask == 0)
+			continue;
+
+		ev[n].events = mask;
+		ev[n].data = e->data;
+		n++;
+	}
+	spa_list_insert_list(r->ready.prev, &keep);
+	return n;
+}
+
+static int impl_pollfd_wait(void *object, int pfd,
+		struct spa_poll_event *ev, int n_ev, int timeout)
+{
+	struct impl *impl = object;
+	struct __kernel_timespec ts, *tsp = NULL;
+	struct io_uring_cqe *cqe;
+	struct entry *e, *t;
+	struct ring *r;
+	unsigned head, count = 0, wait_nr;
+	int res, n;
+
+	if (SPA_UNLIKELY((r = ring_find(impl, pfd)) == NULL))
+		return -EBADF;
+
+	/* the loop can be iterated by another thread after a leave */
+	if (SPA_UNLIKELY(!ring_is_owner(r))) {
+		__atomic_store_n(&r->owner, pthread_self(), __ATOMIC_RELAXED);
+		__atomic_store_n(&r->has_owner, true, __ATOMIC_RELEASE);
+	}
+	current_ring = r;
+
+	ring_process_ops(r);
+
+	spa_list_for_each_safe(e, t, &r->update, update_link) {
+		spa_list_remove(&e->update_link);
+		e->update = false;
+		entry_do_update(e);
+	}
+	spa_list_for_each_safe(e, t, &r->idle, link) {
+		if (entry_arm(e) < 0)
+			break;
+	}
+	wait_nr = (timeout == 0 || !spa_list_is_empty(&r->ready)) ? 0 : 1;
+
+	/* submit the new requests and wait for completions in one go */
+	if (wait_nr == 0) {
+		res = io_uring_submit(&r->uring);
+	} else if (timeout > 0) {
+		ts.tv_sec = timeout / 1000;
+		ts.tv_nsec = (timeout % 1000) * SPA_NSEC_PER_MSEC;
+		tsp = &ts;
+		res = io_uring_submit_and_wait_timeout(&r->uring, &cqe, wait_nr, tsp, NULL);
+	} else {
+		res = io_uring_submit_and_wait(&r->uring, wait_nr);
+	}
+	r->n_pending_writes = 0;
+
+	if (SPA_UNLIKELY(res < 0 && res != -ETIME && res != -EBUSY))
+		return res;
+
+	io_uring_for_each_cqe(&r->uring, head, cqe) {
+		handle_cqe(r, cqe);
+		count++;
+	}
+	io_uring_cq_advance(&r->uring, count);
+
+	/* removed fds must not be reported anymore */
+	ring_process_ops(r);
+
+	n = collect_events(r, ev, n_ev);
+
+	return n;
+}
+
+/* timers */
+static int impl_timerfd_create(void *object, int clockid, int flags)
+{
+	struct impl *impl = object;
+	int fl = 0, res;
+	if (flags & SPA_FD_CLOEXEC)
+		fl |= TFD_CLOEXEC;
+	if (flags & SPA_FD_NONBLOCK)
+		fl |= TFD_NONBLOCK;
+	res = timerfd_create(clockid, fl);
+	spa_log_debug(impl->log, "%p: new fd:%d", impl, res);
+	if (res < 0)
+		return -errno;
+	fd_info_set_counter(impl, res, true);
+	return res;
+}
+
+static struct entry *counter_entry(struct impl *impl, int fd)
+{
+	struct fd_info *info;
+	struct entry *e;
+
+	if ((info = fd_info_get(impl, fd, false)) == NULL ||
+	    (e = fd_info_get_entry(info)) == NULL || !e->counter)
+		return NULL;
+	return e;
+}
+
+static int impl_timerfd_settime(void *object,
+			int fd, int flags,
+			const struct itimerspec *new_value,
+			struct itimerspec *old_value)
+{
+	struct impl *impl = object;
+	struct entry *e;
+	int fl = 0, res;
+
+	if (flags & SPA_FD_TIMER_ABSTIME)
+		fl |= TFD_TIMER_ABSTIME;
+	if (flags & SPA_FD_TIMER_CANCEL_ON_SET)
+		fl |= TFD_TIMER_CANCEL_ON_SET;
+
+	if ((e = counter_entry(impl, fd)) != NULL) {
+		if (ring_is_owner(e->ring))
+			entry_discard(e);
+		else
+			entry_queue_op(e, OP_DISCARD);
+	}
+	res = timerfd_settime(fd, fl, new_value, old_value);
+	return res < 0 ? -errno : res;
+}
+
+static int impl_timerfd_gettime(void *object,
+			int fd, struct itimerspec *curr_value)
+{
+	int res = timerfd_gettime(fd, curr_value);
+	return res < 0 ? -errno : res;
+
+}
+
+static int read_counter(struct impl *impl, int fd, uint64_t *value)
+{
+	struct entry *e;
+	int res;
+
+	/* the value was read together with the poll, only the owner of the
+	 * ring can take it, other threads read the fd */
+	if ((e = counter_entry(impl, fd)) != NULL && e->has_value &&
+	    ring_is_owner(e->ring)) {
+		res = e->error;
+		*value = e->value;
+		e->has_value = false;
+		e->error = 0;
+		e->revents &= ~POLLIN;
+		if (!e->armed)
+			entry_set_idle(e);
+		else
+			entry_unqueue(e);
+		return res;
+	}
+	flush_writes(impl);
+	if (read(fd, value, sizeof(uint64_t)) != sizeof(uint64_t))
+		return -errno;
+	return 0;
+}
+
+static int impl_timerfd_read(void *object, int fd, uint64_t *expirations)
+{
+	return read_counter(object, fd, expirations);
+}
+
+/* events */
+static int impl_eventfd_create(void *object, int flags)
+{
+	struct impl *impl = object;
+	int fl = 0, res, err;
+	if (flags & SPA_FD_CLOEXEC)
+		fl |= EFD_CLOEXEC;
+	if (flags & SPA_FD_NONBLOCK)
+		fl |= EFD_NONBLOCK;
+	if (flags & SPA_FD_EVENT_SEMAPHORE)
+		fl |= EFD_SEMAPHORE;
+	res = eventfd(0, fl);
+	err = -errno; /* save errno in case it is overwritten before return */
+	spa_log_debug(impl->log, "%p: new fd:%d", impl, res);
+	if (res < 0)
+		return err;
+	fd_info_set_counter(impl, res, true);
+	return res;
+}
+
+static int queue_write(struct ring *r, int fd, uint64_t count)
+{
+	struct io_uring_sqe *sqe;
+	struct write_slot *s;
+
+	if ((s = r->free_slots) == NULL)
+		return -EBUSY;
+	if ((sqe = io_uring_get_sqe(&r->uring)) == NULL)
+		return -EBUSY;
+
+	r->free_slots = s->next;
+	s->value = count;
+	io_uring_prep_write(sqe, fd, &s->value, sizeof(s->value), 0);
+	io_uring_sqe_set_data64(sqe, (uint64_t)(uintptr_t)s | TAG_WRITE);
+	r->n_pending_writes++;
+	return 0;
+}
+
+static int impl_eventfd_write(void *object, int fd, uint64_t count)
+{
+	struct impl *impl = object;
+	struct ring *r = current_ring;
+
+	/* writes from the thread of the ring are submitted together with
+	 * the next wait */
+	if (impl->defer_writes && r != NULL && r->impl == impl &&
+	    queue_write(r, fd, count) == 0)
+		return 0;
+
+	if (write(fd, &count, sizeof(uint64_t)) != sizeof(uint64_t))
+		return -errno;
+	return 0;
+}
+
+static int impl_eventfd_read(void *object, int fd, uint64_t *count)
+{
+	return read_counter(object, fd, count);
+}
+
+/* signals */
+static int impl_signalfd_create(void *object, int signal, int flags)
+{
+	struct impl *impl = object;
+	sigset_t mask;
+	int res, fl = 0;
+
+	if (flags & SPA_FD_CLOEXEC)
+		fl |= SFD_CLOEXEC;
+	if (flags & SPA_FD_NONBLOCK)
+		fl |= SFD_NONBLOCK;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, signal);
+	res = signalfd(-1, &mask, fl);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+	spa_log_debug(impl->log, "%p: new fd:%d", impl, res);
+
+	return res < 0 ? -errno : res;
+}
+
+static int impl_signalfd_read(void *object, int fd, int *signal)
+{
+	struct signalfd_siginfo signal_info;
+	int len;
+
+	len = read(fd, &signal_info, sizeof signal_info);
+	if (!(len == -1 && errno == EAGAIN) && len != sizeof signal_info)
+		return -errno;
+
+	*signal = signal_info.ssi_signo;
+
+	return 0;
+}
+
+static const struct spa_system_methods impl_system = {
+	SPA_VERSION_SYSTEM_METHODS,
+	.read = impl_read,
+	.write = impl_write,
+	.ioctl = impl_ioctl,
+	.close = impl_close,
+	.clock_gettime = impl_clock_gettime,
+	.clock_getres = impl_clock_getres,
+	.pollfd_create = impl_pollfd_create,
+	.pollfd_add = impl_pollfd_add,
+	.pollfd_mod = impl_pollfd_mod,
+	.pollfd_del = impl_pollfd_del,
+	.pollfd_wait = impl_pollfd_wait,
+	.timerfd_create = impl_timerfd_create,
+	.timerfd_settime = impl_timerfd_settime,
+	.timerfd_gettime = impl_timerfd_gettime,
+	.timerfd_read = impl_timerfd_read,
+	.eventfd_create = impl_eventfd_create,
+	.eventfd_write = impl_eventfd_write,
+	.eventfd_read = impl_eventfd_read,
+	.signalfd_create = impl_signalfd_create,
+	.signalfd_read = impl_signalfd_read,
+};
+
+static int impl_get_interface(struct spa_handle *handle, const char *type, void **interface)
+{
+	struct impl *impl;
+
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+	spa_return_val_if_fail(interface != NULL, -EINVAL);
+
+	impl = (struct impl *) handle;
+
+	if (spa_streq(type, SPA_TYPE_INTERFACE_System))
+		*interface = &impl->system;
+	else
+		return -ENOENT;
+
+	return 0;
+}
+
+static int impl_clear(struct spa_handle *handle)
+{
+	struct impl *impl;
+
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+
+	impl = (struct impl *) handle;
+
+	for (int i = 0; i < FD_MAX_CHUNKS; i++)
+		free(impl->chunks[i]);
+
+	return 0;
+}
+
+static size_t
+impl_get_size(const struct spa_handle_factory *factory,
+	      const struct spa_dict *params)
+{
+	return sizeof(struct impl);
+}
+
+static int
+impl_init(const struct spa_handle_factory *factory,
+	  struct spa_handle *handle,
+	  const struct spa_dict *info,
+	  const struct spa_support *support,
+	  uint32_t n_support)
+{
+	struct impl *impl;
+	struct io_uring_params p;
+	struct io_uring probe;
+	const char *str;
+	int res;
+
+	spa_return_val_if_fail(factory != NULL, -EINVAL);
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+
+	handle->get_interface = impl_get_interface;
+	handle->clear = impl_clear;
+
+	impl = (struct impl *) handle;
+	impl->system.iface = SPA_INTERFACE_INIT(
+			SPA_TYPE_INTERFACE_System,
+			SPA_VERSION_SYSTEM,
+			&impl_system, impl);
+
+	impl->log = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_Log);
+	spa_log_topic_init(impl->log, &log_topic);
+
+	impl->entries = DEFAULT_ENTRIES;
+	if (info && (str = spa_dict_lookup(info, "uring.entries")) != NULL)
+		spa_atou32(str, &impl->entries, 0);
+	if (info && (str = spa_dict_lookup(info, "uring.defer-writes")) != NULL)
+		impl->defer_writes = spa_atob(str);
+
+	/* we need the timeout argument to io_uring_enter() to submit and
+	 * wait with one syscall and we can't lose completions */
+	spa_zero(p);
+	if ((res = io_uring_queue_init_params(2, &probe, &p)) < 0) {
+		spa_log_error(impl->log, "%p: io_uring not available: %s",
+				impl, spa_strerror(res));
+		return res;
+	}
+	io_uring_queue_exit(&probe);
+	if (!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_NODROP)) {
+		spa_log_error(impl->log, "%p: io_uring is missing features %08x",
+				impl, p.features);
+		return -ENOTSUP;
+	}
+
+	spa_log_debug(impl->log, "%p: initialized entries:%u defer-writes:%d", impl,
+			impl->entries, impl->defer_writes);
+
+	return 0;
+}
+
+static const struct spa_interface_info impl_interfaces[] = {
+	{SPA_TYPE_INTERFACE_System,},
+};
+
+static int
+impl_enum_interface_info(const struct spa_handle_factory *factory,
+			 const struct spa_interface_info **info,
+			 uint32_t *index)
+{
+	spa_return_val_if_fail(factory != NULL, -EINVAL);
+	spa_return_val_if_fail(info != NULL, -EINVAL);
+	spa_return_val_if_fail(index != NULL, -EINVAL);
+
+	if (*index >= SPA_N_ELEMENTS(impl_interfaces))
+		return 0;
+
+	*info = &impl_interfaces[(*index)++];
+	return 1;
+}
+
+const struct spa_handle_factory spa_support_uring_system_factory = {
+	SPA_VERSION_HANDLE_FACTORY,
+	SPA_NAME_SUPPORT_SYSTEM,
+	NULL,
+	impl_get_size,
+	impl_init,
+	impl_enum_interface_info
+};
@@ -0,0 +1,533 @@
+/* Spa */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <time.h>
+#include <assert.h>
+#include <dlfcn.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+
+#include <spa/support/plugin.h>
+#include <spa/support/loop.h>
+#include <spa/support/system.h>
+#include <spa/utils/atomic.h>
+#include <spa/utils/names.h>
+#include <spa/utils/result.h>
+#include <spa/utils/string.h>
+#include <spa/utils/type.h>
+
+#define MAX_COUNT	100000
+#define MAX_SOURCES	64
+#define MAX_PRODUCERS	4
+#define MAX_TIMERS	10000
+
+struct producer {
+	struct data *data;
+	pthread_t thread;
+	uint32_t id;
+	uint32_t count;
+	bool block;
+};
+
+struct invoke_msg {
+	uint64_t time;
+	uint32_t producer;
+	uint32_t seq;
+};
+
+struct timer {
+	struct data *data;
+	struct spa_source *source;
+	uint64_t expire;
+};
+
+struct data {
+	const char *plugin_dir;
+
+	void *system_lib;
+	void *loop_lib;
+	struct spa_handle *system_handle;
+	struct spa_handle *loop_handle;
+
+	struct spa_system *system;
+	struct spa_loop *loop;
+	struct spa_loop_control *control;
+	struct spa_loop_utils *utils;
+
+	struct spa_source *sources[MAX_SOURCES];
+	uint32_t n_sources;
+	uint32_t pending;
+
+	pthread_t thread;
+	bool running;
+	int reply_fd;
+
+	struct producer producers[MAX_PRODUCERS];
+	uint32_t last_seq[MAX_PRODUCERS];
+	uint64_t *latency;
+	uint32_t n_latency;
+	uint32_t errors;
+
+	struct timer *timers;
+	uint32_t n_timers;
+	uint32_t fired;
+	uint64_t max_late;
+};
+
+static int load_handle(struct data *data, void **lib, struct spa_handle **handle,
+		const char *name, const char *factory_name,
+		const struct spa_support *support, uint32_t n_support)
+{
+	spa_handle_factory_enum_func_t enum_func;
+	const struct spa_handle_factory *factory;
+	char path[PATH_MAX];
+	uint32_t i;
+	int res;
+
+	snprintf(path, sizeof(path), "%s/%s.so", data->plugin_dir, name);
+	if ((*lib = dlopen(path, RTLD_NOW)) == NULL) {
+		fprintf(stderr, "can't load %s: %s\n", path, dlerror());
+		return -ENOENT;
+	}
+	if ((enum_func = dlsym(*lib, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL)
+		return -ENOENT;
+
+	for (i = 0;;) {
+		if ((res = enum_func(&factory, &i)) <= 0)
+			return res == 0 ? -ENOENT : res;
+		if (spa_streq(factory->name, factory_name))
+			break;
+	}
+	*handle = calloc(1, spa_handle_factory_get_size(factory, NULL));
+	if (*handle == NULL)
+		return -errno;
+	if ((res = spa_handle_factory_init(factory, *handle, NULL, support, n_support)) < 0) {
+		free(*handle);
+		*handle = NULL;
+		return res;
+	}
+	return 0;
+}
+
+static void unload(struct data *data)
+{
+	if (data->loop_handle) {
+		spa_handle_clear(data->loop_handle);
+		free(data->loop_handle);
+	}
+	if (data->system_handle) {
+		spa_handle_clear(data->system_handle);
+		free(data->system_handle);
+	}
+	if (data->loop_lib)
+		dlclose(data->loop_lib);
+	if (data->system_lib)
+		dlclose(data->system_lib);
+}
+
+static int load(struct data *data, const char *system_lib)
+{
+	struct spa_support support[1];
+	void *iface;
+	int res;
+
+	if ((res = load_handle(data, &data->system_lib, &data->system_handle,
+				system_lib, SPA_NAME_SUPPORT_SYSTEM, NULL, 0)) < 0)
+		return res;
+	if ((res = spa_handle_get_interface(data->system_handle,
+				SPA_TYPE_INTERFACE_System, &iface)) < 0)
+		return res;
+	data->system = iface;
+
+	support[0] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_System, data->system);
+	if ((res = load_handle(data, &data->loop_lib, &data->loop_handle,
+				"support/libspa-support", SPA_NAME_SUPPORT_LOOP, support, 1)) < 0)
+		return res;
+	if ((res = spa_handle_get_interface(data->loop_handle,
+				SPA_TYPE_INTERFACE_Loop, &iface)) < 0)
+		return res;
+	data->loop = iface;
+	if ((res = spa_handle_get_interface(data->loop_handle,
+				SPA_TYPE_INTERFACE_LoopControl, &iface)) < 0)
+		return res;
+	data->control = iface;
+	if ((res = spa_handle_get_interface(data->loop_handle,
+				SPA_TYPE_INTERFACE_LoopUtils, &iface)) < 0)
+		return res;
+	data->utils = iface;
+	return 0;
+}
+
+static void *loop_thread(void *arg)
+{
+	struct data *data = arg;
+
+	spa_loop_control_enter(data->control);
+	while (SPA_ATOMIC_LOAD(data->running))
+		spa_loop_control_iterate(data->control, -1);
+	spa_loop_control_leave(data->control);
+	return NULL;
+}
+
+static void on_event(void *arg, uint64_t count)
+{
+	struct data *data = arg;
+	uint64_t val = 1;
+
+	if (--data->pending > 0)
+		return;
+
+	if (write(data->reply_fd, &val, sizeof(val)) != sizeof(val))
+		fprintf(stderr, "write failed: %m\n");
+}
+
+static void wait_reply(struct data *data)
+{
+	uint64_t val;
+	if (read(data->reply_fd, &val, sizeof(val)) != sizeof(val))
+		fprintf(stderr, "read failed: %m\n");
+}
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static uint64_t get_cpu_time(long *switches)
+{
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	*switches = ru.ru_nvcsw + ru.ru_nivcsw;
+	return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * SPA_NSEC_PER_SEC +
+		(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * SPA_NSEC_PER_USEC;
+}
+
+static void report(const char *lib, const char *test, uint32_t count,
+		struct timespec *ts, struct timespec *te,
+		uint64_t cpu_start, long sw_start)
+{
+	uint64_t t, cpu;
+	long sw;
+
+	cpu = get_cpu_time(&sw) - cpu_start;
+	t = SPA_TIMESPEC_TO_NSEC(te) - SPA_TIMESPEC_TO_NSEC(ts);
+
+	fprintf(stderr, "%s: %s: %u in %"PRIu64" ns, %"PRIu64" ns/op, "
+			"cpu %"PRIu64" ns/op, %.2f switches/op\n",
+			lib, test, count, t, t / count, cpu / count,
+			(double)(sw - sw_start) / count);
+}
+
+static void test_ping_pong(struct data *data, const char *lib)
+{
+	struct timespec ts, te;
+	uint64_t cpu;
+	long sw;
+	uint32_t i;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	cpu = get_cpu_time(&sw);
+	for (i = 0; i < MAX_COUNT; i++) {
+		data->pending = 1;
+		spa_loop_utils_signal_event(data->utils, data->sources[0]);
+		wait_reply(data);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &te);
+	report(lib, "ping-pong", MAX_COUNT, &ts, &te, cpu, sw);
+}
+
+static void test_burst(struct data *data, const char *lib)
+{
+	struct timespec ts, te;
+	uint64_t cpu;
+	long sw;
+	uint32_t i, j;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	cpu = get_cpu_time(&sw);
+	for (i = 0; i < MAX_COUNT / MAX_SOURCES; i++) {
+		data->pending = data->n_sources;
+		for (j = 0; j < data->n_sources; j++)
+			spa_loop_utils_signal_event(data->utils, data->sources[j]);
+		wait_reply(data);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &te);
+	report(lib, "burst", i * data->n_sources, &ts, &te, cpu, sw);
+}
+
+static int do_invoke(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *d, size_t size, void *user_data)
+{
+	struct data *data = user_data;
+	const struct invoke_msg *msg = d;
+
+	/* items from one producer must arrive in order */
+	if (msg->seq != data->last_seq[msg->producer] + 1)
+		data->errors++;
+	data->last_seq[msg->producer] = msg->seq;
+	data->latency[data->n_latency++] = get_time_ns() - msg->time;
+	return 0;
+}
+
+static void *producer_thread(void *arg)
+{
+	struct producer *p = arg;
+	struct invoke_msg msg;
+	uint32_t i;
+
+	for (i = 1; i <= p->count; i++) {
+		msg.time = get_time_ns();
+		msg.producer = p->id;
+		msg.seq = i;
+		spa_loop_invoke(p->data->loop, do_invoke, 0, &msg, sizeof(msg),
+				p->block, p->data);
+	}
+	return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t va = *(const uint64_t *)a, vb = *(const uint64_t *)b;
+	return va < vb ? -1 : va > vb ? 1 : 0;
+}
+
+static void test_invoke(struct data *data, const char *lib, uint32_t n_producers, bool block)
+{
+	struct timespec ts, te;
+	uint32_t i, count = MAX_COUNT / n_producers, total = count * n_producers;
+	uint64_t *lat, cpu;
+	char name[64];
+	long sw;
+
+	data->latency = lat = calloc(total, sizeof(uint64_t));
+	data->n_latency = 0;
+	data->errors = 0;
+	spa_zero(data->last_seq);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	cpu = get_cpu_time(&sw);
+	for (i = 0; i < n_producers; i++) {
+		struct producer *p = &data->producers[i];
+		p->data = data;
+		p->id = i;
+		p->count = count;
+		p->block = block;
+		pthread_create(&p->thread, NULL, producer_thread, p);
+	}
+	for (i = 0; i < n_producers; i++)
+		pthread_join(data->producers[i].thread, NULL);
+
+	/* wait for the loop to flush everything */
+	data->pending = 1;
+	spa_loop_utils_signal_event(data->utils, data->sources[0]);
+	wait_reply(data);
+	while (SPA_ATOMIC_LOAD(data->n_latency) < total)
+		usleep(1000);
+	clock_gettime(CLOCK_MONOTONIC, &te);
+
+	snprintf(name, sizeof(name), "invoke %s %u producers",
+			block ? "block" : "async", n_producers);
+	report(lib, name, total, &ts, &te, cpu, sw);
+
+	qsort(lat, total, sizeof(uint64_t), cmp_u64);
+	fprintf(stderr, "%s: %s: latency p50 %"PRIu64" p99 %"PRIu64" p99.9 %"PRIu64
+			" max %"PRIu64" ns, %u out of order\n", lib, name,
+			lat[total / 2], lat[total * 99 / 100], lat[total * 999 / 1000],
+			lat[total - 1], data->errors);
+	assert(data->errors == 0);
+
+	data->latency = NULL;
+	free(lat);
+}
+
+static uint32_t count_fds(void)
+{
+	struct dirent *d;
+	uint32_t count = 0;
+	DIR *dir;
+
+	if ((dir = opendir("/proc/self/fd")) == NULL)
+		return 0;
+	while ((d = readdir(dir)) != NULL)
+		if (d->d_name[0] != '.')
+			count++;
+	closedir(dir);
+	return count;
+}
+
+static void on_timer(void *arg, uint64_t expirations)
+{
+	struct data *data = arg;
+	data->fired++;
+}
+
+static void on_timer_late(void *arg, uint64_t expirations)
+{
+	struct timer *t = arg;
+	struct data *data = t->data;
+	uint64_t now = get_time_ns();
+
+	data->fired++;
+	if (now > t->expire)
+		data->max_late = SPA_MAX(data->max_late, now - t->expire);
+}
+
+static void test_timers(struct data *data, const char *lib)
+{
+	struct timespec ts, te, value;
+	uint64_t cpu, now;
+	uint32_t i, j, fds;
+	long sw;
+
+	data->timers = calloc(MAX_TIMERS, sizeof(struct timer));
+	assert(data->timers != NULL);
+
+	spa_loop_control_enter(data->control);
+
+	fds = count_fds();
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	cpu = get_cpu_time(&sw);
+	for (i = 0; i < MAX_TIMERS; i++) {
+		struct timer *t = &data->timers[i];
+		t->data = data;
+		t->source = spa_loop_utils_add_timer(data->utils, on_timer, data);
+		if (t->source == NULL) {
+			fprintf(stderr, "%s: timer %u: %m\n", lib, i);
+			break;
+		}
+	}
+	data->n_timers = i;
+	clock_gettime(CLOCK_MONOTONIC, &te);
+	report(lib, "timer-add", SPA_MAX(data->n_timers, 1u), &ts, &te, cpu, sw);
+	fprintf(stderr, "%s: timer-fds: %u timers use %u fds\n", lib,
+			data->n_timers, count_fds() - fds);
+	if (data->n_timers == 0)
+		goto done;
+
+	/* move the timers around in the next 10ms to 10s, like timeouts
+	 * that are pushed back */
+	srand(0);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	cpu = get_cpu_time(&sw);
+	for (j = 0; j < 10; j++) {
+		for (i = 0; i < data->n_timers; i++) {
+			uint64_t t = 10 * SPA_NSEC_PER_MSEC +
+				(uint64_t)(rand() % 10000) * SPA_NSEC_PER_MSEC;
+			value.tv_sec = t / SPA_NSEC_PER_SEC;
+			value.tv_nsec = t % SPA_NSEC_PER_SEC;
+			spa_loop_utils_update_timer(data->utils, data->timers[i].source,
+					&value, NULL, false);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &te);
+	report(lib, "timer-rearm", j * data->n_timers, &ts, &te, cpu, sw);
+
+	/* let all the timers expire in 100ms, after the setup */
+	now = get_time_ns() + 500 * SPA_NSEC_PER_MSEC;
+	for (i = 0; i < data->n_timers; i++) {
+		struct timer *t = &data->timers[i];
+		spa_loop_utils_destroy_source(data->utils, t->source);
+		t->source = spa_loop_utils_add_timer(data->utils, on_timer_late, t);
+		assert(t->source != NULL);
+		t->expire = now + (uint64_t)i * 100 * SPA_NSEC_PER_MSEC / data->n_timers;
+		value.tv_sec = t->expire / SPA_NSEC_PER_SEC;
+		value.tv_nsec = t->expire % SPA_NSEC_PER_SEC;
+		spa_loop_utils_update_timer(data->utils, t->source, &value, NULL, true);
+	}
+	data->fired = 0;
+	data->max_late = 0;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	cpu = get_cpu_time(&sw);
+	while (data->fired < data->n_timers)
+		spa_loop_control_iterate(data->control, -1);
+	clock_gettime(CLOCK_MONOTONIC, &te);
+	report(lib, "timer-expire", data->n_timers, &ts, &te, cpu, sw);
+	fprintf(stderr, "%s: timer-expire: max late %"PRIu64" us\n", lib,
+			(uint64_t)(data->max_late / SPA_NSEC_PER_USEC));
+
+done:
+	for (i = 0; i < data->n_timers; i++)
+		spa_loop_utils_destroy_source(data->utils, data->timers[i].source);
+	spa_loop_control_leave(data->control);
+
+	free(data->timers);
+	data->timers = NULL;
+}
+
+static int run(struct data *data, const char *lib)
+{
+	uint32_t i;
+	int res;
+
+	if ((res = load(data, lib)) < 0) {
+		fprintf(stderr, "%s: skipped: %s\n", lib, spa_strerror(res));
+		unload(data);
+		return 0;
+	}
+
+	data->reply_fd = eventfd(0, EFD_CLOEXEC);
+	assert(data->reply_fd >= 0);
+
+	for (i = 0; i < MAX_SOURCES; i++) {
+		data->sources[i] = spa_loop_utils_add_event(data->utils, on_event, data);
+		assert(data->sources[i] != NULL);
+	}
+	data->n_sources = MAX_SOURCES;
+
+	data->running = true;
+	pthread_create(&data->thread, NULL, loop_thread, data);
+
+	test_ping_pong(data, lib);
+	test_burst(data, lib);
+	test_invoke(data, lib, 1, false);
+	test_invoke(data, lib, MAX_PRODUCERS, false);
+	test_invoke(data, lib, MAX_PRODUCERS, true);
+
+	SPA_ATOMIC_STORE(data->running, false);
+	data->pending = 1;
+	spa_loop_utils_signal_event(data->utils, data->sources[0]);
+	pthread_join(data->thread, NULL);
+
+	test_timers(data, lib);
+
+	for (i = 0; i < data->n_sources; i++)
+		spa_loop_utils_destroy_source(data->utils, data->sources[i]);
+	close(data->reply_fd);
+
+	unload(data);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	static const char * const libs[] = {
+		"support/libspa-support",
+		"support/libspa-uring",
+	};
+	const char *plugin_dir;
+	struct data data;
+	uint32_t i;
+
+	if ((plugin_dir = getenv("SPA_PLUGIN_DIR")) == NULL) {
+		fprintf(stderr, "SPA_PLUGIN_DIR not set, skipping\n");
+		return 0;
+	}
+	for (i = 0; i < SPA_N_ELEMENTS(libs); i++) {
+		spa_zero(data);
+		data.plugin_dir = plugin_dir;
+		run(&data, libs[i]);
+	}
+	return 0;
+}
@@ -1,16 +1,24 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
 #include <sched.h>
 #include <errno.h>
+#include <time.h>
 #include <semaphore.h>
 
+#include <spa/utils/atomic.h>
 #include <spa/utils/ringbuffer.h>
 
 #define DEFAULT_SIZE 0x2000
 #define ARRAY_SIZE 63
 #define MAX_VALUE 0x10000
 
+#define DEFAULT_PRODUCERS 4
+#define MAX_PRODUCERS 64
+#define MESSAGES_PER_PRODUCER (1 << 16)
+
 #if defined(__FreeBSD__) || defined(__MidnightBSD__) || defined (__GNU__)
 #include <sys/param.h>
 #if (__FreeBSD_version >= 1400000 && __FreeBSD_version < 1400043) \
@@ -105,6 +113,142 @@ static void *writer_start(void *arg)
 	return NULL;
 }
 
+/* multiple producers, each with their own ringbuffer, like the invoke
+ * queues of the loop. The reader merges the queues in the order of a
+ * shared counter. */
+struct message {
+	uint64_t count;
+	uint64_t time;
+	uint32_t producer;
+	uint32_t seq;
+};
+
+struct producer {
+	struct spa_ringbuffer rb;
+	void *data;
+	uint32_t id;
+	pthread_t thread;
+};
+
+static struct producer producers[MAX_PRODUCERS];
+static uint32_t n_producers;
+static uint64_t message_count;
+static uint64_t *latency;
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * SPA_NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void *producer_start(void *arg)
+{
+	struct producer *p = arg;
+	struct message m;
+	uint32_t i;
+
+	for (i = 1; i <= MESSAGES_PER_PRODUCER; ) {
+		uint32_t index;
+		int32_t avail;
+
+		avail = size - spa_ringbuffer_get_write_index(&p->rb, &index);
+		if (avail < (int32_t)sizeof(m)) {
+			sched_yield();
+			continue;
+		}
+		m.count = SPA_ATOMIC_INC(message_count);
+		m.time = get_time_ns();
+		m.producer = p->id;
+		m.seq = i++;
+		spa_ringbuffer_write_data(&p->rb, p->data, size, index % size, &m, sizeof(m));
+		spa_ringbuffer_write_update(&p->rb, index + sizeof(m));
+	}
+	return NULL;
+}
+
+static void *consumer_start(void *arg)
+{
+	uint32_t seq[MAX_PRODUCERS] = { 0, };
+	uint64_t n_messages = 0, total = (uint64_t)n_producers * MESSAGES_PER_PRODUCER;
+
+	while (n_messages < total) {
+		struct producer *p = NULL;
+		struct message m, cm;
+		uint32_t i, index = 0, cindex;
+
+		/* take the oldest message of all the producers */
+		for (i = 0; i < n_producers; i++) {
+			if (spa_ringbuffer_get_read_index(&producers[i].rb, &cindex) <
+			    (int32_t)sizeof(cm))
+				continue;
+			spa_ringbuffer_read_data(&producers[i].rb, producers[i].data, size,
+					cindex % size, &cm, sizeof(cm));
+			if (p == NULL || cm.count < m.count) {
+				p = &producers[i];
+				index = cindex;
+				m = cm;
+			}
+		}
+		if (p == NULL) {
+			sched_yield();
+			continue;
+		}
+
+		spa_ringbuffer_read_update(&p->rb, index + sizeof(m));
+
+		spa_assert(m.seq == seq[m.producer] + 1);
+		seq[m.producer] = m.seq;
+		latency[n_messages++] = get_time_ns() - m.time;
+	}
+	return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t va = *(const uint64_t *)a, vb = *(const uint64_t *)b;
+	return va < vb ? -1 : va > vb ? 1 : 0;
+}
+
+static void run_producers(void)
+{
+	pthread_t consumer_thread;
+	uint64_t t1, t2, total;
+	uint32_t i;
+
+	printf("starting %u producer stress test\n", n_producers);
+
+	total = (uint64_t)n_producers * MESSAGES_PER_PRODUCER;
+	latency = calloc(total, sizeof(uint64_t));
+
+	for (i = 0; i < n_producers; i++) {
+		spa_ringbuffer_init(&producers[i].rb);
+		producers[i].data = malloc(size);
+		producers[i].id = i;
+	}
+
+	t1 = get_time_ns();
+	pthread_create(&consumer_thread, NULL, consumer_start, NULL);
+	for (i = 0; i < n_producers; i++)
+		pthread_create(&producers[i].thread, NULL, producer_start, &producers[i]);
+	for (i = 0; i < n_producers; i++)
+		pthread_join(producers[i].thread, NULL);
+	pthread_join(consumer_thread, NULL);
+	t2 = get_time_ns();
+
+	qsort(latency, total, sizeof(uint64_t), cmp_u64);
+
+	printf("%"PRIu64" messages in %"PRIu64" ns: %.0f messages/s\n",
+			total, t2 - t1, total * (double)SPA_NSEC_PER_SEC / (t2 - t1));
+	printf("latency p50 %"PRIu64" p99 %"PRIu64" p99.9 %"PRIu64" max %"PRIu64" ns\n",
+			latency[total / 2], latency[total * 99 / 100],
+			latency[total * 999 / 1000], latency[total - 1]);
+
+	for (i = 0; i < n_producers; i++)
+		free(producers[i].data);
+	free(latency);
+}
+
 #define exit_error(msg) \
 do { perror(msg); exit(EXIT_FAILURE); } while (0)
 
@@ -120,6 +264,12 @@ int main(int argc, char *argv[])
 	else
 		size = DEFAULT_SIZE;
 
+	if (argc > 2)
+		sscanf(argv[2], "%u", &n_producers);
+	else
+		n_producers = DEFAULT_PRODUCERS;
+	n_producers = SPA_CLAMP(n_producers, 1u, (uint32_t)MAX_PRODUCERS);
+
 	printf("buffer size (bytes): %d\n", size);
 	printf("array size (bytes): %zd\n", sizeof(int) * ARRAY_SIZE);
 
@@ -144,5 +294,7 @@ int main(int argc, char *argv[])
 
 	printf("read %u, written %u\n", rb.readindex, rb.writeindex);
 
+	run_producers();
+
 	return 0;
 }
@@ -0,0 +1,295 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+
+#include <spa/utils/defs.h>
+
+#include "module-avb/packet-ring.h"
+
+/* Send and receive AVTP sized frames over a veth pair. Needs CAP_NET_RAW
+ * and a veth pair that is up:
+ *
+ *   ip link add pwveth0 type veth peer name pwveth1
+ *   ip link set pwveth0 up && ip link set pwveth1 up
+ *   pw-benchmark-avb-ring pwveth0 pwveth1
+ *
+ * The send test sends the frames of one cycle with one sendto() per frame
+ * and with one sendmmsg(). The receive test sends one frame every 125 usec,
+ * the class A frame rate, from a thread and receives them with one wakeup
+ * and recv() per frame and with a TPACKET_V3 ring.
+ *
+ * The CPU time per frame is converted to the CPU load of one stream of
+ * 8000 frames/s. */
+
+#define FRAMES		8	/* frames per cycle, 1 ms of class A */
+#define FRAME_SIZE	(18 + 24 + 6 * 8 * 4)	/* header + 6 frames of 8 channels */
+#define SEND_CYCLES	20000
+#define RECV_FRAMES	16000
+#define RATE		8000
+
+#ifndef ETH_P_TSN
+#define ETH_P_TSN	0x22F0
+#endif
+
+static const uint8_t dest[6] = { 0x91, 0xe0, 0xf0, 0x00, 0xfe, 0x01 };
+
+struct data {
+	const char *send_if;
+	const char *recv_if;
+
+	int send_fd;
+	int recv_fd;
+	struct sockaddr_ll addr;
+	struct avb_packet_ring ring;
+	uint8_t frame[FRAME_SIZE];
+
+	uint32_t received;
+	uint32_t wakeups;
+};
+
+static uint64_t cpu_nsec(clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static int get_ifindex(int fd, const char *name)
+{
+	struct ifreq req;
+	spa_zero(req);
+	snprintf(req.ifr_name, sizeof(req.ifr_name), "%s", name);
+	if (ioctl(fd, SIOCGIFINDEX, &req) < 0)
+		return -errno;
+	return req.ifr_ifindex;
+}
+
+static int make_send_socket(struct data *d)
+{
+	int ifindex;
+
+	if ((d->send_fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL))) < 0)
+		return -errno;
+	if ((ifindex = get_ifindex(d->send_fd, d->send_if)) < 0)
+		return ifindex;
+
+	spa_zero(d->addr);
+	d->addr.sll_family = AF_PACKET;
+	d->addr.sll_protocol = htons(ETH_P_TSN);
+	d->addr.sll_ifindex = ifindex;
+	d->addr.sll_halen = ETH_ALEN;
+	memcpy(d->addr.sll_addr, dest, ETH_ALEN);
+
+	memcpy(d->frame, dest, 6);
+	d->frame[12] = 0x22;
+	d->frame[13] = 0xf0;
+	return 0;
+}
+
+static int make_recv_socket(struct data *d, bool ring)
+{
+	struct sockaddr_ll sa;
+	struct packet_mreq mreq;
+	int res, ifindex;
+
+	if ((d->recv_fd = socket(AF_PACKET, SOCK_RAW | SOCK_NONBLOCK, htons(ETH_P_ALL))) < 0)
+		return -errno;
+	if ((ifindex = get_ifindex(d->recv_fd, d->recv_if)) < 0)
+		return ifindex;
+	if (ring && (res = avb_packet_ring_init(&d->ring, d->recv_fd, AVB_PACKET_RING_BLOCKS)) < 0)
+		return res;
+
+	spa_zero(sa);
+	sa.sll_family = AF_PACKET;
+	sa.sll_protocol = htons(ETH_P_TSN);
+	sa.sll_ifindex = ifindex;
+	if (bind(d->recv_fd, (struct sockaddr*)&sa, sizeof(sa)) < 0)
+		return -errno;
+
+	spa_zero(mreq);
+	mreq.mr_ifindex = ifindex;
+	mreq.mr_type = PACKET_MR_MULTICAST;
+	mreq.mr_alen = ETH_ALEN;
+	memcpy(mreq.mr_address, dest, ETH_ALEN);
+	if (setsockopt(d->recv_fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+		return -errno;
+	return 0;
+}
+
+static void close_sockets(struct data *d)
+{
+	avb_packet_ring_clear(&d->ring);
+	if (d->send_fd > 0)
+		close(d->send_fd);
+	if (d->recv_fd > 0)
+		close(d->recv_fd);
+	d->send_fd = d->recv_fd = -1;
+}
+
+static int send_frames(struct data *d, uint32_t n_frames, bool batch)
+{
+	struct mmsghdr msgs[FRAMES];
+	struct iovec iov = { .iov_base = d->frame, .iov_len = sizeof(d->frame) };
+	uint32_t i;
+
+	if (!batch) {
+		for (i = 0; i < n_frames; i++) {
+			if (sendto(d->send_fd, d->frame, sizeof(d->frame), 0,
+					(struct sockaddr*)&d->addr, sizeof(d->addr)) < 0)
+				return -errno;
+		}
+		return 0;
+	}
+	spa_zero(msgs);
+	for (i = 0; i < n_frames; i++) {
+		msgs[i].msg_hdr.msg_name = &d->addr;
+		msgs[i].msg_hdr.msg_namelen = sizeof(d->addr);
+		msgs[i].msg_hdr.msg_iov = &iov;
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	if (sendmmsg(d->send_fd, msgs, n_frames, 0) < 0)
+		return -errno;
+	return 0;
+}
+
+static void *sender_thread(void *data)
+{
+	struct data *d = data;
+	struct timespec ts;
+	uint32_t i;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	for (i = 0; i < RECV_FRAMES; i++) {
+		ts.tv_nsec += SPA_NSEC_PER_SEC / RATE;
+		if (ts.tv_nsec >= (long)SPA_NSEC_PER_SEC) {
+			ts.tv_sec++;
+			ts.tv_nsec -= SPA_NSEC_PER_SEC;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+		send_frames(d, 1, false);
+	}
+	return NULL;
+}
+
+static void count_frame(void *data, uint8_t *frame, uint32_t len)
+{
+	struct data *d = data;
+	if (len >= 14 && memcmp(frame, dest, 6) == 0)
+		d->received++;
+}
+
+/* like the main loop, wait for the socket and handle it */
+static int recv_frames(struct data *d)
+{
+	struct pollfd pfd = { .fd = d->recv_fd, .events = POLLIN };
+	uint8_t buffer[2048];
+	ssize_t len;
+
+	while (d->received < RECV_FRAMES) {
+		if (poll(&pfd, 1, 100) == 0)
+			return -ETIMEDOUT;
+		d->wakeups++;
+
+		if (d->ring.map != NULL) {
+			avb_packet_ring_read(&d->ring, count_frame, d);
+		} else {
+			if ((len = recv(d->recv_fd, buffer, sizeof(buffer), 0)) < 0) {
+				if (errno == EAGAIN)
+					continue;
+				return -errno;
+			}
+			count_frame(d, buffer, len);
+		}
+	}
+	return 0;
+}
+
+static int run_send(struct data *d, bool batch)
+{
+	uint64_t cpu = 0, t0;
+	uint64_t total = (uint64_t)SEND_CYCLES * FRAMES;
+	uint32_t i;
+	int res;
+
+	if ((res = make_send_socket(d)) < 0)
+		goto done;
+
+	for (i = 0; i < SEND_CYCLES; i++) {
+		t0 = cpu_nsec(CLOCK_PROCESS_CPUTIME_ID);
+		if ((res = send_frames(d, FRAMES, batch)) < 0)
+			goto done;
+		cpu += cpu_nsec(CLOCK_PROCESS_CPUTIME_ID) - t0;
+	}
+	fprintf(stdout, "%-8s %-8s %12.0f %8.3f%% %8s\n",
+			"send", batch ? "sendmmsg" : "sendto",
+			total * 1e9 / cpu, cpu / (double)total * RATE / 1e9 * 100.0, "-");
+done:
+	close_sockets(d);
+	return res;
+}
+
+static int run_recv(struct data *d, bool ring)
+{
+	pthread_t thread;
+	uint64_t cpu;
+	int res;
+
+	d->received = d->wakeups = 0;
+	if ((res = make_send_socket(d)) < 0 ||
+	    (res = make_recv_socket(d, ring)) < 0)
+		goto done;
+
+	cpu = cpu_nsec(CLOCK_THREAD_CPUTIME_ID);
+	pthread_create(&thread, NULL, sender_thread, d);
+	res = recv_frames(d);
+	cpu = cpu_nsec(CLOCK_THREAD_CPUTIME_ID) - cpu;
+	pthread_join(thread, NULL);
+	if (res < 0)
+		goto done;
+
+	fprintf(stdout, "%-8s %-8s %12.0f %8.3f%% %8.2f\n",
+			"recv", ring ? "ring" : "recv",
+			d->received * 1e9 / cpu, cpu / (double)d->received * RATE / 1e9 * 100.0,
+			d->received / (double)d->wakeups);
+done:
+	close_sockets(d);
+	return res;
+}
+
+int main(int argc, char *argv[])
+{
+	struct data d;
+	int res;
+
+	spa_zero(d);
+	d.send_fd = d.recv_fd = -1;
+	d.send_if = argc > 1 ? argv[1] : "pwveth0";
+	d.recv_if = argc > 2 ? argv[2] : "pwveth1";
+
+	fprintf(stdout, "%-8s %-8s %12s %9s %8s\n",
+			"test", "mode", "frames/s", "cpu", "frm/wake");
+	if ((res = run_send(&d, false)) < 0 ||
+	    (res = run_send(&d, true)) < 0 ||
+	    (res = run_recv(&d, false)) < 0 ||
+	    (res = run_recv(&d, true)) < 0) {
+		fprintf(stderr, "can't run on %s/%s: %s\n",
+				d.send_if, d.recv_if, strerror(-res));
+		return 77;
+	}
+	return 0;
+}
@@ -0,0 +1,202 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <spa/utils/defs.h>
+
+#include "network-batch.h"
+
+/* Send and receive RTP sized packets over loopback, one socket pair per
+ * stream, one packet at a time and batched. Every cycle, each stream sends
+ * PACKETS packets and then all of them are received again.
+ *
+ * The CPU time per packet is converted to the CPU load of one stream
+ * with a packet time of 1 ms, like AES67. */
+
+#define MAX_STREAMS	64
+#define PACKETS		8
+#define PACKET_SIZE	(12 + 288)	/* RTP header + 1 ms of 48kHz stereo S24 */
+#define CYCLES		2000
+
+enum send_mode {
+	SEND_SINGLE,
+	SEND_MMSG,
+	SEND_GSO,
+};
+
+enum recv_mode {
+	RECV_SINGLE,
+	RECV_MMSG,
+};
+
+struct stream {
+	int send_fd;
+	int recv_fd;
+	struct pw_net_batch send_batch;
+	struct pw_net_batch recv_batch;
+};
+
+struct data {
+	struct stream streams[MAX_STREAMS];
+	uint32_t n_streams;
+	uint8_t packet[PACKET_SIZE];
+};
+
+static uint64_t cpu_nsec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static int make_pair(struct stream *s)
+{
+	struct sockaddr_in sa;
+	socklen_t len = sizeof(sa);
+	int val = 4 * 1024 * 1024;
+
+	spa_zero(sa);
+	sa.sin_family = AF_INET;
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if ((s->recv_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)) < 0)
+		return -errno;
+	if (setsockopt(s->recv_fd, SOL_SOCKET, SO_RCVBUF, &val, sizeof(val)) < 0)
+		fprintf(stderr, "SO_RCVBUF failed: %m\n");
+	if (bind(s->recv_fd, (struct sockaddr*)&sa, sizeof(sa)) < 0 ||
+	    getsockname(s->recv_fd, (struct sockaddr*)&sa, &len) < 0)
+		return -errno;
+
+	if ((s->send_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)) < 0)
+		return -errno;
+	if (connect(s->send_fd, (struct sockaddr*)&sa, len) < 0)
+		return -errno;
+	return 0;
+}
+
+static int send_packets(struct data *d, struct stream *s, enum send_mode mode)
+{
+	struct iovec iov = { .iov_base = d->packet, .iov_len = sizeof(d->packet) };
+	uint32_t i;
+
+	if (mode == SEND_SINGLE) {
+		for (i = 0; i < PACKETS; i++)
+			if (send(s->send_fd, d->packet, sizeof(d->packet), 0) < 0)
+				return -errno;
+		return 0;
+	}
+	for (i = 0; i < PACKETS; i++)
+		pw_net_batch_add(&s->send_batch, &iov, 1);
+	return pw_net_batch_flush(&s->send_batch, s->send_fd, 0);
+}
+
+static int recv_packets(struct stream *s, enum recv_mode mode)
+{
+	uint8_t buffer[2048];
+	int res, count = 0;
+
+	while (count < PACKETS) {
+		if (mode == RECV_SINGLE)
+			res = recv(s->recv_fd, buffer, sizeof(buffer), 0) < 0 ? -errno : 1;
+		else
+			res = pw_net_batch_recv(&s->recv_batch, s->recv_fd,
+					PACKETS - count, 0);
+		if (res == -EAGAIN)
+			continue;
+		if (res < 0)
+			return res;
+		count += res;
+	}
+	return count;
+}
+
+static void run(struct data *d, enum send_mode smode, enum recv_mode rmode)
+{
+	static const char *snames[] = { "send", "sendmmsg", "gso" };
+	static const char *rnames[] = { "recv", "recvmmsg" };
+	uint64_t send_cpu = 0, recv_cpu = 0, t0, t1, t2;
+	uint64_t total = (uint64_t)CYCLES * PACKETS * d->n_streams;
+	uint32_t i, j;
+	int res;
+
+	for (j = 0; j < d->n_streams; j++)
+		d->streams[j].send_batch.gso = smode == SEND_GSO;
+
+	for (i = 0; i < CYCLES; i++) {
+		t0 = cpu_nsec();
+		for (j = 0; j < d->n_streams; j++) {
+			if ((res = send_packets(d, &d->streams[j], smode)) < 0) {
+				fprintf(stderr, "%s: %s\n", snames[smode], strerror(-res));
+				return;
+			}
+		}
+		t1 = cpu_nsec();
+		for (j = 0; j < d->n_streams; j++) {
+			if ((res = recv_packets(&d->streams[j], rmode)) < 0) {
+				fprintf(stderr, "%s: %s\n", rnames[rmode], strerror(-res));
+				return;
+			}
+		}
+		t2 = cpu_nsec();
+		send_cpu += t1 - t0;
+		recv_cpu += t2 - t1;
+	}
+	if (smode == SEND_GSO && !d->streams[0].send_batch.gso)
+		fprintf(stderr, "GSO not supported, used sendmmsg\n");
+
+	/* packets/s of CPU time and the CPU load of a 1000 packets/s stream */
+	fprintf(stdout, "%-9s %-9s %8u %12.0f %12.0f %8.3f%% %8.3f%%\n",
+			snames[smode], rnames[rmode], d->n_streams,
+			total * 1e9 / send_cpu, total * 1e9 / recv_cpu,
+			send_cpu / (double)total * 1000.0 / 1e9 * 100.0,
+			recv_cpu / (double)total * 1000.0 / 1e9 * 100.0);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data d;
+	uint32_t i;
+	int res;
+
+	spa_zero(d);
+	d.n_streams = argc > 1 ? (uint32_t)atoi(argv[1]) : 32;
+	d.n_streams = SPA_CLAMP(d.n_streams, 1u, (uint32_t)MAX_STREAMS);
+	memset(d.packet, 0x55, sizeof(d.packet));
+
+	for (i = 0; i < d.n_streams; i++) {
+		struct stream *s = &d.streams[i];
+		if ((res = make_pair(s)) < 0) {
+			fprintf(stderr, "can't make sockets: %s\n", strerror(-res));
+			return 77;
+		}
+		if (pw_net_batch_init(&s->send_batch, PACKETS, PACKET_SIZE, true) < 0 ||
+		    pw_net_batch_init(&s->recv_batch, PACKETS, 2048, false) < 0)
+			return -1;
+	}
+
+	fprintf(stdout, "%-9s %-9s %8s %12s %12s %9s %9s\n",
+			"send", "recv", "streams", "send pkt/s", "recv pkt/s",
+			"send cpu", "recv cpu");
+	run(&d, SEND_SINGLE, RECV_SINGLE);
+	run(&d, SEND_MMSG, RECV_MMSG);
+	run(&d, SEND_GSO, RECV_MMSG);
+
+	for (i = 0; i < d.n_streams; i++) {
+		struct stream *s = &d.streams[i];
+		close(s->send_fd);
+		close(s->recv_fd);
+		pw_net_batch_clear(&s->send_batch);
+		pw_net_batch_clear(&s->recv_batch);
+	}
+	return 0;
+}
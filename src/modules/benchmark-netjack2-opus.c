@@ -0,0 +1,135 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include <opus/opus.h>
+#include <opus/opus_custom.h>
+
+#include <spa/utils/defs.h>
+
+#include <pipewire/pipewire.h>
+
+#include "work-pool.h"
+
+/* Encode and decode the channels of a netjack2 opus stream, one channel
+ * after the other and on a work pool, like module-netjack2 does with
+ * netjack2.opus-threads.
+ *
+ * The wall clock time per cycle is compared to the period, the time the
+ * process thread has for one cycle. */
+
+#define RATE		48000
+#define PERIOD		256
+#define CHANNELS	16
+#define KBPS		128
+#define MAX_ENCODED	(KBPS * 1024 * PERIOD / RATE / 8)
+#define CYCLES		2000
+
+struct data {
+	uint32_t n_channels;
+	OpusCustomMode *mode;
+	OpusCustomEncoder *enc[CHANNELS];
+	OpusCustomDecoder *dec[CHANNELS];
+	float pcm[CHANNELS][PERIOD];
+	float out[CHANNELS][PERIOD];
+	uint8_t encoded[CHANNELS][MAX_ENCODED];
+	int encoded_size[CHANNELS];
+	struct pw_work_pool pool;
+};
+
+static uint64_t get_nsec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void do_encode(void *data, uint32_t i)
+{
+	struct data *d = data;
+	d->encoded_size[i] = opus_custom_encode_float(d->enc[i], d->pcm[i], PERIOD,
+			d->encoded[i], MAX_ENCODED);
+}
+
+static void do_decode(void *data, uint32_t i)
+{
+	struct data *d = data;
+	opus_custom_decode_float(d->dec[i], d->encoded[i], SPA_MAX(d->encoded_size[i], 0),
+			d->out[i], PERIOD);
+}
+
+static int run(struct data *d, uint32_t n_threads)
+{
+	uint64_t t0, total = 0, max = 0, period;
+	uint32_t i;
+	int res;
+
+	if ((res = pw_work_pool_init(&d->pool, n_threads)) < 0)
+		return res;
+
+	for (i = 0; i < CYCLES; i++) {
+		t0 = get_nsec();
+		pw_work_pool_run(&d->pool, d->n_channels, do_encode, d);
+		pw_work_pool_run(&d->pool, d->n_channels, do_decode, d);
+		t0 = get_nsec() - t0;
+		total += t0;
+		max = SPA_MAX(max, t0);
+	}
+	pw_work_pool_clear(&d->pool);
+
+	period = (uint64_t)PERIOD * SPA_NSEC_PER_SEC / RATE;
+	fprintf(stdout, "%8u %8u %10.1f %10.1f %8.1f%%\n",
+			d->n_channels, n_threads, total / (double)CYCLES / 1000.0,
+			max / 1000.0, total / (double)CYCLES / period * 100.0);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct data d;
+	uint32_t i, j;
+	int res = 0;
+
+	pw_init(&argc, &argv);
+
+	spa_zero(d);
+	d.n_channels = argc > 1 ? (uint32_t)atoi(argv[1]) : CHANNELS;
+	d.n_channels = SPA_CLAMP(d.n_channels, 1u, (uint32_t)CHANNELS);
+
+	if ((d.mode = opus_custom_mode_create(RATE, PERIOD, &res)) == NULL)
+		goto error;
+	for (i = 0; i < d.n_channels; i++) {
+		if ((d.enc[i] = opus_custom_encoder_create(d.mode, 1, &res)) == NULL ||
+		    (d.dec[i] = opus_custom_decoder_create(d.mode, 1, &res)) == NULL)
+			goto error;
+		opus_custom_encoder_ctl(d.enc[i], OPUS_SET_BITRATE(KBPS * 1024));
+		opus_custom_encoder_ctl(d.enc[i], OPUS_SET_COMPLEXITY(10));
+		for (j = 0; j < PERIOD; j++)
+			d.pcm[i][j] = 0.5f * sinf(2.0f * (float)M_PI * (220.0f * (i + 1)) * j / RATE);
+	}
+
+	fprintf(stdout, "%8s %8s %10s %10s %9s\n",
+			"channels", "threads", "avg usec", "max usec", "period");
+	run(&d, 0);
+	for (i = 1; i <= 4; i *= 2)
+		run(&d, i);
+
+	for (i = 0; i < d.n_channels; i++) {
+		opus_custom_encoder_destroy(d.enc[i]);
+		opus_custom_decoder_destroy(d.dec[i]);
+	}
+	opus_custom_mode_destroy(d.mode);
+	pw_deinit();
+	return 0;
+
+error:
+	fprintf(stderr, "can't create opus codec: %s\n", opus_strerror(res));
+	pw_deinit();
+	return 77;
+}
@@ -0,0 +1,260 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <spa/utils/defs.h>
+#include <spa/utils/atomic.h>
+
+#include "busy-poll.h"
+
+/* Measure the time between sending a netjack2 sync packet and receiving the
+ * reply of the peer, once every period, like the manager does every cycle.
+ * The peer waits for the sync and the manager waits for the reply with a
+ * blocking recv() and with netjack2.busy-poll. With busy-poll, the peer
+ * wakes up before the next sync is expected and spins for it, like the
+ * driver does.
+ *
+ * Without arguments, both sides run in this process over the loopback. To
+ * measure between two network namespaces, join them with a veth pair:
+ *
+ *   ip netns add a; ip netns add b
+ *   ip link add va type veth peer name vb
+ *   ip link set va netns a; ip link set vb netns b
+ *   ip -n a addr add 10.0.0.1/24 dev va; ip -n a link set va up
+ *   ip -n b addr add 10.0.0.2/24 dev vb; ip -n b link set vb up
+ *
+ * and run the peer in one:
+ *
+ *   pw-benchmark-netjack2-sync echo <port> [busy-poll usec]
+ *
+ * and the manager in the other:
+ *
+ *   pw-benchmark-netjack2-sync ping <ip> <port>
+ *
+ * Spinning only helps when both sides have a CPU of their own. */
+
+#define PERIOD_USEC	2667	/* 128 samples at 48000 */
+#define CYCLES		5000
+#define PACKET_SIZE	64
+#define PORT		19000
+#define BUSY_POLL	50
+
+struct data {
+	int fd;
+	struct sockaddr_in addr;
+	uint32_t busy_poll;
+	uint64_t rtt[CYCLES];
+	int running;
+};
+
+static uint64_t get_nsec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static int make_socket(struct sockaddr_in *addr, uint32_t busy_poll)
+{
+	struct timeval timeout = { .tv_sec = 1 };
+	int fd;
+
+	if ((fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)) < 0)
+		return -errno;
+	if (bind(fd, (struct sockaddr*)addr, sizeof(*addr)) < 0) {
+		close(fd);
+		return -errno;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	if (busy_poll > 0)
+		pw_busy_poll_init(fd, busy_poll);
+	return fd;
+}
+
+static void sleep_until(uint64_t nsec)
+{
+	struct timespec ts;
+	ts.tv_sec = nsec / SPA_NSEC_PER_SEC;
+	ts.tv_nsec = nsec % SPA_NSEC_PER_SEC;
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+static ssize_t recv_wait(int fd, uint64_t spin, void *buffer, size_t size,
+		struct sockaddr_in *from)
+{
+	socklen_t len = sizeof(*from);
+	pw_busy_poll_wait(fd, spin);
+	return recvfrom(fd, buffer, size, 0, (struct sockaddr*)from, &len);
+}
+
+static int run_echo(int fd, uint32_t busy_poll, int *running)
+{
+	uint8_t buffer[PACKET_SIZE];
+	struct sockaddr_in from;
+	uint64_t spin = (uint64_t)busy_poll * SPA_NSEC_PER_USEC, next = 0;
+	bool late = false;
+	ssize_t len;
+
+	while (SPA_ATOMIC_LOAD(*running)) {
+		if (spin > 0 && next > 0) {
+			sleep_until(next - spin);
+			late = pw_busy_poll_ready(fd);
+		}
+		if ((len = recv_wait(fd, late ? 0 : 2 * spin, buffer, sizeof(buffer), &from)) < 0) {
+			next = 0;
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+			return -errno;
+		}
+		/* when the sync was already there, wake up earlier than last time */
+		next = (late ? next - spin : get_nsec()) + PERIOD_USEC * SPA_NSEC_PER_USEC;
+		sendto(fd, buffer, len, 0, (struct sockaddr*)&from, sizeof(from));
+	}
+	return 0;
+}
+
+static void *echo_thread(void *data)
+{
+	struct data *d = data;
+	run_echo(d->fd, d->busy_poll, &d->running);
+	return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+static int run_ping(struct data *d, int fd, uint32_t busy_poll, const char *mode)
+{
+	uint8_t buffer[PACKET_SIZE];
+	struct sockaddr_in from;
+	uint64_t t0, next;
+	double sum = 0, sum2 = 0, mean;
+	uint32_t i, n = 0, lost = 0;
+
+	memset(buffer, 's', sizeof(buffer));
+	next = get_nsec();
+	for (i = 0; i < CYCLES; i++) {
+		next += PERIOD_USEC * SPA_NSEC_PER_USEC;
+		sleep_until(next);
+
+		t0 = get_nsec();
+		if (sendto(fd, buffer, sizeof(buffer), 0,
+				(struct sockaddr*)&d->addr, sizeof(d->addr)) < 0)
+			return -errno;
+		if (recv_wait(fd, (uint64_t)busy_poll * SPA_NSEC_PER_USEC,
+				buffer, sizeof(buffer), &from) < 0) {
+			lost++;
+			continue;
+		}
+		d->rtt[n] = get_nsec() - t0;
+		sum += d->rtt[n];
+		sum2 += (double)d->rtt[n] * d->rtt[n];
+		n++;
+	}
+	if (n == 0)
+		return -ETIMEDOUT;
+
+	qsort(d->rtt, n, sizeof(uint64_t), cmp_u64);
+	mean = sum / n;
+	fprintf(stdout, "%-6s %8.1f %8.1f %8.1f %8.1f %8.1f %8u\n", mode,
+			d->rtt[n / 2] / 1000.0, d->rtt[n * 99 / 100] / 1000.0,
+			d->rtt[n * 999 / 1000] / 1000.0, d->rtt[n - 1] / 1000.0,
+			sqrt(SPA_MAX(sum2 / n - mean * mean, 0.0)) / 1000.0, lost);
+	return 0;
+}
+
+static void set_addr(struct sockaddr_in *addr, const char *ip, uint16_t port)
+{
+	spa_zero(*addr);
+	addr->sin_family = AF_INET;
+	addr->sin_port = htons(port);
+	inet_pton(AF_INET, ip, &addr->sin_addr);
+}
+
+static int run_local(struct data *d, uint32_t busy_poll, const char *mode)
+{
+	struct sockaddr_in addr;
+	pthread_t thread;
+	int fd, res;
+
+	set_addr(&addr, "127.0.0.1", PORT);
+	if ((d->fd = make_socket(&addr, busy_poll)) < 0)
+		return d->fd;
+	set_addr(&addr, "127.0.0.1", PORT + 1);
+	if ((fd = make_socket(&addr, busy_poll)) < 0) {
+		close(d->fd);
+		return fd;
+	}
+	set_addr(&d->addr, "127.0.0.1", PORT);
+
+	d->busy_poll = busy_poll;
+	d->running = 1;
+	pthread_create(&thread, NULL, echo_thread, d);
+
+	res = run_ping(d, fd, busy_poll, mode);
+
+	SPA_ATOMIC_STORE(d->running, 0);
+	pthread_join(thread, NULL);
+	close(fd);
+	close(d->fd);
+	return res;
+}
+
+int main(int argc, char *argv[])
+{
+	static struct data d;
+	struct sockaddr_in addr;
+	uint32_t busy_poll = BUSY_POLL;
+	int fd, res;
+
+	if (argc > 2 && strcmp(argv[1], "echo") == 0) {
+		if (argc > 3)
+			busy_poll = atoi(argv[3]);
+		set_addr(&addr, "0.0.0.0", atoi(argv[2]));
+		if ((res = fd = make_socket(&addr, busy_poll)) < 0)
+			goto error;
+		d.running = 1;
+		return run_echo(fd, busy_poll, &d.running) < 0 ? 1 : 0;
+	}
+
+	fprintf(stdout, "%-6s %8s %8s %8s %8s %8s %8s\n", "wait",
+			"p50 us", "p99 us", "p99.9 us", "max us", "jitter", "lost");
+
+	if (argc > 3 && strcmp(argv[1], "ping") == 0) {
+		set_addr(&addr, "0.0.0.0", 0);
+		set_addr(&d.addr, argv[2], atoi(argv[3]));
+		if ((res = fd = make_socket(&addr, 0)) < 0 ||
+		    (res = run_ping(&d, fd, 0, "block")) < 0)
+			goto error;
+		close(fd);
+		if ((res = fd = make_socket(&addr, busy_poll)) < 0 ||
+		    (res = run_ping(&d, fd, busy_poll, "spin")) < 0)
+			goto error;
+		close(fd);
+		return 0;
+	}
+
+	if ((res = run_local(&d, 0, "block")) < 0 ||
+	    (res = run_local(&d, busy_poll, "spin")) < 0)
+		goto error;
+	return 0;
+
+error:
+	fprintf(stderr, "can't run: %s\n", strerror(-res));
+	return 77;
+}
@@ -0,0 +1,193 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <pulse/pulseaudio.h>
+
+#include <spa/utils/defs.h>
+
+/* Measure how long it takes to list the sinks of a running pipewire-pulse
+ * server with an increasing number of null sinks. The first list after
+ * the sinks were added fills the info cache of the server, the lists after
+ * that are served from the cache.
+ *
+ * Run it against a server that is not used by anything else:
+ *
+ *   pw-benchmark-pulse-list [max sinks]
+ */
+
+#define MAX_SINKS	1000
+#define LISTS		50
+#define MAX_WAIT	1000	/* lists until the new sinks show up */
+
+struct data {
+	pa_mainloop *ml;
+	pa_context *context;
+	uint32_t *modules;
+	uint32_t n_modules;
+	uint32_t n_sinks;
+	uint32_t base_sinks;
+	uint64_t times[LISTS];
+};
+
+static uint64_t get_nsec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static int wait_operation(struct data *d, pa_operation *o)
+{
+	if (o == NULL)
+		return -1;
+	while (pa_operation_get_state(o) == PA_OPERATION_RUNNING)
+		if (pa_mainloop_iterate(d->ml, 1, NULL) < 0)
+			break;
+	pa_operation_unref(o);
+	return 0;
+}
+
+static void on_module_loaded(pa_context *c, uint32_t idx, void *userdata)
+{
+	struct data *d = userdata;
+	if (idx != PA_INVALID_INDEX)
+		d->modules[d->n_modules++] = idx;
+}
+
+static void on_sink_info(pa_context *c, const pa_sink_info *i, int eol, void *userdata)
+{
+	struct data *d = userdata;
+	if (eol == 0)
+		d->n_sinks++;
+}
+
+static uint64_t list_sinks(struct data *d)
+{
+	uint64_t t0 = get_nsec();
+
+	d->n_sinks = 0;
+	wait_operation(d, pa_context_get_sink_info_list(d->context, on_sink_info, d));
+	return get_nsec() - t0;
+}
+
+/* Add null sinks and return the time of the first list that has all of
+ * them. Each new sink invalidates the cache of all objects, so this list
+ * is not served from the cache. */
+static int64_t add_sinks(struct data *d, uint32_t n_sinks)
+{
+	char args[128];
+	uint64_t t;
+	uint32_t i, n_modules;
+
+	while ((n_modules = d->n_modules) < n_sinks) {
+		snprintf(args, sizeof(args), "sink_name=pw-benchmark-pulse-list-%u",
+				d->n_modules);
+		if (wait_operation(d, pa_context_load_module(d->context,
+					"module-null-sink", args, on_module_loaded, d)) < 0 ||
+		    d->n_modules == n_modules)
+			return -1;
+	}
+	for (i = 0; i < MAX_WAIT; i++) {
+		t = list_sinks(d);
+		if (d->n_sinks >= d->base_sinks + d->n_modules)
+			return t;
+	}
+	return -1;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+static int run(struct data *d, uint32_t n_sinks)
+{
+	int64_t cold;
+	uint32_t i;
+
+	if ((cold = add_sinks(d, n_sinks)) < 0)
+		return -1;
+
+	for (i = 0; i < LISTS; i++)
+		d->times[i] = list_sinks(d);
+	qsort(d->times, LISTS, sizeof(uint64_t), cmp_u64);
+
+	fprintf(stdout, "%8u %8u %10.3f %10.3f %10.3f %10.2f\n",
+			n_sinks, d->n_sinks, cold / 1e6,
+			d->times[LISTS / 2] / 1e6, d->times[LISTS * 99 / 100] / 1e6,
+			d->n_sinks ? d->times[LISTS / 2] / 1e3 / d->n_sinks : 0.0);
+	return 0;
+}
+
+static int connect_context(struct data *d)
+{
+	pa_context_state_t state;
+
+	if (pa_context_connect(d->context, NULL, PA_CONTEXT_NOFLAGS, NULL) < 0)
+		return -1;
+	while (true) {
+		state = pa_context_get_state(d->context);
+		if (state == PA_CONTEXT_READY)
+			return 0;
+		if (!PA_CONTEXT_IS_GOOD(state))
+			return -1;
+		if (pa_mainloop_iterate(d->ml, 1, NULL) < 0)
+			return -1;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	static const uint32_t steps[] = { 10, 50, 100, 250, 500, 1000 };
+	struct data d;
+	uint32_t i, max_sinks = MAX_SINKS;
+	int res = 0;
+
+	if (argc > 1)
+		max_sinks = SPA_CLAMP(atoi(argv[1]), 1, MAX_SINKS);
+
+	spa_zero(d);
+	d.modules = calloc(max_sinks, sizeof(uint32_t));
+	d.ml = pa_mainloop_new();
+	d.context = pa_context_new(pa_mainloop_get_api(d.ml), "pw-benchmark-pulse-list");
+
+	if (d.modules == NULL || d.context == NULL || connect_context(&d) < 0) {
+		fprintf(stderr, "can't connect to the server: %s\n",
+				d.context ? pa_strerror(pa_context_errno(d.context)) : "no memory");
+		res = 77;
+		goto done;
+	}
+	fprintf(stdout, "%s: %s\n", pa_context_get_server(d.context),
+			pa_context_is_local(d.context) ? "local" : "remote");
+	fprintf(stdout, "%8s %8s %10s %10s %10s %10s\n", "added", "sinks",
+			"cold ms", "p50 ms", "p99 ms", "us/sink");
+
+	list_sinks(&d);
+	d.base_sinks = d.n_sinks;
+	for (i = 0; i < SPA_N_ELEMENTS(steps) && steps[i] <= max_sinks; i++) {
+		if (run(&d, steps[i]) < 0) {
+			fprintf(stderr, "can't add %u sinks: %s\n", steps[i],
+					pa_strerror(pa_context_errno(d.context)));
+			res = 1;
+			break;
+		}
+	}
+
+	for (i = 0; i < d.n_modules; i++)
+		wait_operation(&d, pa_context_unload_module(d.context, d.modules[i], NULL, NULL));
+
+	pa_context_disconnect(d.context);
+done:
+	if (d.context)
+		pa_context_unref(d.context);
+	pa_mainloop_free(d.ml);
+	free(d.modules);
+	return res;
+}
@@ -0,0 +1,277 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <pulse/pulseaudio.h>
+
+#include <spa/utils/defs.h>
+#include <spa/utils/atomic.h>
+
+/* Count the underruns of a low latency playback stream of a running
+ * pipewire-pulse server, first on a quiet server and then while other
+ * clients flood the server with introspection requests, like mixer
+ * applications do.
+ *
+ *   pw-benchmark-pulse-storm [seconds] [storm clients] [latency msec]
+ *
+ * Run it with pulse.io-thread = false and with pulse.io-thread = true to
+ * see what the I/O thread does for the playback under load. */
+
+#define SECONDS		10
+#define STORM_CLIENTS	4
+#define LATENCY_MSEC	10
+#define MAX_CLIENTS	64
+
+struct data;
+
+struct storm {
+	struct data *data;
+	pthread_t thread;
+	pa_mainloop *ml;
+	pa_context *context;
+	uint64_t ops;
+};
+
+struct data {
+	pa_mainloop *ml;
+	pa_context *context;
+	pa_stream *stream;
+	pa_sample_spec spec;
+
+	struct storm storm[MAX_CLIENTS];
+	uint32_t n_storm;
+	int storming;
+	int running;
+
+	uint32_t underruns;
+	uint32_t requests;
+	uint64_t last_request;
+	uint64_t max_gap;
+};
+
+static uint64_t get_nsec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static int connect_context(pa_mainloop *ml, pa_context *c)
+{
+	pa_context_state_t state;
+
+	if (pa_context_connect(c, NULL, PA_CONTEXT_NOFLAGS, NULL) < 0)
+		return -1;
+	while (true) {
+		state = pa_context_get_state(c);
+		if (state == PA_CONTEXT_READY)
+			return 0;
+		if (!PA_CONTEXT_IS_GOOD(state))
+			return -1;
+		if (pa_mainloop_iterate(ml, 1, NULL) < 0)
+			return -1;
+	}
+}
+
+static void wait_operation(pa_mainloop *ml, pa_operation *o)
+{
+	if (o == NULL)
+		return;
+	while (pa_operation_get_state(o) == PA_OPERATION_RUNNING)
+		if (pa_mainloop_iterate(ml, 1, NULL) < 0)
+			break;
+	pa_operation_unref(o);
+}
+
+static void on_sink_info(pa_context *c, const pa_sink_info *i, int eol, void *userdata) { }
+static void on_sink_input_info(pa_context *c, const pa_sink_input_info *i, int eol, void *userdata) { }
+static void on_client_info(pa_context *c, const pa_client_info *i, int eol, void *userdata) { }
+static void on_card_info(pa_context *c, const pa_card_info *i, int eol, void *userdata) { }
+
+static void *storm_thread(void *userdata)
+{
+	struct storm *s = userdata;
+	struct data *d = s->data;
+
+	while (SPA_ATOMIC_LOAD(d->running)) {
+		if (!SPA_ATOMIC_LOAD(d->storming)) {
+			pa_mainloop_iterate(s->ml, 0, NULL);
+			nanosleep(&(struct timespec) { 0, 1000000 }, NULL);
+			continue;
+		}
+		/* what a mixer does when something changes */
+		wait_operation(s->ml, pa_context_get_sink_info_list(s->context, on_sink_info, NULL));
+		wait_operation(s->ml, pa_context_get_sink_input_info_list(s->context,
+					on_sink_input_info, NULL));
+		wait_operation(s->ml, pa_context_get_client_info_list(s->context,
+					on_client_info, NULL));
+		wait_operation(s->ml, pa_context_get_card_info_list(s->context, on_card_info, NULL));
+		SPA_ATOMIC_INC(s->ops);
+	}
+	return NULL;
+}
+
+static void on_write(pa_stream *s, size_t nbytes, void *userdata)
+{
+	struct data *d = userdata;
+	uint64_t now = get_nsec();
+	void *data;
+
+	if (d->last_request != 0)
+		d->max_gap = SPA_MAX(d->max_gap, now - d->last_request);
+	d->last_request = now;
+	d->requests++;
+
+	while (nbytes > 0) {
+		size_t size = nbytes;
+		if (pa_stream_begin_write(s, &data, &size) < 0 || size == 0)
+			break;
+		memset(data, 0, size);
+		pa_stream_write(s, data, size, NULL, 0, PA_SEEK_RELATIVE);
+		nbytes -= SPA_MIN(size, nbytes);
+	}
+}
+
+static void on_underflow(pa_stream *s, void *userdata)
+{
+	struct data *d = userdata;
+	d->underruns++;
+}
+
+static int start_stream(struct data *d, uint32_t latency_msec)
+{
+	pa_buffer_attr attr;
+
+	d->spec.format = PA_SAMPLE_FLOAT32LE;
+	d->spec.rate = 48000;
+	d->spec.channels = 2;
+
+	if ((d->stream = pa_stream_new(d->context, "storm playback", &d->spec, NULL)) == NULL)
+		return -1;
+	pa_stream_set_write_callback(d->stream, on_write, d);
+	pa_stream_set_underflow_callback(d->stream, on_underflow, d);
+
+	attr.maxlength = (uint32_t) -1;
+	attr.tlength = pa_usec_to_bytes((pa_usec_t)latency_msec * PA_USEC_PER_MSEC, &d->spec);
+	attr.prebuf = (uint32_t) -1;
+	attr.minreq = (uint32_t) -1;
+	attr.fragsize = (uint32_t) -1;
+	if (pa_stream_connect_playback(d->stream, NULL, &attr,
+				PA_STREAM_ADJUST_LATENCY, NULL, NULL) < 0)
+		return -1;
+
+	while (pa_stream_get_state(d->stream) != PA_STREAM_READY) {
+		if (!PA_STREAM_IS_GOOD(pa_stream_get_state(d->stream)))
+			return -1;
+		if (pa_mainloop_iterate(d->ml, 1, NULL) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+static void run_phase(struct data *d, const char *name, uint32_t seconds, bool storm)
+{
+	uint64_t end, ops = 0;
+	uint32_t i;
+
+	for (i = 0; i < d->n_storm; i++)
+		SPA_ATOMIC_STORE(d->storm[i].ops, 0);
+	d->underruns = 0;
+	d->requests = 0;
+	d->max_gap = 0;
+	d->last_request = 0;
+
+	SPA_ATOMIC_STORE(d->storming, storm);
+	end = get_nsec() + (uint64_t)seconds * SPA_NSEC_PER_SEC;
+	while (get_nsec() < end)
+		if (pa_mainloop_iterate(d->ml, 1, NULL) < 0)
+			break;
+	SPA_ATOMIC_STORE(d->storming, false);
+
+	for (i = 0; i < d->n_storm; i++)
+		ops += SPA_ATOMIC_LOAD(d->storm[i].ops);
+
+	fprintf(stdout, "%-8s %10u %10u %12.2f %12.1f\n", name, d->underruns,
+			d->requests, d->max_gap / 1e6, (double)ops / seconds);
+}
+
+int main(int argc, char *argv[])
+{
+	static struct data d;
+	uint32_t i, seconds = SECONDS, latency = LATENCY_MSEC;
+	int res = 0;
+
+	if (argc > 1)
+		seconds = SPA_MAX(atoi(argv[1]), 1);
+	d.n_storm = STORM_CLIENTS;
+	if (argc > 2)
+		d.n_storm = SPA_CLAMP(atoi(argv[2]), 0, MAX_CLIENTS);
+	if (argc > 3)
+		latency = SPA_MAX(atoi(argv[3]), 1);
+
+	d.ml = pa_mainloop_new();
+	d.context = pa_context_new(pa_mainloop_get_api(d.ml), "pw-benchmark-pulse-storm");
+	if (d.context == NULL || connect_context(d.ml, d.context) < 0) {
+		fprintf(stderr, "can't connect to the server\n");
+		res = 77;
+		goto done;
+	}
+	for (i = 0; i < d.n_storm; i++) {
+		struct storm *s = &d.storm[i];
+		s->data = &d;
+		s->ml = pa_mainloop_new();
+		s->context = pa_context_new(pa_mainloop_get_api(s->ml), "pw-benchmark-pulse-storm-mixer");
+		if (s->context == NULL || connect_context(s->ml, s->context) < 0) {
+			fprintf(stderr, "can't connect storm client %u\n", i);
+			res = 1;
+			goto done;
+		}
+	}
+	if (start_stream(&d, latency) < 0) {
+		fprintf(stderr, "can't start the playback stream: %s\n",
+				pa_strerror(pa_context_errno(d.context)));
+		res = 1;
+		goto done;
+	}
+
+	d.running = true;
+	for (i = 0; i < d.n_storm; i++)
+		pthread_create(&d.storm[i].thread, NULL, storm_thread, &d.storm[i]);
+
+	fprintf(stdout, "%u s, %u mixer clients, %u ms latency\n", seconds, d.n_storm, latency);
+	fprintf(stdout, "%-8s %10s %10s %12s %12s\n", "phase", "underruns",
+			"requests", "max gap ms", "lists/s");
+
+	run_phase(&d, "quiet", seconds, false);
+	run_phase(&d, "storm", seconds, true);
+
+	SPA_ATOMIC_STORE(d.running, false);
+	for (i = 0; i < d.n_storm; i++)
+		pthread_join(d.storm[i].thread, NULL);
+
+done:
+	if (d.stream) {
+		pa_stream_disconnect(d.stream);
+		pa_stream_unref(d.stream);
+	}
+	for (i = 0; i < d.n_storm; i++) {
+		if (d.storm[i].context) {
+			pa_context_disconnect(d.storm[i].context);
+			pa_context_unref(d.storm[i].context);
+		}
+		if (d.storm[i].ml)
+			pa_mainloop_free(d.storm[i].ml);
+	}
+	if (d.context) {
+		pa_context_disconnect(d.context);
+		pa_context_unref(d.context);
+	}
+	pa_mainloop_free(d.ml);
+	return res;
+}
@@ -0,0 +1,144 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <spa/utils/defs.h>
+
+#include "module-raop/packet.h"
+
+/* Frame and encrypt the audio packets of one AirPlay receiver, like
+ * module-raop-sink does for every packet it sends.
+ *
+ * The old way, with the key schedule made again for every packet and the
+ * samples written one byte at a time by the bit writer, is compared to the
+ * current one. Both must make the same packets. The CPU time is given per
+ * packet and as the load of one receiver on one CPU. */
+
+#define RATE		44100
+#define FRAMES		352	/* FRAMES_PER_UDP_PACKET */
+#define PACKET_SIZE	(FRAMES * 4 + 16)
+#define PACKETS		20000
+
+static uint64_t get_nsec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static int old_write_pcm(void *dst, const void *frames, uint32_t n_frames)
+{
+	const uint8_t *d = frames;
+	uint8_t *bp, *b;
+	int bpos = 0;
+	uint32_t i;
+
+	b = bp = dst;
+
+	raop_bit_writer(&bp, &bpos, 1, 3);
+	raop_bit_writer(&bp, &bpos, 0, 4);
+	raop_bit_writer(&bp, &bpos, 0, 8);
+	raop_bit_writer(&bp, &bpos, 0, 4);
+	raop_bit_writer(&bp, &bpos, 1, 1);
+	raop_bit_writer(&bp, &bpos, 0, 2);
+	raop_bit_writer(&bp, &bpos, 1, 1);
+	raop_bit_writer(&bp, &bpos, (n_frames >> 24) & 0xff, 8);
+	raop_bit_writer(&bp, &bpos, (n_frames >> 16) & 0xff, 8);
+	raop_bit_writer(&bp, &bpos, (n_frames >> 8)  & 0xff, 8);
+	raop_bit_writer(&bp, &bpos, (n_frames)       & 0xff, 8);
+
+	for (i = 0; i < n_frames; i++) {
+		raop_bit_writer(&bp, &bpos, *(d + 1), 8);
+		raop_bit_writer(&bp, &bpos, *(d + 0), 8);
+		raop_bit_writer(&bp, &bpos, *(d + 3), 8);
+		raop_bit_writer(&bp, &bpos, *(d + 2), 8);
+		d += 4;
+	}
+	return bp - b + 1;
+}
+
+static int old_aes_encrypt(EVP_CIPHER_CTX *ctx, const uint8_t key[16],
+		const uint8_t iv[16], uint8_t *data, int len)
+{
+	int i = len & ~0xf, clen = i;
+	EVP_EncryptInit(ctx, EVP_aes_128_cbc(), key, iv);
+	EVP_EncryptUpdate(ctx, data, &clen, data, i);
+	return i;
+}
+
+int main(void)
+{
+	static uint8_t frames[FRAMES * 4], old[PACKET_SIZE], new[PACKET_SIZE];
+	uint8_t key[16], iv[16];
+	EVP_CIPHER_CTX *ctx_old, *ctx_new;
+	uint64_t t0, t_old, t_new;
+	uint32_t i, n_frames;
+	int res = 0, len = 0;
+
+	srand(0);
+	for (i = 0; i < sizeof(key); i++) {
+		key[i] = rand();
+		iv[i] = rand();
+	}
+	for (i = 0; i < sizeof(frames); i++)
+		frames[i] = rand();
+
+	ctx_old = EVP_CIPHER_CTX_new();
+	ctx_new = EVP_CIPHER_CTX_new();
+	if (ctx_old == NULL || ctx_new == NULL ||
+	    (res = raop_aes_init(ctx_new, key, iv)) < 0) {
+		fprintf(stderr, "can't create cipher context\n");
+		return 77;
+	}
+
+	/* all packet sizes must give the same packets */
+	for (n_frames = 0; n_frames <= FRAMES; n_frames++) {
+		memset(old, 0x55, sizeof(old));
+		memset(new, 0xaa, sizeof(new));
+		len = old_write_pcm(old, frames, n_frames);
+		if (raop_write_pcm(new, frames, n_frames) != len) {
+			fprintf(stderr, "size differs for %u frames\n", n_frames);
+			return 1;
+		}
+		old_aes_encrypt(ctx_old, key, iv, old, len);
+		raop_aes_encrypt(ctx_new, iv, new, len);
+		if (memcmp(old, new, len) != 0) {
+			fprintf(stderr, "packet differs for %u frames\n", n_frames);
+			return 1;
+		}
+	}
+
+	t0 = get_nsec();
+	for (i = 0; i < PACKETS; i++) {
+		frames[i % sizeof(frames)]++;
+		len = old_write_pcm(old, frames, FRAMES);
+		old_aes_encrypt(ctx_old, key, iv, old, len);
+	}
+	t_old = get_nsec() - t0;
+
+	t0 = get_nsec();
+	for (i = 0; i < PACKETS; i++) {
+		frames[i % sizeof(frames)]++;
+		len = raop_write_pcm(new, frames, FRAMES);
+		raop_aes_encrypt(ctx_new, iv, new, len);
+	}
+	t_new = get_nsec() - t0;
+
+	fprintf(stdout, "%-6s %10s %12s %12s\n", "path", "ns/packet", "% CPU/recv", "recv/CPU");
+	fprintf(stdout, "%-6s %10.1f %12.3f %12.0f\n", "old", (double)t_old / PACKETS,
+			100.0 * t_old / PACKETS * RATE / FRAMES / SPA_NSEC_PER_SEC,
+			(double)SPA_NSEC_PER_SEC * PACKETS * FRAMES / RATE / t_old);
+	fprintf(stdout, "%-6s %10.1f %12.3f %12.0f\n", "new", (double)t_new / PACKETS,
+			100.0 * t_new / PACKETS * RATE / FRAMES / SPA_NSEC_PER_SEC,
+			(double)SPA_NSEC_PER_SEC * PACKETS * FRAMES / RATE / t_new);
+
+	EVP_CIPHER_CTX_free(ctx_old);
+	EVP_CIPHER_CTX_free(ctx_new);
+	return 0;
+}
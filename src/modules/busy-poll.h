@@ -0,0 +1,65 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#ifndef BUSY_POLL_H
+#define BUSY_POLL_H
+
+#include <errno.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include <spa/utils/defs.h>
+
+/* Spin on a socket for a short time before a blocking receive. When the
+ * packet comes in while spinning, the wakeup of the thread is saved. With
+ * SO_BUSY_POLL, the kernel also polls the queue of the device while the
+ * socket is read, instead of waiting for the interrupt.
+ *
+ * Spinning keeps the CPU busy, it only helps when the packet is expected
+ * soon and when the sender runs on another CPU. */
+
+/* let the kernel poll the device for up to usec when the socket is read */
+static inline int pw_busy_poll_init(int fd, uint32_t usec)
+{
+#ifdef SO_BUSY_POLL
+	int val = usec;
+	if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &val, sizeof(val)) < 0)
+		return -errno;
+	return 0;
+#else
+	return -ENOTSUP;
+#endif
+}
+
+/* returns true when a receive on fd will not block */
+static inline bool pw_busy_poll_ready(int fd)
+{
+	uint8_t c;
+	return recv(fd, &c, sizeof(c), MSG_PEEK | MSG_DONTWAIT) >= 0 ||
+		(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR);
+}
+
+/* spin for up to nsec until there is a packet or an error on fd. Returns
+ * true when a receive will not block. */
+static inline bool pw_busy_poll_wait(int fd, uint64_t nsec)
+{
+	struct timespec ts;
+	uint64_t end;
+
+	if (nsec == 0)
+		return false;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	end = SPA_TIMESPEC_TO_NSEC(&ts) + nsec;
+	while (true) {
+		if (pw_busy_poll_ready(fd))
+			return true;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		if ((uint64_t)SPA_TIMESPEC_TO_NSEC(&ts) >= end)
+			return false;
+	}
+}
+
+#endif /* BUSY_POLL_H */
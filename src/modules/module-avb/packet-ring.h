@@ -0,0 +1,112 @@
+/* AVB support */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#ifndef AVB_PACKET_RING_H
+#define AVB_PACKET_RING_H
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <linux/if_packet.h>
+
+#include <spa/utils/defs.h>
+#include <spa/utils/atomic.h>
+
+/* A TPACKET_V3 receive ring on an AF_PACKET socket.
+ *
+ * The kernel writes the frames into blocks of memory that are shared with
+ * us and wakes us up when a block is full or after the block timeout. All
+ * frames of the ready blocks are then handled without a system call or a
+ * copy per frame. */
+
+#define AVB_PACKET_RING_BLOCK_SIZE	(1u<<16)
+#define AVB_PACKET_RING_FRAME_SIZE	(1u<<11)
+#define AVB_PACKET_RING_BLOCKS		16
+/* msec before a block that is not full is handed to us */
+#define AVB_PACKET_RING_TIMEOUT		1
+
+struct avb_packet_ring {
+	void *map;
+	size_t size;
+	uint32_t block_size;
+	uint32_t n_blocks;
+	uint32_t block;
+};
+
+/* configure the ring on fd, this needs to be done before bind(). On error,
+ * fd has no ring and the frames can be received with recv(), except for
+ * -EBUSY, when a ring is left on fd that can't be used. */
+static inline int avb_packet_ring_init(struct avb_packet_ring *r, int fd, uint32_t n_blocks)
+{
+	struct tpacket_req3 req;
+	int val = TPACKET_V3, res;
+
+	spa_zero(*r);
+	if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &val, sizeof(val)) < 0)
+		return -errno;
+
+	spa_zero(req);
+	req.tp_block_size = AVB_PACKET_RING_BLOCK_SIZE;
+	req.tp_block_nr = n_blocks;
+	req.tp_frame_size = AVB_PACKET_RING_FRAME_SIZE;
+	req.tp_frame_nr = req.tp_block_size / req.tp_frame_size * req.tp_block_nr;
+	req.tp_retire_blk_tov = AVB_PACKET_RING_TIMEOUT;
+	if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0)
+		return -errno;
+
+	r->size = (size_t)req.tp_block_size * req.tp_block_nr;
+	r->map = mmap(NULL, r->size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, 0);
+	if (r->map == MAP_FAILED) {
+		res = -errno;
+		r->map = NULL;
+		/* the kernel would put the frames in the ring, where nobody
+		 * reads them, remove it again */
+		spa_zero(req);
+		if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0)
+			return -EBUSY;
+		return res;
+	}
+	r->block_size = req.tp_block_size;
+	r->n_blocks = req.tp_block_nr;
+	return 0;
+}
+
+static inline void avb_packet_ring_clear(struct avb_packet_ring *r)
+{
+	if (r->map != NULL)
+		munmap(r->map, r->size);
+	spa_zero(*r);
+}
+
+/* Call func for all frames of the ready blocks and give the blocks back
+ * to the kernel. Returns the number of frames. */
+static inline int avb_packet_ring_read(struct avb_packet_ring *r,
+		void (*func) (void *data, uint8_t *frame, uint32_t len), void *data)
+{
+	struct tpacket_block_desc *bd;
+	struct tpacket3_hdr *hdr;
+	uint32_t i, n_frames;
+	int count = 0;
+
+	while (true) {
+		bd = SPA_PTROFF(r->map, (size_t)r->block * r->block_size, struct tpacket_block_desc);
+		if (!(SPA_ATOMIC_LOAD(bd->hdr.bh1.block_status) & TP_STATUS_USER))
+			break;
+
+		n_frames = bd->hdr.bh1.num_pkts;
+		hdr = SPA_PTROFF(bd, bd->hdr.bh1.offset_to_first_pkt, struct tpacket3_hdr);
+		for (i = 0; i < n_frames; i++) {
+			func(data, SPA_PTROFF(hdr, hdr->tp_mac, uint8_t), hdr->tp_snaplen);
+			hdr = SPA_PTROFF(hdr, hdr->tp_next_offset, struct tpacket3_hdr);
+		}
+		count += n_frames;
+
+		SPA_ATOMIC_STORE(bd->hdr.bh1.block_status, TP_STATUS_KERNEL);
+		r->block = (r->block + 1) % r->n_blocks;
+	}
+	return count;
+}
+
+#endif /* AVB_PACKET_RING_H */
@@ -9,6 +9,7 @@
 #include <net/if.h>
 #include <sys/ioctl.h>
 
+#include <spa/utils/result.h>
 #include <spa/debug/mem.h>
 #include <spa/pod/builder.h>
 #include <spa/param/audio/format-utils.h>
@@ -86,12 +87,9 @@ set_iovec(struct spa_ringbuffer *rbuf, void *buffer, uint32_t size,
 static int flush_write(struct stream *stream, uint64_t current_time)
 {
 	int32_t avail;
-	uint32_t index;
+	uint32_t index, i, n_pdus;
         uint64_t ptime, txtime;
-	int pdu_count;
-	ssize_t n;
-	struct avb_frame_header *h = (void*)stream->pdu;
-	struct avb_packet_iec61883 *p = SPA_PTROFF(h, sizeof(*h), void);
+	int pdu_count, n;
 	uint8_t dbc;
 
 	avail = spa_ringbuffer_get_read_index(&stream->ring, &index);
@@ -102,29 +100,39 @@ static int flush_write(struct stream *stream, uint64_t current_time)
 	ptime = txtime + stream->mtt;
 	dbc = stream->dbc;
 
-	while (pdu_count--) {
-		*(uint64_t*)CMSG_DATA(stream->cmsg) = txtime;
+	while (pdu_count > 0) {
+		n_pdus = SPA_MIN(pdu_count, MAX_PDU_BATCH);
 
-		set_iovec(&stream->ring,
-			stream->buffer_data,
-			stream->buffer_size,
-			index % stream->buffer_size,
-			&stream->iov[1], stream->payload_size);
+		/* each PDU has its own header and launch time */
+		for (i = 0; i < n_pdus; i++) {
+			struct avb_packet_iec61883 *p = SPA_PTROFF(stream->headers[i],
+					sizeof(struct avb_frame_header), void);
+			struct cmsghdr *cmsg = CMSG_FIRSTHDR(&stream->msgs[i].msg_hdr);
 
-		p->seq_num = stream->pdu_seq++;
-		p->tv = 1;
-		p->timestamp = ptime;
-		p->dbc = dbc;
+			*(uint64_t*)CMSG_DATA(cmsg) = txtime;
 
-		n = sendmsg(stream->source->fd, &stream->msg, MSG_NOSIGNAL);
-		if (n < 0 || n != (ssize_t)stream->pdu_size) {
-			pw_log_error("sendmsg() failed %zd != %zd: %m",
-					n, stream->pdu_size);
+			set_iovec(&stream->ring,
+				stream->buffer_data,
+				stream->buffer_size,
+				index % stream->buffer_size,
+				&stream->iov[i][1], stream->payload_size);
+
+			memcpy(stream->headers[i], stream->pdu, stream->hdr_size);
+			p->seq_num = stream->pdu_seq++;
+			p->tv = 1;
+			p->timestamp = ptime;
+			p->dbc = dbc;
+
+			txtime += stream->pdu_period;
+			ptime += stream->pdu_period;
+			index += stream->payload_size;
+			dbc += stream->frames_per_pdu;
 		}
-		txtime += stream->pdu_period;
-		ptime += stream->pdu_period;
-		index += stream->payload_size;
-		dbc += stream->frames_per_pdu;
+		n = sendmmsg(stream->source->fd, stream->msgs, n_pdus, MSG_NOSIGNAL);
+		if (n < 0 || n != (int)n_pdus)
+			pw_log_error("sendmmsg() failed %d != %u: %m", n, n_pdus);
+
+		pdu_count -= n_pdus;
 	}
 	stream->dbc = dbc;
 	spa_ringbuffer_read_update(&stream->ring, index);
@@ -210,22 +218,32 @@ static void setup_pdu(struct stream *stream)
 
 static int setup_msg(struct stream *stream)
 {
-	stream->iov[0].iov_base = stream->pdu;
-	stream->iov[0].iov_len = stream->hdr_size;
-	stream->iov[1].iov_base = SPA_PTROFF(stream->pdu, stream->hdr_size, void);
-	stream->iov[1].iov_len = stream->payload_size;
-	stream->iov[2].iov_base = SPA_PTROFF(stream->pdu, stream->hdr_size, void);
-	stream->iov[2].iov_len = 0;
-	stream->msg.msg_name = &stream->sock_addr;
-	stream->msg.msg_namelen = sizeof(stream->sock_addr);
-	stream->msg.msg_iov = stream->iov;
-	stream->msg.msg_iovlen = 3;
-	stream->msg.msg_control = stream->control;
-	stream->msg.msg_controllen = sizeof(stream->control);
-	stream->cmsg = CMSG_FIRSTHDR(&stream->msg);
-	stream->cmsg->cmsg_level = SOL_SOCKET;
-	stream->cmsg->cmsg_type = SCM_TXTIME;
-	stream->cmsg->cmsg_len = CMSG_LEN(sizeof(__u64));
+	uint32_t i;
+
+	spa_assert_se(stream->hdr_size <= MAX_PDU_HEADER);
+
+	for (i = 0; i < MAX_PDU_BATCH; i++) {
+		struct msghdr *msg = &stream->msgs[i].msg_hdr;
+		struct iovec *iov = stream->iov[i];
+		struct cmsghdr *cmsg;
+
+		iov[0].iov_base = stream->headers[i];
+		iov[0].iov_len = stream->hdr_size;
+		iov[1].iov_base = SPA_PTROFF(stream->pdu, stream->hdr_size, void);
+		iov[1].iov_len = stream->payload_size;
+		iov[2].iov_base = SPA_PTROFF(stream->pdu, stream->hdr_size, void);
+		iov[2].iov_len = 0;
+		msg->msg_name = &stream->sock_addr;
+		msg->msg_namelen = sizeof(stream->sock_addr);
+		msg->msg_iov = iov;
+		msg->msg_iovlen = 3;
+		msg->msg_control = stream->control[i];
+		msg->msg_controllen = sizeof(stream->control[i]);
+		cmsg = CMSG_FIRSTHDR(msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_TXTIME;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(__u64));
+	}
 	return 0;
 }
 
@@ -415,6 +433,13 @@ static int setup_socket(struct stream *stream)
 	} else {
 		struct packet_mreq mreq;
 
+		if ((res = avb_packet_ring_init(&stream->ring_rx, fd, AVB_PACKET_RING_BLOCKS)) == -EBUSY) {
+			pw_log_error("can't remove the unusable receive ring");
+			goto error_close;
+		} else if (res < 0)
+			pw_log_warn("can't map receive ring, receiving frames one by one: %s",
+					spa_strerror(res));
+
 		res = bind(fd, (struct sockaddr *) &stream->sock_addr, sizeof(stream->sock_addr));
 		if (res < 0) {
 			pw_log_error("bind() failed: %m");
@@ -441,6 +466,7 @@ static int setup_socket(struct stream *stream)
 	return fd;
 
 error_close:
+	avb_packet_ring_clear(&stream->ring_rx);
 	close(fd);
 	return res;
 }
@@ -467,6 +493,24 @@ static void handle_iec61883_packet(struct stream *stream,
 	}
 }
 
+static void handle_frame(void *data, uint8_t *buffer, uint32_t len)
+{
+	struct stream *stream = data;
+	struct avb_frame_header *h = (void*)buffer;
+	struct avb_packet_iec61883 *p = SPA_PTROFF(h, sizeof(*h), void);
+
+	if (len < sizeof(struct avb_packet_header)) {
+		pw_log_warn("short packet received (%u < %d)", len,
+				(int)sizeof(struct avb_packet_header));
+		return;
+	}
+	if (memcmp(h->dest, stream->addr, 6) != 0 ||
+	    p->subtype != AVB_SUBTYPE_61883_IIDC)
+		return;
+
+	handle_iec61883_packet(stream, p, len - sizeof(*h));
+}
+
 static void on_socket_data(void *data, int fd, uint32_t mask)
 {
 	struct stream *stream = data;
@@ -475,24 +519,17 @@ static void on_socket_data(void *data, int fd, uint32_t mask)
 		int len;
 		uint8_t buffer[2048];
 
+		if (stream->ring_rx.map != NULL) {
+			avb_packet_ring_read(&stream->ring_rx, handle_frame, stream);
+			return;
+		}
+
 		len = recv(fd, buffer, sizeof(buffer), 0);
 
-		if (len < 0) {
+		if (len < 0)
 			pw_log_warn("got recv error: %m");
-		}
-		else if (len < (int)sizeof(struct avb_packet_header)) {
-			pw_log_warn("short packet received (%d < %d)", len,
-					(int)sizeof(struct avb_packet_header));
-		} else {
-			struct avb_frame_header *h = (void*)buffer;
-			struct avb_packet_iec61883 *p = SPA_PTROFF(h, sizeof(*h), void);
-
-			if (memcmp(h->dest, stream->addr, 6) != 0 ||
-			    p->subtype != AVB_SUBTYPE_61883_IIDC)
-				return;
-
-			handle_iec61883_packet(stream, p, len - sizeof(*h));
-		}
+		else
+			handle_frame(stream, buffer, len);
 	}
 }
 
@@ -557,6 +594,7 @@ int stream_deactivate(struct stream *stream, uint64_t now)
 		pw_loop_destroy_source(stream->server->impl->loop, stream->source);
 		stream->source = NULL;
 	}
+	avb_packet_ring_clear(&stream->ring_rx);
 
 	avb_mrp_attribute_leave(stream->vlan_attr->mrp, now);
 
@@ -15,9 +15,15 @@
 
 #include <pipewire/pipewire.h>
 
+#include "packet-ring.h"
+
 #define BUFFER_SIZE	(1u<<16)
 #define BUFFER_MASK	(BUFFER_SIZE-1)
 
+/* max number of PDUs sent with one sendmmsg() */
+#define MAX_PDU_BATCH	32
+#define MAX_PDU_HEADER	64
+
 struct stream {
 	struct spa_list link;
 
@@ -50,11 +56,13 @@ struct stream {
 	uint8_t prev_seq;
 	uint8_t dbc;
 
-	struct iovec iov[3];
 	struct sockaddr_ll sock_addr;
-	struct msghdr msg;
-	char control[CMSG_SPACE(sizeof(uint64_t))];
-	struct cmsghdr *cmsg;
+	struct mmsghdr msgs[MAX_PDU_BATCH];
+	struct iovec iov[MAX_PDU_BATCH][3];
+	uint8_t headers[MAX_PDU_BATCH][MAX_PDU_HEADER];
+	char control[MAX_PDU_BATCH][CMSG_SPACE(sizeof(uint64_t))];
+
+	struct avb_packet_ring ring_rx;
 
 	struct spa_ringbuffer ring;
 	void *buffer_data;
@@ -34,6 +34,8 @@ PW_LOG_TOPIC_EXTERN(mod_topic);
 #define AREA_SIZE	(4096u / sizeof(struct spa_io_buffers))
 #define MAX_AREAS	32
 
+#define DEFAULT_RING_SIZE	(1u << 20)
+
 #define CHECK_FREE_PORT(impl,d,p)	(p <= pw_map_get_size(&impl->ports[d]) && !CHECK_PORT(impl,d,p))
 #define CHECK_PORT(impl,d,p)		(pw_map_lookup(&impl->ports[d], p) != NULL)
 #define GET_PORT(impl,d,p)		(pw_map_lookup(&impl->ports[d], p))
@@ -54,6 +56,7 @@ struct mix {
 	uint32_t peer_id;
 	uint32_t n_buffers;
 	uint32_t impl_mix_id;
+	struct spa_io_buffers *io;
 	struct buffer buffers[MAX_BUFFERS];
 };
 
@@ -114,6 +117,22 @@ struct impl {
 
 	struct pw_memblock *activation;
 
+	/* stream.ring, the server writes the input into the ring of the
+	 * client, see struct pw_node_ring */
+	unsigned int ring_mode:1;
+	uint32_t ring_size;
+	uint32_t ring_wakeup;
+	uint32_t ring_planes;
+	struct pw_memblock *ring_mem;
+	struct spa_source ring_source;	/* triggered by the peers */
+	int ring_fd;			/* wakes up the client */
+	uint32_t ring_cycles;		/* cycles since the last divider wakeup */
+	struct ring_rt {
+		struct pw_node_ring *ring;
+		uint32_t n_planes;	/* of the ring, the header is not trusted */
+		struct mix *mix;	/* the only mix of the input port */
+	} rt;
+
 	struct spa_hook node_listener;
 	struct spa_hook resource_listener;
 	struct spa_hook object_listener;
@@ -285,6 +304,8 @@ static int clear_buffers(struct impl *impl, struct mix *mix)
 	return 0;
 }
 
+static void set_ring_rt(struct impl *impl, struct pw_node_ring *ring, struct mix *mix);
+
 static void free_mix(struct port *p, struct mix *mix)
 {
 	struct impl *impl = p->impl;
@@ -292,6 +313,9 @@ static void free_mix(struct port *p, struct mix *mix)
 	if (mix == NULL)
 		return;
 
+	if (impl->rt.mix == mix)
+		set_ring_rt(impl, impl->rt.ring, NULL);
+
 	if (mix->n_buffers) {
 		/* this shouldn't happen */
 		spa_log_warn(impl->log, "%p: mix port-id:%u freeing leaked buffers", impl, mix->mix_id - 1u);
@@ -414,6 +438,76 @@ static int impl_node_set_io(void *object, uint32_t id, void *data, size_t size)
 				       mem_offset, mem_size);
 }
 
+static int do_update_ring(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct impl *impl = user_data;
+	impl->rt = *(const struct ring_rt *)data;
+	return 0;
+}
+
+static void set_ring_rt(struct impl *impl, struct pw_node_ring *ring, struct mix *mix)
+{
+	struct ring_rt rt = { ring, ring ? impl->ring_planes : 0, mix };
+
+	if (impl->rt.ring == ring && impl->rt.n_planes == rt.n_planes &&
+	    impl->rt.mix == mix)
+		return;
+	spa_loop_invoke(impl->data_loop, do_update_ring, 0, &rt, sizeof(rt), true, impl);
+}
+
+/* (re)allocate the ring for the planes of the input buffers. The server
+ * writes into the ring when there is only one link on the input port, with
+ * more links the client mixes and writes into the ring itself. */
+static void update_ring(struct impl *impl)
+{
+	struct port *p;
+	struct mix *mix, *found = NULL;
+	struct pw_memblock *mem;
+	uint32_t i, n_found = 0, n_planes = 0;
+	size_t size;
+
+	if (!impl->ring_mode || (p = GET_PORT(impl, SPA_DIRECTION_INPUT, 0)) == NULL)
+		return;
+
+	for (i = 0; i < pw_map_get_size(&p->mix); i++) {
+		if ((mix = pw_map_lookup(&p->mix, i)) == NULL || mix->n_buffers == 0)
+			continue;
+		n_planes = SPA_MAX(n_planes, mix->buffers[0].outbuf->n_datas);
+		if (mix->io != NULL) {
+			found = mix;
+			n_found++;
+		}
+	}
+	n_planes = SPA_MIN(n_planes, PW_NODE_RING_MAX_PLANES);
+
+	if (n_planes > impl->ring_planes) {
+		size = pw_node_ring_get_size(impl->ring_size, n_planes);
+		mem = pw_mempool_alloc(impl->context_pool,
+				PW_MEMBLOCK_FLAG_READWRITE |
+				PW_MEMBLOCK_FLAG_SEAL |
+				PW_MEMBLOCK_FLAG_MAP,
+				SPA_DATA_MemFd, size);
+		if (mem == NULL) {
+			pw_log_warn("%p: can't allocate ring of %zu bytes: %m", impl, size);
+		} else {
+			pw_node_ring_init(mem->map->ptr, impl->ring_size, n_planes,
+					impl->ring_wakeup);
+			/* stop writing in the old ring before it is freed */
+			set_ring_rt(impl, NULL, NULL);
+			impl_node_set_io(impl, SPA_IO_Memory, mem->map->ptr, size);
+			if (impl->ring_mem)
+				pw_memblock_unref(impl->ring_mem);
+			impl->ring_mem = mem;
+			impl->ring_planes = n_planes;
+			pw_log_info("%p: ring of %u bytes with %u planes, wakeup at %u",
+					impl, impl->ring_size, n_planes, impl->ring_wakeup);
+		}
+	}
+	set_ring_rt(impl, impl->ring_mem ? impl->ring_mem->map->ptr : NULL,
+			n_found == 1 ? found : NULL);
+}
+
 static int impl_node_send_command(void *object, const struct spa_command *command)
 {
 	struct impl *impl = object;
@@ -699,6 +793,13 @@ static int do_port_set_io(struct impl *impl,
 	if ((mix = find_mix(port, mix_id)) == NULL)
 		return -EINVAL;
 
+	if (id == SPA_IO_Buffers) {
+		if (impl->rt.mix == mix)
+			set_ring_rt(impl, impl->rt.ring, NULL);
+		mix->io = data && size >= sizeof(struct spa_io_buffers) ? data : NULL;
+		update_ring(impl);
+	}
+
 	old = pw_mempool_find_tag(impl->client_pool, tag, sizeof(tag));
 
 	if (data) {
@@ -754,6 +855,7 @@ do_port_use_buffers(struct impl *impl,
 	struct mix *mix;
 	uint32_t i, j;
 	struct pw_client_node_buffer *mb;
+	int res;
 
 	p = GET_PORT(impl, direction, port_id);
 	if (p == NULL)
@@ -772,6 +874,9 @@ do_port_use_buffers(struct impl *impl,
 	if ((mix = find_mix(p, mix_id)) == NULL)
 		return -EINVAL;
 
+	if (impl->rt.mix == mix)
+		set_ring_rt(impl, impl->rt.ring, NULL);
+
 	clear_buffers(impl, mix);
 
 	if (n_buffers > 0) {
@@ -883,9 +988,11 @@ do_port_use_buffers(struct impl *impl,
 	}
 	mix->n_buffers = n_buffers;
 
-	return pw_client_node_resource_port_use_buffers(impl->resource,
+	res = pw_client_node_resource_port_use_buffers(impl->resource,
 						 direction, port_id, mix_id, flags,
 						 n_buffers, mb);
+	update_ring(impl);
+	return res;
 }
 
 static int
@@ -1141,6 +1248,65 @@ static void node_on_data_fd_events(struct spa_source *source)
 	}
 }
 
+/* with node.cycle-divider, also wake up the client every Nth cycle. The ring
+ * has the data of all the cycles since the last wakeup. */
+static inline bool ring_cycle_wakeup(struct impl *impl, struct pw_node_ring *ring,
+		uint32_t divider)
+{
+	if (divider <= 1 || ++impl->ring_cycles < divider)
+		return false;
+	impl->ring_cycles = 0;
+	return SPA_ATOMIC_CAS(ring->pending, PW_NODE_RING_IDLE, PW_NODE_RING_WAKEUP);
+}
+
+/* the peers trigger the node, write the input into the ring and only wake up
+ * the client when the ring has enough data */
+static void node_on_ring_fd_events(struct spa_source *source)
+{
+	struct impl *impl = source->data;
+	struct pw_impl_node *node = impl->this.node;
+	struct pw_node_ring *ring = impl->rt.ring;
+	struct mix *mix = impl->rt.mix;
+	struct spa_io_buffers *io;
+	bool wakeup = true;
+	uint64_t cmd;
+	int res;
+
+	if (SPA_UNLIKELY(source->rmask & (SPA_IO_ERR | SPA_IO_HUP))) {
+		spa_log_warn(impl->log, "%p: got error", impl);
+		return;
+	}
+	if (SPA_UNLIKELY(!(source->rmask & SPA_IO_IN)))
+		return;
+
+	if (SPA_UNLIKELY(spa_system_eventfd_read(impl->data_system, source->fd, &cmd) < 0))
+		pw_log_warn("%p: read failed %m", impl);
+
+	/* when driving, the client needs to run its timers */
+	if (SPA_LIKELY(ring != NULL && mix != NULL && !node->driving)) {
+		io = mix->io;
+		wakeup = false;
+		if (io->status == SPA_STATUS_HAVE_DATA && io->buffer_id < mix->n_buffers) {
+			res = pw_node_ring_write(ring, impl->ring_size, impl->rt.n_planes,
+					impl->ring_wakeup, mix->buffers[io->buffer_id].outbuf);
+			if (res < 0) {
+				/* not mapped here, let the client write it */
+				wakeup = true;
+			} else {
+				io->status = SPA_STATUS_NEED_DATA;
+				wakeup = res > 0 ||
+					ring_cycle_wakeup(impl, ring, node->rt.cycle_divider);
+			}
+		}
+	}
+	if (wakeup) {
+		if (SPA_UNLIKELY(spa_system_eventfd_write(impl->data_system, impl->ring_fd, 1) < 0))
+			pw_log_warn("%p: write failed %m", impl);
+	} else {
+		pw_impl_node_skip(node);
+	}
+}
+
 static const struct spa_node_methods impl_node = {
 	SPA_VERSION_NODE_METHODS,
 	.add_listener = impl_node_add_listener,
@@ -1180,6 +1346,13 @@ impl_init(struct impl *impl,
 	impl->data_source.mask = SPA_IO_IN | SPA_IO_ERR | SPA_IO_HUP;
 	impl->data_source.rmask = 0;
 
+	impl->ring_source.func = node_on_ring_fd_events;
+	impl->ring_source.data = impl;
+	impl->ring_source.fd = -1;
+	impl->ring_source.mask = SPA_IO_IN | SPA_IO_ERR | SPA_IO_HUP;
+	impl->ring_source.rmask = 0;
+	impl->ring_fd = -1;
+
 	return 0;
 }
 
@@ -1221,6 +1394,16 @@ static void client_node_resource_destroy(void *data)
 				true,
 				&impl->data_source);
 	}
+	if (impl->ring_source.fd != -1) {
+		spa_loop_invoke(impl->data_loop,
+				do_remove_source,
+				SPA_ID_INVALID,
+				NULL,
+				0,
+				true,
+				&impl->ring_source);
+		impl->ring_source.fd = -1;
+	}
 	if (this->node)
 		pw_impl_node_destroy(this->node);
 }
@@ -1314,8 +1497,9 @@ void pw_impl_client_node_registered(struct pw_impl_client_node *this, struct pw_
 
 	pw_resource_set_bound_id(impl->resource, node_id);
 
+	/* with a ring, the server is triggered and wakes up the client */
 	pw_client_node_resource_transport(impl->resource,
-					  this->node->source.fd,
+					  impl->ring_mode ? impl->ring_fd : this->node->source.fd,
 					  impl->data_source.fd,
 					  impl->activation->id,
 					  0,
@@ -1366,6 +1550,19 @@ static void node_initialized(void *data)
 	pw_log_debug("%p: transport read-fd:%d write-fd:%d", impl,
 			impl->data_source.fd, this->node->source.fd);
 
+	if (impl->ring_mode) {
+		impl->ring_fd = spa_system_eventfd_create(data_system,
+				SPA_FD_CLOEXEC | SPA_FD_NONBLOCK);
+		if (impl->ring_fd < 0) {
+			pw_log_warn("%p: can't create ring eventfd: %s", impl,
+					spa_strerror(impl->ring_fd));
+			impl->ring_mode = false;
+		} else {
+			impl->ring_source.fd = this->node->source.fd;
+			spa_loop_add_source(impl->data_loop, &impl->ring_source);
+		}
+	}
+
 	if (add_area(impl) < 0)
 		return;
 
@@ -1408,6 +1605,10 @@ static void node_free(void *data)
 	pw_map_clear(&impl->ports[1]);
 	pw_map_clear(&impl->io_map);
 
+	if (impl->ring_mem)
+		pw_memblock_unref(impl->ring_mem);
+	if (impl->ring_fd != -1)
+		spa_system_close(data_system, impl->ring_fd);
 	if (impl->data_source.fd != -1)
 		spa_system_close(data_system, impl->data_source.fd);
 	free(impl);
@@ -1720,6 +1921,22 @@ struct pw_impl_client_node *pw_impl_client_node_new(struct pw_resource *resource
 
 	pw_properties_setf(properties, PW_KEY_CLIENT_ID, "%d", client->global->id);
 
+	impl->ring_mode = pw_properties_get_bool(properties, "stream.ring", false);
+	if (impl->ring_mode) {
+		uint32_t size = pw_properties_get_uint32(properties, "stream.ring.size",
+				DEFAULT_RING_SIZE);
+		size = SPA_ROUND_UP_N(SPA_CLAMP(size, 4096u, 1u << 30), 4096u);
+		/* the ring indexes wrap around, the size needs to be a power of 2 */
+		while (size & (size - 1))
+			size += size & -size;
+		impl->ring_size = size;
+		impl->ring_wakeup = pw_properties_get_uint32(properties,
+				"stream.ring.wakeup", size / 4);
+	} else if (pw_properties_get_uint32(properties, PW_KEY_NODE_CYCLE_DIVIDER, 1) > 1) {
+		pw_log_warn("%p: %s needs stream.ring, ignored", impl,
+				PW_KEY_NODE_CYCLE_DIVIDER);
+	}
+
 	this = &impl->this;
 
 	impl->context = context;
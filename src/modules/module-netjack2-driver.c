@@ -63,6 +63,12 @@
  * - `netjack2.save`: if jack port connections should be save automatically. Can also be
  *                   placed per stream.
  * - `netjack2.latency`: the latency in cycles, default 2
+ * - `netjack2.opus-threads`: extra threads to encode and decode opus channels with,
+ *                   default 0
+ * - `netjack2.busy-poll`: the usec to spin for the sync and for the packets after the sync,
+ *                   which saves a wakeup when they come in time. The data loop wakes up this
+ *                   long before the next sync is expected and spins until twice as long for
+ *                   it. Also sets SO_BUSY_POLL. Needs a spare CPU. default 0
  * - `audio.channels`: the number of audio ports. Can also be added to the stream props.
  * - `midi.ports`: the number of midi ports. Can also be added to the stream props.
  * - `source.props`: Extra properties for the source filter.
@@ -92,6 +98,8 @@
  *         #netjack2.client-name = PipeWire
  *         #netjack2.save        = false
  *         #netjack2.latency     = 2
+ *         #netjack2.opus-threads = 0
+ *         #netjack2.busy-poll = 0
  *         #midi.ports           = 0
  *         #audio.channels       = 2
  *         #audio.position       = [ FL FR ]
@@ -123,6 +131,8 @@ PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
 #define MAX_MTU			9000
 
 #define DEFAULT_NETWORK_LATENCY	2
+#define DEFAULT_OPUS_THREADS	0
+#define DEFAULT_BUSY_POLL	0
 #define NETWORK_MAX_LATENCY	30
 
 #define DEFAULT_CLIENT_NAME	"PipeWire"
@@ -144,6 +154,8 @@ PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
 			"( netjack2.client-name=<name of the NETJACK2 client> ) "	\
 			"( netjack2.save=<bool, save ports> ) "			\
 			"( netjack2.latency=<latency in cycles, default 2> ) "	\
+			"( netjack2.opus-threads=<opus threads, default 0> ) "	\
+			"( netjack2.busy-poll=<usec to spin, default 0> ) "	\
 			"( midi.ports=<number of midi ports> ) "		\
 			"( audio.channels=<number of channels> ) "		\
 			"( audio.position=<channel map> ) "			\
@@ -204,6 +216,8 @@ struct impl {
 	int dscp;
 	int mtu;
 	uint32_t latency;
+	uint32_t opus_threads;
+	uint32_t busy_poll;
 	uint32_t quantum_limit;
 
 	struct pw_impl_module *module;
@@ -232,6 +246,8 @@ struct impl {
 
 	struct spa_source *setup_socket;
 	struct spa_source *socket;
+	struct spa_source *sync_timer;
+	uint64_t sync_target;
 	struct spa_source *timer;
 	int32_t init_retry;
 
@@ -244,6 +260,7 @@ struct impl {
 	unsigned int do_disconnect:1;
 	unsigned int done:1;
 	unsigned int new_xrun:1;
+	unsigned int sync_late:1;
 	unsigned int started:1;
 };
 
@@ -619,6 +636,29 @@ static inline uint64_t get_time_nsec(struct impl *impl)
 	return nsec;
 }
 
+/* with busy_poll, wake up a little before the next sync is expected. When
+ * the sync was already there when we woke up, we don't know when it came in
+ * and we wake up a little earlier than last time for the next one. */
+static void schedule_sync_timer(struct impl *impl, uint32_t nframes)
+{
+	struct timespec value;
+	uint64_t next, spin = (uint64_t)impl->busy_poll * SPA_NSEC_PER_USEC;
+
+	if (impl->sync_timer == NULL || impl->samplerate == 0)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &value);
+	next = impl->sync_late ? impl->sync_target : (uint64_t)SPA_TIMESPEC_TO_NSEC(&value);
+	next += (uint64_t)nframes * SPA_NSEC_PER_SEC / impl->samplerate;
+	next -= SPA_MIN(spin, next);
+	impl->sync_target = next;
+	impl->sync_late = false;
+
+	value.tv_sec = next / SPA_NSEC_PER_SEC;
+	value.tv_nsec = next % SPA_NSEC_PER_SEC;
+	pw_loop_update_timer(impl->data_loop, impl->sync_timer, &value, NULL, true);
+}
+
 static void
 on_data_io(void *data, int fd, uint32_t mask)
 {
@@ -638,6 +678,7 @@ on_data_io(void *data, int fd, uint32_t mask)
 		if (nframes == 0)
 			return;
 
+		schedule_sync_timer(impl, nframes);
 		nsec = get_time_nsec(impl);
 
 		if (!impl->done) {
@@ -694,6 +735,22 @@ on_data_io(void *data, int fd, uint32_t mask)
 	}
 }
 
+/* spin for the sync, when it comes in we handle it here without waiting for
+ * the wakeup of the socket source */
+static void on_sync_timer(void *data, uint64_t expirations)
+{
+	struct impl *impl = data;
+	uint64_t spin = (uint64_t)impl->busy_poll * SPA_NSEC_PER_USEC;
+
+	if (impl->socket == NULL || !impl->started)
+		return;
+	if (pw_busy_poll_ready(impl->socket->fd))
+		impl->sync_late = true;
+	else if (!pw_busy_poll_wait(impl->socket->fd, 2 * spin))
+		return;
+	on_data_io(impl, impl->socket->fd, SPA_IO_IN);
+}
+
 static bool is_multicast(struct sockaddr *sa, socklen_t salen)
 {
 	if (sa->sa_family == AF_INET) {
@@ -855,6 +912,10 @@ static int handle_follower_setup(struct impl *impl, struct nj2_session_params *p
 	peer->send_volume = &impl->sink.volume;
 	peer->recv_volume = &impl->source.volume;
 	peer->quantum_limit = impl->quantum_limit;
+	peer->busy_poll = impl->busy_poll;
+#ifdef HAVE_OPUS_CUSTOM
+	peer->opus_threads = impl->opus_threads;
+#endif
 	netjack2_init(peer);
 
 	int bufsize = NETWORK_MAX_LATENCY * (peer->params.mtu +
@@ -1006,6 +1067,14 @@ static int create_netjack2_socket(struct impl *impl)
 		pw_log_error("can't create data source: %m");
 		goto out;
 	}
+	if (impl->busy_poll > 0) {
+		impl->sync_timer = pw_loop_add_timer(impl->data_loop, on_sync_timer, impl);
+		if (impl->sync_timer == NULL) {
+			res = -errno;
+			pw_log_error("can't create sync timer: %m");
+			goto out;
+		}
+	}
 
 	impl->init_retry = -1;
 	update_timer(impl, FOLLOWER_INIT_TIMEOUT);
@@ -1042,6 +1111,10 @@ static int destroy_netjack2_socket(struct impl *impl)
 {
 	update_timer(impl, 0);
 
+	if (impl->sync_timer) {
+		pw_loop_destroy_source(impl->data_loop, impl->sync_timer);
+		impl->sync_timer = NULL;
+	}
 	if (impl->socket) {
 		pw_loop_destroy_source(impl->data_loop, impl->socket);
 		impl->socket = NULL;
@@ -1263,6 +1336,10 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 	}
 	impl->latency = pw_properties_get_uint32(impl->props, "netjack2.latency",
 			DEFAULT_NETWORK_LATENCY);
+	impl->opus_threads = pw_properties_get_uint32(impl->props, "netjack2.opus-threads",
+			DEFAULT_OPUS_THREADS);
+	impl->busy_poll = pw_properties_get_uint32(impl->props, "netjack2.busy-poll",
+			DEFAULT_BUSY_POLL);
 
 	if (pw_properties_get(props, PW_KEY_NODE_VIRTUAL) == NULL)
 		pw_properties_set(props, PW_KEY_NODE_VIRTUAL, "true");
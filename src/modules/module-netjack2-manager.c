@@ -70,6 +70,12 @@
  * - `netjack2.period-size`: the buffer size to use, default 1024
  * - `netjack2.encoding`: the encoding, float|opus|int, default float
  * - `netjack2.kbps`: the number of kilobits per second when encoding, default 64
+ * - `netjack2.opus-threads`: extra threads to encode and decode opus channels with,
+ *                   default 0
+ * - `netjack2.busy-poll`: the usec to spin before waiting for the reply of the driver, which saves
+ *                   a wakeup when they come in time. Also sets SO_BUSY_POLL. Set the
+ *                   net.core.busy_poll sysctl to also busy poll in the data loop.
+ *                   default 0
  * - `audio.channels`: the number of audio ports. Can also be added to the stream props.
  * - `midi.ports`: the number of midi ports. Can also be added to the stream props.
  * - `source.props`: Extra properties for the source filter.
@@ -100,6 +106,8 @@
  *         #netjack2.period-size = 1024
  *         #netjack2.encoding    = float # float|opus
  *         #netjack2.kbps        = 64
+ *         #netjack2.opus-threads = 0
+ *         #netjack2.busy-poll = 0
  *         #midi.ports           = 0
  *         #audio.channels       = 2
  *         #audio.position       = [ FL FR ]
@@ -137,6 +145,8 @@ PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
 #define DEFAULT_PERIOD_SIZE	1024
 #define DEFAULT_ENCODING	"float"
 #define DEFAULT_KBPS		64
+#define DEFAULT_OPUS_THREADS	0
+#define DEFAULT_BUSY_POLL	0
 #define DEFAULT_CHANNELS	2
 #define DEFAULT_POSITION	"[ FL FR ]"
 #define DEFAULT_MIDI_PORTS	1
@@ -151,6 +161,8 @@ PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
 			"( netjack2.connect=<bool, autoconnect ports> ) "	\
 			"( netjack2.sample-rate=<sampl erate, default 48000> ) "\
 			"( netjack2.period-size=<period size, default 1024> ) "	\
+			"( netjack2.opus-threads=<opus threads, default 0> ) "	\
+			"( netjack2.busy-poll=<usec to spin, default 0> ) "	\
 			"( midi.ports=<number of midi ports> ) "		\
 			"( audio.channels=<number of channels> ) "		\
 			"( audio.position=<channel map> ) "			\
@@ -251,6 +263,8 @@ struct impl {
 	uint32_t samplerate;
 	uint32_t encoding;
 	uint32_t kbps;
+	uint32_t opus_threads;
+	uint32_t busy_poll;
 	uint32_t quantum_limit;
 
 	struct pw_impl_module *module;
@@ -988,6 +1002,10 @@ static int handle_follower_available(struct impl *impl, struct nj2_session_param
 	peer->send_volume = &follower->sink.volume;
 	peer->recv_volume = &follower->source.volume;
 	peer->quantum_limit = impl->quantum_limit;
+	peer->busy_poll = impl->busy_poll;
+#ifdef HAVE_OPUS_CUSTOM
+	peer->opus_threads = impl->opus_threads;
+#endif
 	netjack2_init(peer);
 
 	int bufsize = NETWORK_MAX_LATENCY * (peer->params.mtu +
@@ -1312,6 +1330,10 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 	}
 	impl->kbps = pw_properties_get_uint32(impl->props, "netjack2.kbps",
 			DEFAULT_KBPS);
+	impl->opus_threads = pw_properties_get_uint32(impl->props, "netjack2.opus-threads",
+			DEFAULT_OPUS_THREADS);
+	impl->busy_poll = pw_properties_get_uint32(impl->props, "netjack2.busy-poll",
+			DEFAULT_BUSY_POLL);
 
 	if (pw_properties_get(props, PW_KEY_NODE_VIRTUAL) == NULL)
 		pw_properties_set(props, PW_KEY_NODE_VIRTUAL, "true");
@@ -1,9 +1,14 @@
 
 #include <byteswap.h>
 
+#include "../network-batch.h"
+#include "../busy-poll.h"
+
 #ifdef HAVE_OPUS_CUSTOM
 #include <opus/opus.h>
 #include <opus/opus_custom.h>
+
+#include "../work-pool.h"
 #endif
 
 struct volume {
@@ -120,10 +125,25 @@ struct netjack2_peer {
 	void *encoded_data;
 	uint32_t encoded_size;
 	uint32_t max_encoded_size;
+
+	struct pw_net_batch send_batch;
+	struct pw_net_batch recv_batch;
+
+	/* usec to spin before a blocking receive */
+	uint32_t busy_poll;
 #ifdef HAVE_OPUS_CUSTOM
 	OpusCustomMode *opus_config;
 	OpusCustomEncoder **opus_enc;
 	OpusCustomDecoder **opus_dec;
+
+	/* the channels are encoded and decoded in parallel */
+	uint32_t opus_threads;
+	struct pw_work_pool opus_pool;
+	struct {
+		struct data_info *info;
+		uint32_t n_info;
+		uint32_t nframes;
+	} opus_job;
 #endif
 
 	unsigned fix_midi:1;
@@ -135,6 +155,16 @@ static int netjack2_init(struct netjack2_peer *peer)
 
 	peer->empty = calloc(peer->quantum_limit, sizeof(float));
 
+	if (peer->busy_poll > 0 && (res = pw_busy_poll_init(peer->fd, peer->busy_poll)) < 0)
+		pw_log_warn("can't set SO_BUSY_POLL, only spinning: %s", spa_strerror(res));
+
+	if ((res = pw_net_batch_init(&peer->send_batch, PW_NET_BATCH_MAX,
+			peer->params.mtu, true)) < 0)
+		return res;
+	if ((res = pw_net_batch_init(&peer->recv_batch, PW_NET_BATCH_MAX,
+			peer->params.mtu, false)) < 0)
+		return res;
+
 	peer->midi_size = peer->params.period_size * sizeof(float) *
 		SPA_MAX(peer->params.send_midi_channels, peer->params.recv_midi_channels);
 	peer->midi_data = calloc(1, peer->midi_size);
@@ -182,6 +212,9 @@ static int netjack2_init(struct netjack2_peer *peer)
 					1, &res)) == NULL)
 				goto error_opus;
 		}
+		if ((res = pw_work_pool_init(&peer->opus_pool, peer->opus_threads)) < 0)
+			pw_log_warn("can't start opus threads: %s", spa_strerror(res));
+		res = 0;
 #else
 		return -ENOTSUP;
 #endif
@@ -203,8 +236,11 @@ static void netjack2_cleanup(struct netjack2_peer *peer)
 
 	free(peer->empty);
 	free(peer->midi_data);
+	pw_net_batch_clear(&peer->send_batch);
+	pw_net_batch_clear(&peer->recv_batch);
 #ifdef HAVE_OPUS_CUSTOM
 	int32_t i;
+	pw_work_pool_clear(&peer->opus_pool);
 	if (peer->opus_enc != NULL) {
 		for (i = 0; i < peer->params.send_audio_channels; i++) {
 			if (peer->opus_enc[i])
@@ -232,6 +268,56 @@ struct data_info {
 	bool filled;
 };
 
+/* queue a packet, the packets of a cycle are sent together in
+ * netjack2_send_data() */
+static void netjack2_send(struct netjack2_peer *peer, void *buffer, size_t size)
+{
+	struct iovec iov = { .iov_base = buffer, .iov_len = size };
+	int res;
+
+	if ((res = pw_net_batch_add(&peer->send_batch, &iov, 1)) == -ENOSPC) {
+		pw_net_batch_flush(&peer->send_batch, peer->fd, 0);
+		res = pw_net_batch_add(&peer->send_batch, &iov, 1);
+	}
+	if (res < 0)
+		send(peer->fd, buffer, size, 0);
+}
+
+/* Like recv() but first returns the packets that were received in a batch.
+ * n_packets is the number of packets we expect for the current cycle, they
+ * are received together, the first one blocking. With busy_poll, we spin
+ * for a while before we block, unless MSG_DONTWAIT is given. */
+static ssize_t netjack2_recv(struct netjack2_peer *peer, void *buffer, size_t size,
+		int flags, uint32_t n_packets)
+{
+	struct pw_net_batch *b = &peer->recv_batch;
+	uint8_t *data;
+	uint32_t len;
+	int res;
+
+	if (b->pos >= b->n_packets) {
+		if (!(flags & MSG_DONTWAIT))
+			pw_busy_poll_wait(peer->fd, (uint64_t)peer->busy_poll * SPA_NSEC_PER_USEC);
+		if (n_packets <= 1 || b->max_packets == 0)
+			return recv(peer->fd, buffer, size, flags);
+		if ((res = pw_net_batch_recv(b, peer->fd, n_packets, MSG_WAITFORONE)) < 0)
+			return -1;
+	}
+	len = pw_net_batch_get(b, b->pos, &data);
+	len = SPA_MIN(len, size);
+	memcpy(buffer, data, len);
+	if (!(flags & MSG_PEEK))
+		b->pos++;
+	return len;
+}
+
+static inline uint32_t remaining_packets(struct nj2_packet_header *header)
+{
+	uint32_t num_packets = ntohl(header->num_packets);
+	uint32_t sub_cycle = ntohl(header->sub_cycle);
+	return num_packets > sub_cycle ? num_packets - sub_cycle : 1;
+}
+
 static inline void fix_midi_event(uint8_t *data, size_t size)
 {
 	/* fixup NoteOn with vel 0 */
@@ -366,7 +452,7 @@ static int netjack2_send_sync(struct netjack2_peer *peer, uint32_t nframes)
 	p = SPA_PTROFF(buffer, sizeof(header), int32_t);
 	for (i = 0; i < active_ports; i++)
 		p[i] = htonl(i);
-	send(peer->fd, buffer, packet_size, 0);
+	netjack2_send(peer, buffer, packet_size);
 	return 0;
 }
 
@@ -426,7 +512,7 @@ static int netjack2_send_midi(struct netjack2_peer *peer, uint32_t nframes,
 		memcpy(SPA_PTROFF(buffer, sizeof(header), void),
 			SPA_PTROFF(midi_data, i * max_size, void),
 			copy_size);
-		send(peer->fd, buffer, packet_size, 0);
+		netjack2_send(peer, buffer, packet_size);
 		//nj2_dump_packet_header(&header);
 	}
 	return 0;
@@ -483,12 +569,58 @@ static int netjack2_send_float(struct netjack2_peer *peer, uint32_t nframes,
 		header.is_last = htonl(is_last);
 		header.packet_size = htonl(packet_size);
 		memcpy(buffer, &header, sizeof(header));
-		send(peer->fd, buffer, packet_size, 0);
+		netjack2_send(peer, buffer, packet_size);
 		//nj2_dump_packet_header(&header);
 	}
 	return 0;
 }
 
+#ifdef HAVE_OPUS_CUSTOM
+static void netjack2_encode_opus(void *data, uint32_t i)
+{
+	struct netjack2_peer *peer = data;
+	struct data_info *info = peer->opus_job.info;
+	uint32_t max_encoded = peer->max_encoded_size;
+	uint16_t *ap = SPA_PTROFF(peer->encoded_data, i * max_encoded, uint16_t);
+	void *pcm;
+	int res;
+
+	if (i >= peer->opus_job.n_info || (pcm = info[i].data) == NULL)
+		pcm = peer->empty;
+
+	res = opus_custom_encode_float(peer->opus_enc[i],
+			pcm, peer->opus_job.nframes, (unsigned char*)&ap[1], max_encoded - 2);
+
+	if (res < 0 || res > 0xffff) {
+		pw_log_warn("encoding error %d", res);
+		ap[0] = 0;
+	} else {
+		ap[0] = htons(res);
+	}
+}
+
+static void netjack2_decode_opus(void *data, uint32_t i)
+{
+	struct netjack2_peer *peer = data;
+	struct data_info *info = peer->opus_job.info;
+	uint16_t *ap = SPA_PTROFF(peer->encoded_data, i * peer->max_encoded_size, uint16_t);
+	void *pcm;
+	int res;
+
+	if (i >= peer->opus_job.n_info || (pcm = info[i].data) == NULL)
+		return;
+
+	res = opus_custom_decode_float(peer->opus_dec[i],
+			(unsigned char*)&ap[1], ntohs(ap[0]),
+			pcm, peer->opus_job.nframes);
+
+	if (res < 0 || res > 0xffff || res != (int)peer->opus_job.nframes)
+		pw_log_warn("decoding error %d", res);
+	else
+		info[i].filled = true;
+}
+#endif
+
 static int netjack2_send_opus(struct netjack2_peer *peer, uint32_t nframes,
 		struct data_info *info, uint32_t n_info)
 {
@@ -512,24 +644,10 @@ static int netjack2_send_opus(struct netjack2_peer *peer, uint32_t nframes,
 
 	encoded_data = peer->encoded_data;
 
-	for (i = 0; i < active_ports; i++) {
-		uint16_t *ap = SPA_PTROFF(encoded_data, i * max_encoded, uint16_t);
-		void *pcm;
-		int res;
-
-		if (i >= n_info || (pcm = info[i].data) == NULL)
-			pcm = peer->empty;
-
-		res = opus_custom_encode_float(peer->opus_enc[i],
-				pcm, nframes, (unsigned char*)&ap[1], max_encoded - 2);
-
-		if (res < 0 || res > 0xffff) {
-			pw_log_warn("encoding error %d", res);
-			ap[0] = 0;
-		} else {
-			ap[0] = htons(res);
-		}
-	}
+	peer->opus_job.info = info;
+	peer->opus_job.n_info = n_info;
+	peer->opus_job.nframes = nframes;
+	pw_work_pool_run(&peer->opus_pool, active_ports, netjack2_encode_opus, peer);
 
 	strcpy(header.type, "header");
 	header.data_type = htonl('a');
@@ -557,7 +675,7 @@ static int netjack2_send_opus(struct netjack2_peer *peer, uint32_t nframes,
 						j * max_encoded + i * sub_period_bytes, void),
 					data_size);
 		}
-		send(peer->fd, buffer, packet_size, 0);
+		netjack2_send(peer, buffer, packet_size);
 		//nj2_dump_packet_header(&header);
 	}
 	return 0;
@@ -625,7 +743,7 @@ static int netjack2_send_int(struct netjack2_peer *peer, uint32_t nframes,
 						j * max_encoded + i * sub_period_bytes, void),
 					data_size);
 		}
-		send(peer->fd, buffer, packet_size, 0);
+		netjack2_send(peer, buffer, packet_size);
 		//nj2_dump_packet_header(&header);
 	}
 	return 0;
@@ -648,16 +766,19 @@ static int netjack2_send_data(struct netjack2_peer *peer, uint32_t nframes,
 		netjack2_send_opus(peer, nframes, audio, n_audio);
 		break;
 	}
+	pw_net_batch_flush(&peer->send_batch, peer->fd, 0);
 	return 0;
 }
 
+/* Called when the socket is readable. Returns 0 when the sync is not there
+ * yet, we are then woken up again when it comes in. */
 static inline int32_t netjack2_driver_sync_wait(struct netjack2_peer *peer)
 {
 	struct nj2_packet_header sync;
 	ssize_t len;
 
 	while (true) {
-		if ((len = recv(peer->fd, &sync, sizeof(sync), 0)) < 0)
+		if ((len = netjack2_recv(peer, &sync, sizeof(sync), MSG_DONTWAIT, 1)) < 0)
 			goto receive_error;
 
 		if (len >= (ssize_t)sizeof(sync)) {
@@ -678,7 +799,8 @@ static inline int32_t netjack2_driver_sync_wait(struct netjack2_peer *peer)
 	return peer->sync.frames;
 
 receive_error:
-	pw_log_warn("recv error: %m");
+	if (errno != EAGAIN && errno != EWOULDBLOCK)
+		pw_log_warn("recv error: %m");
 	return 0;
 }
 
@@ -689,7 +811,7 @@ static inline int32_t netjack2_manager_sync_wait(struct netjack2_peer *peer)
 	int32_t offset;
 
 	while (true) {
-		if ((len = recv(peer->fd, &sync, sizeof(sync), MSG_PEEK)) < 0)
+		if ((len = netjack2_recv(peer, &sync, sizeof(sync), MSG_PEEK, 1)) < 0)
 			goto receive_error;
 
 		if (len >= (ssize_t)sizeof(sync)) {
@@ -701,7 +823,7 @@ static inline int32_t netjack2_manager_sync_wait(struct netjack2_peer *peer)
 			    ntohl(sync.id) == peer->params.id)
 				break;
 		}
-		if ((len = recv(peer->fd, &sync, sizeof(sync), 0)) < 0)
+		if ((len = netjack2_recv(peer, &sync, sizeof(sync), 0, 1)) < 0)
 			goto receive_error;
 	}
 	peer->sync.cycle = ntohl(sync.cycle);
@@ -716,7 +838,7 @@ static inline int32_t netjack2_manager_sync_wait(struct netjack2_peer *peer)
 		peer->sync.is_last = true;
 		return 0;
 	} else {
-		if ((len = recv(peer->fd, &sync, sizeof(sync), 0)) < 0)
+		if ((len = netjack2_recv(peer, &sync, sizeof(sync), 0, 1)) < 0)
 			goto receive_error;
 	}
 	return peer->sync.frames;
@@ -734,7 +856,7 @@ static int netjack2_recv_midi(struct netjack2_peer *peer, struct nj2_packet_head
 	uint32_t packet_size = SPA_MIN(ntohl(header->packet_size), peer->params.mtu);
 	uint8_t buffer[packet_size], *data = buffer, *midi_data;
 
-	if ((len = recv(peer->fd, buffer, packet_size, 0)) < 0)
+	if ((len = netjack2_recv(peer, buffer, packet_size, 0, 1)) < 0)
 		return -errno;
 
 	active_ports = peer->params.recv_midi_channels;
@@ -787,7 +909,8 @@ static int netjack2_recv_float(struct netjack2_peer *peer, struct nj2_packet_hea
 	uint32_t packet_size = SPA_MIN(ntohl(header->packet_size), peer->params.mtu);
 	uint8_t buffer[packet_size];
 
-	if ((len = recv(peer->fd, buffer, packet_size, 0)) < 0)
+	if ((len = netjack2_recv(peer, buffer, packet_size, 0,
+					remaining_packets(header))) < 0)
 		return -errno;
 
 	active_ports = ntohl(header->active_ports);
@@ -838,7 +961,8 @@ static int netjack2_recv_opus(struct netjack2_peer *peer, struct nj2_packet_head
 	uint8_t buffer[packet_size], *data = buffer, *encoded_data;
 	uint32_t sub_period_bytes, last_period_bytes, data_size, num_packets;
 
-	if ((len = recv(peer->fd, buffer, packet_size, 0)) < 0)
+	if ((len = netjack2_recv(peer, buffer, packet_size, 0,
+					remaining_packets(header))) < 0)
 		return -errno;
 
 	active_ports = peer->params.recv_audio_channels;
@@ -879,23 +1003,10 @@ static int netjack2_recv_opus(struct netjack2_peer *peer, struct nj2_packet_head
 	if (++(*count) < peer->sync.num_packets)
 		return 0;
 
-	for (i = 0; i < active_ports; i++) {
-		uint16_t *ap = SPA_PTROFF(encoded_data, i * max_encoded, uint16_t);
-		void *pcm;
-		int res;
-
-		if (i >= n_info || (pcm = info[i].data) == NULL)
-			continue;
-
-		res = opus_custom_decode_float(peer->opus_dec[i],
-				(unsigned char*)&ap[1], ntohs(ap[0]),
-				pcm, peer->sync.frames);
-
-		if (res < 0 || res > 0xffff || res != peer->sync.frames)
-			pw_log_warn("decoding error %d", res);
-		else
-			info[i].filled = true;
-	}
+	peer->opus_job.info = info;
+	peer->opus_job.n_info = n_info;
+	peer->opus_job.nframes = peer->sync.frames;
+	pw_work_pool_run(&peer->opus_pool, active_ports, netjack2_decode_opus, peer);
 	return 0;
 #else
 	return -ENOTSUP;
@@ -911,7 +1022,8 @@ static int netjack2_recv_int(struct netjack2_peer *peer, struct nj2_packet_heade
 	uint8_t buffer[packet_size], *data = buffer, *encoded_data;
 	uint32_t sub_period_bytes, last_period_bytes, data_size, num_packets;
 
-	if ((len = recv(peer->fd, buffer, packet_size, 0)) < 0)
+	if ((len = netjack2_recv(peer, buffer, packet_size, 0,
+					remaining_packets(header))) < 0)
 		return -errno;
 
 	active_ports = peer->params.recv_audio_channels;
@@ -974,7 +1086,7 @@ static int netjack2_recv_data(struct netjack2_peer *peer,
 	struct nj2_packet_header header;
 
 	while (!peer->sync.is_last) {
-		if ((len = recv(peer->fd, &header, sizeof(header), MSG_PEEK)) < 0)
+		if ((len = netjack2_recv(peer, &header, sizeof(header), MSG_PEEK, 1)) < 0)
 			goto receive_error;
 
 		if (len < (ssize_t)sizeof(header))
@@ -69,6 +69,8 @@
  *     #pulse.default.frag     = 96000/48000   # 2 seconds
  *     #pulse.default.tlength  = 96000/48000   # 2 seconds
  *     #pulse.min.quantum      = 128/48000     # 2.7ms
+ *     #pulse.memfd            = true
+ *     #pulse.io-thread        = false
  *     #pulse.default.format   = F32
  *     #pulse.default.position = [ FL FR ]
  *     # These overrides are only applied when running in a vm.
@@ -111,6 +113,24 @@
  * By default network access is given the "restricted" permissions. The session manager is responsible
  * for assigning permission to clients with restricted permissions (usually read-only permissions).
  *
+ *\code{.unparsed}
+ *     pulse.memfd = true
+ *\endcode
+ *
+ * Local clients of the same user can exchange audio data with the server through shared
+ * memfd memory and a shared ringbuffer (srbchannel) instead of the socket. This avoids
+ * copies and syscalls for each block of data. Set this to false to always use the socket.
+ *
+ *\code{.unparsed}
+ *     pulse.io-thread = false
+ *\endcode
+ *
+ * Read the client connections in a separate thread. Playback data is written into the
+ * stream buffers directly from this thread while commands are still handled in the main
+ * loop. This keeps audio flowing when the main loop is busy, for example when many clients
+ * query the server. pw-benchmark-pulse-storm counts the playback underruns with and
+ * without this option.
+ *
  * ### Playback buffering options
  *
  *\code{.unparsed}
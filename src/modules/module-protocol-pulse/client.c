@@ -5,6 +5,8 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
 
@@ -27,6 +29,7 @@
 #include "operation.h"
 #include "pending-sample.h"
 #include "server.h"
+#include "shm.h"
 #include "stream.h"
 
 PW_LOG_TOPIC_EXTERN(pulse_conn);
@@ -44,11 +47,13 @@ struct client *client_new(struct server *server)
 	client->server = server;
 	client->impl = server->impl;
 	client->connect_tag = SPA_ID_INVALID;
+	client->info_generation = 1;
 
 	pw_map_init(&client->streams, 16, 16);
 	spa_list_init(&client->out_messages);
 	spa_list_init(&client->operations);
 	spa_list_init(&client->pending_samples);
+	spa_list_init(&client->io_queue);
 	spa_hook_list_init(&client->listener_list);
 
 	spa_list_append(&server->clients, &client->link);
@@ -111,6 +116,21 @@ void client_disconnect(struct client *client)
 
 	pw_map_for_each(&client->streams, client_free_stream, client);
 
+	impl_io_lock(impl);
+	if (client->io_source) {
+		pw_loop_destroy_source(impl->io_loop, client->io_source);
+		client->io_source = NULL;
+	}
+	if (client->srb_source) {
+		pw_loop_destroy_source(impl_get_io_loop(impl), client->srb_source);
+		client->srb_source = NULL;
+	}
+	if (client->io_queued) {
+		spa_list_remove(&client->io_link);
+		client->io_queued = false;
+	}
+	impl_io_unlock(impl);
+
 	if (client->source) {
 		pw_loop_destroy_source(impl->loop, client->source);
 		client->source = NULL;
@@ -122,6 +142,19 @@ void client_disconnect(struct client *client)
 	}
 }
 
+static void reader_clear(struct reader *rd)
+{
+	uint32_t i;
+
+	if (rd->message)
+		message_free(rd->message, false, false);
+	rd->message = NULL;
+
+	for (i = 0; i < rd->n_fds; i++)
+		close(rd->fds[i]);
+	rd->n_fds = 0;
+}
+
 void client_free(struct client *client)
 {
 	struct impl *impl = client->impl;
@@ -140,8 +173,14 @@ void client_free(struct client *client)
 	spa_list_consume(p, &client->pending_samples, link)
 		pending_sample_free(p);
 
-	if (client->message)
-		message_free(client->message, false, false);
+	reader_clear(&client->in);
+	reader_clear(&client->srb_in);
+	client_close_fds(client);
+
+	spa_list_consume(msg, &client->io_queue, link) {
+		message_close_fds(msg);
+		message_free(msg, true, false);
+	}
 
 	spa_list_consume(msg, &client->out_messages, link)
 		message_free(msg, true, false);
@@ -165,6 +204,9 @@ void client_free(struct client *client)
 	pw_properties_free(client->props);
 	pw_properties_free(client->routes);
 
+	if (client->shm)
+		shm_free(client->shm);
+
 	spa_hook_list_clean(&client->listener_list);
 
 	free(client);
@@ -193,7 +235,7 @@ int client_queue_message(struct client *client, struct message *msg)
 		goto error;
 	}
 
-	if (msg->length == 0) {
+	if (msg->length == 0 && (msg->flags & FLAG_SHMMASK) == 0) {
 		res = 0;
 		goto error;
 	} else if (msg->length > msg->allocated) {
@@ -219,6 +261,67 @@ error:
 	return res;
 }
 
+static ssize_t client_send(struct client *client, struct message *m,
+		const void *data, size_t size)
+{
+	struct iovec iov;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	union {
+		char buf[CMSG_SPACE(sizeof(m->fds)) + CMSG_SPACE(sizeof(struct ucred))];
+		struct cmsghdr align;
+	} control;
+	ssize_t res;
+
+	/* the fds and credentials can only be passed over the socket */
+	if (client->srb_active && m->n_fds == 0 && !m->creds) {
+		res = srbchannel_write(&client->shm->srb, data, size);
+		return res == 0 ? -ENOSPC : res;
+	}
+
+	iov.iov_base = (void*)data;
+	iov.iov_len = size;
+	spa_zero(msg);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	if (client->out_index == 0 && (m->n_fds > 0 || m->creds)) {
+		spa_zero(control);
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof(control.buf);
+		cmsg = CMSG_FIRSTHDR(&msg);
+		msg.msg_controllen = 0;
+
+		if (m->n_fds > 0) {
+			cmsg->cmsg_level = SOL_SOCKET;
+			cmsg->cmsg_type = SCM_RIGHTS;
+			cmsg->cmsg_len = CMSG_LEN(sizeof(int) * m->n_fds);
+			memcpy(CMSG_DATA(cmsg), m->fds, sizeof(int) * m->n_fds);
+			msg.msg_controllen += CMSG_SPACE(sizeof(int) * m->n_fds);
+			cmsg = SPA_PTROFF(cmsg, CMSG_SPACE(sizeof(int) * m->n_fds), struct cmsghdr);
+		}
+#ifdef SCM_CREDENTIALS
+		if (m->creds) {
+			struct ucred ucred = {
+				.pid = getpid(),
+				.uid = getuid(),
+				.gid = getgid(),
+			};
+			cmsg->cmsg_level = SOL_SOCKET;
+			cmsg->cmsg_type = SCM_CREDENTIALS;
+			cmsg->cmsg_len = CMSG_LEN(sizeof(ucred));
+			memcpy(CMSG_DATA(cmsg), &ucred, sizeof(ucred));
+			msg.msg_controllen += CMSG_SPACE(sizeof(ucred));
+		}
+#endif
+		if (msg.msg_controllen == 0)
+			msg.msg_control = NULL;
+	}
+
+	res = sendmsg(client->source->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+	return res < 0 ? -errno : res;
+}
+
 static int client_try_flush_messages(struct client *client)
 {
 	pw_log_trace("client %p: flushing", client);
@@ -231,12 +334,18 @@ static int client_try_flush_messages(struct client *client)
 		const void *data;
 		size_t size;
 
+		if (client->out_index == 0 && client->srb_pending) {
+			pw_log_debug("client %p: switching to srbchannel", client);
+			client->srb_pending = false;
+			client->srb_active = true;
+		}
+
 		if (client->out_index < sizeof(desc)) {
 			desc.length = htonl(m->length);
 			desc.channel = htonl(m->channel);
-			desc.offset_hi = 0;
+			desc.offset_hi = htonl(m->block_id);
 			desc.offset_lo = 0;
-			desc.flags = 0;
+			desc.flags = htonl(m->flags);
 
 			data = SPA_PTROFF(&desc, client->out_index, void);
 			size = sizeof(desc) - client->out_index;
@@ -254,12 +363,11 @@ static int client_try_flush_messages(struct client *client)
 		}
 
 		while (true) {
-			ssize_t sent = send(client->source->fd, data, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+			ssize_t sent = client_send(client, m, data, size);
 			if (sent < 0) {
-				int res = -errno;
-				if (res == -EINTR)
+				if (sent == -EINTR)
 					continue;
-				return res;
+				return sent;
 			}
 			client->out_index += sent;
 			break;
@@ -273,9 +381,18 @@ int client_flush_messages(struct client *client)
 	client->new_msg_since_last_flush = false;
 
 	int res = client_try_flush_messages(client);
-	if (res >= 0) {
+	/* when the srbchannel is full, we are woken up by the srbchannel
+	 * when there is space again */
+	if (res >= 0 || res == -ENOSPC) {
 		uint32_t mask = client->source->mask;
 
+		if (res == -ENOSPC && client->impl->io_thread) {
+			/* let the I/O thread wake us up */
+			impl_io_lock(client->impl);
+			client->srb_blocked = true;
+			impl_io_unlock(client->impl);
+		}
+
 		if (SPA_FLAG_IS_SET(mask, SPA_IO_OUT)) {
 			SPA_FLAG_CLEAR(mask, SPA_IO_OUT);
 			pw_loop_update_io(client->impl->loop, client->source, mask);
@@ -381,3 +498,110 @@ int client_queue_subscribe_event(struct client *client, uint32_t mask, uint32_t
 
 	return client_queue_message(client, reply);
 }
+
+int client_enable_shm(struct client *client)
+{
+	struct impl *impl = client->impl;
+	struct message *msg;
+	struct shm *shm;
+	int res;
+
+	if ((shm = shm_new()) == NULL)
+		return -errno;
+	if ((res = srbchannel_init(shm)) < 0) {
+		shm_free(shm);
+		return res;
+	}
+	client->shm = shm;
+	client->srb_tag = shm->id;
+
+	pw_log_info("client %p: memfd pool id:%u", client, shm->id);
+
+	/* first register our memfd pool */
+	msg = message_alloc(impl, -1, 0);
+	if (msg == NULL)
+		return -errno;
+	message_put(msg,
+		TAG_U32, COMMAND_REGISTER_MEMFD_SHMID,
+		TAG_U32, -1,
+		TAG_U32, shm->id,
+		TAG_INVALID);
+	msg->fds[0] = shm->block->fd;
+	msg->n_fds = 1;
+	if ((res = client_queue_message(client, msg)) < 0)
+		return res;
+
+	/* then pass the srbchannel semaphores, the client will expect the
+	 * memblock with the ringbuffers next */
+	msg = message_alloc(impl, -1, 0);
+	if (msg == NULL)
+		return -errno;
+	message_put(msg,
+		TAG_U32, COMMAND_ENABLE_SRBCHANNEL,
+		TAG_U32, client->srb_tag,
+		TAG_INVALID);
+	msg->fds[0] = shm->srb.read_fd;
+	msg->fds[1] = shm->srb.write_fd;
+	msg->n_fds = 2;
+	if ((res = client_queue_message(client, msg)) < 0)
+		return res;
+
+	msg = message_alloc(impl, 0, sizeof(struct shm_info));
+	if (msg == NULL)
+		return -errno;
+	shm_block_info(shm, SHM_SRB_BLOCK, SHM_SLOT_SIZE, (struct shm_info*)msg->data);
+	msg->flags = FLAG_SHMDATA | FLAG_SHMDATA_MEMFD_BLOCK | FLAG_SHMWRITABLE;
+
+	return client_queue_message(client, msg);
+}
+
+int client_take_fd(struct client *client)
+{
+	int fd;
+
+	if (client->n_in_fds == 0)
+		return -1;
+
+	fd = client->in_fds[0];
+	client->in_fds[0] = client->in_fds[1];
+	client->n_in_fds--;
+	return fd;
+}
+
+void client_close_fds(struct client *client)
+{
+	uint32_t i;
+
+	for (i = 0; i < client->n_in_fds; i++)
+		close(client->in_fds[i]);
+	client->n_in_fds = 0;
+}
+
+/* Allocate a message for a memblock of size bytes. The data is placed in
+ * our memfd pool when possible so that only a reference to it needs to be
+ * sent. */
+struct message *client_alloc_memblock(struct client *client, uint32_t channel,
+		uint32_t size, void **data)
+{
+	struct message *msg;
+	uint32_t block_id;
+	void *p;
+
+	if (client->shm != NULL && size <= SHM_SLOT_SIZE &&
+	    (p = shm_alloc_block(client->shm, &block_id)) != NULL) {
+		msg = message_alloc(client->impl, channel, sizeof(struct shm_info));
+		if (msg == NULL) {
+			shm_release_block(client->shm, block_id);
+			return NULL;
+		}
+		shm_block_info(client->shm, block_id, size, (struct shm_info*)msg->data);
+		msg->flags = FLAG_SHMDATA | FLAG_SHMDATA_MEMFD_BLOCK;
+		*data = p;
+		return msg;
+	}
+
+	msg = message_alloc(client->impl, channel, size);
+	if (msg != NULL)
+		*data = msg->data;
+	return msg;
+}
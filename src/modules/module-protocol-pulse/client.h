@@ -21,6 +21,7 @@ struct pw_core;
 struct pw_manager;
 struct pw_manager_object;
 struct pw_properties;
+struct shm;
 
 struct descriptor {
 	uint32_t length;
@@ -30,6 +31,14 @@ struct descriptor {
 	uint32_t flags;
 };
 
+struct reader {
+	uint32_t index;
+	struct descriptor desc;
+	struct message *message;
+	int fds[2];			/**< fds received with the current frame */
+	uint32_t n_fds;
+};
+
 struct client {
 	struct spa_list link;
 	struct impl *impl;
@@ -62,10 +71,28 @@ struct client {
 
 	uint32_t connect_tag;
 
-	uint32_t in_index;
+	uint64_t info_generation;	/**< bumped when cached info replies become invalid,
+					  *  starts at 1, 0 marks an invalidated cache */
+
+	struct reader in;		/**< frames from the socket */
+	struct reader srb_in;		/**< frames from the srbchannel */
 	uint32_t out_index;
-	struct descriptor desc;
-	struct message *message;
+	int in_fds[2];			/**< fds of the packet being handled */
+	uint32_t n_in_fds;
+
+	struct shm *shm;		/**< memfd transport, when negotiated */
+	struct spa_source *srb_source;
+	uint32_t srb_tag;
+
+	/* shared with the I/O thread, protected by the I/O thread lock */
+	struct spa_source *io_source;
+	struct spa_list io_link;	/**< link in impl->io_clients */
+	struct spa_list io_queue;	/**< frames for the main loop */
+	uint32_t io_pending;		/**< frames that the main loop must apply in order */
+	int io_res;			/**< error from the I/O thread */
+	bool io_queued;
+	bool io_flush;
+	bool srb_blocked;		/**< our side of the srbchannel is full */
 
 	struct pw_map streams;
 	struct spa_list out_messages;
@@ -77,6 +104,8 @@ struct client {
 	unsigned int disconnect:1;
 	unsigned int new_msg_since_last_flush:1;
 	unsigned int authenticated:1;
+	unsigned int srb_pending:1;	/**< switch to the srbchannel after the current frame */
+	unsigned int srb_active:1;
 
 	struct pw_manager_object *prev_default_sink;
 	struct pw_manager_object *prev_default_source;
@@ -101,6 +130,13 @@ int client_queue_message(struct client *client, struct message *msg);
 int client_flush_messages(struct client *client);
 int client_queue_subscribe_event(struct client *client, uint32_t mask, uint32_t event, uint32_t id);
 
+int client_enable_shm(struct client *client);
+int client_start_srbchannel(struct client *client);
+int client_take_fd(struct client *client);
+void client_close_fds(struct client *client);
+struct message *client_alloc_memblock(struct client *client, uint32_t channel,
+		uint32_t size, void **data);
+
 void client_update_routes(struct client *client, const char *key, const char *value);
 
 static inline void client_unref(struct client *client)
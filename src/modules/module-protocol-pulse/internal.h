@@ -7,6 +7,7 @@
 
 #include "config.h"
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -15,6 +16,7 @@
 #include <spa/utils/ratelimit.h>
 #include <spa/utils/ringbuffer.h>
 #include <pipewire/impl.h>
+#include <pipewire/thread-loop.h>
 
 #include "format.h"
 #include "server.h"
@@ -35,6 +37,8 @@ struct defs {
 	struct channel_map channel_map;
 	uint32_t quantum_limit;
 	uint32_t idle_timeout;
+	bool memfd;
+	bool io_thread;
 };
 
 struct stats {
@@ -64,7 +68,17 @@ struct impl {
 	struct pw_map samples;
 	struct pw_map modules;
 
+	struct pw_core *sample_core;	/**< connection for the sample mixers */
+	struct spa_list sample_mixers;
+
 	struct spa_list free_messages;
+	pthread_mutex_t lock;		/**< protects free_messages and stat */
+
+	struct pw_thread_loop *io_thread;	/**< reads client data when enabled */
+	struct pw_loop *io_loop;
+	struct spa_source *io_event;
+	struct spa_list io_clients;	/**< clients with frames for the main loop */
+
 	struct defs defs;
 	struct stats stat;
 };
@@ -82,6 +96,24 @@ void impl_add_listener(struct impl *impl,
 		struct spa_hook *listener,
 		const struct impl_events *events, void *data);
 
+static inline void impl_io_lock(struct impl *impl)
+{
+	if (impl->io_thread)
+		pw_thread_loop_lock(impl->io_thread);
+}
+
+static inline void impl_io_unlock(struct impl *impl)
+{
+	if (impl->io_thread)
+		pw_thread_loop_unlock(impl->io_thread);
+}
+
+/* the loop that reads client data */
+static inline struct pw_loop *impl_get_io_loop(struct impl *impl)
+{
+	return impl->io_loop ? impl->io_loop : impl->loop;
+}
+
 void broadcast_subscribe_event(struct impl *impl, uint32_t mask, uint32_t event, uint32_t id);
 
 #endif
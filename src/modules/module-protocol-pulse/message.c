@@ -4,6 +4,7 @@
 
 #include <arpa/inet.h>
 #include <math.h>
+#include <unistd.h>
 
 #include <spa/debug/buffer.h>
 #include <spa/utils/defs.h>
@@ -22,32 +23,11 @@
 #define MAX_SIZE	(256*1024)
 #define MAX_ALLOCATED	(16*1024 *1024)
 
-#define VOLUME_MUTED ((uint32_t) 0U)
-#define VOLUME_NORM ((uint32_t) 0x10000U)
-#define VOLUME_MAX ((uint32_t) UINT32_MAX/2)
-
 #define PA_CHANNELS_MAX	(32u)
 
 PW_LOG_TOPIC_EXTERN(pulse_conn);
 #define PW_LOG_TOPIC_DEFAULT pulse_conn
 
-static inline uint32_t volume_from_linear(float vol)
-{
-	uint32_t v;
-	if (vol <= 0.0f)
-		v = VOLUME_MUTED;
-	else
-		v = SPA_CLAMP((uint64_t) lround(cbrt(vol) * VOLUME_NORM),
-				VOLUME_MUTED, VOLUME_MAX);
-	return v;
-}
-
-static inline float volume_to_linear(uint32_t vol)
-{
-	float v = ((float)vol) / VOLUME_NORM;
-	return v * v * v;
-}
-
 static int read_u8(struct message *m, uint8_t *val)
 {
 	if (m->offset + 1 > m->length)
@@ -383,14 +363,19 @@ static int ensure_size(struct message *m, uint32_t size)
 	alloc = SPA_ROUND_UP_N(SPA_MAX(m->allocated + size, 4096u), 4096u);
 	diff = alloc - m->allocated;
 	if ((data = realloc(m->data, alloc)) == NULL) {
+		int res = -errno;
 		free(m->data);
 		m->data = NULL;
+		pthread_mutex_lock(&m->impl->lock);
 		m->impl->stat.allocated -= m->allocated;
+		pthread_mutex_unlock(&m->impl->lock);
 		m->allocated = 0;
-		return -errno;
+		return res;
 	}
+	pthread_mutex_lock(&m->impl->lock);
 	m->impl->stat.allocated += diff;
 	m->impl->stat.accumulated += diff;
+	pthread_mutex_unlock(&m->impl->lock);
 	m->data = data;
 	m->allocated = alloc;
 	return size;
@@ -645,6 +630,19 @@ int message_put(struct message *m, ...)
 	return 0;
 }
 
+/* append already serialized data */
+int message_append(struct message *m, const void *data, uint32_t size)
+{
+	if (ensure_size(m, size) > 0)
+		memcpy(m->data + m->length, data, size);
+	m->length += size;
+
+	if (m->length > m->allocated)
+		return -ENOMEM;
+
+	return 0;
+}
+
 int message_dump(enum spa_log_level level, const char *prefix, struct message *m)
 {
 	int res;
@@ -816,11 +814,17 @@ int message_dump(enum spa_log_level level, const char *prefix, struct message *m
 
 struct message *message_alloc(struct impl *impl, uint32_t channel, uint32_t size)
 {
-	struct message *msg;
+	struct message *msg = NULL;
 
+	/* messages are also allocated from the I/O thread */
+	pthread_mutex_lock(&impl->lock);
 	if (!spa_list_is_empty(&impl->free_messages)) {
 		msg = spa_list_first(&impl->free_messages, struct message, link);
 		spa_list_remove(&msg->link);
+	}
+	pthread_mutex_unlock(&impl->lock);
+
+	if (msg != NULL) {
 		pw_log_trace("using recycled message %p size:%d", msg, size);
 
 		spa_assert(msg->impl == impl);
@@ -830,8 +834,10 @@ struct message *message_alloc(struct impl *impl, uint32_t channel, uint32_t size
 
 		pw_log_trace("new message %p size:%d", msg, size);
 		msg->impl = impl;
-		msg->impl->stat.n_allocated++;
-		msg->impl->stat.n_accumulated++;
+		pthread_mutex_lock(&impl->lock);
+		impl->stat.n_allocated++;
+		impl->stat.n_accumulated++;
+		pthread_mutex_unlock(&impl->lock);
 	}
 
 	if (ensure_size(msg, size) < 0) {
@@ -843,27 +849,48 @@ struct message *message_alloc(struct impl *impl, uint32_t channel, uint32_t size
 	msg->channel = channel;
 	msg->offset = 0;
 	msg->length = size;
+	msg->flags = 0;
+	msg->seek = 0;
+	msg->written = false;
+	msg->block_id = 0;
+	msg->n_fds = 0;
+	msg->creds = false;
 
 	return msg;
 }
 
+/* close the fds that were received with a message */
+void message_close_fds(struct message *msg)
+{
+	uint32_t i;
+
+	for (i = 0; i < msg->n_fds; i++)
+		close(msg->fds[i]);
+	msg->n_fds = 0;
+}
+
 void message_free(struct message *msg, bool dequeue, bool destroy)
 {
+	struct impl *impl = msg->impl;
+
 	if (dequeue)
 		spa_list_remove(&msg->link);
 
-	if (msg->impl->stat.allocated > MAX_ALLOCATED || msg->allocated > MAX_SIZE)
+	pthread_mutex_lock(&impl->lock);
+	if (impl->stat.allocated > MAX_ALLOCATED || msg->allocated > MAX_SIZE)
 		destroy = true;
 
 	if (destroy) {
 		pw_log_trace("destroy message %p size:%d", msg, msg->allocated);
-		msg->impl->stat.n_allocated--;
-		msg->impl->stat.allocated -= msg->allocated;
+		impl->stat.n_allocated--;
+		impl->stat.allocated -= msg->allocated;
+		pthread_mutex_unlock(&impl->lock);
 		free(msg->data);
 		free(msg);
 	} else {
 		pw_log_trace("recycle message %p size:%d/%d", msg, msg->length, msg->allocated);
-		spa_list_append(&msg->impl->free_messages, &msg->link);
 		msg->length = 0;
+		spa_list_append(&impl->free_messages, &msg->link);
+		pthread_mutex_unlock(&impl->lock);
 	}
 }
@@ -22,6 +22,14 @@ struct message {
 	uint32_t length;
 	uint32_t offset;
 	uint8_t *data;
+
+	uint32_t flags;		/**< frame flags */
+	int64_t seek;		/**< seek offset of a memblock frame */
+	bool written;		/**< memblock data was written by the I/O thread */
+	uint32_t block_id;	/**< released block for FLAG_SHMRELEASE */
+	int fds[2];		/**< fds to send along (not owned) or received */
+	uint32_t n_fds;
+	bool creds;		/**< send our credentials along */
 };
 
 enum {
@@ -47,9 +55,11 @@ enum {
 };
 
 struct message *message_alloc(struct impl *impl, uint32_t channel, uint32_t size);
+void message_close_fds(struct message *msg);
 void message_free(struct message *msg, bool dequeue, bool destroy);
 int message_get(struct message *m, ...);
 int message_put(struct message *m, ...);
+int message_append(struct message *m, const void *data, uint32_t size);
 int message_dump(enum spa_log_level level, const char *prefix, struct message *m);
 
 #endif /* PULSE_SERVER_MESSAGE_H */
@@ -103,10 +103,14 @@ static const struct client_events client_events = {
 	.disconnect = on_client_disconnect,
 };
 
-int pending_sample_new(struct client *client, struct sample *sample, struct pw_properties *props, uint32_t tag)
+int pending_sample_new(struct client *client, struct sample *sample, struct pw_properties *props,
+		uint64_t target, float volume, uint32_t tag)
 {
 	struct pending_sample *ps;
-	struct sample_play *p = sample_play_new(client->core, sample, props, sizeof(*ps));
+	struct sample_play *p;
+	int res;
+
+	p = sample_play_new(sample, props, target, volume, sizeof(*ps));
 	if (!p)
 		return -errno;
 
@@ -115,6 +119,13 @@ int pending_sample_new(struct client *client, struct sample *sample, struct pw_p
 	ps->play = p;
 	ps->tag = tag;
 	sample_play_add_listener(p, &ps->listener, &sample_play_events, ps);
+
+	if ((res = sample_play_start(p)) < 0) {
+		spa_hook_remove(&ps->listener);
+		sample_play_destroy(p);
+		return res;
+	}
+
 	client_add_listener(client, &ps->client_listener, &client_events, ps);
 	spa_list_append(&client->pending_samples, &ps->link);
 	client->ref++;
@@ -11,7 +11,6 @@
 #include <spa/utils/hook.h>
 
 struct client;
-struct pw_properties;
 struct sample;
 struct sample_play;
 
@@ -26,7 +25,8 @@ struct pending_sample {
 	unsigned done:1;
 };
 
-int pending_sample_new(struct client *client, struct sample *sample, struct pw_properties *props, uint32_t tag);
+int pending_sample_new(struct client *client, struct sample *sample, struct pw_properties *props,
+		uint64_t target, float volume, uint32_t tag);
 void pending_sample_free(struct pending_sample *ps);
 
 #endif /* PULSE_SERVER_PENDING_SAMPLE_H */
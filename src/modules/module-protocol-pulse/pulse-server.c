@@ -51,7 +51,9 @@
 #include "quirks.h"
 #include "reply.h"
 #include "sample.h"
+#include "sample-play.h"
 #include "server.h"
+#include "shm.h"
 #include "stream.h"
 #include "utils.h"
 #include "volume.h"
@@ -65,6 +67,8 @@
 #define DEFAULT_FORMAT		"F32"
 #define DEFAULT_POSITION	"[ FL FR ]"
 #define DEFAULT_IDLE_TIMEOUT	"0"
+#define DEFAULT_MEMFD		"true"
+#define DEFAULT_IO_THREAD	"false"
 
 #define MAX_FORMATS	32
 /* The max amount of data we send in one block when capturing. In PulseAudio this
@@ -115,6 +119,8 @@ static int do_command_auth(struct client *client, uint32_t command, uint32_t tag
 	uint32_t version;
 	const void *cookie;
 	size_t len;
+	bool do_shm = false;
+	int res;
 
 	if (message_get(m,
 			TAG_U32, &version,
@@ -127,20 +133,73 @@ static int do_command_auth(struct client *client, uint32_t command, uint32_t tag
 	if (len != NATIVE_COOKIE_LENGTH)
 		return -EINVAL;
 
-	if ((version & PROTOCOL_VERSION_MASK) >= 13)
+	if ((version & PROTOCOL_VERSION_MASK) >= 13) {
+		/* we only support the memfd flavour of shared memory */
+		do_shm = (version & PROTOCOL_VERSION_MASK) >= 31 &&
+			SPA_FLAG_IS_SET(version, PROTOCOL_FLAG_SHM | PROTOCOL_FLAG_MEMFD);
 		version &= PROTOCOL_VERSION_MASK;
+	}
 
 	client->version = version;
 	client->authenticated = true;
 
-	pw_log_info("client:%p AUTH tag:%u version:%d", client, tag, version);
+	if (do_shm && (!client->impl->defs.memfd || client->source == NULL ||
+	    !client_is_same_user(client, client->source->fd)))
+		do_shm = false;
+
+	pw_log_info("client:%p AUTH tag:%u version:%d shm:%d", client, tag, version, do_shm);
 
 	reply = reply_new(client, tag);
 	message_put(reply,
-			TAG_U32, PROTOCOL_VERSION,
+			TAG_U32, PROTOCOL_VERSION |
+				(do_shm ? PROTOCOL_FLAG_SHM | PROTOCOL_FLAG_MEMFD : 0),
 			TAG_INVALID);
+	/* the client checks our credentials before using our memory */
+	reply->creds = do_shm;
 
-	return client_queue_message(client, reply);
+	if ((res = client_queue_message(client, reply)) < 0)
+		return res;
+
+	if (do_shm && (res = client_enable_shm(client)) < 0)
+		pw_log_warn("client %p: can't enable shm: %s", client, spa_strerror(res));
+
+	return 0;
+}
+
+static int do_register_memfd_shmid(struct client *client, uint32_t command, uint32_t tag, struct message *m)
+{
+	uint32_t shm_id;
+	int fd, res;
+
+	if (message_get(m,
+			TAG_U32, &shm_id,
+			TAG_INVALID) < 0)
+		return -EPROTO;
+
+	if (client->shm == NULL)
+		return -EACCES;
+
+	if ((fd = client_take_fd(client)) < 0)
+		return -EPROTO;
+
+	pw_log_info("[%s] REGISTER_MEMFD_SHMID tag:%u shm_id:%u", client->name, tag, shm_id);
+
+	/* takes ownership of the fd, failures are not fatal, the client
+	 * will keep on sending the data inline */
+	if ((res = shm_attach_segment(client->shm, shm_id, fd)) < 0)
+		pw_log_warn("[%s] can't attach shm_id:%u: %s", client->name,
+				shm_id, spa_strerror(res));
+	return 0;
+}
+
+static int do_enable_srbchannel(struct client *client, uint32_t command, uint32_t tag, struct message *m)
+{
+	pw_log_info("[%s] ENABLE_SRBCHANNEL tag:%u", client->name, tag);
+
+	if (client->shm == NULL || tag != client->srb_tag)
+		return -EPROTO;
+
+	return client_start_srbchannel(client);
 }
 
 static int reply_set_client_name(struct client *client, uint32_t tag)
@@ -246,6 +305,42 @@ static int send_object_event(struct client *client, struct pw_manager_object *o,
 	return 0;
 }
 
+/* Serialized info replies are cached per object. A cache is valid as long as
+ * its generation matches the client generation, which is bumped for changes
+ * that can affect the info of other objects. Client generations start at 1,
+ * a cache with INFO_GENERATION_INVALID never matches. */
+#define INFO_GENERATION_INVALID		0
+
+struct info_cache {
+	uint64_t generation;
+	uint32_t size;
+	uint8_t data[];
+};
+
+#define INFO_CACHE_CLIENT		"info_cache.client"
+#define INFO_CACHE_MODULE		"info_cache.module"
+#define INFO_CACHE_CARD			"info_cache.card"
+#define INFO_CACHE_SINK			"info_cache.sink"
+#define INFO_CACHE_SOURCE		"info_cache.source"
+#define INFO_CACHE_SINK_INPUT		"info_cache.sink_input"
+#define INFO_CACHE_SOURCE_OUTPUT	"info_cache.source_output"
+
+static void invalidate_info_cache(struct pw_manager_object *o)
+{
+	static const char * const keys[] = {
+		INFO_CACHE_CLIENT, INFO_CACHE_MODULE, INFO_CACHE_CARD,
+		INFO_CACHE_SINK, INFO_CACHE_SOURCE, INFO_CACHE_SINK_INPUT,
+		INFO_CACHE_SOURCE_OUTPUT,
+	};
+	struct info_cache *c;
+	uint32_t i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(keys); i++) {
+		if ((c = pw_manager_object_get_data(o, keys[i])) != NULL)
+			c->generation = INFO_GENERATION_INVALID;
+	}
+}
+
 static uint32_t get_temporary_move_target(struct client *client, struct pw_manager_object *o)
 {
 	struct temporary_move_data *d;
@@ -271,8 +366,10 @@ static void set_temporary_move_target(struct client *client, struct pw_manager_o
 		d = pw_manager_object_get_data(o, "temporary_move_data");
 		if (d == NULL)
 			return;
-		if (d->peer_index != SPA_ID_INVALID)
+		if (d->peer_index != SPA_ID_INVALID) {
 			pw_log_debug("cleared temporary move target for index:%d", o->index);
+			invalidate_info_cache(o);
+		}
 		d->peer_index = SPA_ID_INVALID;
 		d->used = false;
 		return;
@@ -288,6 +385,8 @@ static void set_temporary_move_target(struct client *client, struct pw_manager_o
 			client->name, o->index, index);
 	d->peer_index = index;
 	d->used = false;
+
+	invalidate_info_cache(o);
 }
 
 static void temporary_move_target_timeout(struct client *client, struct pw_manager_object *o)
@@ -576,6 +675,12 @@ static int reply_create_playback_stream(struct stream *stream, struct pw_manager
 
 	lat_usec = set_playback_buffer_attr(stream, &stream->attr);
 
+	/* the stream is complete, the I/O thread can now write the data
+	 * of the client into the ringbuffer */
+	impl_io_lock(client->impl);
+	stream->io_ready = true;
+	impl_io_unlock(client->impl);
+
 	missing = stream_pop_missing(stream);
 	stream->index = id_to_index(manager, stream->id);
 	stream->lat_usec = lat_usec;
@@ -877,6 +982,9 @@ static void manager_added(void *data, struct pw_manager_object *o)
 
 	update_object_info(manager, o, &impl->defs);
 
+	/* new objects change the indexes and links in the info of others */
+	client->info_generation++;
+
 	send_object_event(client, o, SUBSCRIPTION_EVENT_NEW);
 
 	o->change_mask = 0;
@@ -893,6 +1001,12 @@ static void manager_updated(void *data, struct pw_manager_object *o)
 
 	update_object_info(manager, o, &impl->defs);
 
+	/* the sink and source info contains the ports of the card */
+	if (pw_manager_object_is_card(o))
+		client->info_generation++;
+	else
+		invalidate_info_cache(o);
+
 	send_object_event(client, o, SUBSCRIPTION_EVENT_CHANGE);
 
 	o->change_mask = 0;
@@ -908,6 +1022,8 @@ static void manager_removed(void *data, struct pw_manager_object *o)
 	struct client *client = data;
 	const char *str;
 
+	client->info_generation++;
+
 	send_object_event(client, o, SUBSCRIPTION_EVENT_REMOVE);
 
 	send_default_change_subscribe_event(client, pw_manager_object_is_sink(o), pw_manager_object_is_source_or_monitor(o));
@@ -1279,7 +1395,6 @@ do_process_done(struct spa_loop *loop,
 {
 	struct stream *stream = user_data;
 	struct client *client = stream->client;
-	struct impl *impl = client->impl;
 	const struct process_data *pd = data;
 	uint32_t index, towrite;
 	int32_t avail;
@@ -1328,6 +1443,7 @@ do_process_done(struct spa_loop *loop,
 		stream_send_request(stream);
 	} else {
 		struct message *msg;
+		void *dst;
 		stream->write_index += pd->write_inc;
 
 		avail = spa_ringbuffer_get_read_index(&stream->ring, &index);
@@ -1360,14 +1476,14 @@ do_process_done(struct spa_loop *loop,
 				towrite = SPA_MIN(towrite, stream->attr.fragsize);
 				towrite = SPA_ROUND_DOWN(towrite, stream->frame_size);
 
-				msg = message_alloc(impl, stream->channel, towrite);
+				msg = client_alloc_memblock(client, stream->channel, towrite, &dst);
 				if (msg == NULL)
 					return -errno;
 
 				spa_ringbuffer_read_data(&stream->ring,
 						stream->buffer, MAXLENGTH,
 						index % MAXLENGTH,
-						msg->data, towrite);
+						dst, towrite);
 
 				client_queue_message(client, msg);
 
@@ -2332,10 +2448,11 @@ error:
 static int do_finish_upload_stream(struct client *client, uint32_t command, uint32_t tag, struct message *m)
 {
 	struct impl *impl = client->impl;
-	uint32_t channel, event;
+	uint32_t channel, event, n_frames;
 	struct stream *stream;
-	struct sample *sample;
+	struct sample *sample = NULL;
 	const char *name;
+	float *data;
 	int res;
 
 	if (message_get(m,
@@ -2357,6 +2474,10 @@ static int do_finish_upload_stream(struct client *client, uint32_t command, uint
 			client->name, commands[command].name, tag,
 			channel, name);
 
+	data = sample_decode(&stream->ss, stream->buffer, stream->attr.maxlength, &n_frames);
+	if (data == NULL)
+		goto error_errno;
+
 	struct sample *old = find_sample(impl, SPA_ID_INVALID, name);
 	if (old == NULL || old->ref > 1) {
 		sample = calloc(1, sizeof(*sample));
@@ -2376,8 +2497,8 @@ static int do_finish_upload_stream(struct client *client, uint32_t command, uint
 		}
 	} else {
 		pw_properties_free(old->props);
-		free(old->buffer);
-		impl->stat.sample_cache -= old->length;
+		free(old->data);
+		impl->stat.sample_cache -= sample_data_size(old);
 
 		sample = old;
 	}
@@ -2393,13 +2514,13 @@ static int do_finish_upload_stream(struct client *client, uint32_t command, uint
 	sample->props = stream->props;
 	sample->ss = stream->ss;
 	sample->map = stream->map;
-	sample->buffer = stream->buffer;
 	sample->length = stream->attr.maxlength;
+	sample->n_frames = n_frames;
+	sample->data = data;
 
-	impl->stat.sample_cache += sample->length;
+	impl->stat.sample_cache += sample_data_size(sample);
 
 	stream->props = NULL;
-	stream->buffer = NULL;
 	stream_free(stream);
 
 	broadcast_subscribe_event(impl,
@@ -2412,6 +2533,7 @@ static int do_finish_upload_stream(struct client *client, uint32_t command, uint
 error_errno:
 	res = -errno;
 	free(sample);
+	free(data);
 	goto error;
 error_invalid:
 	res = -EINVAL;
@@ -2570,9 +2692,9 @@ static int do_play_sample(struct client *client, uint32_t command, uint32_t tag,
 			return -EPROTO;
 
 	}
-	pw_log_info("[%s] %s tag:%u sink_index:%u sink_name:%s name:%s",
+	pw_log_info("[%s] %s tag:%u sink_index:%u sink_name:%s name:%s volume:%u",
 			client->name, commands[command].name, tag,
-			sink_index, sink_name, name);
+			sink_index, sink_name, name, volume);
 
 	pw_properties_update(props, &client->props->dict);
 
@@ -2587,9 +2709,8 @@ static int do_play_sample(struct client *client, uint32_t command, uint32_t tag,
 	if (sample == NULL)
 		return -ENOENT;
 
-	pw_properties_setf(props, PW_KEY_TARGET_OBJECT, "%"PRIu64, o->serial);
-
-	return pending_sample_new(client, sample, spa_steal_ptr(props), tag);
+	return pending_sample_new(client, sample, spa_steal_ptr(props), o->serial,
+			volume == VOLUME_INVALID ? 1.0f : volume_to_linear(volume), tag);
 }
 
 static int do_remove_sample(struct client *client, uint32_t command, uint32_t tag, struct message *m)
@@ -4177,6 +4298,37 @@ static int fill_source_output_info(struct client *client, struct message *m,
 	return 0;
 }
 
+static int fill_info_cached(struct client *client, struct message *m,
+		struct pw_manager_object *o, const char *key,
+		int (*fill_func) (struct client *client, struct message *m, struct pw_manager_object *o))
+{
+	struct info_cache *c;
+	uint32_t start = m->length, size;
+	int res;
+
+	/* the info of moved streams is not cached because using the temporary
+	 * target has side effects */
+	if (get_temporary_move_target(client, o) != SPA_ID_INVALID)
+		return fill_func(client, m, o);
+
+	c = pw_manager_object_get_data(o, key);
+	if (c != NULL && c->generation != INFO_GENERATION_INVALID &&
+	    c->generation == client->info_generation)
+		return message_append(m, c->data, c->size);
+
+	if ((res = fill_func(client, m, o)) < 0 || m->length > m->allocated)
+		return res;
+
+	size = m->length - start;
+	c = pw_manager_object_add_data(o, key, sizeof(*c) + size);
+	if (c != NULL) {
+		c->generation = client->info_generation;
+		c->size = size;
+		memcpy(c->data, m->data + start, size);
+	}
+	return 0;
+}
+
 static int do_get_info(struct client *client, uint32_t command, uint32_t tag, struct message *m)
 {
 	struct impl *impl = client->impl;
@@ -4186,6 +4338,7 @@ static int do_get_info(struct client *client, uint32_t command, uint32_t tag, st
 	struct pw_manager_object *o;
 	struct selector sel;
 	int (*fill_func) (struct client *client, struct message *m, struct pw_manager_object *o) = NULL;
+	const char *cache_key = NULL;
 
 	spa_zero(sel);
 
@@ -4209,33 +4362,40 @@ static int do_get_info(struct client *client, uint32_t command, uint32_t tag, st
 	case COMMAND_GET_CLIENT_INFO:
 		sel.type = pw_manager_object_is_client;
 		fill_func = fill_client_info;
+		cache_key = INFO_CACHE_CLIENT;
 		break;
 	case COMMAND_GET_MODULE_INFO:
 		sel.type = pw_manager_object_is_module;
 		fill_func = fill_module_info;
+		cache_key = INFO_CACHE_MODULE;
 		break;
 	case COMMAND_GET_CARD_INFO:
 		sel.type = pw_manager_object_is_card;
 		sel.key = PW_KEY_DEVICE_NAME;
 		fill_func = fill_card_info;
+		cache_key = INFO_CACHE_CARD;
 		break;
 	case COMMAND_GET_SINK_INFO:
 		sel.type = pw_manager_object_is_sink;
 		sel.key = PW_KEY_NODE_NAME;
 		fill_func = fill_sink_info;
+		cache_key = INFO_CACHE_SINK;
 		break;
 	case COMMAND_GET_SOURCE_INFO:
 		sel.type = pw_manager_object_is_source_or_monitor;
 		sel.key = PW_KEY_NODE_NAME;
 		fill_func = fill_source_info;
+		cache_key = INFO_CACHE_SOURCE;
 		break;
 	case COMMAND_GET_SINK_INPUT_INFO:
 		sel.type = pw_manager_object_is_sink_input;
 		fill_func = fill_sink_input_info;
+		cache_key = INFO_CACHE_SINK_INPUT;
 		break;
 	case COMMAND_GET_SOURCE_OUTPUT_INFO:
 		sel.type = pw_manager_object_is_source_output;
 		fill_func = fill_source_output_info;
+		cache_key = INFO_CACHE_SOURCE_OUTPUT;
 		break;
 	}
 	if (sel.key) {
@@ -4264,7 +4424,7 @@ static int do_get_info(struct client *client, uint32_t command, uint32_t tag, st
 	if (o == NULL)
 		goto error_noentity;
 
-	if ((res = fill_func(client, reply, o)) < 0)
+	if ((res = fill_info_cached(client, reply, o, cache_key, fill_func)) < 0)
 		goto error;
 
 	return client_queue_message(client, reply);
@@ -4383,12 +4543,14 @@ struct info_list_data {
 	struct client *client;
 	struct message *reply;
 	int (*fill_func) (struct client *client, struct message *m, struct pw_manager_object *o);
+	const char *cache_key;
 };
 
 static int do_list_info(void *data, struct pw_manager_object *object)
 {
 	struct info_list_data *info = data;
-	info->fill_func(info->client, info->reply, object);
+	fill_info_cached(info->client, info->reply, object,
+			info->cache_key, info->fill_func);
 	return 0;
 }
 
@@ -4405,34 +4567,44 @@ static int do_get_info_list(struct client *client, uint32_t command, uint32_t ta
 	struct impl *impl = client->impl;
 	struct pw_manager *manager = client->manager;
 	struct info_list_data info;
+	struct timespec ts[2];
 
 	pw_log_info("[%s] %s tag:%u", client->name,
 			commands[command].name, tag);
 
+	clock_gettime(CLOCK_MONOTONIC, &ts[0]);
+
 	spa_zero(info);
 	info.client = client;
 
 	switch (command) {
 	case COMMAND_GET_CLIENT_INFO_LIST:
 		info.fill_func = fill_client_info;
+		info.cache_key = INFO_CACHE_CLIENT;
 		break;
 	case COMMAND_GET_MODULE_INFO_LIST:
 		info.fill_func = fill_module_info;
+		info.cache_key = INFO_CACHE_MODULE;
 		break;
 	case COMMAND_GET_CARD_INFO_LIST:
 		info.fill_func = fill_card_info;
+		info.cache_key = INFO_CACHE_CARD;
 		break;
 	case COMMAND_GET_SINK_INFO_LIST:
 		info.fill_func = fill_sink_info;
+		info.cache_key = INFO_CACHE_SINK;
 		break;
 	case COMMAND_GET_SOURCE_INFO_LIST:
 		info.fill_func = fill_source_info;
+		info.cache_key = INFO_CACHE_SOURCE;
 		break;
 	case COMMAND_GET_SINK_INPUT_INFO_LIST:
 		info.fill_func = fill_sink_input_info;
+		info.cache_key = INFO_CACHE_SINK_INPUT;
 		break;
 	case COMMAND_GET_SOURCE_OUTPUT_INFO_LIST:
 		info.fill_func = fill_source_output_info;
+		info.cache_key = INFO_CACHE_SOURCE_OUTPUT;
 		break;
 	default:
 		return -ENOTSUP;
@@ -4445,6 +4617,11 @@ static int do_get_info_list(struct client *client, uint32_t command, uint32_t ta
 	if (command == COMMAND_GET_MODULE_INFO_LIST)
 		pw_map_for_each(&impl->modules, do_info_list_module, &info);
 
+	clock_gettime(CLOCK_MONOTONIC, &ts[1]);
+	pw_log_debug("[%s] %s: %u objects, %u bytes in %"PRIi64"ns", client->name,
+			commands[command].name, manager->n_objects, info.reply->length,
+			(int64_t)(SPA_TIMESPEC_TO_NSEC(&ts[1]) - SPA_TIMESPEC_TO_NSEC(&ts[0])));
+
 	return client_queue_message(client, info.reply);
 }
 
@@ -5307,12 +5484,12 @@ const struct command commands[COMMAND_MAX] =
 
 	/* Supported since protocol v30 (6.0) */
 	/* BOTH DIRECTIONS */
-	COMMAND(ENABLE_SRBCHANNEL, do_error_access),
+	COMMAND(ENABLE_SRBCHANNEL, do_enable_srbchannel, COMMAND_ACCESS_WITHOUT_MANAGER),
 	COMMAND(DISABLE_SRBCHANNEL, do_error_access),
 
 	/* Supported since protocol v31 (9.0)
 	 * BOTH DIRECTIONS */
-	COMMAND(REGISTER_MEMFD_SHMID, do_error_access),
+	COMMAND(REGISTER_MEMFD_SHMID, do_register_memfd_shmid, COMMAND_ACCESS_WITHOUT_MANAGER),
 
 	/* Supported since protocol v35 (15.0) */
 	COMMAND(SEND_OBJECT_MESSAGE, do_send_object_message),
@@ -5351,9 +5528,13 @@ static void impl_clear(struct impl *impl)
 	spa_list_consume(c, &impl->cleanup_clients, link)
 		client_free(c);
 
+	servers_stop_io(impl);
+
 	spa_list_consume(msg, &impl->free_messages, link)
 		message_free(msg, true, true);
 
+	sample_mixers_destroy(impl);
+
 	pw_map_for_each(&impl->samples, impl_free_sample, impl);
 	pw_map_clear(&impl->samples);
 
@@ -5378,6 +5559,7 @@ static void impl_clear(struct impl *impl)
 static void impl_free(struct impl *impl)
 {
 	impl_clear(impl);
+	pthread_mutex_destroy(&impl->lock);
 	free(impl);
 }
 
@@ -5450,6 +5632,18 @@ static int parse_uint32(struct pw_properties *props, const char *key, const char
 	return 0;
 }
 
+static int parse_bool(struct pw_properties *props, const char *key, const char *def,
+		bool *res)
+{
+	const char *str;
+	if (props == NULL ||
+	    (str = pw_properties_get(props, key)) == NULL)
+		str = def;
+	*res = spa_atob(str);
+	pw_log_info(": defaults: %s = %s", key, *res ? "true" : "false");
+	return 0;
+}
+
 static void load_defaults(struct defs *def, struct pw_properties *props)
 {
 	parse_frac(props, "pulse.min.req", DEFAULT_MIN_REQ, &def->min_req);
@@ -5461,6 +5655,8 @@ static void load_defaults(struct defs *def, struct pw_properties *props)
 	parse_format(props, "pulse.default.format", DEFAULT_FORMAT, &def->sample_spec);
 	parse_position(props, "pulse.default.position", DEFAULT_POSITION, &def->channel_map);
 	parse_uint32(props, "pulse.idle.timeout", DEFAULT_IDLE_TIMEOUT, &def->idle_timeout);
+	parse_bool(props, "pulse.memfd", DEFAULT_MEMFD, &def->memfd);
+	parse_bool(props, "pulse.io-thread", DEFAULT_IO_THREAD, &def->io_thread);
 	def->sample_spec.channels = def->channel_map.channels;
 	def->quantum_limit = 8192;
 }
@@ -5487,6 +5683,9 @@ struct pw_protocol_pulse *pw_protocol_pulse_new(struct pw_context *context,
 	pw_map_init(&impl->modules, 16, 16);
 	spa_list_init(&impl->cleanup_clients);
 	spa_list_init(&impl->free_messages);
+	spa_list_init(&impl->io_clients);
+	spa_list_init(&impl->sample_mixers);
+	pthread_mutex_init(&impl->lock, NULL);
 
 	impl->loop = pw_context_get_main_loop(context);
 	impl->work_queue = pw_context_get_work_queue(context);
@@ -5541,6 +5740,10 @@ struct pw_protocol_pulse *pw_protocol_pulse_new(struct pw_context *context,
 	load_defaults(&impl->defs, props);
 	impl->props = spa_steal_ptr(props);
 
+	if (impl->defs.io_thread && (res = servers_start_io(impl)) < 0)
+		pw_log_warn("%p: can't start I/O thread: %s",
+				impl, spa_strerror(res));
+
 	pw_context_add_listener(context, &impl->context_listener,
 			&context_events, impl);
 	impl->context = context;
@@ -4,156 +4,378 @@
 
 #include <stdint.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <spa/node/io.h>
 #include <spa/param/audio/raw.h>
 #include <spa/pod/builder.h>
 #include <spa/utils/hook.h>
+#include <spa/utils/ringbuffer.h>
+#include <spa/utils/string.h>
 #include <pipewire/context.h>
 #include <pipewire/core.h>
+#include <pipewire/keys.h>
 #include <pipewire/log.h>
+#include <pipewire/loop.h>
 #include <pipewire/properties.h>
 #include <pipewire/stream.h>
 
 #include "format.h"
+#include "internal.h"
 #include "log.h"
 #include "sample.h"
 #include "sample-play.h"
 
-static void sample_play_stream_state_changed(void *data, enum pw_stream_state old,
-					     enum pw_stream_state state, const char *error)
+/* must be a power of 2 */
+#define MAX_PLAYS	64u
+/* keep an idle mixer stream around for this long */
+#define IDLE_TIMEOUT	(10 * SPA_NSEC_PER_SEC)
+
+/* A long lived stream to a sink that mixes all plays of samples with the
+ * same rate, channel layout and media role. The stream has the properties
+ * of the latest play. New plays are passed to the data thread and finished
+ * plays are passed back to the main thread with lockless ringbuffers. A
+ * play is owned by the data thread between the two. */
+struct sample_mixer {
+	struct spa_list link;
+	struct impl *impl;
+	struct pw_loop *main_loop;
+
+	uint64_t target;
+	char *role;
+	struct sample_spec ss;
+	struct channel_map map;
+
+	struct pw_stream *stream;
+	struct spa_hook listener;
+	uint32_t id;
+
+	struct spa_list plays;
+	uint32_t n_active;		/**< plays owned by the data thread */
+	struct spa_source *done_event;
+	struct spa_source *idle_timer;
+
+	struct spa_ringbuffer start_ring;
+	struct sample_play *start[MAX_PLAYS];
+	struct spa_ringbuffer done_ring;
+	struct sample_play *done[MAX_PLAYS];
+
+	struct spa_list rt_plays;
+
+	unsigned int active:1;
+	unsigned int failed:1;
+};
+
+static void ring_push(struct spa_ringbuffer *ring, struct sample_play **items,
+		struct sample_play *p)
+{
+	uint32_t index;
+
+	spa_ringbuffer_get_write_index(ring, &index);
+	items[index & (MAX_PLAYS - 1)] = p;
+	spa_ringbuffer_write_update(ring, index + 1);
+}
+
+static struct sample_play *ring_pop(struct spa_ringbuffer *ring, struct sample_play **items)
+{
+	struct sample_play *p;
+	uint32_t index;
+
+	if (spa_ringbuffer_get_read_index(ring, &index) <= 0)
+		return NULL;
+
+	p = items[index & (MAX_PLAYS - 1)];
+	spa_ringbuffer_read_update(ring, index + 1);
+	return p;
+}
+
+static void play_free(struct sample_play *p)
+{
+	if (p->mixer)
+		spa_list_remove(&p->link);
+
+	spa_hook_list_clean(&p->hooks);
+	sample_unref(p->sample);
+	free(p);
+}
+
+static void play_ready(struct sample_play *p, uint32_t id)
+{
+	if (p->ready || p->destroyed)
+		return;
+
+	p->ready = true;
+	p->id = id;
+	sample_play_emit_ready(p, id);
+}
+
+static void play_done(struct sample_play *p, int res)
+{
+	if (p->done || p->destroyed)
+		return;
+
+	p->done = true;
+	sample_play_emit_done(p, res);
+}
+
+static void mixer_update_timer(struct sample_mixer *m, uint64_t nsec)
+{
+	struct timespec timeout = {0}, interval = {0};
+
+	timeout.tv_sec = nsec / SPA_NSEC_PER_SEC;
+	timeout.tv_nsec = nsec % SPA_NSEC_PER_SEC;
+	pw_loop_update_timer(m->main_loop, m->idle_timer, &timeout, &interval, false);
+}
+
+static void mixer_set_active(struct sample_mixer *m, bool active)
+{
+	if (m->active == active)
+		return;
+
+	m->active = active;
+	mixer_update_timer(m, active ? 0 : IDLE_TIMEOUT);
+	pw_stream_set_active(m->stream, active);
+}
+
+static void mixer_destroy(struct sample_mixer *m)
 {
-	struct sample_play *p = data;
+	struct sample_play *p;
+
+	pw_log_info("destroy sample mixer %p id:%u target:%"PRIu64,
+			m, m->id, m->target);
+
+	spa_list_remove(&m->link);
+
+	/* after this, the data thread no longer has any of the plays */
+	if (m->stream) {
+		spa_hook_remove(&m->listener);
+		pw_stream_destroy(m->stream);
+	}
+	if (m->done_event)
+		pw_loop_destroy_source(m->main_loop, m->done_event);
+	if (m->idle_timer)
+		pw_loop_destroy_source(m->main_loop, m->idle_timer);
+
+	spa_list_consume(p, &m->plays, link) {
+		spa_list_remove(&p->link);
+		p->mixer = NULL;
+		p->finished = true;
+
+		if (p->destroyed)
+			play_free(p);
+		else if (p->started)
+			play_done(p, -EIO);
+	}
+	free(m->role);
+	free(m);
+}
+
+static void mixer_fail(struct sample_mixer *m, int res)
+{
+	struct sample_play *p, *t;
+
+	if (m->failed)
+		return;
+
+	m->failed = true;
+
+	spa_list_for_each_safe(p, t, &m->plays, link)
+		if (p->started && !p->finished)
+			play_done(p, res);
+
+	/* we can't destroy the stream from its callbacks */
+	mixer_update_timer(m, 1);
+}
+
+static void mixer_on_idle_timeout(void *data, uint64_t expirations)
+{
+	struct sample_mixer *m = data;
+
+	if (m->failed || m->n_active == 0)
+		mixer_destroy(m);
+}
+
+static void mixer_on_done(void *data, uint64_t count)
+{
+	struct sample_mixer *m = data;
+	struct sample_play *p;
+
+	while ((p = ring_pop(&m->done_ring, m->done)) != NULL) {
+		p->finished = true;
+		m->n_active--;
+
+		if (p->destroyed)
+			play_free(p);
+		else
+			play_done(p, 0);
+	}
+	if (m->n_active == 0 && !m->failed)
+		mixer_set_active(m, false);
+}
+
+static void mixer_stream_state_changed(void *data, enum pw_stream_state old,
+				       enum pw_stream_state state, const char *error)
+{
+	struct sample_mixer *m = data;
+	struct sample_play *p, *t;
 
 	switch (state) {
 	case PW_STREAM_STATE_UNCONNECTED:
 	case PW_STREAM_STATE_ERROR:
-		sample_play_emit_done(p, -EIO);
+		mixer_fail(m, -EIO);
 		break;
 	case PW_STREAM_STATE_PAUSED:
-		p->id = pw_stream_get_node_id(p->stream);
-		sample_play_emit_ready(p, p->id);
+	case PW_STREAM_STATE_STREAMING:
+		m->id = pw_stream_get_node_id(m->stream);
+		spa_list_for_each_safe(p, t, &m->plays, link)
+			if (p->started)
+				play_ready(p, m->id);
 		break;
 	default:
 		break;
 	}
 }
 
-static void sample_play_stream_destroy(void *data)
+static void mixer_stream_process(void *data)
 {
-	struct sample_play *p = data;
-
-	pw_log_info("destroy %s", p->sample->name);
-
-	spa_hook_remove(&p->listener);
-	p->stream = NULL;
-
-	sample_unref(p->sample);
-	p->sample = NULL;
-}
-
-static void sample_play_stream_process(void *data)
-{
-	struct sample_play *p = data;
-	struct sample *s = p->sample;
+	struct sample_mixer *m = data;
+	struct sample_play *p, *t;
 	struct pw_buffer *b;
 	struct spa_buffer *buf;
-	uint32_t size;
-	uint8_t *d;
+	uint32_t i, c, n_frames = UINT32_MAX;
+	bool signal = false;
 
-	if (p->offset >= s->length) {
-		pw_stream_flush(p->stream, true);
-		return;
-	}
+	while ((p = ring_pop(&m->start_ring, m->start)) != NULL)
+		spa_list_append(&m->rt_plays, &p->rt_link);
 
-	size = s->length - p->offset;
-
-	if ((b = pw_stream_dequeue_buffer(p->stream)) == NULL) {
+	if ((b = pw_stream_dequeue_buffer(m->stream)) == NULL) {
 		pw_log_warn("out of buffers: %m");
 		return;
 	}
-
 	buf = b->buffer;
-	if ((d = buf->datas[0].data) == NULL)
-		return;
 
-	size = SPA_MIN(size, buf->datas[0].maxsize);
+	for (c = 0; c < buf->n_datas; c++)
+		n_frames = SPA_MIN(n_frames, buf->datas[c].maxsize / sizeof(float));
 	if (b->requested)
-		size = SPA_MIN(size, b->requested * p->stride);
+		n_frames = SPA_MIN(n_frames, b->requested);
 
-	memcpy(d, s->buffer + p->offset, size);
+	for (c = 0; c < buf->n_datas; c++) {
+		struct spa_data *d = &buf->datas[c];
 
-	p->offset += size;
+		if (d->data != NULL)
+			memset(d->data, 0, n_frames * sizeof(float));
 
-	buf->datas[0].chunk->offset = 0;
-	buf->datas[0].chunk->stride = p->stride;
-	buf->datas[0].chunk->size = size;
+		d->chunk->offset = 0;
+		d->chunk->stride = sizeof(float);
+		d->chunk->size = n_frames * sizeof(float);
+	}
 
-	pw_stream_queue_buffer(p->stream, b);
-}
+	spa_list_for_each_safe(p, t, &m->rt_plays, rt_link) {
+		const struct sample *s = p->sample;
+		uint32_t n = SPA_MIN(n_frames, s->n_frames - p->offset);
 
-static void sample_play_stream_drained(void *data)
-{
-	struct sample_play *p = data;
+		for (c = 0; c < buf->n_datas && c < s->ss.channels; c++) {
+			const float *src = s->data + (size_t)c * s->n_frames + p->offset;
+			float *dst = buf->datas[c].data;
+
+			if (dst == NULL)
+				continue;
 
-	sample_play_emit_done(p, 0);
+			for (i = 0; i < n; i++)
+				dst[i] += src[i] * p->volume;
+		}
+		p->offset += n;
+
+		if (p->offset >= s->n_frames) {
+			spa_list_remove(&p->rt_link);
+			ring_push(&m->done_ring, m->done, p);
+			signal = true;
+		}
+	}
+
+	pw_stream_queue_buffer(m->stream, b);
+
+	if (signal)
+		pw_loop_signal_event(m->main_loop, m->done_event);
 }
 
-static const struct pw_stream_events sample_play_stream_events = {
+static const struct pw_stream_events mixer_stream_events = {
 	PW_VERSION_STREAM_EVENTS,
-	.state_changed = sample_play_stream_state_changed,
-	.destroy = sample_play_stream_destroy,
-	.process = sample_play_stream_process,
-	.drained = sample_play_stream_drained,
+	.state_changed = mixer_stream_state_changed,
+	.process = mixer_stream_process,
 };
 
-struct sample_play *sample_play_new(struct pw_core *core,
-				    struct sample *sample, struct pw_properties *props,
-				    size_t user_data_size)
+static struct pw_core *get_core(struct impl *impl)
 {
-	struct sample_play *p;
+	if (impl->sample_core == NULL)
+		impl->sample_core = pw_context_connect(impl->context, NULL, 0);
+	return impl->sample_core;
+}
+
+static struct sample_mixer *mixer_new(struct impl *impl, const struct sample *sample,
+		const struct pw_properties *play_props, uint64_t target)
+{
+	struct sample_mixer *m;
+	struct pw_core *core;
+	struct pw_properties *props;
+	const char *role;
 	uint8_t buffer[1024];
 	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
 	const struct spa_pod *params[1];
 	uint32_t n_params = 0;
 	int res;
 
-	p = calloc(1, sizeof(*p) + user_data_size);
-	if (p == NULL) {
-		res = -errno;
-		goto error_free;
-	}
-
-	p->context = pw_core_get_context(core);
-	p->main_loop = pw_context_get_main_loop(p->context);
-	spa_hook_list_init(&p->hooks);
-	p->user_data = SPA_PTROFF(p, sizeof(struct sample_play), void);
-
-	pw_properties_update(props, &sample->props->dict);
-
-	p->stream = pw_stream_new(core, sample->name, props);
-	props = NULL;
-	if (p->stream == NULL) {
-		res = -errno;
-		goto error_free;
-	}
-
-	/* safe to increment the reference count here because it will be decreased
-	   by the stream's 'destroy' event handler, which will be called
-	   (even if `pw_stream_connect()` fails) */
-	p->sample = sample_ref(sample);
-	p->stride = sample_spec_frame_size(&sample->ss);
-
-	pw_stream_add_listener(p->stream,
-			&p->listener,
-			&sample_play_stream_events, p);
+	if ((core = get_core(impl)) == NULL)
+		return NULL;
+
+	if ((m = calloc(1, sizeof(*m))) == NULL)
+		return NULL;
+
+	m->impl = impl;
+	m->main_loop = impl->loop;
+	m->target = target;
+	m->id = SPA_ID_INVALID;
+	m->ss = SAMPLE_SPEC_INIT;
+	m->ss.format = SPA_AUDIO_FORMAT_F32P;
+	m->ss.rate = sample->ss.rate;
+	m->ss.channels = sample->ss.channels;
+	m->map = sample->map;
+	spa_list_init(&m->plays);
+	spa_list_init(&m->rt_plays);
+	spa_ringbuffer_init(&m->start_ring);
+	spa_ringbuffer_init(&m->done_ring);
+	spa_list_append(&impl->sample_mixers, &m->link);
+
+	role = pw_properties_get(play_props, PW_KEY_MEDIA_ROLE);
+	if (role != NULL && (m->role = strdup(role)) == NULL)
+		goto error_errno;
+
+	m->done_event = pw_loop_add_event(m->main_loop, mixer_on_done, m);
+	m->idle_timer = pw_loop_add_timer(m->main_loop, mixer_on_idle_timeout, m);
+	if (m->done_event == NULL || m->idle_timer == NULL)
+		goto error_errno;
+
+	props = pw_properties_copy(play_props);
+	if (props == NULL)
+		goto error_errno;
+	pw_properties_setf(props, PW_KEY_TARGET_OBJECT, "%"PRIu64, target);
+
+	m->stream = pw_stream_new(core, sample->name, props);
+	if (m->stream == NULL)
+		goto error_errno;
+
+	pw_stream_add_listener(m->stream,
+			&m->listener,
+			&mixer_stream_events, m);
 
 	params[n_params++] = format_build_param(&b, SPA_PARAM_EnumFormat,
-			&sample->ss, &sample->map);
+			&m->ss, &m->map);
 
-	res = pw_stream_connect(p->stream,
+	m->active = true;
+	res = pw_stream_connect(m->stream,
 			PW_DIRECTION_OUTPUT,
 			PW_ID_ANY,
 			PW_STREAM_FLAG_AUTOCONNECT |
@@ -161,27 +383,123 @@ struct sample_play *sample_play_new(struct pw_core *core,
 			PW_STREAM_FLAG_RT_PROCESS,
 			params, n_params);
 	if (res < 0)
-		goto error_cleanup;
+		goto error;
+
+	pw_log_info("new sample mixer %p target:%"PRIu64" rate:%u channels:%u",
+			m, target, m->ss.rate, m->ss.channels);
+
+	return m;
+
+error_errno:
+	res = -errno;
+error:
+	mixer_destroy(m);
+	errno = -res;
+	return NULL;
+}
+
+static struct sample_mixer *mixer_find(struct impl *impl, const struct sample *sample,
+		const char *role, uint64_t target)
+{
+	struct sample_mixer *m;
+
+	spa_list_for_each(m, &impl->sample_mixers, link) {
+		if (m->failed || m->target != target ||
+		    !spa_streq(m->role, role) ||
+		    m->ss.rate != sample->ss.rate ||
+		    m->ss.channels != sample->ss.channels ||
+		    memcmp(m->map.map, sample->map.map,
+			    sample->map.channels * sizeof(sample->map.map[0])) != 0)
+			continue;
+		return m;
+	}
+	return NULL;
+}
+
+struct sample_play *sample_play_new(struct sample *sample, struct pw_properties *props,
+				    uint64_t target, float volume, size_t user_data_size)
+{
+	struct impl *impl = sample->impl;
+	struct sample_mixer *m;
+	struct sample_play *p;
+	const char *role;
+	int res;
+
+	if (sample->data == NULL) {
+		res = -ENOTSUP;
+		goto error;
+	}
+
+	pw_properties_update(props, &sample->props->dict);
+	role = pw_properties_get(props, PW_KEY_MEDIA_ROLE);
+
+	if ((m = mixer_find(impl, sample, role, target)) != NULL) {
+		pw_stream_update_properties(m->stream, &props->dict);
+	} else if ((m = mixer_new(impl, sample, props, target)) == NULL) {
+		res = -errno;
+		goto error;
+	}
+	pw_properties_free(props);
+	props = NULL;
+
+	if ((p = calloc(1, sizeof(*p) + user_data_size)) == NULL) {
+		res = -errno;
+		if (m->n_active == 0)
+			mixer_set_active(m, false);
+		goto error;
+	}
+
+	p->mixer = m;
+	p->sample = sample_ref(sample);
+	p->id = SPA_ID_INVALID;
+	p->volume = volume;
+	spa_hook_list_init(&p->hooks);
+	p->user_data = SPA_PTROFF(p, sizeof(struct sample_play), void);
+	spa_list_append(&m->plays, &p->link);
 
 	return p;
 
-error_cleanup:
-	pw_stream_destroy(p->stream);
-error_free:
+error:
 	pw_properties_free(props);
-	free(p);
 	errno = -res;
 	return NULL;
 }
 
-void sample_play_destroy(struct sample_play *p)
+int sample_play_start(struct sample_play *p)
 {
-	if (p->stream)
-		pw_stream_destroy(p->stream);
+	struct sample_mixer *m = p->mixer;
 
-	spa_hook_list_clean(&p->hooks);
+	if (m == NULL || m->failed)
+		return -EIO;
+	if (p->started)
+		return -EBUSY;
+	if (m->n_active >= MAX_PLAYS)
+		return -ENOSPC;
 
-	free(p);
+	pw_log_info("start %s on sample mixer %p", p->sample->name, m);
+
+	p->started = true;
+	m->n_active++;
+	ring_push(&m->start_ring, m->start, p);
+
+	mixer_set_active(m, true);
+
+	if (m->id != SPA_ID_INVALID)
+		play_ready(p, m->id);
+
+	return 0;
+}
+
+void sample_play_destroy(struct sample_play *p)
+{
+	/* the data thread still mixes the sample, the play is freed
+	 * when it finishes or when the mixer is destroyed */
+	if (p->mixer && p->started && !p->finished) {
+		spa_hook_list_clean(&p->hooks);
+		p->destroyed = true;
+		return;
+	}
+	play_free(p);
 }
 
 void sample_play_add_listener(struct sample_play *p, struct spa_hook *listener,
@@ -189,3 +507,16 @@ void sample_play_add_listener(struct sample_play *p, struct spa_hook *listener,
 {
 	spa_hook_list_append(&p->hooks, listener, events, data);
 }
+
+void sample_mixers_destroy(struct impl *impl)
+{
+	struct sample_mixer *m;
+
+	spa_list_consume(m, &impl->sample_mixers, link)
+		mixer_destroy(m);
+
+	if (impl->sample_core) {
+		pw_core_disconnect(impl->sample_core);
+		impl->sample_core = NULL;
+	}
+}
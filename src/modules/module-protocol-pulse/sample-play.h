@@ -11,11 +11,9 @@
 #include <spa/utils/list.h>
 #include <spa/utils/hook.h>
 
+struct impl;
 struct sample;
-struct pw_core;
-struct pw_loop;
-struct pw_stream;
-struct pw_context;
+struct sample_mixer;
 struct pw_properties;
 
 struct sample_play_events {
@@ -30,27 +28,36 @@ struct sample_play_events {
 #define sample_play_emit_ready(p,i) spa_hook_list_call(&p->hooks, struct sample_play_events, ready, 0, i)
 #define sample_play_emit_done(p,r) spa_hook_list_call(&p->hooks, struct sample_play_events, done, 0, r)
 
+/* One play of a cached sample. All plays of samples with the same
+ * layout and media role on the same sink are mixed into one sample_mixer
+ * stream. */
 struct sample_play {
-	struct spa_list link;
+	struct spa_list link;		/**< link in the mixer, main thread */
+	struct spa_list rt_link;	/**< link in the mixer, data thread */
+	struct sample_mixer *mixer;
 	struct sample *sample;
-	struct pw_stream *stream;
 	uint32_t id;
-	struct spa_hook listener;
-	struct pw_context *context;
-	struct pw_loop *main_loop;
-	uint32_t offset;
-	uint32_t stride;
+	uint32_t offset;		/**< in frames, data thread */
+	float volume;
 	struct spa_hook_list hooks;
 	void *user_data;
+	unsigned int started:1;
+	unsigned int ready:1;
+	unsigned int finished:1;	/**< returned by the data thread */
+	unsigned int done:1;
+	unsigned int destroyed:1;
 };
 
-struct sample_play *sample_play_new(struct pw_core *core,
-				    struct sample *sample, struct pw_properties *props,
-				    size_t user_data_size);
+struct sample_play *sample_play_new(struct sample *sample, struct pw_properties *props,
+				    uint64_t target, float volume, size_t user_data_size);
+
+int sample_play_start(struct sample_play *p);
 
 void sample_play_destroy(struct sample_play *p);
 
 void sample_play_add_listener(struct sample_play *p, struct spa_hook *listener,
 			      const struct sample_play_events *events, void *data);
 
+void sample_mixers_destroy(struct impl *impl);
+
 #endif /* PULSER_SERVER_SAMPLE_PLAY_H */
@@ -2,8 +2,10 @@
 /* SPDX-FileCopyrightText: Copyright © 2020 Wim Taymans */
 /* SPDX-License-Identifier: MIT */
 
+#include <errno.h>
 #include <stdlib.h>
 
+#include <spa/param/audio/raw.h>
 #include <pipewire/log.h>
 #include <pipewire/map.h>
 #include <pipewire/properties.h>
@@ -12,19 +14,159 @@
 #include "log.h"
 #include "sample.h"
 
+typedef float (*decode_func_t) (const uint8_t *d);
+
+static inline float s24_to_f32(uint32_t v)
+{
+	return ((int32_t)(v << 8) >> 8) / 8388608.0f;
+}
+
+static inline float s32_to_f32(uint32_t v)
+{
+	return (int32_t)v / 2147483648.0f;
+}
+
+static inline float u32_to_f32(uint32_t v)
+{
+	union { uint32_t i; float f; } u = { .i = v };
+	return u.f;
+}
+
+static inline int16_t ulaw_to_s16(uint8_t u)
+{
+	int t;
+
+	u = ~u;
+	t = ((u & 0x0f) << 3) + 0x84;
+	t <<= (u & 0x70) >> 4;
+
+	return (u & 0x80) ? (0x84 - t) : (t - 0x84);
+}
+
+static inline int16_t alaw_to_s16(uint8_t a)
+{
+	int t, seg;
+
+	a ^= 0x55;
+	t = (a & 0x0f) << 4;
+	seg = (a & 0x70) >> 4;
+
+	switch (seg) {
+	case 0:
+		t += 8;
+		break;
+	case 1:
+		t += 0x108;
+		break;
+	default:
+		t += 0x108;
+		t <<= seg - 1;
+		break;
+	}
+	return (a & 0x80) ? t : -t;
+}
+
+#define LE16(d)	((uint32_t)(d)[0] | (uint32_t)(d)[1] << 8)
+#define BE16(d)	((uint32_t)(d)[1] | (uint32_t)(d)[0] << 8)
+#define LE24(d)	(LE16(d) | (uint32_t)(d)[2] << 16)
+#define BE24(d)	((uint32_t)(d)[2] | (uint32_t)(d)[1] << 8 | (uint32_t)(d)[0] << 16)
+#define LE32(d)	(LE24(d) | (uint32_t)(d)[3] << 24)
+#define BE32(d)	(BE24((d)+1) | (uint32_t)(d)[0] << 24)
+
+static float decode_u8(const uint8_t *d) { return (d[0] - 128) / 128.0f; }
+static float decode_alaw(const uint8_t *d) { return alaw_to_s16(d[0]) / 32768.0f; }
+static float decode_ulaw(const uint8_t *d) { return ulaw_to_s16(d[0]) / 32768.0f; }
+static float decode_s16le(const uint8_t *d) { return (int16_t)LE16(d) / 32768.0f; }
+static float decode_s16be(const uint8_t *d) { return (int16_t)BE16(d) / 32768.0f; }
+static float decode_s24le(const uint8_t *d) { return s24_to_f32(LE24(d)); }
+static float decode_s24be(const uint8_t *d) { return s24_to_f32(BE24(d)); }
+static float decode_s24_32le(const uint8_t *d) { return s24_to_f32(LE24(d)); }
+static float decode_s24_32be(const uint8_t *d) { return s24_to_f32(BE24(d+1)); }
+static float decode_s32le(const uint8_t *d) { return s32_to_f32(LE32(d)); }
+static float decode_s32be(const uint8_t *d) { return s32_to_f32(BE32(d)); }
+static float decode_f32le(const uint8_t *d) { return u32_to_f32(LE32(d)); }
+static float decode_f32be(const uint8_t *d) { return u32_to_f32(BE32(d)); }
+
+static decode_func_t find_decode_func(uint32_t format)
+{
+	switch (format) {
+	case SPA_AUDIO_FORMAT_U8:
+		return decode_u8;
+	case SPA_AUDIO_FORMAT_ALAW:
+		return decode_alaw;
+	case SPA_AUDIO_FORMAT_ULAW:
+		return decode_ulaw;
+	case SPA_AUDIO_FORMAT_S16_LE:
+		return decode_s16le;
+	case SPA_AUDIO_FORMAT_S16_BE:
+		return decode_s16be;
+	case SPA_AUDIO_FORMAT_S24_LE:
+		return decode_s24le;
+	case SPA_AUDIO_FORMAT_S24_BE:
+		return decode_s24be;
+	case SPA_AUDIO_FORMAT_S24_32_LE:
+		return decode_s24_32le;
+	case SPA_AUDIO_FORMAT_S24_32_BE:
+		return decode_s24_32be;
+	case SPA_AUDIO_FORMAT_S32_LE:
+		return decode_s32le;
+	case SPA_AUDIO_FORMAT_S32_BE:
+		return decode_s32be;
+	case SPA_AUDIO_FORMAT_F32_LE:
+		return decode_f32le;
+	case SPA_AUDIO_FORMAT_F32_BE:
+		return decode_f32be;
+	default:
+		return NULL;
+	}
+}
+
+/* Convert the uploaded data to planar float32, the DSP format of the
+ * graph. Playback then only needs to mix the planes into the buffers of
+ * the sample mixer stream of the sink. */
+float *sample_decode(const struct sample_spec *ss, const uint8_t *buffer,
+		uint32_t length, uint32_t *n_frames)
+{
+	uint32_t i, c, n, channels = ss->channels;
+	uint32_t frame_size = sample_spec_frame_size(ss);
+	decode_func_t decode;
+	float *data;
+
+	if ((decode = find_decode_func(ss->format)) == NULL ||
+	    frame_size == 0 || channels == 0) {
+		errno = ENOTSUP;
+		return NULL;
+	}
+
+	n = length / frame_size;
+	if ((data = malloc((size_t)n * channels * sizeof(float))) == NULL)
+		return NULL;
+
+	for (c = 0; c < channels; c++) {
+		const uint8_t *s = buffer + c * (frame_size / channels);
+		float *d = data + (size_t)c * n;
+
+		for (i = 0; i < n; i++, s += frame_size)
+			d[i] = decode(s);
+	}
+	*n_frames = n;
+
+	return data;
+}
+
 void sample_free(struct sample *sample)
 {
 	struct impl * const impl = sample->impl;
 
 	pw_log_info("free sample id:%u name:%s", sample->index, sample->name);
 
-	impl->stat.sample_cache -= sample->length;
+	impl->stat.sample_cache -= sample_data_size(sample);
 
 	if (sample->index != SPA_ID_INVALID)
 		pw_map_remove(&impl->samples, sample->index);
 
 	pw_properties_free(sample->props);
 
-	free(sample->buffer);
+	free(sample->data);
 	free(sample);
 }
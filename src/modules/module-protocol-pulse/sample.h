@@ -20,12 +20,21 @@ struct sample {
 	struct sample_spec ss;
 	struct channel_map map;
 	struct pw_properties *props;
-	uint32_t length;
-	uint8_t *buffer;
+	uint32_t length;		/**< size of the uploaded data */
+	uint32_t n_frames;
+	float *data;			/**< decoded planar float32 data */
 };
 
+float *sample_decode(const struct sample_spec *ss, const uint8_t *buffer,
+		uint32_t length, uint32_t *n_frames);
 void sample_free(struct sample *sample);
 
+/* the memory used by the decoded data */
+static inline uint32_t sample_data_size(const struct sample *sample)
+{
+	return sample->n_frames * sample->ss.channels * sizeof(float);
+}
+
 static inline struct sample *sample_ref(struct sample *sample)
 {
 	sample->ref++;
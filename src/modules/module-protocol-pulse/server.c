@@ -39,6 +39,7 @@
 #include "message.h"
 #include "reply.h"
 #include "server.h"
+#include "shm.h"
 #include "stream.h"
 #include "utils.h"
 #include "flatpak-utils.h"
@@ -103,22 +104,50 @@ finish:
 	return 0;
 }
 
+static const void *memblock_get_data(struct client *client, struct message *msg,
+		uint32_t *length)
+{
+	if (msg->flags & FLAG_SHMDATA)
+		return shm_get_data(client->shm, (const struct shm_info *)msg->data, length);
+
+	*length = msg->length;
+	return msg->data;
+}
+
 static int handle_memblock(struct client *client, struct message *msg)
 {
 	struct stream *stream;
-	uint32_t channel, flags, index;
+	uint32_t channel, flags, index, length;
 	int64_t offset, diff;
 	int32_t filled;
+	const void *data;
 	int res = 0;
 
-	channel = ntohl(client->desc.channel);
-	offset = (int64_t) (
-		(((uint64_t) ntohl(client->desc.offset_hi)) << 32) |
-		(((uint64_t) ntohl(client->desc.offset_lo))));
-	flags = ntohl(client->desc.flags);
+	channel = msg->channel;
+	offset = msg->seek;
+	flags = msg->flags;
+
+	data = memblock_get_data(client, msg, &length);
+	if (data == NULL) {
+		pw_log_warn("client %p [%s]: received memblock for unknown shm id:%u",
+			    client, client->name,
+			    ntohl(((const struct shm_info *)msg->data)->shm_id));
+		res = -EPROTO;
+		goto finish;
+	}
+	if (flags & FLAG_SHMDATA) {
+		struct message *reply;
+
+		/* the data is copied below, the block can be reused right away */
+		if ((reply = message_alloc(client->impl, -1, 0)) != NULL) {
+			reply->flags = FLAG_SHMRELEASE;
+			reply->block_id = ntohl(((const struct shm_info *)msg->data)->block_id);
+			client_queue_message(client, reply);
+		}
+	}
 
 	pw_log_debug("client %p: received memblock channel:%d offset:%" PRIi64 " flags:%08x size:%u",
-		     client, channel, offset, flags, msg->length);
+		     client, channel, offset, flags, length);
 
 	stream = pw_map_lookup(&client->streams, channel);
 	if (stream == NULL || stream->type == STREAM_TYPE_RECORD) {
@@ -129,24 +158,30 @@ static int handle_memblock(struct client *client, struct message *msg)
 
 	filled = spa_ringbuffer_get_write_index(&stream->ring, &index);
 	pw_log_debug("new block %p %p/%u filled:%d index:%d flags:%02x offset:%" PRIu64,
-		     msg, msg->data, msg->length, filled, index, flags, offset);
+		     msg, data, length, filled, index, flags, offset);
 
-	switch (flags & FLAG_SEEKMASK) {
-	case SEEK_RELATIVE:
+	if (msg->written) {
+		/* the I/O thread already wrote the data, only do the accounting */
 		diff = offset;
-		break;
-	case SEEK_ABSOLUTE:
-		diff = offset - (int64_t)stream->write_index;
-		break;
-	case SEEK_RELATIVE_ON_READ:
-	case SEEK_RELATIVE_END:
-		diff = offset - (int64_t)filled;
-		break;
-	default:
-		pw_log_warn("client %p [%s]: received memblock frame with invalid seek mode: %" PRIu32,
-			    client, client->name, (uint32_t)(flags & FLAG_SEEKMASK));
-		res = -EPROTO;
-		goto finish;
+		filled -= diff + length;
+	} else {
+		switch (flags & FLAG_SEEKMASK) {
+		case SEEK_RELATIVE:
+			diff = offset;
+			break;
+		case SEEK_ABSOLUTE:
+			diff = offset - (int64_t)stream->write_index;
+			break;
+		case SEEK_RELATIVE_ON_READ:
+		case SEEK_RELATIVE_END:
+			diff = offset - (int64_t)filled;
+			break;
+		default:
+			pw_log_warn("client %p [%s]: received memblock frame with invalid seek mode: %" PRIu32,
+				    client, client->name, (uint32_t)(flags & FLAG_SEEKMASK));
+			res = -EPROTO;
+			goto finish;
+		}
 	}
 
 	index += diff;
@@ -157,23 +192,25 @@ static int handle_memblock(struct client *client, struct message *msg)
 
 	if (filled < 0) {
 		/* underrun, reported on reader side */
-	} else if (filled + msg->length > stream->attr.maxlength) {
+	} else if (filled + length > stream->attr.maxlength) {
 		/* overrun */
 		stream_send_overflow(stream);
 	}
 
-	/* always write data to ringbuffer, we expect the other side
-	 * to recover */
-	spa_ringbuffer_write_data(&stream->ring,
-			stream->buffer, MAXLENGTH,
-			index % MAXLENGTH,
-			msg->data,
-			SPA_MIN(msg->length, MAXLENGTH));
-	index += msg->length;
-	spa_ringbuffer_write_update(&stream->ring, index);
+	if (!msg->written) {
+		/* always write data to ringbuffer, we expect the other side
+		 * to recover */
+		spa_ringbuffer_write_data(&stream->ring,
+				stream->buffer, MAXLENGTH,
+				index % MAXLENGTH,
+				data,
+				SPA_MIN(length, MAXLENGTH));
+		index += length;
+		spa_ringbuffer_write_update(&stream->ring, index);
+	}
 
-	stream->write_index += msg->length;
-	stream->requested -= msg->length;
+	stream->write_index += length;
+	stream->requested -= length;
 
 	stream_send_request(stream);
 
@@ -185,58 +222,263 @@ finish:
 	return res;
 }
 
-static int do_read(struct client *client)
+static inline bool is_release(struct message *msg)
+{
+	return (msg->flags & FLAG_SHMMASK) == FLAG_SHMRELEASE;
+}
+
+/* frames that the main loop needs to apply in order with the ringbuffer
+ * writes of the I/O thread */
+static inline bool is_ordered(struct message *msg)
+{
+	return !msg->written && !is_release(msg);
+}
+
+/* called from the main loop */
+static int handle_frame(struct client *client, struct message *msg)
+{
+	int res;
+
+	if (is_release(msg)) {
+		if (shm_release_block(client->shm, msg->block_id) < 0)
+			pw_log_warn("client %p: release of invalid block %u",
+					client, msg->block_id);
+		message_free(msg, false, false);
+		return 0;
+	}
+
+	client_close_fds(client);
+	memcpy(client->in_fds, msg->fds, msg->n_fds * sizeof(int));
+	client->n_in_fds = msg->n_fds;
+	msg->n_fds = 0;
+
+	if (msg->channel == (uint32_t)-1)
+		res = handle_packet(client, msg);
+	else
+		res = handle_memblock(client, msg);
+
+	/* fds that were not claimed by the packet */
+	client_close_fds(client);
+
+	return res;
+}
+
+/* called from the I/O thread, write the data into the ringbuffer of the
+ * stream without waiting for the main loop */
+static bool io_write_memblock(struct client *client, struct message *msg)
+{
+	struct stream *stream;
+	const void *data;
+	uint32_t index, length;
+
+	/* the main loop might still change the ringbuffer */
+	if (client->io_pending > 0 ||
+	    (msg->flags & FLAG_SEEKMASK) != SEEK_RELATIVE)
+		return false;
+
+	stream = pw_map_lookup(&client->streams, msg->channel);
+	if (stream == NULL || !stream->io_ready ||
+	    stream->type != STREAM_TYPE_PLAYBACK)
+		return false;
+
+	if ((data = memblock_get_data(client, msg, &length)) == NULL)
+		return false;
+
+	spa_ringbuffer_get_write_index(&stream->ring, &index);
+	index += msg->seek;
+	spa_ringbuffer_write_data(&stream->ring,
+			stream->buffer, MAXLENGTH,
+			index % MAXLENGTH,
+			data,
+			SPA_MIN(length, MAXLENGTH));
+	spa_ringbuffer_write_update(&stream->ring, index + length);
+
+	return true;
+}
+
+static void io_schedule(struct client *client)
+{
+	struct impl * const impl = client->impl;
+
+	if (!client->io_queued) {
+		spa_list_append(&impl->io_clients, &client->io_link);
+		client->io_queued = true;
+		pw_loop_signal_event(impl->loop, impl->io_event);
+	}
+}
+
+static void io_error(struct client *client, int res)
+{
+	struct impl * const impl = client->impl;
+
+	if (client->io_res == 0)
+		client->io_res = res;
+
+	if (client->io_source) {
+		pw_loop_destroy_source(impl->io_loop, client->io_source);
+		client->io_source = NULL;
+	}
+	if (client->srb_source) {
+		pw_loop_destroy_source(impl->io_loop, client->srb_source);
+		client->srb_source = NULL;
+	}
+	io_schedule(client);
+}
+
+static int dispatch_frame(struct client *client, struct message *msg)
+{
+	if (client->impl->io_thread == NULL)
+		return handle_frame(client, msg);
+
+	if (msg->channel != (uint32_t)-1 && io_write_memblock(client, msg))
+		msg->written = true;
+	if (is_ordered(msg))
+		client->io_pending++;
+
+	spa_list_append(&client->io_queue, &msg->link);
+	io_schedule(client);
+	return 0;
+}
+
+static ssize_t do_recv(struct client *client, struct reader *rd, void *data, size_t size)
+{
+	struct iovec iov = { .iov_base = data, .iov_len = size };
+	union {
+		char buf[CMSG_SPACE(sizeof(rd->fds))];
+		struct cmsghdr align;
+	} control;
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control.buf,
+		.msg_controllen = sizeof(control.buf),
+	};
+	struct cmsghdr *cmsg;
+	ssize_t r;
+	int fd;
+
+	fd = client->io_source ? client->io_source->fd : client->source->fd;
+
+	r = recvmsg(fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+	if (r < 0)
+		return -errno;
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		uint32_t i, n_fds;
+		int *fds;
+
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+
+		fds = (int*)CMSG_DATA(cmsg);
+		n_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for (i = 0; i < n_fds; i++) {
+			if (rd->n_fds < SPA_N_ELEMENTS(rd->fds))
+				rd->fds[rd->n_fds++] = fds[i];
+			else
+				close(fds[i]);
+		}
+	}
+	if (msg.msg_flags & MSG_CTRUNC)
+		pw_log_warn("client %p: received too many fds", client);
+
+	return r;
+}
+
+static int do_read(struct client *client, struct reader *rd)
 {
 	struct impl * const impl = client->impl;
+	bool srb = rd == &client->srb_in;
 	size_t size;
 	int res = 0;
 	void *data;
 
-	if (client->in_index < sizeof(client->desc)) {
-		data = SPA_PTROFF(&client->desc, client->in_index, void);
-		size = sizeof(client->desc) - client->in_index;
+	if (rd->index < sizeof(rd->desc)) {
+		data = SPA_PTROFF(&rd->desc, rd->index, void);
+		size = sizeof(rd->desc) - rd->index;
 	} else {
-		uint32_t idx = client->in_index - sizeof(client->desc);
+		uint32_t idx = rd->index - sizeof(rd->desc);
 
-		if (client->message == NULL || client->message->length < idx) {
+		if (rd->message == NULL || rd->message->length < idx) {
 			res = -EPROTO;
 			goto exit;
 		}
 
-		data = SPA_PTROFF(client->message->data, idx, void);
-		size = client->message->length - idx;
+		data = SPA_PTROFF(rd->message->data, idx, void);
+		size = rd->message->length - idx;
 	}
 
 	while (true) {
-		ssize_t r = recv(client->source->fd, data, size, MSG_DONTWAIT);
+		ssize_t r;
 
-		if (r == 0 && size != 0) {
-			res = -EPIPE;
-			goto exit;
-		} else if (r < 0) {
-			if (errno == EINTR)
+		if (srb) {
+			r = srbchannel_read(&client->shm->srb, data, size);
+			if (r == 0 && size != 0)
+				r = -EAGAIN;
+		} else {
+			r = do_recv(client, rd, data, size);
+			if (r == 0 && size != 0) {
+				res = -EPIPE;
+				goto exit;
+			}
+		}
+		if (r < 0) {
+			if (r == -EINTR)
 				continue;
-			res = -errno;
+			res = r;
 			if (res != -EAGAIN && res != -EWOULDBLOCK &&
 			    res != -EPIPE && res != -ECONNRESET)
-				pw_log_warn("recv client:%p res %zd: %m", client, r);
+				pw_log_warn("read client:%p res %zd: %s", client, r,
+						spa_strerror(r));
 			goto exit;
 		}
 
-		client->in_index += r;
+		rd->index += r;
 		break;
 	}
 
-	if (client->in_index == sizeof(client->desc)) {
+	if (rd->index == sizeof(rd->desc)) {
 		uint32_t flags, length, channel;
 
-		flags = ntohl(client->desc.flags);
+		flags = ntohl(rd->desc.flags);
+		length = ntohl(rd->desc.length);
+		channel = ntohl(rd->desc.channel);
+
 		if ((flags & FLAG_SHMMASK) != 0) {
-			res = -EPROTO;
-			goto exit;
+			struct message *msg;
+
+			if (client->shm == NULL) {
+				res = -EPROTO;
+				goto exit;
+			}
+			switch (flags & FLAG_SHMMASK) {
+			case FLAG_SHMREVOKE:
+				/* we never copy out of the client pool lazily */
+				rd->index = 0;
+				goto exit;
+			case FLAG_SHMRELEASE:
+				rd->index = 0;
+				if ((msg = message_alloc(impl, -1, 0)) == NULL) {
+					res = -errno;
+					goto exit;
+				}
+				msg->flags = flags;
+				msg->block_id = ntohl(rd->desc.offset_hi);
+				res = dispatch_frame(client, msg);
+				goto exit;
+			default:
+				if ((flags & FLAG_SHMMASK) != (FLAG_SHMDATA | FLAG_SHMDATA_MEMFD_BLOCK) ||
+				    length != sizeof(struct shm_info) ||
+				    channel == (uint32_t) -1) {
+					pw_log_warn("client %p: received invalid shm frame flags:%08x",
+						    client, flags);
+					res = -EPROTO;
+					goto exit;
+				}
+				break;
+			}
 		}
 
-		length = ntohl(client->desc.length);
 		if (length > FRAME_SIZE_MAX_ALLOW || length <= 0) {
 			pw_log_warn("client %p: received invalid frame size: %u",
 				    client, length);
@@ -244,7 +486,6 @@ static int do_read(struct client *client)
 			goto exit;
 		}
 
-		channel = ntohl(client->desc.channel);
 		if (channel == (uint32_t) -1) {
 			if (flags != 0) {
 				pw_log_warn("client %p: received packet frame with invalid flags",
@@ -254,27 +495,152 @@ static int do_read(struct client *client)
 			}
 		}
 
-		if (client->message)
-			message_free(client->message, false, false);
+		if (rd->message)
+			message_free(rd->message, false, false);
 
-		client->message = message_alloc(impl, channel, length);
-	} else if (client->message &&
-	    client->in_index >= client->message->length + sizeof(client->desc)) {
-		struct message * const msg = client->message;
+		rd->message = message_alloc(impl, channel, length);
+	} else if (rd->message &&
+	    rd->index >= rd->message->length + sizeof(rd->desc)) {
+		struct message * const msg = rd->message;
 
-		client->message = NULL;
-		client->in_index = 0;
+		rd->message = NULL;
+		rd->index = 0;
 
-		if (msg->channel == (uint32_t)-1)
-			res = handle_packet(client, msg);
-		else
-			res = handle_memblock(client, msg);
+		msg->flags = ntohl(rd->desc.flags);
+		msg->seek = (int64_t) (
+			(((uint64_t) ntohl(rd->desc.offset_hi)) << 32) |
+			(((uint64_t) ntohl(rd->desc.offset_lo))));
+
+		memcpy(msg->fds, rd->fds, rd->n_fds * sizeof(int));
+		msg->n_fds = rd->n_fds;
+		rd->n_fds = 0;
+
+		res = dispatch_frame(client, msg);
 	}
 
 exit:
 	return res;
 }
 
+static void handle_client_error(struct client *client, int res)
+{
+	switch (res) {
+	case -EPIPE:
+	case -ECONNRESET:
+		pw_log_info("server %p: client %p [%s] disconnected",
+			    client->server, client, client->name);
+		SPA_FALLTHROUGH;
+	case -EPROTO:
+		/*
+		 * drop the server's reference to the client
+		 * (if it hasn't been dropped already),
+		 * it is guaranteed that this will not call `client_free()`
+		 * since at the beginning of this function an extra reference
+		 * has been acquired which will keep the client alive
+		 */
+		if (client_detach(client))
+			client_unref(client);
+
+		/* then disconnect the client */
+		client_disconnect(client);
+		break;
+	default:
+		pw_log_error("server %p: client %p [%s] error %d (%s)",
+			     client->server, client, client->name, res, spa_strerror(res));
+		break;
+	}
+}
+
+static int read_srbchannel(struct client *client)
+{
+	struct srbchannel *srb = &client->shm->srb;
+	int res;
+
+	do {
+		while (true) {
+			res = do_read(client, &client->srb_in);
+			if (res < 0) {
+				if (res != -EAGAIN)
+					return res;
+				break;
+			}
+			if (client->disconnect)
+				return 0;
+		}
+	} while (!srbchannel_before_poll(srb));
+
+	return 0;
+}
+
+static void
+on_srb_data(void *data, int fd, uint32_t mask)
+{
+	struct client * const client = data;
+	int res;
+
+	if (client->impl->io_thread) {
+		/* in the I/O thread */
+		srbchannel_after_poll(&client->shm->srb);
+
+		if ((res = read_srbchannel(client)) < 0) {
+			io_error(client, res);
+		} else if (client->srb_blocked) {
+			/* the client might have made room in the ringbuffer */
+			client->io_flush = true;
+			io_schedule(client);
+		}
+		return;
+	}
+
+	client->ref++;
+
+	srbchannel_after_poll(&client->shm->srb);
+
+	if ((res = read_srbchannel(client)) < 0)
+		goto error;
+
+	/* the client might have made room in the ringbuffer */
+	if (!client->disconnect && !spa_list_is_empty(&client->out_messages)) {
+		res = client_flush_messages(client);
+		if (res < 0)
+			goto error;
+	}
+
+done:
+	client_unref(client);
+	return;
+
+error:
+	handle_client_error(client, res);
+	goto done;
+}
+
+int client_start_srbchannel(struct client *client)
+{
+	struct impl * const impl = client->impl;
+	int res;
+
+	if (client->shm == NULL || client->srb_source != NULL)
+		return -EINVAL;
+
+	impl_io_lock(impl);
+	client->srb_source = pw_loop_add_io(impl_get_io_loop(impl),
+			client->shm->srb.read_fd,
+			SPA_IO_IN, false, on_srb_data, client);
+	if (client->srb_source == NULL) {
+		res = -errno;
+	} else {
+		/* our writes switch to the srbchannel after the current frame */
+		client->srb_pending = true;
+
+		/* the client might already have written something */
+		res = read_srbchannel(client);
+	}
+	impl_io_unlock(impl);
+
+	return res;
+}
+
 static void
 on_client_data(void *data, int fd, uint32_t mask)
 {
@@ -296,7 +662,7 @@ on_client_data(void *data, int fd, uint32_t mask)
 	if (mask & SPA_IO_IN) {
 		pw_log_trace("client %p: can read", client);
 		while (true) {
-			res = do_read(client);
+			res = do_read(client, &client->in);
 			if (res < 0) {
 				if (res != -EAGAIN && res != -EWOULDBLOCK)
 					goto error;
@@ -317,33 +683,129 @@ done:
 	return;
 
 error:
-	switch (res) {
-	case -EPIPE:
-	case -ECONNRESET:
-		pw_log_info("server %p: client %p [%s] disconnected",
-			    client->server, client, client->name);
-		SPA_FALLTHROUGH;
-	case -EPROTO:
-		/*
-		 * drop the server's reference to the client
-		 * (if it hasn't been dropped already),
-		 * it is guaranteed that this will not call `client_free()`
-		 * since at the beginning of this function an extra reference
-		 * has been acquired which will keep the client alive
-		 */
-		if (client_detach(client))
-			client_unref(client);
+	handle_client_error(client, res);
+	goto done;
+}
 
-		/* then disconnect the client */
-		client_disconnect(client);
-		break;
-	default:
-		pw_log_error("server %p: client %p [%s] error %d (%s)",
-			     client->server, client, client->name, res, spa_strerror(res));
-		break;
+/* in the I/O thread, read the socket and queue the frames for the main loop */
+static void
+on_client_io_data(void *data, int fd, uint32_t mask)
+{
+	struct client * const client = data;
+	int res;
+
+	if (mask & SPA_IO_HUP) {
+		res = -EPIPE;
+	} else if (mask & SPA_IO_ERR) {
+		res = -EIO;
+	} else {
+		while ((res = do_read(client, &client->in)) >= 0);
+		if (res == -EAGAIN || res == -EWOULDBLOCK)
+			return;
 	}
+	io_error(client, res);
+}
 
-	goto done;
+/* in the main loop, handle the frames queued by the I/O thread */
+static void on_io_event(void *data, uint64_t count)
+{
+	struct impl * const impl = data;
+
+	impl_io_lock(impl);
+	while (!spa_list_is_empty(&impl->io_clients)) {
+		struct client *client;
+		struct message *msg;
+		struct spa_list queue;
+		uint32_t n_ordered = 0;
+		bool flush;
+		int res, io_res;
+
+		client = spa_list_first(&impl->io_clients, struct client, io_link);
+		spa_list_remove(&client->io_link);
+		client->io_queued = false;
+
+		spa_list_init(&queue);
+		spa_list_insert_list(&queue, &client->io_queue);
+		spa_list_init(&client->io_queue);
+
+		io_res = client->io_res;
+		client->io_res = 0;
+		flush = client->io_flush;
+		client->io_flush = false;
+		if (flush)
+			client->srb_blocked = false;
+
+		client->ref++;
+		impl_io_unlock(impl);
+
+		res = 0;
+		spa_list_consume(msg, &queue, link) {
+			spa_list_remove(&msg->link);
+			if (is_ordered(msg))
+				n_ordered++;
+			if (res < 0 || client->disconnect) {
+				message_close_fds(msg);
+				message_free(msg, false, false);
+				continue;
+			}
+			res = handle_frame(client, msg);
+		}
+		if (res >= 0)
+			res = io_res;
+		if (res >= 0 && !client->disconnect &&
+		    (flush || client->new_msg_since_last_flush))
+			res = client_flush_messages(client);
+		if (res < 0 && !client->disconnect)
+			handle_client_error(client, res);
+
+		impl_io_lock(impl);
+		client->io_pending -= n_ordered;
+		impl_io_unlock(impl);
+
+		client_unref(client);
+		impl_io_lock(impl);
+	}
+	impl_io_unlock(impl);
+}
+
+int servers_start_io(struct impl *impl)
+{
+	int res;
+
+	impl->io_thread = pw_thread_loop_new("pulse-io", NULL);
+	if (impl->io_thread == NULL)
+		return -errno;
+
+	impl->io_event = pw_loop_add_event(impl->loop, on_io_event, impl);
+	if (impl->io_event == NULL) {
+		res = -errno;
+		goto error;
+	}
+	if ((res = pw_thread_loop_start(impl->io_thread)) < 0)
+		goto error;
+
+	impl->io_loop = pw_thread_loop_get_loop(impl->io_thread);
+
+	pw_log_info("%p: started I/O thread", impl);
+	return 0;
+
+error:
+	servers_stop_io(impl);
+	return res;
+}
+
+void servers_stop_io(struct impl *impl)
+{
+	if (impl->io_thread) {
+		pw_thread_loop_stop(impl->io_thread);
+		pw_thread_loop_destroy(impl->io_thread);
+		impl->io_thread = NULL;
+		impl->io_loop = NULL;
+	}
+	if (impl->io_event) {
+		pw_loop_destroy_source(impl->loop, impl->io_event);
+		impl->io_event = NULL;
+	}
 }
 
 static void
@@ -384,9 +846,11 @@ on_connect(void *data, int fd, uint32_t mask)
 
 	pw_log_debug("server %p: new client %p fd:%d", server, client, client_fd);
 
+	/* with an I/O thread, the main loop only writes to the socket */
 	client->source = pw_loop_add_io(impl->loop,
 					client_fd,
-					SPA_IO_ERR | SPA_IO_HUP | SPA_IO_IN,
+					SPA_IO_ERR | SPA_IO_HUP |
+					(impl->io_thread ? 0 : SPA_IO_IN),
 					true, on_client_data, client);
 	if (client->source == NULL)
 		goto error;
@@ -484,6 +948,15 @@ on_connect(void *data, int fd, uint32_t mask)
 	}
 	pw_properties_set(client->props, PW_KEY_CLIENT_ACCESS, client_access);
 
+	if (impl->io_thread) {
+		impl_io_lock(impl);
+		client->io_source = pw_loop_add_io(impl->io_loop, client_fd,
+				SPA_IO_IN, false, on_client_io_data, client);
+		impl_io_unlock(impl);
+		if (client->io_source == NULL)
+			goto error;
+	}
+
 	return;
 
 error:
@@ -37,4 +37,7 @@ struct server {
 int servers_create_and_start(struct impl *impl, const char *addresses, struct pw_array *servers);
 void server_free(struct server *server);
 
+int servers_start_io(struct impl *impl);
+void servers_stop_io(struct impl *impl);
+
 #endif /* PULSER_SERVER_SERVER_H */
@@ -0,0 +1,314 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+
+#include <spa/buffer/buffer.h>
+#include <spa/utils/atomic.h>
+#include <spa/utils/defs.h>
+#include <pipewire/log.h>
+#include <pipewire/mem.h>
+#include <pipewire/utils.h>
+
+#include "log.h"
+#include "shm.h"
+
+struct shm *shm_new(void)
+{
+	struct shm *shm;
+
+	if ((shm = calloc(1, sizeof(*shm))) == NULL)
+		return NULL;
+
+	shm->srb.read_fd = -1;
+	shm->srb.write_fd = -1;
+
+	if ((shm->pool = pw_mempool_new(NULL)) == NULL)
+		goto error;
+
+	shm->block = pw_mempool_alloc(shm->pool,
+			PW_MEMBLOCK_FLAG_READWRITE |
+			PW_MEMBLOCK_FLAG_SEAL |
+			PW_MEMBLOCK_FLAG_MAP,
+			SPA_DATA_MemFd, SHM_SLOT_SIZE * SHM_N_SLOTS);
+	if (shm->block == NULL)
+		goto error;
+
+	shm->id = pw_rand32();
+	/* reserved for the srbchannel */
+	shm->used = 1ull << SHM_SRB_BLOCK;
+
+	return shm;
+error:
+	shm_free(shm);
+	return NULL;
+}
+
+void shm_free(struct shm *shm)
+{
+	if (shm->srb.read_fd >= 0)
+		close(shm->srb.read_fd);
+	if (shm->srb.write_fd >= 0)
+		close(shm->srb.write_fd);
+	if (shm->pool)
+		pw_mempool_destroy(shm->pool);
+	free(shm);
+}
+
+void *shm_alloc_block(struct shm *shm, uint32_t *block_id)
+{
+	uint64_t avail = ~shm->used;
+	uint32_t slot;
+
+	if (avail == 0)
+		return NULL;
+
+	slot = __builtin_ctzll(avail);
+	shm->used |= 1ull << slot;
+	*block_id = slot;
+
+	return SPA_PTROFF(shm->block->map->ptr, slot * SHM_SLOT_SIZE, void);
+}
+
+int shm_release_block(struct shm *shm, uint32_t block_id)
+{
+	if (block_id >= SHM_N_SLOTS || block_id == SHM_SRB_BLOCK ||
+	    (shm->used & (1ull << block_id)) == 0)
+		return -EINVAL;
+
+	shm->used &= ~(1ull << block_id);
+	return 0;
+}
+
+void shm_block_info(struct shm *shm, uint32_t block_id, uint32_t length,
+		struct shm_info *info)
+{
+	info->block_id = htonl(block_id);
+	info->shm_id = htonl(shm->id);
+	info->index = htonl(block_id * SHM_SLOT_SIZE);
+	info->length = htonl(length);
+}
+
+int shm_attach_segment(struct shm *shm, uint32_t id, int fd)
+{
+	struct shm_segment *seg;
+	struct stat st;
+	uint32_t i;
+	int res;
+
+	for (i = 0; i < shm->n_segments; i++) {
+		if (shm->segments[i].id == id) {
+			res = -EEXIST;
+			goto error;
+		}
+	}
+	if (shm->n_segments >= SHM_MAX_SEGMENTS) {
+		res = -ENOSPC;
+		goto error;
+	}
+	if (fstat(fd, &st) < 0) {
+		res = -errno;
+		goto error;
+	}
+	if (st.st_size <= 0 || st.st_size > UINT32_MAX) {
+		res = -EINVAL;
+		goto error;
+	}
+
+	seg = &shm->segments[shm->n_segments];
+	seg->block = pw_mempool_import(shm->pool, PW_MEMBLOCK_FLAG_READABLE,
+			SPA_DATA_MemFd, fd);
+	if (seg->block == NULL) {
+		res = -errno;
+		goto error;
+	}
+	seg->map = pw_memblock_map(seg->block, PW_MEMMAP_FLAG_READ,
+			0, st.st_size, NULL);
+	if (seg->map == NULL) {
+		res = -errno;
+		pw_memblock_unref(seg->block);
+		return res;
+	}
+	seg->id = id;
+	shm->n_segments++;
+
+	pw_log_debug("shm %p: attached segment id:%u size:%"PRIi64,
+			shm, id, (int64_t)st.st_size);
+	return 0;
+error:
+	close(fd);
+	return res;
+}
+
+const void *shm_get_data(struct shm *shm, const struct shm_info *info, uint32_t *length)
+{
+	uint32_t i, id = ntohl(info->shm_id);
+	uint64_t index = ntohl(info->index), len = ntohl(info->length);
+
+	for (i = 0; i < shm->n_segments; i++) {
+		struct shm_segment *seg = &shm->segments[i];
+
+		if (seg->id != id)
+			continue;
+		if (index + len > seg->map->size)
+			return NULL;
+
+		*length = len;
+		return SPA_PTROFF(seg->map->ptr, index, void);
+	}
+	return NULL;
+}
+
+static void sem_post(struct srb_sem *sem, int fd)
+{
+	uint64_t val = 1;
+
+	if (!SPA_ATOMIC_CAS(sem->signalled, 0, 1) ||
+	    SPA_ATOMIC_LOAD(sem->waiting) <= 0)
+		return;
+
+	SPA_ATOMIC_INC(sem->in_pipe);
+	while (write(fd, &val, sizeof(val)) < 0 && errno == EINTR);
+}
+
+static void sem_flush(struct srb_sem *sem, int fd)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	uint64_t val;
+
+	if (SPA_ATOMIC_LOAD(sem->in_pipe) <= 0)
+		return;
+
+	/* the fd is shared with the client and can't be made
+	 * non-blocking, check if there is something to read first */
+	do {
+		if (poll(&pfd, 1, 0) <= 0 ||
+		    read(fd, &val, sizeof(val)) != sizeof(val))
+			return;
+	} while (__atomic_fetch_sub(&sem->in_pipe, (int)val, __ATOMIC_SEQ_CST) > (int)val);
+}
+
+int srbchannel_init(struct shm *shm)
+{
+	struct srbchannel *srb = &shm->srb;
+	struct srb_header *h = shm->block->map->ptr;
+	uint32_t offset, capacity;
+
+	spa_memzero(h, SHM_SLOT_SIZE);
+
+	offset = SPA_ROUND_UP_N(sizeof(*h), 8);
+	capacity = (SHM_SLOT_SIZE - offset) / 2;
+	capacity = SPA_ROUND_DOWN_N(capacity, 8);
+
+	h->capacity = capacity;
+	h->readbuf_offset = offset;
+	h->writebuf_offset = offset + capacity;
+
+	srb->header = h;
+	srb->read_data = SPA_PTROFF(h, h->readbuf_offset, uint8_t);
+	srb->write_data = SPA_PTROFF(h, h->writebuf_offset, uint8_t);
+	srb->capacity = capacity;
+	srb->read_index = srb->write_index = 0;
+
+	/* the client has a reference to the same eventfds, they need to
+	 * be blocking for the fdsem implementation of PulseAudio */
+	if ((srb->read_fd = eventfd(0, EFD_CLOEXEC)) < 0 ||
+	    (srb->write_fd = eventfd(0, EFD_CLOEXEC)) < 0)
+		return -errno;
+
+	return 0;
+}
+
+ssize_t srbchannel_read(struct srbchannel *srb, void *data, size_t size)
+{
+	struct srb_header *h = srb->header;
+	size_t total = 0;
+
+	while (size > 0) {
+		int count = SPA_ATOMIC_LOAD(h->read_count);
+		uint32_t avail;
+
+		if (count < 0 || (uint32_t)count > srb->capacity)
+			return -EPROTO;
+
+		avail = SPA_MIN((uint32_t)count, srb->capacity - srb->read_index);
+		avail = SPA_MIN(avail, size);
+		if (avail == 0)
+			break;
+
+		memcpy(data, srb->read_data + srb->read_index, avail);
+
+		/* when the ringbuffer was full, the writer waits for space */
+		if (__atomic_fetch_sub(&h->read_count, (int)avail, __ATOMIC_SEQ_CST) >= (int)srb->capacity)
+			sem_post(&h->write_sem, srb->write_fd);
+
+		srb->read_index = (srb->read_index + avail) % srb->capacity;
+		data = SPA_PTROFF(data, avail, void);
+		size -= avail;
+		total += avail;
+	}
+	return total;
+}
+
+ssize_t srbchannel_write(struct srbchannel *srb, const void *data, size_t size)
+{
+	struct srb_header *h = srb->header;
+	size_t total = 0;
+
+	while (size > 0) {
+		int count = SPA_ATOMIC_LOAD(h->write_count);
+		uint32_t avail;
+
+		if (count < 0 || (uint32_t)count > srb->capacity)
+			return -EPROTO;
+
+		avail = SPA_MIN(srb->capacity - (uint32_t)count,
+				srb->capacity - srb->write_index);
+		avail = SPA_MIN(avail, size);
+		if (avail == 0)
+			break;
+
+		memcpy(srb->write_data + srb->write_index, data, avail);
+		__atomic_fetch_add(&h->write_count, (int)avail, __ATOMIC_SEQ_CST);
+
+		srb->write_index = (srb->write_index + avail) % srb->capacity;
+		data = SPA_PTROFF(data, avail, const void);
+		size -= avail;
+		total += avail;
+	}
+	if (total > 0)
+		sem_post(&h->write_sem, srb->write_fd);
+
+	return total;
+}
+
+void srbchannel_after_poll(struct srbchannel *srb)
+{
+	struct srb_header *h = srb->header;
+
+	SPA_ATOMIC_DEC(h->read_sem.waiting);
+	sem_flush(&h->read_sem, srb->read_fd);
+	SPA_ATOMIC_CAS(h->read_sem.signalled, 1, 0);
+}
+
+/* returns false when the client signalled in the meantime and the
+ * srbchannel needs to be read again before we can wait */
+bool srbchannel_before_poll(struct srbchannel *srb)
+{
+	struct srb_header *h = srb->header;
+
+	SPA_ATOMIC_INC(h->read_sem.waiting);
+	if (SPA_ATOMIC_CAS(h->read_sem.signalled, 1, 0)) {
+		SPA_ATOMIC_DEC(h->read_sem.waiting);
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,99 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#ifndef PULSE_SERVER_SHM_H
+#define PULSE_SERVER_SHM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+struct pw_mempool;
+struct pw_memblock;
+struct pw_memmap;
+
+/* PulseAudio uses slots of 64K in its mempool */
+#define SHM_SLOT_SIZE		(64u*1024)
+#define SHM_N_SLOTS		64u
+#define SHM_MAX_SEGMENTS	16u
+/* slot 0 of our pool holds the srbchannel */
+#define SHM_SRB_BLOCK		0u
+
+/* payload of a FLAG_SHMDATA memblock frame, in network byte order */
+struct shm_info {
+	uint32_t block_id;
+	uint32_t shm_id;
+	uint32_t index;
+	uint32_t length;
+};
+
+/* a memfd pool of the client */
+struct shm_segment {
+	uint32_t id;
+	struct pw_memblock *block;
+	struct pw_memmap *map;
+};
+
+/* The layout of the shared memory is defined by the pa_srbchannel and
+ * pa_fdsem implementation of PulseAudio. */
+struct srb_sem {
+	int waiting;
+	int signalled;
+	int in_pipe;
+};
+
+struct srb_header {
+	int read_count;
+	int write_count;
+
+	struct srb_sem read_sem;
+	struct srb_sem write_sem;
+
+	int capacity;
+	int readbuf_offset;
+	int writebuf_offset;
+};
+
+struct srbchannel {
+	struct srb_header *header;
+	uint8_t *read_data;
+	uint8_t *write_data;
+	uint32_t capacity;
+	uint32_t read_index;
+	uint32_t write_index;
+	int read_fd;
+	int write_fd;
+};
+
+struct shm {
+	struct pw_mempool *pool;
+
+	struct pw_memblock *block;	/**< our memfd, shared with the client */
+	uint32_t id;
+	uint64_t used;
+
+	struct shm_segment segments[SHM_MAX_SEGMENTS];
+	uint32_t n_segments;
+
+	struct srbchannel srb;
+};
+
+struct shm *shm_new(void);
+void shm_free(struct shm *shm);
+
+void *shm_alloc_block(struct shm *shm, uint32_t *block_id);
+int shm_release_block(struct shm *shm, uint32_t block_id);
+void shm_block_info(struct shm *shm, uint32_t block_id, uint32_t length,
+		struct shm_info *info);
+
+int shm_attach_segment(struct shm *shm, uint32_t id, int fd);
+const void *shm_get_data(struct shm *shm, const struct shm_info *info, uint32_t *length);
+
+int srbchannel_init(struct shm *shm);
+ssize_t srbchannel_read(struct srbchannel *srb, void *data, size_t size);
+ssize_t srbchannel_write(struct srbchannel *srb, const void *data, size_t size);
+void srbchannel_after_poll(struct srbchannel *srb);
+bool srbchannel_before_poll(struct srbchannel *srb);
+
+#endif /* PULSE_SERVER_SHM_H */
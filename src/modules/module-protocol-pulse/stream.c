@@ -52,9 +52,14 @@ struct stream *stream_new(struct client *client, enum stream_type type, uint32_t
 	if (stream == NULL)
 		return NULL;
 
+	/* the I/O thread looks up streams to write into, it only uses the
+	 * stream when it is ready, see stream->io_ready */
+	impl_io_lock(client->impl);
 	stream->channel = pw_map_insert_new(&client->streams, stream);
+	res = errno;
+	impl_io_unlock(client->impl);
 	if (stream->channel == SPA_ID_INVALID)
-		goto error_errno;
+		goto error;
 
 	stream->impl = client->impl;
 	stream->client = client;
@@ -91,8 +96,7 @@ struct stream *stream_new(struct client *client, enum stream_type type, uint32_t
 
 	return stream;
 
-error_errno:
-	res = errno;
+error:
 	free(stream);
 	errno = res;
 
@@ -122,8 +126,12 @@ void stream_free(struct stream *stream)
 
 		pw_stream_destroy(stream->stream);
 	}
-	if (stream->channel != SPA_ID_INVALID)
+	if (stream->channel != SPA_ID_INVALID) {
+		/* the I/O thread looks up streams to write into */
+		impl_io_lock(impl);
 		pw_map_remove(&client->streams, stream->channel);
+		impl_io_unlock(impl);
+	}
 
 	pw_work_queue_cancel(impl->work_queue, stream, SPA_ID_INVALID);
 
@@ -84,6 +84,8 @@ struct stream {
 
 	struct volume volume;
 	bool muted;
+	bool io_ready;		/* the I/O thread can write into the ringbuffer,
+				 * protected with the I/O thread lock */
 
 	uint32_t drain_tag;
 	unsigned int corked:1;
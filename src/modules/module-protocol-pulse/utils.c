@@ -146,6 +146,31 @@ pid_t get_client_pid(struct client *client, int client_fd)
 	return 0;
 }
 
+/* shared memory is only used between processes of the same user on a
+ * local socket */
+bool client_is_same_user(struct client *client, int client_fd)
+{
+#if defined(__linux__)
+	struct sockaddr_storage addr;
+	struct ucred ucred;
+	socklen_t len;
+
+	len = sizeof(addr);
+	if (getsockname(client_fd, (struct sockaddr*)&addr, &len) < 0 ||
+	    addr.ss_family != AF_UNIX)
+		return false;
+
+	len = sizeof(ucred);
+	if (getsockopt(client_fd, SOL_SOCKET, SO_PEERCRED, &ucred, &len) < 0) {
+		pw_log_warn("client %p: no peercred: %m", client);
+		return false;
+	}
+	return ucred.uid == getuid();
+#else
+	return false;
+#endif
+}
+
 const char *get_server_name(struct pw_context *context)
 {
 	const char *name = NULL;
@@ -5,6 +5,7 @@
 #ifndef PULSE_SERVER_UTILS_H
 #define PULSE_SERVER_UTILS_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <sys/types.h>
 
@@ -14,6 +15,7 @@ struct pw_context;
 int get_runtime_dir(char *buf, size_t buflen);
 int check_flatpak(struct client *client, pid_t pid);
 pid_t get_client_pid(struct client *client, int client_fd);
+bool client_is_same_user(struct client *client, int client_fd);
 const char *get_server_name(struct pw_context *context);
 int create_pid_file(void);
 
@@ -6,6 +6,7 @@
 #ifndef PULSE_SERVER_VOLUME_H
 #define PULSE_SERVER_VOLUME_H
 
+#include <math.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -13,6 +14,11 @@
 
 struct spa_pod;
 
+#define VOLUME_MUTED ((uint32_t) 0U)
+#define VOLUME_NORM ((uint32_t) 0x10000U)
+#define VOLUME_MAX ((uint32_t) UINT32_MAX/2)
+#define VOLUME_INVALID ((uint32_t) UINT32_MAX)
+
 struct volume {
 	uint8_t channels;
 	float values[CHANNELS_MAX];
@@ -59,6 +65,23 @@ static inline void volume_make(struct volume *vol, uint8_t channels)
 	vol->channels = channels;
 }
 
+static inline uint32_t volume_from_linear(float vol)
+{
+	uint32_t v;
+	if (vol <= 0.0f)
+		v = VOLUME_MUTED;
+	else
+		v = SPA_CLAMP((uint64_t) lround(cbrt(vol) * VOLUME_NORM),
+				VOLUME_MUTED, VOLUME_MAX);
+	return v;
+}
+
+static inline float volume_to_linear(uint32_t vol)
+{
+	float v = ((float)vol) / VOLUME_NORM;
+	return v * v * v;
+}
+
 int volume_compare(struct volume *vol, struct volume *other);
 int volume_parse_param(const struct spa_pod *param, struct volume_info *info, bool monitor);
 
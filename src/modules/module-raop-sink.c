@@ -44,6 +44,7 @@
 #include <pipewire/i18n.h>
 
 #include "module-raop/rtsp-client.h"
+#include "module-raop/packet.h"
 #include "module-rtp/rtp.h"
 #include "module-rtp/stream.h"
 
@@ -275,27 +276,6 @@ struct impl {
 	uint32_t filled;
 };
 
-static inline void bit_writer(uint8_t **p, int *pos, uint8_t data, int len)
-{
-	int rb = 8 - *pos - len;
-	if (rb >= 0) {
-		**p = (*pos ? **p : 0) | (data << rb);
-                *pos += len;
-	} else {
-		*(*p)++ |= (data >> -rb);
-		**p = data << (8+rb);
-		*pos = -rb;
-	}
-}
-
-static int aes_encrypt(struct impl *impl, uint8_t *data, int len)
-{
-	int i = len & ~0xf, clen = i;
-	EVP_EncryptInit(impl->ctx, EVP_aes_128_cbc(), impl->aes_key, impl->aes_iv);
-	EVP_EncryptUpdate(impl->ctx, data, &clen, data, i);
-	return i;
-}
-
 static inline uint64_t timespec_to_ntp(struct timespec *ts)
 {
     uint64_t ntp = (uint64_t) ts->tv_nsec * UINT32_MAX / SPA_NSEC_PER_SEC;
@@ -408,36 +388,6 @@ static int send_udp_timing_packet(struct impl *impl, uint64_t remote, uint64_t r
 	return res;
 }
 
-static int write_codec_pcm(void *dst, void *frames, uint32_t n_frames)
-{
-	uint8_t *bp, *b, *d = frames;
-	int bpos = 0;
-	uint32_t i;
-
-	b = bp = dst;
-
-	bit_writer(&bp, &bpos, 1, 3); /* channel=1, stereo */
-	bit_writer(&bp, &bpos, 0, 4); /* Unknown */
-	bit_writer(&bp, &bpos, 0, 8); /* Unknown */
-	bit_writer(&bp, &bpos, 0, 4); /* Unknown */
-	bit_writer(&bp, &bpos, 1, 1); /* Hassize */
-	bit_writer(&bp, &bpos, 0, 2); /* Unused */
-	bit_writer(&bp, &bpos, 1, 1); /* Is-not-compressed */
-	bit_writer(&bp, &bpos, (n_frames >> 24) & 0xff, 8);
-	bit_writer(&bp, &bpos, (n_frames >> 16) & 0xff, 8);
-	bit_writer(&bp, &bpos, (n_frames >> 8)  & 0xff, 8);
-	bit_writer(&bp, &bpos, (n_frames)       & 0xff, 8);
-
-	for (i = 0; i < n_frames; i++) {
-		bit_writer(&bp, &bpos, *(d + 1), 8);
-		bit_writer(&bp, &bpos, *(d + 0), 8);
-		bit_writer(&bp, &bpos, *(d + 3), 8);
-		bit_writer(&bp, &bpos, *(d + 2), 8);
-		d += 4;
-	}
-	return bp - b + 1;
-}
-
 static ssize_t send_packet(int fd, struct msghdr *msg)
 {
 	ssize_t n;
@@ -486,7 +436,7 @@ static void stream_send_packet(void *data, struct iovec *iov, size_t iovlen)
 	switch (impl->codec) {
 	case CODEC_PCM:
 	case CODEC_ALAC:
-		len = write_codec_pcm(dst, (void *)iov[1].iov_base, n_frames);
+		len = raop_write_pcm(dst, (void *)iov[1].iov_base, n_frames);
 		break;
 	default:
 		len = 8 + impl->mtu;
@@ -494,7 +444,7 @@ static void stream_send_packet(void *data, struct iovec *iov, size_t iovlen)
 		break;
 	}
 	if (impl->encryption == CRYPTO_RSA)
-		aes_encrypt(impl, dst, len);
+		raop_aes_encrypt(impl->ctx, impl->aes_iv, dst, len);
 
 	if (impl->protocol == PROTO_TCP) {
 		out[0] |= htonl((uint32_t) len + 12);
@@ -1284,6 +1234,8 @@ static int rtsp_do_announce(struct impl *impl)
 		    (res = pw_getrandom(impl->aes_key, sizeof(impl->aes_key), 0)) < 0 ||
 		    (res = pw_getrandom(impl->aes_iv, sizeof(impl->aes_iv), 0)) < 0)
 			return res;
+		if ((res = raop_aes_init(impl->ctx, impl->aes_key, impl->aes_iv)) < 0)
+			return res;
 
 		base64_encode(rac, sizeof(rac), sac, '\0');
 		pw_properties_set(impl->headers, "Apple-Challenge", sac);
@@ -0,0 +1,99 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#ifndef PIPEWIRE_RAOP_PACKET_H
+#define PIPEWIRE_RAOP_PACKET_H
+
+#include <errno.h>
+#include <stdint.h>
+
+#include <openssl/evp.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static inline void raop_bit_writer(uint8_t **p, int *pos, uint8_t data, int len)
+{
+	int rb = 8 - *pos - len;
+	if (rb >= 0) {
+		**p = (*pos ? **p : 0) | (data << rb);
+		*pos += len;
+	} else {
+		*(*p)++ |= (data >> -rb);
+		**p = data << (8+rb);
+		*pos = -rb;
+	}
+}
+
+/* Write n_frames of S16LE stereo as an uncompressed ALAC frame in dst and
+ * return the size. The samples are big endian and not byte aligned after
+ * the header, each output byte is made of two input bytes. */
+static inline int raop_write_pcm(void *dst, const void *frames, uint32_t n_frames)
+{
+	const uint8_t *d = frames;
+	uint8_t *bp, *b, prev;
+	int bpos = 0, shift;
+	uint32_t i;
+
+	b = bp = dst;
+
+	raop_bit_writer(&bp, &bpos, 1, 3); /* channel=1, stereo */
+	raop_bit_writer(&bp, &bpos, 0, 4); /* Unknown */
+	raop_bit_writer(&bp, &bpos, 0, 8); /* Unknown */
+	raop_bit_writer(&bp, &bpos, 0, 4); /* Unknown */
+	raop_bit_writer(&bp, &bpos, 1, 1); /* Hassize */
+	raop_bit_writer(&bp, &bpos, 0, 2); /* Unused */
+	raop_bit_writer(&bp, &bpos, 1, 1); /* Is-not-compressed */
+	raop_bit_writer(&bp, &bpos, (n_frames >> 24) & 0xff, 8);
+	raop_bit_writer(&bp, &bpos, (n_frames >> 16) & 0xff, 8);
+	raop_bit_writer(&bp, &bpos, (n_frames >> 8)  & 0xff, 8);
+	raop_bit_writer(&bp, &bpos, (n_frames)       & 0xff, 8);
+
+	/* like raop_bit_writer() for 8 bits at a time */
+	shift = bpos;
+	prev = *bp;
+#define RAOP_PUT(v)	do {					\
+	*bp++ = prev | ((v) >> shift);				\
+	prev = (uint8_t)((v) << (8 - shift));			\
+} while (0)
+	for (i = 0; i < n_frames; i++) {
+		RAOP_PUT(d[1]);
+		RAOP_PUT(d[0]);
+		RAOP_PUT(d[3]);
+		RAOP_PUT(d[2]);
+		d += 4;
+	}
+#undef RAOP_PUT
+	*bp = prev;
+	return bp - b + 1;
+}
+
+/* Set the key and iv of the session. The key schedule is made once and is
+ * used for all packets. */
+static inline int raop_aes_init(EVP_CIPHER_CTX *ctx, const uint8_t key[16], const uint8_t iv[16])
+{
+	if (EVP_EncryptInit_ex(ctx, EVP_aes_128_cbc(), NULL, key, iv) != 1)
+		return -EIO;
+	EVP_CIPHER_CTX_set_padding(ctx, 0);
+	return 0;
+}
+
+/* Encrypt the complete AES blocks of a packet in place, every packet starts
+ * again from the iv of the session. */
+static inline int raop_aes_encrypt(EVP_CIPHER_CTX *ctx, const uint8_t iv[16],
+		uint8_t *data, int len)
+{
+	int i = len & ~0xf, clen = i;
+	if (EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, iv) != 1 ||
+	    EVP_EncryptUpdate(ctx, data, &clen, data, i) != 1)
+		return -EIO;
+	return i;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PIPEWIRE_RAOP_PACKET_H */
@@ -117,6 +117,8 @@
  *                     create-stream = {
  *                         #sess.latency.msec = 100
  *                         #sess.ts-direct = false
+ *                         #net.shared-socket = false
+ *                         #net.rtcp = false
  *                         #target.object = ""
  *                     }
  *                 }
@@ -971,6 +973,12 @@ static int session_load_source(struct session *session, struct pw_properties *pr
 	if ((str = pw_properties_get(props, "local.ifname")) != NULL || (str = impl->ifname) != NULL) {
 		fprintf(f, "\"local.ifname\" = \"%s\", ", str);
 	}
+	if ((str = pw_properties_get(props, "net.shared-socket")) != NULL)
+		fprintf(f, "\"net.shared-socket\" = %s, ", str);
+	if ((str = pw_properties_get(props, "net.rtcp")) != NULL)
+		fprintf(f, "\"net.rtcp\" = %s, ", str);
+	if ((str = pw_properties_get(props, "net.rtcp.interval.msec")) != NULL)
+		fprintf(f, "\"net.rtcp.interval.msec\" = %s, ", str);
 
 	if ((media = pw_properties_get(props, "sess.media")) == NULL)
 		media = "audio";
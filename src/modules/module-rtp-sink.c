@@ -14,6 +14,9 @@
 #include <netinet/in.h>
 #include <net/if.h>
 #include <ctype.h>
+#ifdef SO_TXTIME
+#include <linux/net_tstamp.h>
+#endif
 
 #include <spa/utils/hook.h>
 #include <spa/utils/result.h>
@@ -25,8 +28,11 @@
 #include <pipewire/pipewire.h>
 #include <pipewire/impl.h>
 
+#include <module-rtp/rtcp.h>
+#include <module-rtp/rate-control.h>
 #include <module-rtp/stream.h>
 #include "network-utils.h"
+#include "network-batch.h"
 
 #ifndef IPTOS_DSCP
 #define IPTOS_DSCP_MASK 0xfc
@@ -53,6 +59,26 @@
  * - `net.mtu = <int>`: MTU to use, default 1280
  * - `net.ttl = <int>`: TTL to use, default 1
  * - `net.loop = <bool>`: loopback multicast, default false
+ * - `net.batch-size = <int>`: the max number of packets to send with one system call,
+ *       default 32
+ * - `net.gso = <bool>`: use UDP segmentation offload when possible, default true
+ * - `net.txtime = <bool>`: give the packets a SO_TXTIME launch time and send all
+ *       packets of a cycle at once instead of pacing them with a timer, default false.
+ *       This needs the etf or fq qdisc on the interface.
+ * - `net.txtime.clock = <string>`: the clock of the launch times, TAI or MONOTONIC,
+ *       default TAI. Use TAI with the etf qdisc and a PTP synchronized system clock,
+ *       MONOTONIC with the fq qdisc.
+ * - `net.txtime.delay.usec = <int>`: the minimum time between sending a packet and
+ *       its launch time, default 1000
+ * - `net.rtcp = <bool>`: receive RTCP receiver reports on destination.port + 1 and
+ *       adapt the bitrate, FEC and packet time of an opus stream to the reported
+ *       loss and jitter, default false. The rtp-source sends the reports with
+ *       net.rtcp = true.
+ * - `opus.max-bitrate = <int>`: the max bits per second on the wire, with the
+ *       headers, default 128000. Without net.rtcp, this is the bitrate when it is
+ *       set, else the encoder chooses the bitrate.
+ * - `opus.min-bitrate = <int>`: the min bits per second on the wire with net.rtcp,
+ *       default 16000
  * - `sess.min-ptime = <float>`: minimum packet time in milliseconds, default 2
  * - `sess.max-ptime = <float>`: maximum packet time in milliseconds, default 20
  * - `sess.name = <str>`: a session name
@@ -95,6 +121,9 @@
  *         #net.mtu = 1280
  *         #net.ttl = 1
  *         #net.loop = false
+ *         #net.txtime = false
+ *         #net.rtcp = false
+ *         #opus.max-bitrate = 128000
  *         #sess.min-ptime = 2
  *         #sess.max-ptime = 20
  *         #sess.name = "PipeWire RTP stream"
@@ -129,6 +158,19 @@ PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
 
 #define DEFAULT_TS_OFFSET	-1
 
+#define DEFAULT_TXTIME_CLOCK	"TAI"
+#define DEFAULT_TXTIME_DELAY	1000
+
+#define DEFAULT_MIN_BITRATE	16000
+#define DEFAULT_MAX_BITRATE	128000
+
+/* the IP, UDP and RTP headers */
+#define HEADER_SIZE_IP4		(20 + 8 + 12)
+#define HEADER_SIZE_IP6		(40 + 8 + 12)
+
+/* room for the headers on top of the MTU worth of payload */
+#define PACKET_HEADROOM		64
+
 #define USAGE	"( source.ip=<source IP address, default:"DEFAULT_SOURCE_IP"> ) "			\
 		"( destination.ip=<destination IP address, default:"DEFAULT_DESTINATION_IP"> ) "	\
  		"( destination.port=<int, default random beteen 46000 and 47024> ) "			\
@@ -137,6 +179,14 @@ PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
 		"( net.ttl=<desired TTL, default:"SPA_STRINGIFY(DEFAULT_TTL)"> ) "			\
 		"( net.loop=<desired loopback, default:"SPA_STRINGIFY(DEFAULT_LOOP)"> ) "		\
 		"( net.dscp=<desired DSCP, default:"SPA_STRINGIFY(DEFAULT_DSCP)"> ) "			\
+		"( net.batch-size=<max packets per system call, default:32> ) "				\
+		"( net.gso=<use UDP segmentation offload, default:true> ) "				\
+		"( net.txtime=<use SO_TXTIME launch times, default:false> ) "				\
+		"( net.txtime.clock=<TAI|MONOTONIC, default:"DEFAULT_TXTIME_CLOCK"> ) "			\
+		"( net.txtime.delay.usec=<launch time delay, default:"SPA_STRINGIFY(DEFAULT_TXTIME_DELAY)"> ) "	\
+		"( net.rtcp=<adapt to RTCP receiver reports, default:false> ) "				\
+		"( opus.max-bitrate=<max bits per second, default:"SPA_STRINGIFY(DEFAULT_MAX_BITRATE)"> ) "	\
+		"( opus.min-bitrate=<min bits per second, default:"SPA_STRINGIFY(DEFAULT_MIN_BITRATE)"> ) "	\
 		"( sess.name=<a name for the session> ) "						\
 		"( sess.min-ptime=<minimum packet time in milliseconds, default:2> ) "			\
 		"( sess.max-ptime=<maximum packet time in milliseconds, default:20> ) "			\
@@ -186,6 +236,20 @@ struct impl {
 	socklen_t dst_len;
 
 	int rtp_fd;
+	struct pw_net_batch batch;
+
+	bool txtime;
+	clockid_t txtime_clock;
+	uint64_t txtime_delay;
+
+	bool rtcp;
+	bool set_bitrate;
+	uint32_t ssrc;
+	uint32_t min_bitrate;
+	uint32_t max_bitrate;
+	float max_ptime;
+	struct spa_source *rtcp_source;
+	struct rtp_rate_control rate_control;
 };
 
 static bool is_multicast(struct sockaddr *sa, socklen_t salen)
@@ -274,11 +338,31 @@ static void stream_destroy(void *d)
 	impl->stream = NULL;
 }
 
+static void stream_flush_packets(void *data)
+{
+	struct impl *impl = data;
+	int res;
+
+	if ((res = pw_net_batch_flush(&impl->batch, impl->rtp_fd, MSG_NOSIGNAL)) < 0)
+		pw_log_warn("sendmmsg() failed: %s", spa_strerror(res));
+}
+
 static void stream_send_packet(void *data, struct iovec *iov, size_t iovlen)
 {
 	struct impl *impl = data;
 	struct msghdr msg;
 	ssize_t n;
+	int res;
+
+	/* queue the packet, they are sent in stream_flush_packets() */
+	if ((res = pw_net_batch_add(&impl->batch, iov, iovlen)) == -ENOSPC) {
+		stream_flush_packets(impl);
+		res = pw_net_batch_add(&impl->batch, iov, iovlen);
+	}
+	if (res == 0)
+		return;
+
+	stream_flush_packets(impl);
 
 	spa_zero(msg);
 	msg.msg_iov = iov;
@@ -292,6 +376,132 @@ static void stream_send_packet(void *data, struct iovec *iov, size_t iovlen)
 		pw_log_warn("sendmsg() failed: %m");
 }
 
+static void stream_send_packet_txtime(void *data, struct iovec *iov, size_t iovlen,
+		uint64_t txtime)
+{
+#ifdef SO_TXTIME
+	struct impl *impl = data;
+	int res;
+
+	if ((res = pw_net_batch_add_txtime(&impl->batch, iov, iovlen, txtime)) == -ENOSPC) {
+		stream_flush_packets(impl);
+		res = pw_net_batch_add_txtime(&impl->batch, iov, iovlen, txtime);
+	}
+	if (res == 0)
+		return;
+#endif
+	stream_send_packet(data, iov, iovlen);
+}
+
+static int setup_txtime(struct impl *impl)
+{
+#ifdef SO_TXTIME
+	struct sock_txtime txtime_cfg;
+	int res;
+
+	spa_zero(txtime_cfg);
+	txtime_cfg.clockid = impl->txtime_clock;
+	if (setsockopt(impl->rtp_fd, SOL_SOCKET, SO_TXTIME, &txtime_cfg,
+				sizeof(txtime_cfg)) < 0) {
+		res = -errno;
+		pw_log_warn("setsockopt(SO_TXTIME) failed: %m");
+		return res;
+	}
+	return rtp_stream_set_txtime(impl->stream, impl->txtime_clock, impl->txtime_delay);
+#else
+	return -ENOTSUP;
+#endif
+}
+
+static int set_encoding(struct impl *impl)
+{
+	struct rtp_stream_encoding enc;
+	int res;
+
+	if ((res = rtp_stream_get_encoding(impl->stream, &enc)) < 0)
+		return res;
+
+	enc.psamples = impl->rate_control.samples;
+	enc.bitrate = rtp_rate_control_encoder_bitrate(&impl->rate_control);
+	enc.packet_loss = impl->rate_control.packet_loss;
+	return rtp_stream_set_encoding(impl->stream, &enc);
+}
+
+static void on_rtcp_io(void *data, int fd, uint32_t mask)
+{
+	struct impl *impl = data;
+	struct rtcp_report_block block;
+	uint8_t buffer[1500];
+	struct timespec now;
+	uint8_t fraction;
+	ssize_t len;
+
+	if (!(mask & SPA_IO_IN))
+		return;
+
+	while ((len = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0) {
+		if (rtcp_find_report(buffer, len, impl->ssrc, &block) <= 0)
+			continue;
+
+		fraction = rtcp_report_fraction_lost(&block);
+		pw_log_debug("report lost:%u/256 jitter:%u", fraction, ntohl(block.jitter));
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (!rtp_rate_control_report(&impl->rate_control, SPA_TIMESPEC_TO_NSEC(&now),
+					fraction, ntohl(block.jitter)))
+			continue;
+
+		pw_log_info("lost:%u/256 jitter:%u: bitrate:%u samples:%u packet-loss:%u%%",
+				fraction, ntohl(block.jitter),
+				impl->rate_control.bitrate, impl->rate_control.samples,
+				impl->rate_control.packet_loss);
+		set_encoding(impl);
+	}
+}
+
+/* start at the max bitrate with packets that are large enough for it */
+static int setup_encoding(struct impl *impl)
+{
+	struct rtp_stream_encoding enc;
+	int res;
+
+	if ((res = rtp_stream_get_encoding(impl->stream, &enc)) < 0)
+		return res;
+
+	rtp_rate_control_init(&impl->rate_control, impl->min_bitrate, impl->max_bitrate,
+			enc.rate, enc.psamples, impl->max_ptime * enc.rate / 1000,
+			impl->src_addr.ss_family == AF_INET ? HEADER_SIZE_IP4 : HEADER_SIZE_IP6);
+
+	return set_encoding(impl);
+}
+
+static int setup_rtcp(struct impl *impl)
+{
+	struct sockaddr_storage addr = impl->src_addr;
+	int fd, res, val = 1;
+
+	if (addr.ss_family == AF_INET)
+		((struct sockaddr_in*)&addr)->sin_port = htons(impl->dst_port + 1);
+	else
+		((struct sockaddr_in6*)&addr)->sin6_port = htons(impl->dst_port + 1);
+
+	if ((fd = socket(addr.ss_family, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)) < 0)
+		return -errno;
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val)) < 0 ||
+	    bind(fd, (struct sockaddr*)&addr, impl->src_len) < 0) {
+		res = -errno;
+		close(fd);
+		return res;
+	}
+	impl->rtcp_source = pw_loop_add_io(impl->loop, fd, SPA_IO_IN, true, on_rtcp_io, impl);
+	if (impl->rtcp_source == NULL) {
+		res = -errno;
+		close(fd);
+		return res;
+	}
+	return 0;
+}
+
 static void stream_state_changed(void *data, bool started, const char *error)
 {
 	struct impl *impl = data;
@@ -310,7 +520,23 @@ static void stream_state_changed(void *data, bool started, const char *error)
 			return;
 		}
 		impl->rtp_fd = res;
+
+		if (impl->txtime && (res = setup_txtime(impl)) < 0) {
+			pw_log_warn("can't use launch times, pacing with a timer: %s",
+					spa_strerror(res));
+			rtp_stream_set_txtime(impl->stream, -1, 0);
+		}
+		if ((impl->rtcp || impl->set_bitrate) && impl->rtcp_source == NULL &&
+		    (res = setup_encoding(impl)) < 0) {
+			pw_log_warn("can't set the bitrate: %s", spa_strerror(res));
+		} else if (impl->rtcp && impl->rtcp_source == NULL &&
+		    (res = setup_rtcp(impl)) < 0) {
+			pw_log_warn("can't receive RTCP reports: %s", spa_strerror(res));
+		}
 	} else {
+		if (impl->rtcp_source)
+			pw_loop_destroy_source(impl->loop, impl->rtcp_source);
+		impl->rtcp_source = NULL;
 		close(impl->rtp_fd);
 		impl->rtp_fd = -1;
 	}
@@ -383,6 +609,8 @@ static const struct rtp_stream_events stream_events = {
 	.state_changed = stream_state_changed,
 	.param_changed = stream_param_changed,
 	.send_packet = stream_send_packet,
+	.flush_packets = stream_flush_packets,
+	.send_packet_txtime = stream_send_packet_txtime,
 };
 
 static void core_destroy(void *d)
@@ -399,6 +627,8 @@ static const struct pw_proxy_events core_proxy_events = {
 
 static void impl_destroy(struct impl *impl)
 {
+	if (impl->rtcp_source)
+		pw_loop_destroy_source(impl->loop, impl->rtcp_source);
 	if (impl->stream)
 		rtp_stream_destroy(impl->stream);
 
@@ -411,6 +641,7 @@ static void impl_destroy(struct impl *impl)
 	pw_properties_free(impl->stream_props);
 	pw_properties_free(impl->props);
 
+	pw_net_batch_clear(&impl->batch);
 	free(impl->ifname);
 	free(impl->session_name);
 	free(impl);
@@ -552,11 +783,62 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 	impl->mcast_loop = pw_properties_get_bool(props, "net.loop", DEFAULT_LOOP);
 	impl->dscp = pw_properties_get_uint32(props, "net.dscp", DEFAULT_DSCP);
 
+	if ((res = pw_net_batch_init(&impl->batch,
+			pw_properties_get_uint32(props, "net.batch-size", PW_NET_BATCH_MAX),
+			pw_properties_get_uint32(props, "net.mtu", DEFAULT_MTU) + PACKET_HEADROOM,
+			pw_properties_get_bool(props, "net.gso", true))) < 0) {
+		pw_log_error("can't allocate send buffers: %s", spa_strerror(res));
+		goto out;
+	}
+
+	impl->txtime = pw_properties_get_bool(props, "net.txtime", false);
+	if (impl->txtime) {
+		if ((str = pw_properties_get(props, "net.txtime.clock")) == NULL)
+			str = DEFAULT_TXTIME_CLOCK;
+		if (spa_streq(str, "TAI")) {
+			impl->txtime_clock = CLOCK_TAI;
+		} else if (spa_streq(str, "MONOTONIC")) {
+			impl->txtime_clock = CLOCK_MONOTONIC;
+		} else {
+			res = -EINVAL;
+			pw_log_error("invalid net.txtime.clock %s", str);
+			goto out;
+		}
+		impl->txtime_delay = pw_properties_get_uint32(props, "net.txtime.delay.usec",
+				DEFAULT_TXTIME_DELAY) * SPA_NSEC_PER_USEC;
+#ifdef SO_TXTIME
+		res = pw_net_batch_init_txtime(&impl->batch);
+#else
+		res = -ENOTSUP;
+#endif
+		if (res < 0) {
+			pw_log_warn("can't use launch times: %s", spa_strerror(res));
+			impl->txtime = false;
+		}
+	}
+
 	ts_offset = pw_properties_get_int64(props, "sess.ts-offset", DEFAULT_TS_OFFSET);
 	if (ts_offset == -1)
 		ts_offset = pw_rand32();
 	pw_properties_setf(stream_props, "rtp.sender-ts-offset", "%u", (uint32_t)ts_offset);
 
+	impl->rtcp = pw_properties_get_bool(props, "net.rtcp", false);
+	impl->min_bitrate = pw_properties_get_uint32(props, "opus.min-bitrate",
+			DEFAULT_MIN_BITRATE);
+	impl->max_bitrate = pw_properties_get_uint32(props, "opus.max-bitrate",
+			DEFAULT_MAX_BITRATE);
+	impl->set_bitrate = pw_properties_get(props, "opus.max-bitrate") != NULL;
+	if ((str = pw_properties_get(props, "sess.max-ptime")) == NULL ||
+	    !spa_atof(str, &impl->max_ptime))
+		impl->max_ptime = DEFAULT_MAX_PTIME;
+	if (impl->rtcp) {
+		/* the reports are about our SSRC */
+		if (pw_properties_fetch_uint32(stream_props, "rtp.sender-ssrc", &impl->ssrc) < 0) {
+			impl->ssrc = pw_rand32();
+			pw_properties_setf(stream_props, "rtp.sender-ssrc", "%u", impl->ssrc);
+		}
+	}
+
 	pw_net_get_ip(&impl->src_addr, addr, sizeof(addr), NULL, NULL);
 	pw_properties_set(stream_props, "rtp.source.ip", addr);
 	pw_net_get_ip(&impl->dst_addr, addr, sizeof(addr), NULL, NULL);
@@ -29,8 +29,10 @@
 #include <pipewire/pipewire.h>
 #include <pipewire/impl.h>
 
+#include <module-rtp/rtcp.h>
 #include <module-rtp/stream.h>
 #include "network-utils.h"
+#include "network-batch.h"
 
 #ifdef __FreeBSD__
 #define ifr_ifindex ifr_index
@@ -59,9 +61,26 @@
  * - `node.always-process = <bool>`: true to receive even when not running
  * - `sess.latency.msec = <float>`: target network latency in milliseconds, default 100
  * - `sess.ignore-ssrc = <bool>`: ignore SSRC, default false
+ * - `sess.max-reorder = <int>`: the max number of packets that can be reordered or
+ *                lost without a resync, default 16. Lost packets are concealed.
  * - `sess.media = <string>`: the media type audio|midi|opus, default audio
+ * - `net.batch-size = <int>`: the max number of packets to receive with one
+ *                system call, default 32
+ * - `net.shared-socket = <bool>`: share one socket with the other sources in this
+ *                process that receive a multicast stream on the same port and
+ *                interface, default false. The packets of all streams are then
+ *                received with one wakeup.
+ * - `net.rtcp = <bool>`: send RTCP receiver reports with the loss and jitter of the
+ *                stream to the sender, on source.port + 1, default false. The
+ *                rtp-sink can use them to adapt the bitrate.
+ * - `net.rtcp.interval.msec = <int>`: the time between receiver reports, default 1000
  * - `stream.props = {}`: properties to be passed to the stream
  *
+ * The stream properties rtp.stats.received, rtp.stats.lost, rtp.stats.reordered,
+ * rtp.stats.late and rtp.stats.concealed have the number of received, lost,
+ * reordered and dropped late packets and the number of concealed samples. They
+ * are updated every cleanup.sec when they changed.
+ *
  * ## General options
  *
  * Options with well-known behavior:
@@ -89,6 +108,7 @@
  *         #source.port = 0
  *         sess.latency.msec = 100
  *         #sess.ignore-ssrc = false
+ *         #net.rtcp = false
  *         #node.always-process = false
  *         #sess.media = "audio"
  *         #audio.format = "S16BE"
@@ -117,11 +137,21 @@ PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
 
 #define DEFAULT_TS_OFFSET		-1
 
+#define DEFAULT_RTCP_INTERVAL		1000
+
+#define MAX_PACKET_SIZE			2048
+#define MAX_CONTROL_SIZE		64
+
 #define USAGE   "( local.ifname=<local interface name to use> ) "						\
 		"( source.ip=<source IP address, default:"DEFAULT_SOURCE_IP"> ) "				\
  		"source.port=<int, source port> "								\
 		"( sess.latency.msec=<target network latency, default "SPA_STRINGIFY(DEFAULT_SESS_LATENCY)"> ) "\
 		"( sess.ignore-ssrc=<to ignore SSRC, default false> ) "\
+		"( sess.max-reorder=<max reordered or lost packets, default "SPA_STRINGIFY(DEFAULT_MAX_REORDER)"> ) "\
+		"( net.batch-size=<max packets per system call, default:32> ) "\
+		"( net.shared-socket=<share the socket with other sources, default:false> ) "\
+		"( net.rtcp=<send RTCP receiver reports, default:false> ) "\
+		"( net.rtcp.interval.msec=<time between reports, default:"SPA_STRINGIFY(DEFAULT_RTCP_INTERVAL)"> ) "\
  		"( sess.media=<string, the media type audio|midi|opus, default audio> ) "			\
 		"( audio.format=<format, default:"DEFAULT_FORMAT"> ) "						\
 		"( audio.rate=<sample rate, default:"SPA_STRINGIFY(DEFAULT_RATE)"> ) "				\
@@ -155,6 +185,7 @@ struct impl {
 	uint32_t cleanup_interval;
 
 	struct spa_source *timer;
+	struct rtp_stream_stats last_stats;	/* in the stream properties */
 
 	struct pw_properties *stream_props;
 	struct rtp_stream *stream;
@@ -163,36 +194,89 @@ struct impl {
 	struct sockaddr_storage src_addr;
 	socklen_t src_len;
 	struct spa_source *source;
+	struct pw_net_batch batch;
+
+	struct shared_socket *shared;
+	struct spa_list shared_link;
+	uint32_t ssrc;
+
+	/* the address of the sender, updated from the data loop */
+	struct sockaddr_storage sender_addr;
+	socklen_t sender_len;
+	int rtcp_fd;
+	uint32_t rtcp_interval;
+	uint32_t rtcp_ssrc;
+	struct spa_source *rtcp_timer;
+	struct rtcp_report_state report;
 
 	unsigned receiving:1;
+	unsigned use_shared:1;
+	unsigned have_ssrc:1;
+	unsigned ignore_ssrc:1;
+	unsigned rtcp:1;
 };
 
+/* Multicast sources on the same port and interface can share one socket
+ * that joins all their groups. The packets are dispatched to the sources
+ * by destination address and SSRC. The list of sockets is only used from
+ * the main thread, the list of receivers is changed from the data loop. */
+struct shared_socket {
+	struct spa_list link;
+	int ref;
+
+	struct pw_loop *data_loop;
+	int af;
+	uint16_t port;
+	char *ifname;
+
+	struct spa_source *source;
+	struct pw_net_batch batch;
+	struct spa_list receivers;
+};
+
+static struct spa_list shared_sockets = SPA_LIST_INIT(&shared_sockets);
+
+static inline void update_sender(struct impl *impl, struct msghdr *msg)
+{
+	if (msg->msg_namelen == impl->sender_len &&
+	    memcmp(msg->msg_name, &impl->sender_addr, msg->msg_namelen) == 0)
+		return;
+	memcpy(&impl->sender_addr, msg->msg_name, SPA_MIN(msg->msg_namelen,
+				(socklen_t)sizeof(impl->sender_addr)));
+	impl->sender_len = msg->msg_namelen;
+}
+
 static void
 on_rtp_io(void *data, int fd, uint32_t mask)
 {
 	struct impl *impl = data;
-	ssize_t len;
-	uint8_t buffer[2048];
+	int i, res;
+	uint32_t len;
+	uint8_t *buffer;
 
 	if (mask & SPA_IO_IN) {
-		if ((len = recv(fd, buffer, sizeof(buffer), 0)) < 0)
+		if ((res = pw_net_batch_recv(&impl->batch, fd,
+				impl->batch.max_packets, MSG_DONTWAIT)) < 0)
 			goto receive_error;
 
-		if (len < 12)
-			goto short_packet;
-
-		if (SPA_LIKELY(impl->stream))
-			rtp_stream_receive_packet(impl->stream, buffer, len);
+		for (i = 0; i < res; i++) {
+			len = pw_net_batch_get(&impl->batch, i, &buffer);
+			if (len < 12) {
+				pw_log_warn("short packet received");
+				continue;
+			}
+			if (SPA_LIKELY(impl->stream))
+				rtp_stream_receive_packet(impl->stream, buffer, len);
+			if (impl->rtcp)
+				update_sender(impl, pw_net_batch_get_msg(&impl->batch, i));
 
-		impl->receiving = true;
+			impl->receiving = true;
+		}
 	}
 	return;
 
 receive_error:
-	pw_log_warn("recv error: %m");
-	return;
-short_packet:
-	pw_log_warn("short packet received");
+	pw_log_warn("recv error: %s", spa_strerror(res));
 	return;
 }
 
@@ -293,15 +377,333 @@ error:
 	return res;
 }
 
+static bool is_multicast(const struct sockaddr_storage *sa)
+{
+	if (sa->ss_family == AF_INET) {
+		static const uint32_t ipv4_mcast_mask = 0xe0000000;
+		const struct sockaddr_in *sa4 = (const struct sockaddr_in*)sa;
+		return (ntohl(sa4->sin_addr.s_addr) & ipv4_mcast_mask) == ipv4_mcast_mask;
+	} else if (sa->ss_family == AF_INET6) {
+		const struct sockaddr_in6 *sa6 = (const struct sockaddr_in6*)sa;
+		return sa6->sin6_addr.s6_addr[0] == 0xff;
+	}
+	return false;
+}
+
+static bool packet_destination_matches(struct msghdr *msg, const struct sockaddr_storage *sa)
+{
+	struct cmsghdr *cmsg;
+
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO &&
+		    sa->ss_family == AF_INET) {
+			const struct sockaddr_in *sa4 = (const struct sockaddr_in*)sa;
+			struct in_pktinfo info;
+			memcpy(&info, CMSG_DATA(cmsg), sizeof(info));
+			return info.ipi_addr.s_addr == sa4->sin_addr.s_addr;
+		}
+		if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PKTINFO &&
+		    sa->ss_family == AF_INET6) {
+			const struct sockaddr_in6 *sa6 = (const struct sockaddr_in6*)sa;
+			struct in6_pktinfo info;
+			memcpy(&info, CMSG_DATA(cmsg), sizeof(info));
+			return memcmp(&info.ipi6_addr, &sa6->sin6_addr, sizeof(info.ipi6_addr)) == 0;
+		}
+	}
+	return false;
+}
+
+static void
+on_shared_io(void *data, int fd, uint32_t mask)
+{
+	struct shared_socket *s = data;
+	struct impl *impl;
+	int i, res;
+	uint32_t len, ssrc;
+	uint8_t *buffer;
+	struct msghdr *msg;
+
+	if (mask & SPA_IO_IN) {
+		if ((res = pw_net_batch_recv(&s->batch, fd,
+				s->batch.max_packets, MSG_DONTWAIT)) < 0)
+			goto receive_error;
+
+		for (i = 0; i < res; i++) {
+			len = pw_net_batch_get(&s->batch, i, &buffer);
+			if (len < 12) {
+				pw_log_warn("short packet received");
+				continue;
+			}
+			msg = pw_net_batch_get_msg(&s->batch, i);
+			memcpy(&ssrc, &buffer[8], sizeof(ssrc));
+			ssrc = ntohl(ssrc);
+
+			spa_list_for_each(impl, &s->receivers, shared_link) {
+				if (!packet_destination_matches(msg, &impl->src_addr))
+					continue;
+				if (impl->have_ssrc && !impl->ignore_ssrc && impl->ssrc != ssrc)
+					continue;
+				if (SPA_LIKELY(impl->stream))
+					rtp_stream_receive_packet(impl->stream, buffer, len);
+				if (impl->rtcp)
+					update_sender(impl, msg);
+
+				impl->receiving = true;
+			}
+		}
+	}
+	return;
+
+receive_error:
+	pw_log_warn("recv error: %s", spa_strerror(res));
+	return;
+}
+
+static int make_shared_socket(int af, uint16_t port)
+{
+	int fd, val, res;
+	struct sockaddr_storage ba;
+	socklen_t len;
+
+	if ((fd = socket(af, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)) < 0) {
+		pw_log_error("socket failed: %m");
+		return -errno;
+	}
+	val = 1;
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val)) < 0) {
+		res = -errno;
+		pw_log_error("setsockopt failed: %m");
+		goto error;
+	}
+
+	spa_zero(ba);
+	if (af == AF_INET) {
+		struct sockaddr_in *ba4 = (struct sockaddr_in*)&ba;
+		ba4->sin_family = AF_INET;
+		ba4->sin_port = htons(port);
+		ba4->sin_addr.s_addr = INADDR_ANY;
+		len = sizeof(*ba4);
+		res = setsockopt(fd, IPPROTO_IP, IP_PKTINFO, &val, sizeof(val));
+#ifdef IP_MULTICAST_ALL
+		if (res == 0) {
+			/* only receive the groups joined on this socket */
+			val = 0;
+			res = setsockopt(fd, IPPROTO_IP, IP_MULTICAST_ALL, &val, sizeof(val));
+		}
+#endif
+	} else if (af == AF_INET6) {
+		struct sockaddr_in6 *ba6 = (struct sockaddr_in6*)&ba;
+		ba6->sin6_family = AF_INET6;
+		ba6->sin6_port = htons(port);
+		ba6->sin6_addr = in6addr_any;
+		len = sizeof(*ba6);
+		res = setsockopt(fd, IPPROTO_IPV6, IPV6_RECVPKTINFO, &val, sizeof(val));
+	} else {
+		res = -EINVAL;
+		goto error;
+	}
+	if (res < 0) {
+		res = -errno;
+		pw_log_error("setsockopt failed: %m");
+		goto error;
+	}
+
+	if (bind(fd, (struct sockaddr*)&ba, len) < 0) {
+		res = -errno;
+		pw_log_error("bind() failed: %m");
+		goto error;
+	}
+	return fd;
+error:
+	close(fd);
+	return res;
+}
+
+static int shared_socket_membership(struct shared_socket *s,
+		const struct sockaddr_storage *sa, bool join)
+{
+	unsigned int ifindex = 0;
+	char addr[128];
+	int res;
+
+	if (s->ifname && (ifindex = if_nametoindex(s->ifname)) == 0)
+		pw_log_warn("if_nametoindex %s failed: %m", s->ifname);
+
+	pw_net_get_ip(sa, addr, sizeof(addr), NULL, NULL);
+
+	if (sa->ss_family == AF_INET) {
+		const struct sockaddr_in *sa4 = (const struct sockaddr_in*)sa;
+		struct ip_mreqn mr4;
+		memset(&mr4, 0, sizeof(mr4));
+		mr4.imr_multiaddr = sa4->sin_addr;
+		mr4.imr_ifindex = ifindex;
+		pw_log_info("%s IPv4 group: %s", join ? "join" : "leave", addr);
+		res = setsockopt(s->source->fd, IPPROTO_IP,
+				join ? IP_ADD_MEMBERSHIP : IP_DROP_MEMBERSHIP,
+				&mr4, sizeof(mr4));
+	} else {
+		const struct sockaddr_in6 *sa6 = (const struct sockaddr_in6*)sa;
+		struct ipv6_mreq mr6;
+		memset(&mr6, 0, sizeof(mr6));
+		mr6.ipv6mr_multiaddr = sa6->sin6_addr;
+		mr6.ipv6mr_interface = ifindex;
+		pw_log_info("%s IPv6 group: %s", join ? "join" : "leave", addr);
+		res = setsockopt(s->source->fd, IPPROTO_IPV6,
+				join ? IPV6_JOIN_GROUP : IPV6_LEAVE_GROUP,
+				&mr6, sizeof(mr6));
+	}
+	if (res < 0) {
+		res = -errno;
+		pw_log_error("%s mcast failed: %m", join ? "join" : "leave");
+		return res;
+	}
+	return 0;
+}
+
+static bool same_group(const struct sockaddr_storage *a, const struct sockaddr_storage *b)
+{
+	if (a->ss_family != b->ss_family)
+		return false;
+	if (a->ss_family == AF_INET)
+		return ((const struct sockaddr_in*)a)->sin_addr.s_addr ==
+			((const struct sockaddr_in*)b)->sin_addr.s_addr;
+	return memcmp(&((const struct sockaddr_in6*)a)->sin6_addr,
+			&((const struct sockaddr_in6*)b)->sin6_addr,
+			sizeof(struct in6_addr)) == 0;
+}
+
+/* the group is joined once for all receivers of the same group */
+static bool shared_socket_has_group(struct shared_socket *s, struct impl *impl)
+{
+	struct impl *o;
+	spa_list_for_each(o, &s->receivers, shared_link) {
+		if (o != impl && same_group(&o->src_addr, &impl->src_addr))
+			return true;
+	}
+	return false;
+}
+
+static void shared_socket_unref(struct shared_socket *s)
+{
+	if (--s->ref > 0)
+		return;
+
+	spa_list_remove(&s->link);
+	if (s->source)
+		pw_loop_destroy_source(s->data_loop, s->source);
+	pw_net_batch_clear(&s->batch);
+	free(s->ifname);
+	free(s);
+}
+
+static struct shared_socket *shared_socket_ref(struct impl *impl)
+{
+	struct shared_socket *s;
+	int fd, res;
+
+	spa_list_for_each(s, &shared_sockets, link) {
+		if (s->data_loop == impl->data_loop &&
+		    s->af == impl->src_addr.ss_family &&
+		    s->port == impl->src_port &&
+		    spa_streq(s->ifname, impl->ifname)) {
+			s->ref++;
+			return s;
+		}
+	}
+
+	if ((s = calloc(1, sizeof(*s))) == NULL)
+		return NULL;
+
+	s->ref = 1;
+	s->data_loop = impl->data_loop;
+	s->af = impl->src_addr.ss_family;
+	s->port = impl->src_port;
+	s->ifname = impl->ifname ? strdup(impl->ifname) : NULL;
+	spa_list_init(&s->receivers);
+	spa_list_append(&shared_sockets, &s->link);
+
+	if ((res = pw_net_batch_init(&s->batch, impl->batch.max_packets,
+			MAX_PACKET_SIZE, false)) < 0 ||
+	    (res = pw_net_batch_init_control(&s->batch, MAX_CONTROL_SIZE)) < 0 ||
+	    (res = pw_net_batch_init_names(&s->batch)) < 0)
+		goto error;
+
+	if ((fd = make_shared_socket(s->af, s->port)) < 0) {
+		res = fd;
+		goto error;
+	}
+	s->source = pw_loop_add_io(s->data_loop, fd,
+				SPA_IO_IN, true, on_shared_io, s);
+	if (s->source == NULL) {
+		res = -errno;
+		close(fd);
+		goto error;
+	}
+	return s;
+error:
+	shared_socket_unref(s);
+	errno = -res;
+	return NULL;
+}
+
+static int do_add_receiver(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct impl *impl = user_data;
+	spa_list_append(&impl->shared->receivers, &impl->shared_link);
+	return 0;
+}
+
+static int do_remove_receiver(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct impl *impl = user_data;
+	spa_list_remove(&impl->shared_link);
+	return 0;
+}
+
+static int shared_start(struct impl *impl)
+{
+	struct shared_socket *s;
+	int res;
+
+	if ((s = shared_socket_ref(impl)) == NULL) {
+		pw_log_error("failed to create shared socket: %m");
+		return -errno;
+	}
+	if (!shared_socket_has_group(s, impl) &&
+	    (res = shared_socket_membership(s, &impl->src_addr, true)) < 0) {
+		shared_socket_unref(s);
+		return res;
+	}
+	impl->shared = s;
+	pw_loop_invoke(impl->data_loop, do_add_receiver, 1, NULL, 0, true, impl);
+	return 0;
+}
+
+static void shared_stop(struct impl *impl)
+{
+	struct shared_socket *s = impl->shared;
+
+	pw_loop_invoke(impl->data_loop, do_remove_receiver, 1, NULL, 0, true, impl);
+	if (!shared_socket_has_group(s, impl))
+		shared_socket_membership(s, &impl->src_addr, false);
+	impl->shared = NULL;
+	shared_socket_unref(s);
+}
+
 static int stream_start(struct impl *impl)
 {
 	int fd;
 
-	if (impl->source != NULL)
+	if (impl->source != NULL || impl->shared != NULL)
 		return 0;
 
 	pw_log_info("starting RTP listener");
 
+	if (impl->use_shared && is_multicast(&impl->src_addr))
+		return shared_start(impl);
+
 	if ((fd = make_socket((const struct sockaddr *)&impl->src_addr,
 					impl->src_len, impl->ifname)) < 0) {
 		pw_log_error("failed to create socket: %m");
@@ -320,12 +722,15 @@ static int stream_start(struct impl *impl)
 
 static void stream_stop(struct impl *impl)
 {
-	if (!impl->source)
+	if (!impl->source && !impl->shared)
 		return;
 
 	pw_log_info("stopping RTP listener");
 
-	pw_loop_destroy_source(impl->data_loop, impl->source);
+	if (impl->shared)
+		shared_stop(impl);
+	if (impl->source)
+		pw_loop_destroy_source(impl->data_loop, impl->source);
 	impl->source = NULL;
 }
 
@@ -419,10 +824,47 @@ static const struct rtp_stream_events stream_events = {
 	.param_changed = stream_param_changed,
 };
 
+static void update_stats(struct impl *impl)
+{
+	struct rtp_stream_stats stats, *last = &impl->last_stats;
+	struct spa_dict_item items[5];
+	char val[5][32];
+
+	if (impl->stream == NULL)
+		return;
+
+	rtp_stream_get_stats(impl->stream, &stats);
+
+	/* the properties are sent to all clients, only update them when
+	 * something changed */
+	if (stats.received == last->received && stats.lost == last->lost &&
+	    stats.reordered == last->reordered && stats.late == last->late &&
+	    stats.concealed == last->concealed)
+		return;
+	*last = stats;
+
+	snprintf(val[0], sizeof(val[0]), "%"PRIu64, stats.received);
+	snprintf(val[1], sizeof(val[1]), "%"PRIu64, stats.lost);
+	snprintf(val[2], sizeof(val[2]), "%"PRIu64, stats.reordered);
+	snprintf(val[3], sizeof(val[3]), "%"PRIu64, stats.late);
+	snprintf(val[4], sizeof(val[4]), "%"PRIu64, stats.concealed);
+	items[0] = SPA_DICT_ITEM_INIT("rtp.stats.received", val[0]);
+	items[1] = SPA_DICT_ITEM_INIT("rtp.stats.lost", val[1]);
+	items[2] = SPA_DICT_ITEM_INIT("rtp.stats.reordered", val[2]);
+	items[3] = SPA_DICT_ITEM_INIT("rtp.stats.late", val[3]);
+	items[4] = SPA_DICT_ITEM_INIT("rtp.stats.concealed", val[4]);
+	rtp_stream_update_properties(impl->stream, &SPA_DICT_INIT_ARRAY(items));
+
+	pw_log_debug("received:%s lost:%s reordered:%s late:%s concealed:%s",
+			val[0], val[1], val[2], val[3], val[4]);
+}
+
 static void on_timer_event(void *data, uint64_t expirations)
 {
 	struct impl *impl = data;
 
+	update_stats(impl);
+
 	if (!impl->receiving) {
 		pw_log_info("timeout, inactive RTP source");
 		//pw_impl_module_schedule_destroy(impl->module);
@@ -432,6 +874,75 @@ static void on_timer_event(void *data, uint64_t expirations)
 	impl->receiving = false;
 }
 
+static void send_report(struct impl *impl)
+{
+	struct rtp_stream_stats stats;
+	struct rtcp_source_stats source;
+	struct sockaddr_storage addr;
+	uint8_t buffer[RTCP_RR_SIZE];
+	socklen_t len;
+	size_t size;
+
+	if (impl->stream == NULL || impl->sender_len == 0)
+		return;
+
+	rtp_stream_get_stats(impl->stream, &stats);
+	if (stats.received == 0)
+		return;
+
+	spa_zero(source);
+	source.ssrc = stats.ssrc;
+	source.max_seq = stats.max_seq;
+	source.received = stats.received;
+	source.lost = stats.lost;
+	source.jitter = stats.jitter;
+	size = rtcp_rr_build((struct rtcp_rr*)buffer, impl->rtcp_ssrc, &source, &impl->report);
+
+	/* the sender receives the reports on the port after the RTP port */
+	addr = impl->sender_addr;
+	len = impl->sender_len;
+	if (addr.ss_family == AF_INET)
+		((struct sockaddr_in*)&addr)->sin_port = htons(impl->src_port + 1);
+	else if (addr.ss_family == AF_INET6)
+		((struct sockaddr_in6*)&addr)->sin6_port = htons(impl->src_port + 1);
+	else
+		return;
+
+	if (sendto(impl->rtcp_fd, buffer, size, MSG_NOSIGNAL,
+				(struct sockaddr*)&addr, len) < 0)
+		pw_log_debug("sendto() failed: %m");
+}
+
+static void on_rtcp_timer_event(void *data, uint64_t expirations)
+{
+	struct impl *impl = data;
+	send_report(impl);
+}
+
+static int setup_rtcp(struct impl *impl)
+{
+	struct timespec value, interval;
+
+	if ((impl->rtcp_fd = socket(impl->src_addr.ss_family,
+			SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)) < 0) {
+		pw_log_error("socket failed: %m");
+		return -errno;
+	}
+	if (pw_net_batch_init_names(&impl->batch) < 0)
+		return -errno;
+
+	impl->rtcp_ssrc = pw_rand32();
+	impl->rtcp_timer = pw_loop_add_timer(impl->loop, on_rtcp_timer_event, impl);
+	if (impl->rtcp_timer == NULL)
+		return -errno;
+
+	value.tv_sec = impl->rtcp_interval / SPA_MSEC_PER_SEC;
+	value.tv_nsec = (impl->rtcp_interval % SPA_MSEC_PER_SEC) * SPA_NSEC_PER_MSEC;
+	interval = value;
+	pw_loop_update_timer(impl->loop, impl->rtcp_timer, &value, &interval, false);
+	return 0;
+}
+
 static void core_destroy(void *d)
 {
 	struct impl *impl = d;
@@ -446,20 +957,24 @@ static const struct pw_proxy_events core_proxy_events = {
 
 static void impl_destroy(struct impl *impl)
 {
+	stream_stop(impl);
 	if (impl->stream)
 		rtp_stream_destroy(impl->stream);
-	if (impl->source)
-		pw_loop_destroy_source(impl->data_loop, impl->source);
 
 	if (impl->core && impl->do_disconnect)
 		pw_core_disconnect(impl->core);
 
 	if (impl->timer)
 		pw_loop_destroy_source(impl->loop, impl->timer);
+	if (impl->rtcp_timer)
+		pw_loop_destroy_source(impl->loop, impl->rtcp_timer);
+	if (impl->rtcp_fd >= 0)
+		close(impl->rtcp_fd);
 
 	pw_properties_free(impl->stream_props);
 	pw_properties_free(impl->props);
 
+	pw_net_batch_clear(&impl->batch);
 	free(impl->ifname);
 	free(impl);
 }
@@ -519,6 +1034,8 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 	if (impl == NULL)
 		return -errno;
 
+	impl->rtcp_fd = -1;
+
 	if (args == NULL)
 		args = "";
 
@@ -569,6 +1086,7 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 	copy_props(impl, props, "sess.latency.msec");
 	copy_props(impl, props, "sess.ts-direct");
 	copy_props(impl, props, "sess.ignore-ssrc");
+	copy_props(impl, props, "sess.max-reorder");
 
 	str = pw_properties_get(props, "local.ifname");
 	impl->ifname = str ? strdup(str) : NULL;
@@ -600,6 +1118,18 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 	impl->cleanup_interval = pw_properties_get_uint32(props,
 			"cleanup.sec", DEFAULT_CLEANUP_SEC);
 
+	impl->use_shared = pw_properties_get_bool(props, "net.shared-socket", false);
+	impl->have_ssrc = pw_properties_fetch_uint32(stream_props,
+			"rtp.receiver-ssrc", &impl->ssrc) == 0;
+	impl->ignore_ssrc = pw_properties_get_bool(stream_props, "sess.ignore-ssrc", false);
+
+	if ((res = pw_net_batch_init(&impl->batch,
+			pw_properties_get_uint32(props, "net.batch-size", PW_NET_BATCH_MAX),
+			MAX_PACKET_SIZE, false)) < 0) {
+		pw_log_error("can't allocate receive buffers: %s", spa_strerror(res));
+		goto out;
+	}
+
 	impl->core = pw_context_get_object(impl->context, PW_TYPE_INTERFACE_Core);
 	if (impl->core == NULL) {
 		str = pw_properties_get(props, PW_KEY_REMOTE_NAME);
@@ -635,6 +1165,14 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 	interval.tv_nsec = 0;
 	pw_loop_update_timer(impl->loop, impl->timer, &value, &interval, false);
 
+	impl->rtcp = pw_properties_get_bool(props, "net.rtcp", false);
+	impl->rtcp_interval = pw_properties_get_uint32(props, "net.rtcp.interval.msec",
+			DEFAULT_RTCP_INTERVAL);
+	if (impl->rtcp && (res = setup_rtcp(impl)) < 0) {
+		pw_log_error("can't set up RTCP: %s", spa_strerror(res));
+		goto out;
+	}
+
 	impl->stream = rtp_stream_new(impl->core,
 			PW_DIRECTION_OUTPUT, pw_properties_copy(stream_props),
 			&stream_events, impl);
@@ -94,6 +94,63 @@ static void rtp_audio_process_playback(void *data)
 	pw_stream_queue_buffer(impl->stream, buf);
 }
 
+/* fill samples at write by repeating the samples of the last packet */
+static void rtp_audio_conceal(struct impl *impl, uint32_t write, uint32_t samples)
+{
+	uint8_t tmp[4096];
+	uint32_t stride = impl->stride, chunk = impl->last_samples, n;
+
+	pw_log_debug("conceal %u samples at %u", samples, write);
+	impl->stats.concealed += samples;
+
+	if (chunk == 0)
+		memset(tmp, 0, sizeof(tmp));
+
+	while (samples > 0) {
+		n = SPA_MIN(samples, sizeof(tmp) / stride);
+		if (chunk > 0) {
+			/* the source stays chunk samples behind, so this also
+			 * repeats what we concealed before */
+			n = SPA_MIN(n, chunk);
+			spa_ringbuffer_read_data(&impl->ring,
+					impl->buffer, BUFFER_SIZE,
+					((write - chunk) * stride) & BUFFER_MASK,
+					tmp, n * stride);
+		}
+		spa_ringbuffer_write_data(&impl->ring,
+				impl->buffer, BUFFER_SIZE,
+				(write * stride) & BUFFER_MASK,
+				tmp, n * stride);
+		write += n;
+		samples -= n;
+	}
+	spa_ringbuffer_write_update(&impl->ring, write);
+}
+
+/* a reordered packet, put it in its place when it was not played yet */
+static int rtp_audio_receive_late(struct impl *impl, uint32_t write,
+		uint8_t *data, uint32_t samples)
+{
+	uint32_t read, end;
+
+	spa_ringbuffer_get_read_index(&impl->ring, &read);
+	spa_ringbuffer_get_write_index(&impl->ring, &end);
+
+	if ((int32_t)(write - read) < 0 || (int32_t)(end - (write + samples)) < 0) {
+		pw_log_debug("late packet write:%u read:%u end:%u", write, read, end);
+		impl->stats.late++;
+		return 0;
+	}
+	spa_ringbuffer_write_data(&impl->ring,
+			impl->buffer, BUFFER_SIZE,
+			(write * impl->stride) & BUFFER_MASK,
+			data, samples * impl->stride);
+	impl->stats.reordered++;
+	if (impl->stats.lost > 0)
+		impl->stats.lost--;
+	return 0;
+}
+
 static int rtp_audio_receive(struct impl *impl, uint8_t *buffer, ssize_t len)
 {
 	struct rtp_header *hdr;
@@ -120,17 +177,11 @@ static int rtp_audio_receive(struct impl *impl, uint8_t *buffer, ssize_t len)
 	impl->have_ssrc = !impl->ignore_ssrc;
 
 	seq = ntohs(hdr->sequence_number);
-	if (impl->have_seq && impl->seq != seq) {
-		pw_log_info("unexpected seq (%d != %d) SSRC:%u",
-				seq, impl->seq, hdr->ssrc);
-		impl->have_sync = false;
-	}
-	impl->seq = seq + 1;
-	impl->have_seq = true;
-
 	timestamp = ntohl(hdr->timestamp) - impl->ts_offset;
 
 	impl->receiving = true;
+	impl->stats.received++;
+	rtp_update_jitter(impl, timestamp);
 
 	plen = len - hlen;
 	samples = plen / stride;
@@ -140,6 +191,25 @@ static int rtp_audio_receive(struct impl *impl, uint8_t *buffer, ssize_t len)
 	/* we always write to timestamp + delay */
 	write = timestamp + impl->target_buffer;
 
+	switch (rtp_check_seq(impl, seq)) {
+	case RTP_SEQ_LATE:
+		return rtp_audio_receive_late(impl, write, &buffer[hlen], samples);
+	case RTP_SEQ_LOST:
+		if (impl->have_sync && (int32_t)(write - expected_write) > 0) {
+			if (write - expected_write <= rtp_max_conceal(impl))
+				rtp_audio_conceal(impl, expected_write, write - expected_write);
+			else
+				impl->have_sync = false;
+		}
+		filled = spa_ringbuffer_get_write_index(&impl->ring, &expected_write);
+		break;
+	case RTP_SEQ_RESYNC:
+		impl->have_sync = false;
+		break;
+	default:
+		break;
+	}
+
 	if (!impl->have_sync) {
 		pw_log_info("sync to timestamp:%u seq:%u ts_offset:%u SSRC:%u target:%u direct:%u",
 				timestamp, seq, impl->ts_offset, impl->ssrc,
@@ -173,6 +243,7 @@ static int rtp_audio_receive(struct impl *impl, uint8_t *buffer, ssize_t len)
 				&buffer[hlen], (samples * stride));
 		write += samples;
 		spa_ringbuffer_write_update(&impl->ring, write);
+		impl->last_samples = samples;
 	}
 	return 0;
 
@@ -194,13 +265,12 @@ unexpected_ssrc:
 
 static void set_timer(struct impl *impl, uint64_t time, uint64_t itime)
 {
-	struct itimerspec ts;
-	ts.it_value.tv_sec = time / SPA_NSEC_PER_SEC;
-	ts.it_value.tv_nsec = time % SPA_NSEC_PER_SEC;
-	ts.it_interval.tv_sec = itime / SPA_NSEC_PER_SEC;
-	ts.it_interval.tv_nsec = itime % SPA_NSEC_PER_SEC;
-	spa_system_timerfd_settime(impl->data_loop->system,
-			impl->timer->fd, SPA_FD_TIMER_ABSTIME, &ts, NULL);
+	struct timespec value, interval;
+	value.tv_sec = time / SPA_NSEC_PER_SEC;
+	value.tv_nsec = time % SPA_NSEC_PER_SEC;
+	interval.tv_sec = itime / SPA_NSEC_PER_SEC;
+	interval.tv_nsec = itime % SPA_NSEC_PER_SEC;
+	pw_loop_update_timer(impl->data_loop, impl->timer, &value, &interval, true);
 	impl->timer_running = time != 0 && itime != 0;
 }
 
@@ -214,6 +284,37 @@ set_iovec(struct spa_ringbuffer *rbuf, void *buffer, uint32_t size,
 	iov[1].iov_base = buffer;
 }
 
+/* map the graph clock to the txtime clock, the first sample of the cycle
+ * is sent at the start of the cycle plus the delay */
+static void rtp_audio_update_txtime(struct impl *impl, struct spa_io_position *pos,
+		uint32_t timestamp)
+{
+	struct timespec now, mono;
+	uint64_t nsec;
+
+	clock_gettime(impl->txtime_clock, &now);
+	clock_gettime(CLOCK_MONOTONIC, &mono);
+	nsec = SPA_TIMESPEC_TO_NSEC(&now);
+
+	impl->txtime_min = nsec + impl->txtime_delay;
+	impl->txtime_timestamp = timestamp;
+	if (SPA_LIKELY(pos)) {
+		impl->txtime_base = pos->clock.nsec + nsec - SPA_TIMESPEC_TO_NSEC(&mono) +
+			impl->txtime_delay;
+		impl->txtime_period = SPA_NSEC_PER_SEC / (impl->rate * pos->clock.rate_diff);
+	} else {
+		impl->txtime_base = impl->txtime_min;
+		impl->txtime_period = SPA_NSEC_PER_SEC / (double)impl->rate;
+	}
+}
+
+static inline uint64_t rtp_audio_txtime(struct impl *impl, uint32_t timestamp)
+{
+	int64_t t = impl->txtime_base +
+		(int32_t)(timestamp - impl->txtime_timestamp) * impl->txtime_period;
+	return SPA_MAX((uint64_t)SPA_MAX(t, 0), impl->txtime_min);
+}
+
 static void rtp_audio_flush_packets(struct impl *impl, uint32_t num_packets)
 {
 	int32_t avail, tosend;
@@ -254,7 +355,11 @@ static void rtp_audio_flush_packets(struct impl *impl, uint32_t num_packets)
 		pw_log_trace("sending %d packet:%d ts_offset:%d timestamp:%d",
 				tosend, num_packets, impl->ts_offset, timestamp);
 
-		rtp_stream_emit_send_packet(impl, iov, 3);
+		if (impl->txtime)
+			rtp_stream_emit_send_packet_txtime(impl, iov, 3,
+					rtp_audio_txtime(impl, timestamp));
+		else
+			rtp_stream_emit_send_packet(impl, iov, 3);
 
 		impl->seq++;
 		impl->first = false;
@@ -262,6 +367,7 @@ static void rtp_audio_flush_packets(struct impl *impl, uint32_t num_packets)
 		avail -= tosend;
 		num_packets--;
 	}
+	rtp_stream_emit_flush_packets(impl);
 	spa_ringbuffer_read_update(&impl->ring, timestamp);
 done:
 	if (avail < tosend && impl->timer_running)
@@ -343,6 +449,13 @@ static void rtp_audio_process_capture(void *data)
 	pending = filled / impl->psamples;
 	num_queued = (filled + wanted) / impl->psamples;
 
+	if (impl->txtime) {
+		/* hand all packets to the kernel, they leave at their launch time */
+		rtp_audio_update_txtime(impl, pos, timestamp);
+		if (num_queued > 0)
+			rtp_audio_flush_packets(impl, num_queued);
+		return;
+	}
 	if (num_queued > 0) {
 		/* flush all previous packets plus new one right away */
 		rtp_audio_flush_packets(impl, pending + 1);
@@ -440,6 +440,7 @@ static void rtp_midi_flush_packets(struct impl *impl,
 		rtp_stream_emit_send_packet(impl, iov, 3);
 		impl->seq++;
 	}
+	rtp_stream_emit_flush_packets(impl);
 }
 
 static void rtp_midi_process_capture(void *data)
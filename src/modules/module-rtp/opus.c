@@ -99,6 +99,35 @@ static void rtp_opus_process_playback(void *data)
 	pw_stream_queue_buffer(impl->stream, buf);
 }
 
+/* let the decoder fill the missing samples at write */
+static void rtp_opus_conceal(struct impl *impl, uint32_t write, uint32_t samples)
+{
+	OpusMSDecoder *dec = impl->stream_data;
+	uint32_t stride = impl->stride, index, end, n;
+	int res;
+
+	pw_log_debug("conceal %u samples at %u", samples, write);
+
+	while (samples > 0) {
+		index = (write * stride) & BUFFER_MASK2;
+		/* multiple of 2.5ms, max 60ms at 48kHz */
+		n = SPA_MIN(samples, 2880u);
+		res = opus_multistream_decode_float(dec, NULL, 0,
+				(float*)&impl->buffer[index], n, 0);
+		if (res <= 0)
+			break;
+
+		end = index + (res * stride);
+		if (end > BUFFER_SIZE2)
+			memmove(impl->buffer, &impl->buffer[BUFFER_SIZE2], end - BUFFER_SIZE2);
+
+		impl->stats.concealed += res;
+		write += res;
+		samples -= SPA_MIN(samples, (uint32_t)res);
+	}
+	spa_ringbuffer_write_update(&impl->ring, write);
+}
+
 static int rtp_opus_receive(struct impl *impl, uint8_t *buffer, ssize_t len)
 {
 	struct rtp_header *hdr;
@@ -127,17 +156,11 @@ static int rtp_opus_receive(struct impl *impl, uint8_t *buffer, ssize_t len)
 	impl->have_ssrc = !impl->ignore_ssrc;
 
 	seq = ntohs(hdr->sequence_number);
-	if (impl->have_seq && impl->seq != seq) {
-		pw_log_info("unexpected seq (%d != %d) SSRC:%u",
-				seq, impl->seq, hdr->ssrc);
-		impl->have_sync = false;
-	}
-	impl->seq = seq + 1;
-	impl->have_seq = true;
-
 	timestamp = ntohl(hdr->timestamp) - impl->ts_offset;
 
 	impl->receiving = true;
+	impl->stats.received++;
+	rtp_update_jitter(impl, timestamp);
 
 	plen = len - hlen;
 
@@ -146,6 +169,27 @@ static int rtp_opus_receive(struct impl *impl, uint8_t *buffer, ssize_t len)
 	/* we always write to timestamp + delay */
 	write = timestamp + impl->target_buffer;
 
+	switch (rtp_check_seq(impl, seq)) {
+	case RTP_SEQ_LATE:
+		/* the decoder has moved on, we can't use it anymore */
+		impl->stats.late++;
+		return 0;
+	case RTP_SEQ_LOST:
+		if (impl->have_sync && (int32_t)(write - expected_write) > 0) {
+			if (write - expected_write <= rtp_max_conceal(impl))
+				rtp_opus_conceal(impl, expected_write, write - expected_write);
+			else
+				impl->have_sync = false;
+		}
+		filled = spa_ringbuffer_get_write_index(&impl->ring, &expected_write);
+		break;
+	case RTP_SEQ_RESYNC:
+		impl->have_sync = false;
+		break;
+	default:
+		break;
+	}
+
 	if (!impl->have_sync) {
 		pw_log_info("sync to timestamp:%u seq:%u ts_offset:%u SSRC:%u target:%u direct:%u",
 				timestamp, seq, impl->ts_offset, impl->ssrc,
@@ -254,6 +298,7 @@ static void rtp_opus_flush_packets(struct impl *impl)
 		offset += tosend;
 		avail -= tosend;
 	}
+	rtp_stream_emit_flush_packets(impl);
 
 	pw_log_trace("move %d offset:%d", avail, offset);
 	memmove(impl->buffer, &impl->buffer[offset * stride], avail * stride);
@@ -317,24 +362,53 @@ static void rtp_opus_process_capture(void *data)
 	rtp_opus_flush_packets(impl);
 }
 
+/* the largest opus frame size that fits in samples */
+static uint32_t rtp_opus_frame_size(uint32_t samples)
+{
+	if (samples >= 2880)
+		return 2880;
+	else if (samples >= 1920)
+		return 1920;
+	else if (samples >= 960)
+		return 960;
+	else if (samples >= 480)
+		return 480;
+	else if (samples >= 240)
+		return 240;
+	return 120;
+}
+
+static int rtp_opus_set_encoding(struct impl *impl, const struct rtp_stream_encoding *enc)
+{
+	OpusMSEncoder *encoder = impl->stream_data;
+
+	if (encoder == NULL)
+		return -EIO;
+
+	if (enc->psamples > 0)
+		impl->psamples = rtp_opus_frame_size(enc->psamples);
+
+	opus_multistream_encoder_ctl(encoder,
+			OPUS_SET_BITRATE(enc->bitrate > 0 ? (opus_int32)enc->bitrate : OPUS_AUTO));
+	opus_multistream_encoder_ctl(encoder, OPUS_SET_INBAND_FEC(enc->packet_loss > 0));
+	opus_multistream_encoder_ctl(encoder,
+			OPUS_SET_PACKET_LOSS_PERC(SPA_MIN(enc->packet_loss, 100u)));
+
+	impl->bitrate = enc->bitrate;
+	impl->packet_loss = enc->packet_loss;
+
+	pw_log_info("bitrate:%u psamples:%u packet-loss:%u%%",
+			impl->bitrate, impl->psamples, impl->packet_loss);
+	return 0;
+}
+
 static int rtp_opus_init(struct impl *impl, enum spa_direction direction)
 {
 	int err;
 	unsigned char mapping[64];
 	uint32_t i;
 
-	if (impl->psamples >= 2880)
-		impl->psamples = 2880;
-	else if (impl->psamples >= 1920)
-		impl->psamples = 1920;
-	else if (impl->psamples >= 960)
-		impl->psamples = 960;
-	else if (impl->psamples >= 480)
-		impl->psamples = 480;
-	else if (impl->psamples >= 240)
-		impl->psamples = 240;
-	else
-		impl->psamples = 120;
+	impl->psamples = rtp_opus_frame_size(impl->psamples);
 
 	for (i = 0; i < impl->info.info.opus.channels; i++)
 		mapping[i] = i;
@@ -366,6 +440,11 @@ static int rtp_opus_init(struct impl *impl, enum spa_direction direction)
 	return impl->stream_data ? 0 : err;
 }
 #else
+static int rtp_opus_set_encoding(struct impl *impl, const struct rtp_stream_encoding *enc)
+{
+	return -ENOTSUP;
+}
+
 static int rtp_opus_init(struct impl *impl, enum spa_direction direction)
 {
 	return -ENOTSUP;
@@ -0,0 +1,143 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#ifndef PIPEWIRE_RTP_RATE_CONTROL_H
+#define PIPEWIRE_RTP_RATE_CONTROL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <spa/utils/defs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Sender side rate control driven by RTCP receiver reports.
+ *
+ * The bitrate on the wire, with the IP, UDP and RTP headers, is kept between
+ * min_bitrate and max_bitrate. Like the loss based controller of GCC
+ * (draft-ietf-rmcat-gcc-02), it is lowered when more than 10% of the packets
+ * are lost, kept when between 2% and 10% are lost and raised by 8% when there
+ * is no loss. Rising jitter is seen as a queue building up and also lowers
+ * the bitrate a little.
+ *
+ * When the headers become a large part of the bitrate, the packets are made
+ * larger, up to max_samples. The reported loss is also given to the encoder
+ * so that it can add FEC. */
+
+#define RTP_RATE_LOSS_HIGH		26	/* 10% in 1/256 */
+#define RTP_RATE_LOSS_LOW		5	/* 2% in 1/256 */
+/* min time between two changes, so that the reports see the last change */
+#define RTP_RATE_HOLD_NSEC		(1 * SPA_NSEC_PER_SEC)
+/* the headers should not use more than 1/8 of the bitrate */
+#define RTP_RATE_OVERHEAD_DIV		8
+/* jitter of more than this number of packets is seen as congestion */
+#define RTP_RATE_JITTER_PACKETS		2
+/* the lowest bitrate of the encoder */
+#define RTP_RATE_MIN_ENCODER_BITRATE	6000
+
+struct rtp_rate_control {
+	uint32_t min_bitrate;
+	uint32_t max_bitrate;
+	uint32_t rate;
+	uint32_t min_samples;
+	uint32_t max_samples;
+	uint32_t overhead;	/* header bytes per packet */
+
+	uint32_t bitrate;	/* on the wire */
+	uint32_t samples;	/* per packet */
+	uint32_t packet_loss;	/* expected loss in percent */
+
+	uint64_t last_change;
+	uint64_t last_loss;
+};
+
+static inline uint32_t rtp_rate_control_overhead(struct rtp_rate_control *rc, uint32_t samples)
+{
+	return (uint64_t)rc->overhead * 8 * rc->rate / samples;
+}
+
+/* the smallest packets, doubling from min_samples, with little overhead */
+static inline uint32_t rtp_rate_control_samples(struct rtp_rate_control *rc)
+{
+	uint32_t samples = rc->min_samples;
+
+	while (samples * 2 <= rc->max_samples &&
+	    rtp_rate_control_overhead(rc, samples) * RTP_RATE_OVERHEAD_DIV > rc->bitrate)
+		samples *= 2;
+	return samples;
+}
+
+static inline void rtp_rate_control_init(struct rtp_rate_control *rc,
+		uint32_t min_bitrate, uint32_t max_bitrate, uint32_t rate,
+		uint32_t min_samples, uint32_t max_samples, uint32_t overhead)
+{
+	spa_zero(*rc);
+	rc->min_bitrate = SPA_MIN(min_bitrate, max_bitrate);
+	rc->max_bitrate = max_bitrate;
+	rc->rate = rate;
+	rc->min_samples = SPA_MAX(min_samples, 1u);
+	rc->max_samples = SPA_MAX(max_samples, rc->min_samples);
+	rc->overhead = overhead;
+	rc->bitrate = max_bitrate;
+	rc->samples = rtp_rate_control_samples(rc);
+}
+
+/* the bitrate for the encoder, without the headers */
+static inline uint32_t rtp_rate_control_encoder_bitrate(struct rtp_rate_control *rc)
+{
+	uint32_t overhead = rtp_rate_control_overhead(rc, rc->samples);
+	if (rc->bitrate < overhead + RTP_RATE_MIN_ENCODER_BITRATE)
+		return RTP_RATE_MIN_ENCODER_BITRATE;
+	return rc->bitrate - overhead;
+}
+
+/* Handle a report with the fraction of lost packets, in 1/256, and the
+ * jitter in samples, at time now in nsec. Returns true when the bitrate,
+ * the packet size or the expected loss changed. */
+static inline bool rtp_rate_control_report(struct rtp_rate_control *rc, uint64_t now,
+		uint8_t fraction_lost, uint32_t jitter)
+{
+	uint32_t bitrate = rc->bitrate, samples = rc->samples;
+	uint32_t packet_loss = rc->packet_loss, target = bitrate;
+	bool congested = jitter > RTP_RATE_JITTER_PACKETS * rc->samples;
+
+	if (fraction_lost > RTP_RATE_LOSS_LOW || congested)
+		rc->last_loss = now;
+
+	if (rc->last_change != 0 && now - rc->last_change < RTP_RATE_HOLD_NSEC)
+		return false;
+
+	if (fraction_lost > RTP_RATE_LOSS_HIGH) {
+		/* bitrate * (1 - 0.5 * loss) */
+		target = (uint64_t)bitrate * (512 - fraction_lost) / 512;
+	} else if (congested) {
+		target = (uint64_t)bitrate * 15 / 16;
+	} else if (fraction_lost <= RTP_RATE_LOSS_LOW &&
+	    now - rc->last_loss >= 2 * RTP_RATE_HOLD_NSEC) {
+		target = (uint64_t)bitrate * 108 / 100 + 1000;
+	}
+	rc->bitrate = SPA_CLAMP(target, rc->min_bitrate, rc->max_bitrate);
+	rc->samples = rtp_rate_control_samples(rc);
+
+	/* expect the reported loss, forget it slowly when it goes away */
+	if (fraction_lost > RTP_RATE_LOSS_LOW)
+		rc->packet_loss = (fraction_lost * 100u + 255) / 256;
+	else
+		rc->packet_loss = packet_loss / 2;
+
+	if (rc->bitrate == bitrate && rc->samples == samples &&
+	    rc->packet_loss == packet_loss)
+		return false;
+
+	rc->last_change = now;
+	return true;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PIPEWIRE_RTP_RATE_CONTROL_H */
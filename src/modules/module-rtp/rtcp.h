@@ -0,0 +1,178 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#ifndef PIPEWIRE_RTCP_H
+#define PIPEWIRE_RTCP_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include <spa/utils/defs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* RTCP receiver reports, RFC 3550. The reports are sent without SDES, as
+ * reduced-size RTCP (RFC 5506). */
+
+#define RTCP_SR		200
+#define RTCP_RR		201
+
+struct rtcp_header {
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+	unsigned rc:5;
+	unsigned p:1;
+	unsigned v:2;
+#elif __BYTE_ORDER == __BIG_ENDIAN
+	unsigned v:2;
+	unsigned p:1;
+	unsigned rc:5;
+#else
+#error "Unknown byte order"
+#endif
+	uint8_t pt;
+	uint16_t length;	/* in 32 bit words, minus one */
+} __attribute__ ((packed));
+
+struct rtcp_report_block {
+	uint32_t ssrc;
+	uint32_t lost;		/* fraction lost in the upper 8 bits, cumulative in the rest */
+	uint32_t max_seq;
+	uint32_t jitter;
+	uint32_t lsr;
+	uint32_t dlsr;
+} __attribute__ ((packed));
+
+struct rtcp_rr {
+	struct rtcp_header header;
+	uint32_t ssrc;
+	struct rtcp_report_block blocks[0];
+} __attribute__ ((packed));
+
+/* the size of the sender info in a sender report */
+#define RTCP_SENDER_INFO_SIZE	20
+
+/* interarrival jitter, arrival and timestamp are in samples */
+struct rtcp_jitter {
+	double jitter;
+	int32_t transit;
+	bool valid;
+};
+
+static inline void rtcp_jitter_update(struct rtcp_jitter *j, uint32_t arrival, uint32_t timestamp)
+{
+	int32_t transit = arrival - timestamp, d;
+
+	if (j->valid) {
+		d = transit - j->transit;
+		j->jitter += ((d < 0 ? -(double)d : (double)d) - j->jitter) / 16.0;
+	}
+	j->transit = transit;
+	j->valid = true;
+}
+
+/* extend the 16 bits seq with the cycles of max_seq */
+static inline uint32_t rtcp_extend_seq(uint32_t max_seq, uint16_t seq)
+{
+	int16_t diff = seq - (uint16_t)max_seq;
+	return diff > 0 ? max_seq + diff : max_seq;
+}
+
+/* what a receiver knows about a sender */
+struct rtcp_source_stats {
+	uint32_t ssrc;
+	uint32_t max_seq;	/* extended highest sequence number */
+	uint64_t received;
+	uint64_t lost;
+	uint32_t jitter;	/* in samples */
+};
+
+/* the stats at the previous report */
+struct rtcp_report_state {
+	uint32_t max_seq;
+	uint64_t received;
+	bool valid;
+};
+
+#define RTCP_RR_SIZE	(sizeof(struct rtcp_rr) + sizeof(struct rtcp_report_block))
+
+/* Make a receiver report from ssrc about one sender in rr, which needs
+ * RTCP_RR_SIZE bytes. Returns the size of the report. */
+static inline size_t rtcp_rr_build(struct rtcp_rr *rr, uint32_t ssrc,
+		const struct rtcp_source_stats *stats, struct rtcp_report_state *prior)
+{
+	struct rtcp_report_block *b = &rr->blocks[0];
+	int64_t expected = 0, lost;
+	uint32_t fraction = 0, cumulative;
+
+	if (prior->valid) {
+		expected = (int32_t)(stats->max_seq - prior->max_seq);
+		lost = expected - (int64_t)(stats->received - prior->received);
+		if (expected > 0 && lost > 0)
+			fraction = SPA_MIN((lost << 8) / expected, 255);
+	}
+	prior->max_seq = stats->max_seq;
+	prior->received = stats->received;
+	prior->valid = true;
+
+	cumulative = SPA_MIN(stats->lost, 0x7fffffu);
+
+	memset(rr, 0, RTCP_RR_SIZE);
+	rr->header.v = 2;
+	rr->header.rc = 1;
+	rr->header.pt = RTCP_RR;
+	rr->header.length = htons(RTCP_RR_SIZE / 4 - 1);
+	rr->ssrc = htonl(ssrc);
+	b->ssrc = htonl(stats->ssrc);
+	b->lost = htonl(fraction << 24 | cumulative);
+	b->max_seq = htonl(stats->max_seq);
+	b->jitter = htonl(stats->jitter);
+	return RTCP_RR_SIZE;
+}
+
+/* Find the report about ssrc in the compound RTCP packet in buffer.
+ * Returns 1 when found, 0 when not and < 0 when the packet is invalid. */
+static inline int rtcp_find_report(const uint8_t *buffer, size_t len, uint32_t ssrc,
+		struct rtcp_report_block *block)
+{
+	struct rtcp_header hdr;
+	size_t offset = 0, size, skip, i;
+
+	while (offset + sizeof(hdr) <= len) {
+		memcpy(&hdr, &buffer[offset], sizeof(hdr));
+		size = (ntohs(hdr.length) + 1) * 4;
+		if (hdr.v != 2 || offset + size > len)
+			return -EPROTO;
+
+		if (hdr.pt == RTCP_RR || hdr.pt == RTCP_SR) {
+			/* the reporter SSRC and the sender info */
+			skip = sizeof(hdr) + 4 + (hdr.pt == RTCP_SR ? RTCP_SENDER_INFO_SIZE : 0);
+			for (i = 0; i < hdr.rc; i++) {
+				if (skip + sizeof(*block) > size)
+					return -EPROTO;
+				memcpy(block, &buffer[offset + skip], sizeof(*block));
+				if (ntohl(block->ssrc) == ssrc)
+					return 1;
+				skip += sizeof(*block);
+			}
+		}
+		offset += size;
+	}
+	return 0;
+}
+
+static inline uint8_t rtcp_report_fraction_lost(const struct rtcp_report_block *block)
+{
+	return ntohl(block->lost) >> 24;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PIPEWIRE_RTCP_H */
@@ -5,6 +5,7 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 
+#include <spa/utils/atomic.h>
 #include <spa/utils/result.h>
 #include <spa/utils/json.h>
 #include <spa/utils/ringbuffer.h>
@@ -21,6 +22,7 @@
 #include <pipewire/impl.h>
 
 #include <module-rtp/rtp.h>
+#include <module-rtp/rtcp.h>
 #include <module-rtp/stream.h>
 #include <module-rtp/apple-midi.h>
 
@@ -36,6 +38,8 @@
 #define rtp_stream_emit_param_changed(s,i,p)	rtp_stream_emit(s, param_changed,0,i,p)
 #define rtp_stream_emit_send_packet(s,i,l)	rtp_stream_emit(s, send_packet,0,i,l)
 #define rtp_stream_emit_send_feedback(s,seq)	rtp_stream_emit(s, send_feedback,0,seq)
+#define rtp_stream_emit_flush_packets(s)	rtp_stream_emit(s, flush_packets,1)
+#define rtp_stream_emit_send_packet_txtime(s,i,l,t)	rtp_stream_emit(s, send_packet_txtime,2,i,l,t)
 
 struct impl {
 	struct spa_audio_info info;
@@ -54,6 +58,7 @@ struct impl {
 
 	uint32_t rate;
 	uint32_t stride;
+	enum pw_direction direction;
 	uint8_t payload;
 	uint32_t ssrc;
 	uint16_t seq;
@@ -64,6 +69,17 @@ struct impl {
 	uint32_t ts_offset;
 	uint32_t psamples;
 	uint32_t mtu;
+	uint32_t max_reorder;
+	uint32_t last_samples;
+	struct rtp_stream_stats stats;
+	struct rtcp_jitter jitter;
+	/* the stats are updated when receiving, a copy is published for
+	 * the main thread */
+	uint32_t stats_seq;
+	struct rtp_stream_stats stats_copy;
+
+	uint32_t bitrate;
+	uint32_t packet_loss;
 
 	struct spa_ringbuffer ring;
 	uint8_t buffer[BUFFER_SIZE];
@@ -89,10 +105,80 @@ struct impl {
 	struct spa_source *timer;
 	bool timer_running;
 
+	bool txtime;
+	clockid_t txtime_clock;
+	uint64_t txtime_delay;
+	uint64_t txtime_min;
+	uint64_t txtime_base;
+	uint32_t txtime_timestamp;
+	double txtime_period;
+
 	int (*receive_rtp)(struct impl *impl, uint8_t *buffer, ssize_t len);
 	void (*flush_timeout)(struct impl *impl, uint64_t expirations);
 };
 
+enum {
+	RTP_SEQ_OK,
+	RTP_SEQ_LOST,
+	RTP_SEQ_LATE,
+	RTP_SEQ_RESYNC,
+};
+
+/* Check the sequence number of a received packet. Packets that arrive up
+ * to max_reorder packets late, and gaps of up to max_reorder packets,
+ * don't need a resync. */
+static int rtp_check_seq(struct impl *impl, uint16_t seq)
+{
+	int16_t diff = seq - impl->seq;
+	int res = RTP_SEQ_OK;
+
+	if (!impl->have_seq || !impl->have_sync || diff == 0)
+		goto done;
+
+	if (diff < 0 && -diff <= (int32_t)impl->max_reorder) {
+		pw_log_debug("reordered seq %u, expected %u", seq, impl->seq);
+		return RTP_SEQ_LATE;
+	} else if (diff > 0 && diff <= (int32_t)impl->max_reorder) {
+		pw_log_debug("lost %d packets before seq %u", diff, seq);
+		impl->stats.lost += diff;
+		res = RTP_SEQ_LOST;
+	} else {
+		pw_log_info("unexpected seq (%d != %d) SSRC:%u",
+				seq, impl->seq, impl->ssrc);
+		res = RTP_SEQ_RESYNC;
+	}
+done:
+	if (!impl->have_seq)
+		impl->stats.max_seq = seq;
+	else if (res == RTP_SEQ_RESYNC)
+		impl->stats.max_seq += (int16_t)(seq - (uint16_t)impl->stats.max_seq);
+	else
+		impl->stats.max_seq = rtcp_extend_seq(impl->stats.max_seq, seq);
+
+	impl->seq = seq + 1;
+	impl->have_seq = true;
+	return res;
+}
+
+/* the jitter of the packet arrival times, for the receiver reports */
+static inline void rtp_update_jitter(struct impl *impl, uint32_t timestamp)
+{
+	struct timespec ts;
+	uint32_t arrival;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	arrival = (uint64_t)ts.tv_sec * impl->rate +
+		(uint64_t)ts.tv_nsec * impl->rate / SPA_NSEC_PER_SEC;
+	rtcp_jitter_update(&impl->jitter, arrival, timestamp);
+}
+
+/* the max number of samples we conceal before we resync */
+static inline uint32_t rtp_max_conceal(struct impl *impl)
+{
+	return SPA_MIN(impl->max_reorder * SPA_MAX(impl->psamples, impl->last_samples),
+			BUFFER_SIZE2 / impl->stride);
+}
+
 #include "module-rtp/audio.c"
 #include "module-rtp/midi.c"
 #include "module-rtp/opus.c"
@@ -412,6 +498,8 @@ struct rtp_stream *rtp_stream_new(struct pw_core *core,
 	impl->marker_on_first = pw_properties_get_bool(props, "sess.marker-on-first", false);
 	impl->ignore_ssrc = pw_properties_get_bool(props, "sess.ignore-ssrc", false);
 	impl->direct_timestamp = pw_properties_get_bool(props, "sess.ts-direct", false);
+	impl->direction = direction;
+	impl->max_reorder = pw_properties_get_uint32(props, "sess.max-reorder", DEFAULT_MAX_REORDER);
 
 	if (direction == PW_DIRECTION_INPUT) {
 		impl->ssrc = pw_properties_get_uint32(props, "rtp.sender-ssrc", pw_rand32());
@@ -609,10 +697,21 @@ int rtp_stream_update_properties(struct rtp_stream *s, const struct spa_dict *di
 	return pw_stream_update_properties(impl->stream, dict);
 }
 
+static void publish_stats(struct impl *impl)
+{
+	SPA_SEQ_WRITE(impl->stats_seq);
+	impl->stats_copy = impl->stats;
+	impl->stats_copy.ssrc = ntohl(impl->ssrc);
+	impl->stats_copy.jitter = impl->jitter.jitter;
+	SPA_SEQ_WRITE(impl->stats_seq);
+}
+
 int rtp_stream_receive_packet(struct rtp_stream *s, uint8_t *buffer, size_t len)
 {
 	struct impl *impl = (struct impl*)s;
-	return impl->receive_rtp(impl, buffer, len);
+	int res = impl->receive_rtp(impl, buffer, len);
+	publish_stats(impl);
+	return res;
 }
 
 uint64_t rtp_stream_get_time(struct rtp_stream *s, uint64_t *rate)
@@ -628,6 +727,19 @@ uint64_t rtp_stream_get_time(struct rtp_stream *s, uint64_t *rate)
 		pos->clock.rate.num / pos->clock.rate.denom;
 }
 
+void rtp_stream_get_stats(struct rtp_stream *s, struct rtp_stream_stats *stats)
+{
+	struct impl *impl = (struct impl*)s;
+
+	uint32_t seq1, seq2;
+
+	do {
+		seq1 = SPA_SEQ_READ(impl->stats_seq);
+		*stats = impl->stats_copy;
+		seq2 = SPA_SEQ_READ(impl->stats_seq);
+	} while (!SPA_SEQ_READ_SUCCESS(seq1, seq2));
+}
+
 uint16_t rtp_stream_get_seq(struct rtp_stream *s)
 {
 	struct impl *impl = (struct impl*)s;
@@ -642,6 +754,59 @@ void rtp_stream_set_first(struct rtp_stream *s)
 	impl->first = true;
 }
 
+int rtp_stream_set_txtime(struct rtp_stream *s, clockid_t clock, uint64_t delay)
+{
+	struct impl *impl = (struct impl*)s;
+
+	if (clock == -1) {
+		impl->txtime = false;
+		return 0;
+	}
+	/* only audio is paced */
+	if (impl->info.media_subtype != SPA_MEDIA_SUBTYPE_raw)
+		return -ENOTSUP;
+
+	impl->txtime_clock = clock;
+	impl->txtime_delay = delay;
+	impl->txtime = true;
+	return 0;
+}
+
+int rtp_stream_get_encoding(struct rtp_stream *s, struct rtp_stream_encoding *enc)
+{
+	struct impl *impl = (struct impl*)s;
+
+	if (impl->info.media_subtype != SPA_MEDIA_SUBTYPE_opus ||
+	    impl->direction != PW_DIRECTION_INPUT)
+		return -ENOTSUP;
+
+	enc->rate = impl->rate;
+	enc->psamples = impl->psamples;
+	enc->bitrate = impl->bitrate;
+	enc->packet_loss = impl->packet_loss;
+	return 0;
+}
+
+static int do_set_encoding(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct impl *impl = user_data;
+	return rtp_opus_set_encoding(impl, data);
+}
+
+int rtp_stream_set_encoding(struct rtp_stream *s, const struct rtp_stream_encoding *enc)
+{
+	struct impl *impl = (struct impl*)s;
+
+	if (impl->info.media_subtype != SPA_MEDIA_SUBTYPE_opus ||
+	    impl->direction != PW_DIRECTION_INPUT)
+		return -ENOTSUP;
+
+	/* the encoder is used from the data loop */
+	return pw_loop_invoke(impl->data_loop, do_set_encoding, 1,
+			enc, sizeof(*enc), false, impl);
+}
+
 enum pw_stream_state rtp_stream_get_state(struct rtp_stream *s, const char **error)
 {
 	struct impl *impl = (struct impl*)s;
@@ -23,8 +23,10 @@ struct rtp_stream;
 #define DEFAULT_MIN_PTIME	2.0f
 #define DEFAULT_MAX_PTIME	20.0f
 
+#define DEFAULT_MAX_REORDER	16
+
 struct rtp_stream_events {
-#define RTP_VERSION_STREAM_EVENTS        0
+#define RTP_VERSION_STREAM_EVENTS        2
 	uint32_t version;
 
 	void (*destroy) (void *data);
@@ -36,6 +38,32 @@ struct rtp_stream_events {
 	void (*send_packet) (void *data, struct iovec *iov, size_t iovlen);
 
 	void (*send_feedback) (void *data, uint32_t seqnum);
+
+	/* the packets of send_packet can be sent now, since version 1 */
+	void (*flush_packets) (void *data);
+
+	/* like send_packet but the packet should leave at txtime, in the clock
+	 * of rtp_stream_set_txtime(), since version 2 */
+	void (*send_packet_txtime) (void *data, struct iovec *iov, size_t iovlen,
+			uint64_t txtime);
+};
+
+struct rtp_stream_stats {
+	uint64_t received;	/* packets received */
+	uint64_t lost;		/* packets that never arrived */
+	uint64_t reordered;	/* packets that arrived late and were used */
+	uint64_t late;		/* packets that arrived too late and were dropped */
+	uint64_t concealed;	/* samples filled in for missing packets */
+	uint32_t ssrc;		/* of the sender */
+	uint32_t max_seq;	/* extended highest sequence number */
+	uint32_t jitter;	/* interarrival jitter in samples */
+};
+
+struct rtp_stream_encoding {
+	uint32_t rate;		/* samples per second, can't be changed */
+	uint32_t psamples;	/* samples per packet */
+	uint32_t bitrate;	/* bits per second, 0 for the encoder default */
+	uint32_t packet_loss;	/* expected loss in percent, > 0 enables FEC */
 };
 
 struct rtp_stream *rtp_stream_new(struct pw_core *core,
@@ -50,10 +78,22 @@ int rtp_stream_receive_packet(struct rtp_stream *s, uint8_t *buffer, size_t len)
 
 uint64_t rtp_stream_get_time(struct rtp_stream *s, uint64_t *rate);
 
+void rtp_stream_get_stats(struct rtp_stream *s, struct rtp_stream_stats *stats);
+
 uint16_t rtp_stream_get_seq(struct rtp_stream *s);
 
 void rtp_stream_set_first(struct rtp_stream *s);
 
+/* Emit all packets of a cycle at once with send_packet_txtime instead of
+ * pacing them with a timer. The launch time is in clock and at least
+ * delay nsec in the future. A clock of -1 disables this. */
+int rtp_stream_set_txtime(struct rtp_stream *s, clockid_t clock, uint64_t delay);
+
+/* Get and change the encoding of a sender. Only opus can be changed, the
+ * change is applied before the next packet is encoded. */
+int rtp_stream_get_encoding(struct rtp_stream *s, struct rtp_stream_encoding *enc);
+int rtp_stream_set_encoding(struct rtp_stream *s, const struct rtp_stream_encoding *enc);
+
 enum pw_stream_state rtp_stream_get_state(struct rtp_stream *s, const char **error);
 
 int rtp_stream_set_param(struct rtp_stream *s, uint32_t id, const struct spa_pod *param);
@@ -31,6 +31,7 @@
 
 #include <module-vban/stream.h>
 #include "network-utils.h"
+#include "network-batch.h"
 
 #ifdef __FreeBSD__
 #define ifr_ifindex ifr_index
@@ -54,8 +55,12 @@
  * - `source.port = <int>`: the source port
  * - `node.always-process = <bool>`: true to receive even when not running
  * - `sess.latency.msec = <str>`: target network latency in milliseconds, default 100
+ * - `sess.latency.adaptive = <bool>`: lower the latency to what the measured jitter
+ *       of the packets needs, with sess.latency.msec as the max, default false
  * - `sess.ignore-ssrc = <bool>`: ignore SSRC, default false
  * - `sess.media = <string>`: the media type audio|midi|opus, default audio
+ * - `net.batch-size = <int>`: the max number of packets to receive with one
+ *                system call, default 32
  * - `stream.props = {}`: properties to be passed to the stream
  *
  * ## General options
@@ -84,6 +89,7 @@
  *         #source.ip = 127.0.0.1
  *         #source.port = 6980
  *         sess.latency.msec = 100
+ *         #sess.latency.adaptive = false
  *         #sess.ignore-ssrc = false
  *         #node.always-process = false
  *         #sess.media = "audio"
@@ -112,10 +118,14 @@ PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
 #define DEFAULT_SOURCE_IP		"127.0.0.1"
 #define DEFAULT_SOURCE_PORT		6980
 
+#define MAX_PACKET_SIZE			2048
+
 #define USAGE   "( local.ifname=<local interface name to use> ) "						\
 		"( source.ip=<source IP address, default:"DEFAULT_SOURCE_IP"> ) "				\
  		"( source.port=<int, source port, default:"SPA_STRINGIFY(DEFAULT_SOURCE_PORT)"> "		\
 		"( sess.latency.msec=<target network latency, default "SPA_STRINGIFY(DEFAULT_SESS_LATENCY)"> ) "\
+		"( sess.latency.adaptive=<follow the jitter, default:false> ) "					\
+		"( net.batch-size=<max packets per system call, default:32> ) "\
  		"( sess.media=<string, the media type audio|midi, default audio> ) "				\
 		"( audio.format=<format, default:"DEFAULT_FORMAT"> ) "						\
 		"( audio.rate=<sample rate, default:"SPA_STRINGIFY(DEFAULT_RATE)"> ) "				\
@@ -157,6 +167,7 @@ struct impl {
 	struct sockaddr_storage src_addr;
 	socklen_t src_len;
 	struct spa_source *source;
+	struct pw_net_batch batch;
 
 	unsigned receiving:1;
 };
@@ -165,28 +176,31 @@ static void
 on_vban_io(void *data, int fd, uint32_t mask)
 {
 	struct impl *impl = data;
-	ssize_t len;
-	uint8_t buffer[2048];
+	int i, res;
+	uint32_t len;
+	uint8_t *buffer;
 
 	if (mask & SPA_IO_IN) {
-		if ((len = recv(fd, buffer, sizeof(buffer), 0)) < 0)
+		if ((res = pw_net_batch_recv(&impl->batch, fd,
+				impl->batch.max_packets, MSG_DONTWAIT)) < 0)
 			goto receive_error;
 
-		if (len < 12)
-			goto short_packet;
-
-		if (SPA_LIKELY(impl->stream))
-			vban_stream_receive_packet(impl->stream, buffer, len);
+		for (i = 0; i < res; i++) {
+			len = pw_net_batch_get(&impl->batch, i, &buffer);
+			if (len < 12) {
+				pw_log_warn("short packet received");
+				continue;
+			}
+			if (SPA_LIKELY(impl->stream))
+				vban_stream_receive_packet(impl->stream, buffer, len);
 
-		impl->receiving = true;
+			impl->receiving = true;
+		}
 	}
 	return;
 
 receive_error:
-	pw_log_warn("recv error: %m");
-	return;
-short_packet:
-	pw_log_warn("short packet received");
+	pw_log_warn("recv error: %s", spa_strerror(res));
 	return;
 }
 
@@ -373,6 +387,7 @@ static void impl_destroy(struct impl *impl)
 	pw_properties_free(impl->stream_props);
 	pw_properties_free(impl->props);
 
+	pw_net_batch_clear(&impl->batch);
 	free(impl->ifname);
 	free(impl);
 }
@@ -478,6 +493,7 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 	copy_props(impl, props, "sess.min-ptime");
 	copy_props(impl, props, "sess.max-ptime");
 	copy_props(impl, props, "sess.latency.msec");
+	copy_props(impl, props, "sess.latency.adaptive");
 
 	str = pw_properties_get(props, "local.ifname");
 	impl->ifname = str ? strdup(str) : NULL;
@@ -500,6 +516,13 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 	impl->cleanup_interval = pw_properties_get_uint32(props,
 			"cleanup.sec", DEFAULT_CLEANUP_SEC);
 
+	if ((res = pw_net_batch_init(&impl->batch,
+			pw_properties_get_uint32(props, "net.batch-size", PW_NET_BATCH_MAX),
+			MAX_PACKET_SIZE, false)) < 0) {
+		pw_log_error("can't allocate receive buffers: %s", spa_strerror(res));
+		goto out;
+	}
+
 	impl->core = pw_context_get_object(impl->context, PW_TYPE_INTERFACE_Core);
 	if (impl->core == NULL) {
 		str = pw_properties_get(props, PW_KEY_REMOTE_NAME);
@@ -25,8 +25,10 @@
 #include <pipewire/pipewire.h>
 #include <pipewire/impl.h>
 
+#include <module-vban/vban.h>
 #include <module-vban/stream.h>
 #include "network-utils.h"
+#include "network-batch.h"
 
 #ifndef IPTOS_DSCP
 #define IPTOS_DSCP_MASK 0xfc
@@ -53,8 +55,18 @@
  * - `net.mtu = <int>`: MTU to use, default 1500
  * - `net.ttl = <int>`: TTL to use, default 1
  * - `net.loop = <bool>`: loopback multicast, default false
+ * - `net.batch-size = <int>`: the max number of packets to send with one system call,
+ *       default 32
+ * - `net.gso = <bool>`: use UDP segmentation offload when possible, default true
  * - `sess.min-ptime = <int>`: minimum packet time in milliseconds, default 2
  * - `sess.max-ptime = <int>`: maximum packet time in milliseconds, default 20
+ * - `vban.ptime = <float>`: the packet time in milliseconds, default the largest
+ *       packet time up to sess.max-ptime that fits in the MTU
+ * - `vban.framecount = <int>`: the number of frames per packet, at most 256, this
+ *       overrides vban.ptime
+ * - `sess.latency.msec = <float>`: the latency of the sink, default vban.ptime. The
+ *       packets of a cycle are spread over the cycle, so the packet rate and the
+ *       quantum can be chosen separately.
  * - `sess.name = <str>`: a session name
  * - `sess.media = <string>`: the media type audio|midi, default audio
  * - `stream.props = {}`: properties to be passed to the stream
@@ -90,6 +102,8 @@
  *         #net.loop = false
  *         #sess.min-ptime = 2
  *         #sess.max-ptime = 20
+ *         #vban.framecount = 64
+ *         #sess.latency.msec = 2
  *         #sess.name = "PipeWire VBAN stream"
  *         #sess.media = "audio"
  *         #audio.format = "S16LE"
@@ -119,6 +133,9 @@ PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
 #define DEFAULT_LOOP		false
 #define DEFAULT_DSCP		34 /* Default to AES-67 AF41 (34) */
 
+/* room for the headers on top of the MTU worth of payload */
+#define PACKET_HEADROOM		64
+
 #define USAGE	"( source.ip=<source IP address, default:"DEFAULT_SOURCE_IP"> ) "			\
 		"( destination.ip=<destination IP address, default:"DEFAULT_DESTINATION_IP"> ) "	\
  		"( destination.port=<int, default:"SPA_STRINGIFY(DEFAULT_PORT)"> ) "			\
@@ -127,9 +144,14 @@ PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
 		"( net.ttl=<desired TTL, default:"SPA_STRINGIFY(DEFAULT_TTL)"> ) "			\
 		"( net.loop=<desired loopback, default:"SPA_STRINGIFY(DEFAULT_LOOP)"> ) "		\
 		"( net.dscp=<desired DSCP, default:"SPA_STRINGIFY(DEFAULT_DSCP)"> ) "			\
+		"( net.batch-size=<max packets per system call, default:32> ) "				\
+		"( net.gso=<use UDP segmentation offload, default:true> ) "				\
 		"( sess.name=<a name for the session> ) "						\
 		"( sess.min-ptime=<minimum packet time in milliseconds, default:2> ) "			\
 		"( sess.max-ptime=<maximum packet time in milliseconds, default:20> ) "			\
+		"( vban.ptime=<packet time in milliseconds> ) "						\
+		"( vban.framecount=<frames per packet, max:256> ) "					\
+		"( sess.latency.msec=<latency in milliseconds, default:vban.ptime> ) "			\
  		"( sess.media=<string, the media type audio|midi, default audio> ) "			\
 		"( audio.format=<format, default:"DEFAULT_FORMAT"> ) "					\
 		"( audio.rate=<sample rate, default:"SPA_STRINGIFY(DEFAULT_RATE)"> ) "			\
@@ -176,6 +198,7 @@ struct impl {
 	socklen_t dst_len;
 
 	int vban_fd;
+	struct pw_net_batch batch;
 };
 
 static void stream_destroy(void *d)
@@ -184,11 +207,31 @@ static void stream_destroy(void *d)
 	impl->stream = NULL;
 }
 
+static void stream_flush_packets(void *data)
+{
+	struct impl *impl = data;
+	int res;
+
+	if ((res = pw_net_batch_flush(&impl->batch, impl->vban_fd, MSG_NOSIGNAL)) < 0)
+		pw_log_debug("sendmmsg() failed: %s", spa_strerror(res));
+}
+
 static void stream_send_packet(void *data, struct iovec *iov, size_t iovlen)
 {
 	struct impl *impl = data;
 	struct msghdr msg;
 	ssize_t n;
+	int res;
+
+	/* queue the packet, they are sent in stream_flush_packets() */
+	if ((res = pw_net_batch_add(&impl->batch, iov, iovlen)) == -ENOSPC) {
+		stream_flush_packets(impl);
+		res = pw_net_batch_add(&impl->batch, iov, iovlen);
+	}
+	if (res == 0)
+		return;
+
+	stream_flush_packets(impl);
 
 	spa_zero(msg);
 	msg.msg_iov = iov;
@@ -217,6 +260,7 @@ static const struct vban_stream_events stream_events = {
 	.destroy = stream_destroy,
 	.state_changed = stream_state_changed,
 	.send_packet = stream_send_packet,
+	.flush_packets = stream_flush_packets,
 };
 
 static bool is_multicast(struct sockaddr *sa, socklen_t salen)
@@ -306,6 +350,7 @@ static void impl_destroy(struct impl *impl)
 	pw_properties_free(impl->stream_props);
 	pw_properties_free(impl->props);
 
+	pw_net_batch_clear(&impl->batch);
 	free(impl->ifname);
 	free(impl->session_name);
 	free(impl);
@@ -422,6 +467,8 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 	copy_props(impl, props, "sess.max-ptime");
 	copy_props(impl, props, "sess.latency.msec");
 	copy_props(impl, props, "sess.ts-refclk");
+	copy_props(impl, props, "vban.ptime");
+	copy_props(impl, props, "vban.framecount");
 
 	str = pw_properties_get(props, "local.ifname");
 	impl->ifname = str ? strdup(str) : NULL;
@@ -445,6 +492,14 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 	impl->mcast_loop = pw_properties_get_bool(props, "net.loop", DEFAULT_LOOP);
 	impl->dscp = pw_properties_get_uint32(props, "net.dscp", DEFAULT_DSCP);
 
+	if ((res = pw_net_batch_init(&impl->batch,
+			pw_properties_get_uint32(props, "net.batch-size", PW_NET_BATCH_MAX),
+			pw_properties_get_uint32(props, "net.mtu", DEFAULT_MTU) + PACKET_HEADROOM,
+			pw_properties_get_bool(props, "net.gso", true))) < 0) {
+		pw_log_error("can't allocate send buffers: %s", spa_strerror(res));
+		goto out;
+	}
+
 	pw_net_get_ip(&impl->src_addr, addr, sizeof(addr), NULL, NULL);
 	pw_properties_set(stream_props, "vban.source.ip", addr);
 	pw_net_get_ip(&impl->dst_addr, addr, sizeof(addr), NULL, NULL);
@@ -23,6 +23,7 @@ static void vban_audio_process_playback(void *data)
 
 	avail = spa_ringbuffer_get_read_index(&impl->ring, &timestamp);
 
+	impl->quantum = wanted;
 	target_buffer = impl->target_buffer;
 
 	if (avail < (int32_t)wanted) {
@@ -51,7 +52,17 @@ static void vban_audio_process_playback(void *data)
 			pw_log_warn("overrun %u > %u", avail, target_buffer * 8);
 			timestamp += avail - target_buffer;
 			avail = target_buffer;
+		} else if (impl->adaptive && impl->settle > 0 &&
+		    avail > (int32_t)(target_buffer + 2 * impl->max_error)) {
+			/* the jitter was measured after the sync, skip once to the
+			 * new target, later changes are followed with the rate */
+			pw_log_info("lower latency %u -> %u", avail, target_buffer);
+			timestamp += avail - target_buffer;
+			avail = target_buffer;
+			impl->settle = 0;
 		}
+		if (impl->settle > 0)
+			impl->settle--;
 		/* try to adjust our playback rate to keep the
 		 * requested target_buffer bytes in the ringbuffer */
 		error = (float)target_buffer - (float)avail;
@@ -84,6 +95,56 @@ static void vban_audio_process_playback(void *data)
 	pw_stream_queue_buffer(impl->stream, buf);
 }
 
+/* the target_buffer is a cycle and a packet plus the peak arrival jitter,
+ * which also covers the bursts of a sender with a big quantum */
+static void vban_audio_update_target(struct impl *impl)
+{
+	uint32_t target;
+
+	target = impl->quantum + impl->last_samples + impl->jitter;
+	target = SPA_MIN(target, impl->max_target);
+	if (target == impl->target_buffer)
+		return;
+
+	pw_log_debug("jitter:%u target:%u -> %u", impl->jitter,
+			impl->target_buffer, target);
+	impl->target_buffer = target;
+}
+
+static void vban_audio_update_jitter(struct impl *impl, uint32_t timestamp, uint32_t samples)
+{
+	struct timespec now;
+	int32_t transit;
+	uint32_t jitter;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	transit = (uint32_t)(now.tv_sec * impl->rate +
+			now.tv_nsec * (uint64_t)impl->rate / SPA_NSEC_PER_SEC) - timestamp;
+
+	impl->last_samples = samples;
+	if (impl->jitter_samples == 0) {
+		impl->transit_base = transit;
+		impl->transit_min = impl->transit_max = 0;
+	}
+	transit -= impl->transit_base;
+	impl->transit_min = SPA_MIN(impl->transit_min, transit);
+	impl->transit_max = SPA_MAX(impl->transit_max, transit);
+	impl->jitter_samples += samples;
+
+	/* follow a higher jitter right away and forget it slowly, the window
+	 * of about a second is short enough to not see the clock drift */
+	jitter = impl->transit_max - impl->transit_min;
+	if (jitter > impl->jitter) {
+		impl->jitter = jitter;
+		vban_audio_update_target(impl);
+	}
+	if (impl->jitter_samples >= impl->rate) {
+		impl->jitter = (impl->jitter * 7 + jitter) / 8;
+		impl->jitter_samples = 0;
+		vban_audio_update_target(impl);
+	}
+}
+
 static int vban_audio_receive(struct impl *impl, uint8_t *buffer, ssize_t len)
 {
 	struct vban_header *hdr;
@@ -116,10 +177,20 @@ static int vban_audio_receive(struct impl *impl, uint8_t *buffer, ssize_t len)
 	timestamp = impl->timestamp;
 	impl->timestamp += samples;
 
+	if (impl->adaptive) {
+		if (!impl->have_sync)
+			impl->jitter_samples = 0;
+		vban_audio_update_jitter(impl, timestamp, samples);
+	}
+
 	filled = spa_ringbuffer_get_write_index(&impl->ring, &expected_write);
 
-	/* we always write to timestamp + delay */
-	write = timestamp + impl->target_buffer;
+	/* we always write to timestamp + delay, an adaptive delay is fixed at
+	 * the sync and a new target_buffer is reached with the rate matching */
+	if (impl->adaptive && impl->have_sync)
+		write = expected_write;
+	else
+		write = timestamp + impl->target_buffer;
 
 	if (!impl->have_sync) {
 		pw_log_info("sync to timestamp:%u target:%u",
@@ -134,6 +205,7 @@ static int vban_audio_receive(struct impl *impl, uint8_t *buffer, ssize_t len)
 		spa_dll_init(&impl->dll);
 		spa_dll_set_bw(&impl->dll, SPA_DLL_BW_MAX, 128, impl->rate);
 		memset(impl->buffer, 0, BUFFER_SIZE);
+		impl->settle = SETTLE_CYCLES;
 		impl->have_sync = true;
 	} else if (expected_write != write) {
 		pw_log_debug("unexpected write (%u != %u)",
@@ -175,7 +247,18 @@ set_iovec(struct spa_ringbuffer *rbuf, void *buffer, uint32_t size,
 	iov[1].iov_base = buffer;
 }
 
-static void vban_audio_flush_packets(struct impl *impl)
+static void set_timer(struct impl *impl, uint64_t time, uint64_t itime)
+{
+	struct timespec value, interval;
+	value.tv_sec = time / SPA_NSEC_PER_SEC;
+	value.tv_nsec = time % SPA_NSEC_PER_SEC;
+	interval.tv_sec = itime / SPA_NSEC_PER_SEC;
+	interval.tv_nsec = itime % SPA_NSEC_PER_SEC;
+	pw_loop_update_timer(impl->data_loop, impl->timer, &value, &interval, true);
+	impl->timer_running = time != 0 && itime != 0;
+}
+
+static void vban_audio_flush_packets(struct impl *impl, uint32_t num_packets)
 {
 	int32_t avail, tosend;
 	uint32_t stride, timestamp;
@@ -186,7 +269,9 @@ static void vban_audio_flush_packets(struct impl *impl)
 	tosend = impl->psamples;
 
 	if (avail < tosend)
-		return;
+		goto done;
+
+	num_packets = SPA_MIN(num_packets, (uint32_t)(avail / tosend));
 
 	stride = impl->stride;
 
@@ -197,7 +282,7 @@ static void vban_audio_flush_packets(struct impl *impl)
 	iov[0].iov_base = &header;
 	iov[0].iov_len = sizeof(header);
 
-	while (avail >= tosend) {
+	while (num_packets > 0) {
 		set_iovec(&impl->ring,
 			impl->buffer, BUFFER_SIZE,
 			(timestamp * stride) & BUFFER_MASK,
@@ -210,9 +295,21 @@ static void vban_audio_flush_packets(struct impl *impl)
 		timestamp += tosend;
 		avail -= tosend;
 		header.n_frames++;
+		num_packets--;
 	}
+	vban_stream_emit_flush_packets(impl);
 	impl->header.n_frames = header.n_frames;
 	spa_ringbuffer_read_update(&impl->ring, timestamp);
+done:
+	if (avail < tosend && impl->timer_running)
+		set_timer(impl, 0, 0);
+}
+
+static void vban_audio_flush_timeout(struct impl *impl, uint64_t expirations)
+{
+	if (expirations > 1)
+		pw_log_warn("missing timeout %"PRIu64, expirations);
+	vban_audio_flush_packets(impl, expirations);
 }
 
 static void vban_audio_process_capture(void *data)
@@ -222,6 +319,9 @@ static void vban_audio_process_capture(void *data)
 	struct spa_data *d;
 	uint32_t offs, size, timestamp, expected_timestamp, stride;
 	int32_t filled, wanted;
+	uint32_t pending, num_queued;
+	struct spa_io_position *pos;
+	uint64_t next_nsec, quantum;
 
 	if ((buf = pw_stream_dequeue_buffer(impl->stream)) == NULL) {
 		pw_log_debug("Out of stream buffers: %m");
@@ -236,11 +336,17 @@ static void vban_audio_process_capture(void *data)
 
 	filled = spa_ringbuffer_get_write_index(&impl->ring, &expected_timestamp);
 
-	if (SPA_LIKELY(impl->io_position)) {
-		uint32_t rate = impl->io_position->clock.rate.denom;
-		timestamp = impl->io_position->clock.position * impl->rate / rate;
-	} else
+	pos = impl->io_position;
+	if (SPA_LIKELY(pos)) {
+		uint32_t rate = pos->clock.rate.denom;
+		timestamp = pos->clock.position * impl->rate / rate;
+		next_nsec = pos->clock.next_nsec;
+		quantum = pos->clock.duration * SPA_NSEC_PER_SEC / (rate * pos->clock.rate_diff);
+	} else {
 		timestamp = expected_timestamp;
+		next_nsec = 0;
+		quantum = 0;
+	}
 
 	if (!impl->have_sync) {
 		pw_log_info("sync to timestamp:%u", timestamp);
@@ -248,6 +354,7 @@ static void vban_audio_process_capture(void *data)
 		memset(impl->buffer, 0, BUFFER_SIZE);
 		impl->have_sync = true;
 		expected_timestamp = timestamp;
+		filled = 0;
 	} else {
 		if (SPA_ABS((int32_t)expected_timestamp - (int32_t)timestamp) > 32) {
 			pw_log_warn("expected %u != timestamp %u", expected_timestamp, timestamp);
@@ -255,6 +362,7 @@ static void vban_audio_process_capture(void *data)
 		} else if (filled + wanted > (int32_t)(BUFFER_SIZE / stride)) {
 			pw_log_warn("overrun %u + %u > %u", filled, wanted, BUFFER_SIZE / stride);
 			impl->have_sync = false;
+			filled = 0;
 		}
 	}
 
@@ -268,7 +376,22 @@ static void vban_audio_process_capture(void *data)
 
 	pw_stream_queue_buffer(impl->stream, buf);
 
-	vban_audio_flush_packets(impl);
+	pending = filled / impl->psamples;
+	num_queued = (filled + wanted) / impl->psamples;
+
+	if (num_queued > 0) {
+		/* flush all previous packets plus new one right away */
+		vban_audio_flush_packets(impl, pending + 1);
+		num_queued -= SPA_MIN(num_queued, pending + 1);
+
+		if (num_queued > 0) {
+			/* spread the remaining packets over the cycle */
+			int64_t interval = quantum / (num_queued + 1);
+			uint64_t time = next_nsec - num_queued * interval;
+			pw_log_trace("%u %u %"PRIu64" %"PRIu64, pending, num_queued, time, interval);
+			set_timer(impl, time, interval);
+		}
+	}
 }
 
 static int vban_audio_init(struct impl *impl, enum spa_direction direction)
@@ -278,5 +401,6 @@ static int vban_audio_init(struct impl *impl, enum spa_direction direction)
 	else
 		impl->stream_events.process = vban_audio_process_playback;
 	impl->receive_vban = vban_audio_receive;
+	impl->flush_timeout = vban_audio_flush_timeout;
 	return 0;
 }
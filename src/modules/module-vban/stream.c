@@ -28,12 +28,16 @@
 #define BUFFER_SIZE2			(BUFFER_SIZE>>1)
 #define BUFFER_MASK2			(BUFFER_SIZE2-1)
 
+/* the cycles after a sync in which the adaptive latency can skip data */
+#define SETTLE_CYCLES			32
+
 #define vban_stream_emit(s,m,v,...)		spa_hook_list_call(&s->listener_list, \
 							struct vban_stream_events, m, v, ##__VA_ARGS__)
 #define vban_stream_emit_destroy(s)		vban_stream_emit(s, destroy, 0)
 #define vban_stream_emit_state_changed(s,n,e)	vban_stream_emit(s, state_changed,0,n,e)
 #define vban_stream_emit_send_packet(s,i,l)	vban_stream_emit(s, send_packet,0,i,l)
 #define vban_stream_emit_send_feedback(s,seq)	vban_stream_emit(s, send_feedback,0,seq)
+#define vban_stream_emit_flush_packets(s)	vban_stream_emit(s, flush_packets,1)
 
 struct impl {
 	struct spa_audio_info info;
@@ -50,6 +54,10 @@ struct impl {
 
 	void *stream_data;
 
+	struct pw_loop *data_loop;
+	struct spa_source *timer;
+	bool timer_running;
+
 	uint32_t rate;
 	uint32_t stride;
 	uint32_t psamples;
@@ -69,6 +77,17 @@ struct impl {
 	uint32_t target_buffer;
 	float max_error;
 
+	/* adaptive target_buffer, from the arrival jitter of the packets */
+	uint32_t max_target;
+	uint32_t quantum;
+	uint32_t last_samples;
+	uint32_t jitter;
+	uint32_t jitter_samples;
+	int32_t transit_base;
+	int32_t transit_min;
+	int32_t transit_max;
+	uint32_t settle;
+
 	float last_timestamp;
 	float last_time;
 
@@ -77,8 +96,10 @@ struct impl {
 	unsigned have_sync:1;
 	unsigned receiving:1;
 	unsigned first:1;
+	unsigned adaptive:1;
 
 	int (*receive_vban)(struct impl *impl, uint8_t *buffer, ssize_t len);
+	void (*flush_timeout)(struct impl *impl, uint64_t expirations);
 };
 
 #include "module-vban/audio.c"
@@ -114,6 +135,12 @@ static void stream_io_changed(void *data, uint32_t id, void *area, uint32_t size
 	}
 }
 
+static void on_flush_timeout(void *d, uint64_t expirations)
+{
+	struct impl *impl = d;
+	impl->flush_timeout(d, expirations);
+}
+
 static void stream_destroy(void *d)
 {
 	struct impl *impl = d;
@@ -243,11 +270,16 @@ static void parse_audio_info(const struct pw_properties *props, struct spa_audio
 		parse_position(info, DEFAULT_POSITION, strlen(DEFAULT_POSITION));
 }
 
-static uint32_t msec_to_samples(struct impl *impl, uint32_t msec)
+static uint32_t msec_to_samples(struct impl *impl, float msec)
 {
 	return msec * impl->rate / 1000;
 }
 
+static float samples_to_msec(struct impl *impl, uint32_t samples)
+{
+	return samples * 1000.0f / impl->rate;
+}
+
 struct vban_stream *vban_stream_new(struct pw_core *core,
 		enum pw_direction direction, struct pw_properties *props,
 		const struct vban_stream_events *events, void *data)
@@ -257,11 +289,11 @@ struct vban_stream *vban_stream_new(struct pw_core *core,
 	char tmp[64];
 	uint8_t buffer[1024];
 	struct spa_pod_builder b;
-	uint32_t n_params, min_samples, max_samples;
-	float min_ptime, max_ptime;
+	uint32_t n_params, min_samples, max_samples, framecount;
+	float min_ptime, max_ptime, latency_msec;
 	const struct spa_pod *params[1];
 	enum pw_stream_flags flags;
-	int latency_msec;
+	struct pw_context *context;
 	int res;
 
 	impl = calloc(1, sizeof(*impl));
@@ -273,6 +305,14 @@ struct vban_stream *vban_stream_new(struct pw_core *core,
 	impl->first = true;
 	spa_hook_list_init(&impl->listener_list);
 	impl->stream_events = stream_events;
+	context = pw_core_get_context(core);
+	impl->data_loop = pw_data_loop_get_loop(pw_context_get_data_loop(context));
+	impl->timer = pw_loop_add_timer(impl->data_loop, on_flush_timeout, impl);
+	if (impl->timer == NULL) {
+		res = -errno;
+		pw_log_error("can't create timer");
+		goto out;
+	}
 
 	if ((str = pw_properties_get(props, "sess.media")) == NULL)
 		str = "audio";
@@ -358,33 +398,63 @@ struct vban_stream *vban_stream_new(struct pw_core *core,
 	if (!spa_atof(str, &max_ptime))
 		max_ptime = DEFAULT_MAX_PTIME;
 
-	min_samples = min_ptime * impl->rate / 1000;
-	max_samples = SPA_MIN(256, max_ptime * impl->rate / 1000);
+	/* a packet has at most VBAN_MAX_SAMPLES and fits in the MTU */
+	max_samples = SPA_MIN((uint32_t)VBAN_SAMPLES_MAX_NB,
+			(SPA_MAX(impl->mtu, (uint32_t)VBAN_HEADER_SIZE) - VBAN_HEADER_SIZE) / impl->stride);
+	max_samples = SPA_MAX(max_samples, 1u);
+	min_samples = SPA_MIN(msec_to_samples(impl, min_ptime), max_samples);
+	max_samples = SPA_CLAMP(msec_to_samples(impl, max_ptime), min_samples, max_samples);
 
 	float ptime = 0;
 	if ((str = pw_properties_get(props, "vban.ptime")) != NULL)
 		if (!spa_atof(str, &ptime))
 			ptime = 0.0;
 
-	if (ptime) {
-		impl->psamples = ptime * impl->rate / 1000;
-	} else {
-		impl->psamples = impl->mtu / impl->stride;
-		impl->psamples = SPA_CLAMP(impl->psamples, min_samples, max_samples);
-		if (direction == PW_DIRECTION_OUTPUT)
-			pw_properties_set(props, "vban.ptime",
-					spa_dtoa(tmp, sizeof(tmp),
-						impl->psamples * 1000.0 / impl->rate));
+	framecount = 0;
+	if ((str = pw_properties_get(props, "vban.framecount")) != NULL)
+		if (!spa_atou32(str, &framecount, 0))
+			framecount = 0;
+
+	if (framecount > 0)
+		impl->psamples = framecount;
+	else if (ptime > 0.0f)
+		impl->psamples = msec_to_samples(impl, ptime);
+	else
+		impl->psamples = max_samples;
+
+	if (impl->psamples < 1 || impl->psamples > max_samples) {
+		pw_log_warn("%u samples per packet is not in 1..%u",
+				impl->psamples, max_samples);
+		impl->psamples = SPA_CLAMP(impl->psamples, 1u, max_samples);
+	}
+	ptime = samples_to_msec(impl, impl->psamples);
+	if (direction == PW_DIRECTION_INPUT) {
+		pw_properties_set(props, "vban.ptime", spa_dtoa(tmp, sizeof(tmp), ptime));
+		pw_properties_setf(props, "vban.framecount", "%u", impl->psamples);
+	}
+
+	/* For senders, the default latency is ptime and for a receiver it is
+	 * DEFAULT_SESS_LATENCY. A sender with a bigger sess.latency.msec runs
+	 * with a bigger quantum and spreads the packets of a cycle over the
+	 * cycle. */
+	str = pw_properties_get(props, "sess.latency.msec");
+	if (!spa_atof(str, &latency_msec)) {
+		latency_msec = direction == PW_DIRECTION_INPUT ?
+			ptime :
+			DEFAULT_SESS_LATENCY;
 	}
-	latency_msec = pw_properties_get_uint32(props,
-			"sess.latency.msec", DEFAULT_SESS_LATENCY);
-	impl->target_buffer = msec_to_samples(impl, latency_msec);
+	impl->target_buffer = SPA_MAX(msec_to_samples(impl, latency_msec), impl->psamples);
 	impl->max_error = msec_to_samples(impl, ERROR_MSEC);
 
+	/* the receiver lowers the target_buffer to what the jitter needs */
+	impl->adaptive = direction == PW_DIRECTION_OUTPUT &&
+		pw_properties_get_bool(props, "sess.latency.adaptive", false);
+	impl->max_target = impl->target_buffer;
+
 	pw_properties_setf(props, PW_KEY_NODE_RATE, "1/%d", impl->rate);
 	if (direction == PW_DIRECTION_INPUT) {
 		pw_properties_setf(props, PW_KEY_NODE_LATENCY, "%d/%d",
-				impl->psamples, impl->rate);
+				impl->target_buffer, impl->rate);
 	} else {
 		pw_properties_setf(props, PW_KEY_NODE_LATENCY, "%d/%d",
 				impl->target_buffer / 2, impl->rate);
@@ -467,6 +537,9 @@ void vban_stream_destroy(struct vban_stream *s)
 	if (impl->stream)
 		pw_stream_destroy(impl->stream);
 
+	if (impl->timer)
+		pw_loop_destroy_source(impl->data_loop, impl->timer);
+
 	spa_hook_list_clean(&impl->listener_list);
 	free(impl);
 }
@@ -24,7 +24,7 @@ struct vban_stream;
 #define DEFAULT_MAX_PTIME	20
 
 struct vban_stream_events {
-#define VBAN_VERSION_STREAM_EVENTS        0
+#define VBAN_VERSION_STREAM_EVENTS        1
 	uint32_t version;
 
 	void (*destroy) (void *data);
@@ -34,6 +34,9 @@ struct vban_stream_events {
 	void (*send_packet) (void *data, struct iovec *iov, size_t iovlen);
 
 	void (*send_feedback) (void *data, uint32_t senum);
+
+	/* the packets of send_packet can be sent now, since version 1 */
+	void (*flush_packets) (void *data);
 };
 
 struct vban_stream *vban_stream_new(struct pw_core *core,
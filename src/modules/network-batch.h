@@ -0,0 +1,331 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#ifndef NETWORK_BATCH_H
+#define NETWORK_BATCH_H
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+#include <spa/utils/defs.h>
+
+/* Receive and send datagrams in batches with recvmmsg() and sendmmsg().
+ *
+ * For sending, packets are queued in one contiguous buffer. When they all
+ * have the same size (the last one can be smaller), they are sent with
+ * one UDP GSO (UDP_SEGMENT) send. Otherwise, or when GSO fails, they are
+ * sent with sendmmsg(). Packets can have a SO_TXTIME launch time. */
+
+#define PW_NET_BATCH_MAX	32
+/* the kernel limits the total size of a GSO send */
+#define PW_NET_GSO_MAX_SIZE	(65535 - 8 - 40)
+
+struct pw_net_batch {
+	uint32_t max_packets;
+	uint32_t packet_size;
+
+	uint8_t *data;
+	struct mmsghdr *msgs;
+	struct iovec *iov;
+	uint8_t *control;
+	uint32_t control_size;
+	struct sockaddr_storage *names;
+	uint64_t *txtime;
+
+	uint32_t n_packets;
+	uint32_t pos;
+	uint32_t size;
+
+	unsigned int gso:1;
+
+	uint64_t packets;
+	uint64_t syscalls;
+};
+
+static inline int pw_net_batch_init(struct pw_net_batch *b, uint32_t max_packets,
+		uint32_t packet_size, bool gso)
+{
+	spa_zero(*b);
+	b->max_packets = SPA_CLAMP(max_packets, 1u, (uint32_t)PW_NET_BATCH_MAX);
+	b->packet_size = packet_size;
+	b->data = calloc(b->max_packets, packet_size);
+	b->msgs = calloc(b->max_packets, sizeof(struct mmsghdr));
+	b->iov = calloc(b->max_packets, sizeof(struct iovec));
+	if (b->data == NULL || b->msgs == NULL || b->iov == NULL) {
+		free(b->data);
+		free(b->msgs);
+		free(b->iov);
+		spa_zero(*b);
+		return -errno;
+	}
+#ifdef UDP_SEGMENT
+	b->gso = gso;
+#endif
+	return 0;
+}
+
+/* also receive control_size bytes of ancillary data per packet, they
+ * can be read with pw_net_batch_get_msg() */
+static inline int pw_net_batch_init_control(struct pw_net_batch *b, uint32_t control_size)
+{
+	free(b->control);
+	b->control_size = 0;
+	if ((b->control = calloc(b->max_packets, control_size)) == NULL)
+		return -errno;
+	b->control_size = control_size;
+	return 0;
+}
+
+/* also receive the source address of the packets, they can be read with
+ * pw_net_batch_get_msg() */
+static inline int pw_net_batch_init_names(struct pw_net_batch *b)
+{
+	free(b->names);
+	if ((b->names = calloc(b->max_packets, sizeof(struct sockaddr_storage))) == NULL)
+		return -errno;
+	return 0;
+}
+
+#ifdef SO_TXTIME
+#define PW_NET_TXTIME_CONTROL_SIZE	CMSG_SPACE(sizeof(uint64_t))
+
+/* allow packets to be queued with pw_net_batch_add_txtime(). The socket
+ * needs SO_TXTIME. GSO is not used because all segments of one send
+ * would get the same launch time. */
+static inline int pw_net_batch_init_txtime(struct pw_net_batch *b)
+{
+	int res;
+
+	if ((res = pw_net_batch_init_control(b, PW_NET_TXTIME_CONTROL_SIZE)) < 0)
+		return res;
+	free(b->txtime);
+	if ((b->txtime = calloc(b->max_packets, sizeof(uint64_t))) == NULL)
+		return -errno;
+	b->gso = false;
+	return 0;
+}
+#endif
+
+static inline void pw_net_batch_clear(struct pw_net_batch *b)
+{
+	free(b->txtime);
+	free(b->names);
+	free(b->control);
+	free(b->data);
+	free(b->msgs);
+	free(b->iov);
+	spa_zero(*b);
+}
+
+/* Receive up to n_packets datagrams. Use MSG_WAITFORONE on blocking
+ * sockets to only wait for the first one. Returns the number of packets,
+ * which can be read with pw_net_batch_get(). */
+static inline int pw_net_batch_recv(struct pw_net_batch *b, int fd,
+		uint32_t n_packets, int flags)
+{
+	uint32_t i;
+	int res;
+
+	n_packets = SPA_CLAMP(n_packets, 1u, b->max_packets);
+	for (i = 0; i < n_packets; i++) {
+		b->iov[i].iov_base = SPA_PTROFF(b->data, i * b->packet_size, void);
+		b->iov[i].iov_len = b->packet_size;
+		spa_zero(b->msgs[i]);
+		b->msgs[i].msg_hdr.msg_iov = &b->iov[i];
+		b->msgs[i].msg_hdr.msg_iovlen = 1;
+		if (b->names != NULL) {
+			b->msgs[i].msg_hdr.msg_name = &b->names[i];
+			b->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+		}
+		if (b->control != NULL) {
+			b->msgs[i].msg_hdr.msg_control = SPA_PTROFF(b->control,
+					i * b->control_size, void);
+			b->msgs[i].msg_hdr.msg_controllen = b->control_size;
+		}
+	}
+	b->pos = 0;
+	b->n_packets = 0;
+
+	b->syscalls++;
+	if ((res = recvmmsg(fd, b->msgs, n_packets, flags, NULL)) < 0)
+		return -errno;
+
+	b->n_packets = res;
+	b->packets += res;
+	return res;
+}
+
+static inline uint32_t pw_net_batch_get(struct pw_net_batch *b, uint32_t index, uint8_t **data)
+{
+	*data = b->iov[index].iov_base;
+	return b->msgs[index].msg_len;
+}
+
+static inline struct msghdr *pw_net_batch_get_msg(struct pw_net_batch *b, uint32_t index)
+{
+	return &b->msgs[index].msg_hdr;
+}
+
+static inline bool pw_net_batch_full(struct pw_net_batch *b, size_t size)
+{
+	return b->n_packets == b->max_packets ||
+		b->size + size > (size_t)b->max_packets * b->packet_size;
+}
+
+/* queue one packet, the iovec is copied. Returns -ENOSPC when the
+ * batch needs to be flushed first. */
+static inline int pw_net_batch_add(struct pw_net_batch *b, const struct iovec *iov, size_t iovlen)
+{
+	size_t i, size = 0;
+	uint8_t *p;
+
+	for (i = 0; i < iovlen; i++)
+		size += iov[i].iov_len;
+	if (size > b->packet_size)
+		return -EMSGSIZE;
+	if (pw_net_batch_full(b, size))
+		return -ENOSPC;
+
+	p = SPA_PTROFF(b->data, b->size, uint8_t);
+	b->iov[b->n_packets].iov_base = p;
+	b->iov[b->n_packets].iov_len = size;
+	for (i = 0; i < iovlen; i++) {
+		memcpy(p, iov[i].iov_base, iov[i].iov_len);
+		p += iov[i].iov_len;
+	}
+	if (b->txtime != NULL)
+		b->txtime[b->n_packets] = 0;
+	b->size += size;
+	b->n_packets++;
+	return 0;
+}
+
+#ifdef SO_TXTIME
+/* queue one packet that is sent at txtime, in the clock of SO_TXTIME */
+static inline int pw_net_batch_add_txtime(struct pw_net_batch *b, const struct iovec *iov,
+		size_t iovlen, uint64_t txtime)
+{
+	int res;
+
+	if (b->txtime == NULL)
+		return -EINVAL;
+	if ((res = pw_net_batch_add(b, iov, iovlen)) < 0)
+		return res;
+	b->txtime[b->n_packets - 1] = txtime;
+	return 0;
+}
+
+static inline void pw_net_batch_set_txtime(struct pw_net_batch *b, uint32_t index)
+{
+	struct msghdr *msg = &b->msgs[index].msg_hdr;
+	struct cmsghdr *cmsg;
+
+	msg->msg_control = SPA_PTROFF(b->control, index * b->control_size, void);
+	msg->msg_controllen = PW_NET_TXTIME_CONTROL_SIZE;
+	cmsg = CMSG_FIRSTHDR(msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_TXTIME;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+	memcpy(CMSG_DATA(cmsg), &b->txtime[index], sizeof(uint64_t));
+}
+#endif
+
+#ifdef UDP_SEGMENT
+static inline int pw_net_batch_send_gso(struct pw_net_batch *b, int fd, int flags)
+{
+	char control[CMSG_SPACE(sizeof(uint16_t))];
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	struct iovec iov;
+	uint16_t segment = b->iov[0].iov_len;
+	uint32_t i;
+	ssize_t res;
+
+	if (b->size > PW_NET_GSO_MAX_SIZE || segment == 0)
+		return -EINVAL;
+	for (i = 1; i < b->n_packets; i++) {
+		if (b->iov[i].iov_len > segment ||
+		    (b->iov[i].iov_len < segment && i + 1 < b->n_packets))
+			return -EINVAL;
+	}
+
+	iov.iov_base = b->data;
+	iov.iov_len = b->size;
+
+	spa_zero(msg);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_UDP;
+	cmsg->cmsg_type = UDP_SEGMENT;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+	memcpy(CMSG_DATA(cmsg), &segment, sizeof(segment));
+
+	b->syscalls++;
+	if ((res = sendmsg(fd, &msg, flags)) < 0) {
+		res = -errno;
+		/* not supported by the kernel or the device */
+		if (res == -EIO || res == -EINVAL || res == -ENOPROTOOPT ||
+		    res == -EOPNOTSUPP)
+			b->gso = false;
+		return res;
+	}
+	return 0;
+}
+#endif
+
+/* Send all queued packets. Returns a negative errno when not all packets
+ * could be sent. The queue is always emptied. */
+static inline int pw_net_batch_flush(struct pw_net_batch *b, int fd, int flags)
+{
+	uint32_t i, sent = 0;
+	int res = 0;
+
+	if (b->n_packets == 0)
+		return 0;
+
+#ifdef UDP_SEGMENT
+	if (b->gso && b->n_packets > 1 &&
+	    pw_net_batch_send_gso(b, fd, flags) == 0) {
+		sent = b->n_packets;
+		goto done;
+	}
+#endif
+	for (i = 0; i < b->n_packets; i++) {
+		spa_zero(b->msgs[i]);
+		b->msgs[i].msg_hdr.msg_iov = &b->iov[i];
+		b->msgs[i].msg_hdr.msg_iovlen = 1;
+#ifdef SO_TXTIME
+		if (b->txtime != NULL && b->txtime[i] != 0)
+			pw_net_batch_set_txtime(b, i);
+#endif
+	}
+	while (sent < b->n_packets) {
+		b->syscalls++;
+		if ((res = sendmmsg(fd, &b->msgs[sent], b->n_packets - sent, flags)) < 0) {
+			res = -errno;
+			if (res == -EINTR)
+				continue;
+			break;
+		}
+		if (res == 0)
+			break;
+		sent += res;
+		res = 0;
+	}
+done:
+	b->packets += sent;
+	b->n_packets = 0;
+	b->size = 0;
+	return res;
+}
+
+#endif /* NETWORK_BATCH_H */
@@ -0,0 +1,349 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <spa/utils/defs.h>
+
+#include "module-rtp/rtcp.h"
+#include "module-rtp/rate-control.h"
+
+/* Send opus sized RTP packets over a veth pair with a slow link and let the
+ * rate control follow the RTCP receiver reports, like module-rtp-sink with
+ * net.rtcp and module-rtp-source.
+ *
+ * The sender and the receiver are in their own network namespace, so this
+ * needs root and the ip and tc tools. The link is shaped with netem, or with
+ * tbf when netem is not available.
+ *
+ * After the rate control converged, the bitrate on the wire must stay within
+ * the opus budget and the link rate, without much loss and without falling
+ * to the min bitrate. */
+
+#define SENDER_IP	"10.99.0.1"
+#define RECEIVER_IP	"10.99.0.2"
+#define PORT		46000
+#define LINK_KBIT	64
+
+#define RATE		48000
+#define MIN_SAMPLES	480	/* 10 ms */
+#define MAX_SAMPLES	1920	/* 40 ms */
+#define MIN_BITRATE	16000
+#define MAX_BITRATE	128000
+#define HEADER_SIZE	40	/* IPv4 + UDP + RTP */
+#define RTP_SIZE	12
+
+#define REPORT_NSEC	SPA_NSEC_PER_SEC
+#define DURATION	24	/* seconds */
+#define CONVERGED	12	/* seconds, measure after this */
+
+static uint64_t get_nsec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static int run(const char *fmt, ...) SPA_PRINTF_FUNC(1, 2);
+static int run(const char *fmt, ...)
+{
+	char cmd[512];
+	va_list args;
+	int res;
+
+	va_start(args, fmt);
+	vsnprintf(cmd, sizeof(cmd), fmt, args);
+	va_end(args);
+
+	res = system(cmd);
+	return res == 0 ? 0 : -EIO;
+}
+
+static int make_socket(const char *ip, uint16_t port)
+{
+	struct sockaddr_in sa;
+	int fd;
+
+	if ((fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)) < 0)
+		return -errno;
+
+	spa_zero(sa);
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(port);
+	inet_pton(AF_INET, ip, &sa.sin_addr);
+	if (bind(fd, (struct sockaddr*)&sa, sizeof(sa)) < 0) {
+		close(fd);
+		return -errno;
+	}
+	return fd;
+}
+
+static void set_dest(struct sockaddr_in *sa, const char *ip, uint16_t port)
+{
+	spa_zero(*sa);
+	sa->sin_family = AF_INET;
+	sa->sin_port = htons(port);
+	inet_pton(AF_INET, ip, &sa->sin_addr);
+}
+
+/* like module-rtp-source with net.rtcp */
+static int receiver(void)
+{
+	struct rtcp_source_stats stats;
+	struct rtcp_report_state prior;
+	struct rtcp_jitter jitter;
+	struct sockaddr_in dest;
+	uint8_t buffer[2048], report[RTCP_RR_SIZE];
+	uint64_t now, end, next_report;
+	bool first = true;
+	int fd;
+
+	if ((fd = make_socket(RECEIVER_IP, PORT)) < 0)
+		return fd;
+	set_dest(&dest, SENDER_IP, PORT + 1);
+
+	spa_zero(stats);
+	spa_zero(prior);
+	spa_zero(jitter);
+
+	now = get_nsec();
+	end = now + (DURATION + 2) * SPA_NSEC_PER_SEC;
+	next_report = now + REPORT_NSEC;
+
+	while ((now = get_nsec()) < end) {
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+		ssize_t len;
+
+		if (now >= next_report) {
+			if (!first) {
+				stats.lost = SPA_MAX((int64_t)stats.max_seq + 1 -
+						(int64_t)stats.received, 0);
+				stats.jitter = jitter.jitter;
+				len = rtcp_rr_build((struct rtcp_rr*)report, 0x12345678, &stats, &prior);
+				sendto(fd, report, len, 0, (struct sockaddr*)&dest, sizeof(dest));
+			}
+			next_report += REPORT_NSEC;
+			continue;
+		}
+		if (poll(&pfd, 1, (next_report - now) / SPA_NSEC_PER_MSEC + 1) <= 0)
+			continue;
+		if ((len = recv(fd, buffer, sizeof(buffer), 0)) < RTP_SIZE)
+			continue;
+
+		uint16_t seq = buffer[2] << 8 | buffer[3];
+		uint32_t timestamp = (uint32_t)buffer[4] << 24 | buffer[5] << 16 |
+			buffer[6] << 8 | buffer[7];
+		uint32_t ssrc;
+		memcpy(&ssrc, &buffer[8], 4);
+
+		if (first) {
+			stats.ssrc = ntohl(ssrc);
+			stats.max_seq = seq;
+			first = false;
+		} else {
+			stats.max_seq = rtcp_extend_seq(stats.max_seq, seq);
+		}
+		stats.received++;
+		rtcp_jitter_update(&jitter, now * RATE / SPA_NSEC_PER_SEC, timestamp);
+	}
+	close(fd);
+	return 0;
+}
+
+/* like module-rtp-sink with net.rtcp */
+static int sender(void)
+{
+	struct rtp_rate_control rc;
+	struct rtcp_report_block block;
+	struct sockaddr_in dest;
+	uint8_t buffer[2048];
+	uint64_t start, now, next, sent_bytes = 0, sent_start = 0;
+	uint32_t timestamp = 0, ssrc = 0x4d2, n_reports = 0, lost_sum = 0;
+	uint16_t seq = 0;
+	int fd, rtcp_fd, res = 0;
+	double wire_rate, lost;
+
+	if ((fd = make_socket(SENDER_IP, PORT)) < 0)
+		return fd;
+	if ((rtcp_fd = make_socket(SENDER_IP, PORT + 1)) < 0) {
+		close(fd);
+		return rtcp_fd;
+	}
+	set_dest(&dest, RECEIVER_IP, PORT);
+
+	rtp_rate_control_init(&rc, MIN_BITRATE, MAX_BITRATE, RATE,
+			MIN_SAMPLES, MAX_SAMPLES, HEADER_SIZE);
+
+	fprintf(stdout, "%6s %8s %8s %6s %6s %8s\n",
+			"time", "bitrate", "encoder", "ptime", "fec", "lost");
+
+	start = next = get_nsec();
+	while ((now = get_nsec()) < start + DURATION * SPA_NSEC_PER_SEC) {
+		struct pollfd pfd = { .fd = rtcp_fd, .events = POLLIN };
+		ssize_t len;
+
+		if (now >= next) {
+			/* the encoder fills the packet at its bitrate */
+			uint32_t payload = (uint64_t)rtp_rate_control_encoder_bitrate(&rc) *
+				rc.samples / RATE / 8;
+
+			payload = SPA_MIN(payload, sizeof(buffer) - RTP_SIZE);
+			spa_zero(buffer);
+			buffer[0] = 0x80;
+			buffer[1] = 96;
+			buffer[2] = seq >> 8;
+			buffer[3] = seq;
+			buffer[4] = timestamp >> 24;
+			buffer[5] = timestamp >> 16;
+			buffer[6] = timestamp >> 8;
+			buffer[7] = timestamp;
+			memcpy(&buffer[8], &(uint32_t){ htonl(ssrc) }, 4);
+
+			sendto(fd, buffer, RTP_SIZE + payload, 0,
+					(struct sockaddr*)&dest, sizeof(dest));
+			seq++;
+			timestamp += rc.samples;
+			next += (uint64_t)rc.samples * SPA_NSEC_PER_SEC / RATE;
+
+			if (now - start >= CONVERGED * SPA_NSEC_PER_SEC) {
+				if (sent_start == 0)
+					sent_start = now;
+				sent_bytes += HEADER_SIZE + payload;
+			}
+			continue;
+		}
+		if (poll(&pfd, 1, (next - now) / SPA_NSEC_PER_MSEC) <= 0)
+			continue;
+		if ((len = recv(rtcp_fd, buffer, sizeof(buffer), 0)) <= 0 ||
+		    rtcp_find_report(buffer, len, ssrc, &block) != 1)
+			continue;
+
+		uint8_t fraction_lost = rtcp_report_fraction_lost(&block);
+
+		rtp_rate_control_report(&rc, now, fraction_lost, ntohl(block.jitter));
+		fprintf(stdout, "%6.1f %8u %8u %6u %6u %7.1f%%\n",
+				(now - start) / 1e9, rc.bitrate,
+				rtp_rate_control_encoder_bitrate(&rc),
+				rc.samples * 1000 / RATE, rc.packet_loss,
+				fraction_lost * 100.0 / 256.0);
+
+		if (now - start >= CONVERGED * SPA_NSEC_PER_SEC) {
+			n_reports++;
+			lost_sum += fraction_lost;
+		}
+	}
+	close(fd);
+	close(rtcp_fd);
+
+	if (n_reports == 0 || sent_start == 0) {
+		fprintf(stderr, "no receiver reports\n");
+		return -EIO;
+	}
+	wire_rate = sent_bytes * 8 * 1e9 / (now - sent_start);
+	lost = lost_sum * 100.0 / 256.0 / n_reports;
+
+	fprintf(stdout, "wire %.0f bits/s (link %u, budget %u), lost %.1f%%\n",
+			wire_rate, LINK_KBIT * 1000, MAX_BITRATE, lost);
+
+	/* the headers of the link layer are not counted, allow some more */
+	if (wire_rate > MAX_BITRATE || wire_rate > LINK_KBIT * 1000 * 1.1) {
+		fprintf(stderr, "bitrate above the link rate\n");
+		res = -EIO;
+	}
+	if (wire_rate < MIN_BITRATE * 1.5) {
+		fprintf(stderr, "bitrate collapsed\n");
+		res = -EIO;
+	}
+	if (lost > 10.0) {
+		fprintf(stderr, "too much loss\n");
+		res = -EIO;
+	}
+	return res;
+}
+
+static int setup_link(pid_t peer)
+{
+	if (run("ip link add pwrtp0 type veth peer name pwrtp1 netns %d", peer) < 0 ||
+	    run("ip link set lo up") < 0 ||
+	    run("ip addr add %s/24 dev pwrtp0", SENDER_IP) < 0 ||
+	    run("ip link set pwrtp0 up") < 0)
+		return -EIO;
+
+	/* the queue of the link holds about 100 ms */
+	if (run("tc qdisc add dev pwrtp0 root netem rate %ukbit delay 10ms limit 10 "
+				"2>/dev/null", LINK_KBIT) < 0 &&
+	    run("tc qdisc add dev pwrtp0 root tbf rate %ukbit burst 1600 latency 100ms",
+				LINK_KBIT) < 0)
+		return -EIO;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int to_child[2], to_parent[2], status, res = 0;
+	char c = 0;
+	pid_t pid;
+
+	if (geteuid() != 0) {
+		fprintf(stderr, "needs root for network namespaces\n");
+		return 77;
+	}
+	if (unshare(CLONE_NEWNET) < 0) {
+		fprintf(stderr, "can't make network namespace: %m\n");
+		return 77;
+	}
+	if (pipe(to_child) < 0 || pipe(to_parent) < 0)
+		return 1;
+
+	if ((pid = fork()) < 0)
+		return 1;
+
+	if (pid == 0) {
+		if (unshare(CLONE_NEWNET) < 0)
+			_exit(1);
+		write(to_parent[1], &c, 1);
+		/* wait for the link */
+		if (read(to_child[0], &c, 1) != 1 || c != 0)
+			_exit(1);
+		if (run("ip link set lo up") < 0 ||
+		    run("ip addr add %s/24 dev pwrtp1", RECEIVER_IP) < 0 ||
+		    run("ip link set pwrtp1 up") < 0)
+			_exit(1);
+		write(to_parent[1], &c, 1);
+		_exit(receiver() < 0 ? 1 : 0);
+	}
+
+	if (read(to_parent[0], &c, 1) != 1 || (res = setup_link(pid)) < 0) {
+		fprintf(stderr, "can't make the link, needs ip and tc\n");
+		c = 1;
+		write(to_child[1], &c, 1);
+		waitpid(pid, NULL, 0);
+		return 77;
+	}
+	write(to_child[1], &c, 1);
+	if (read(to_parent[0], &c, 1) != 1) {
+		waitpid(pid, NULL, 0);
+		return 77;
+	}
+
+	res = sender();
+
+	kill(pid, SIGTERM);
+	waitpid(pid, &status, 0);
+
+	return res < 0 ? 1 : 0;
+}
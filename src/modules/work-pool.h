@@ -0,0 +1,137 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+#include <errno.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <semaphore.h>
+
+#include <spa/utils/defs.h>
+#include <spa/utils/atomic.h>
+
+#include <pipewire/thread.h>
+
+/* Run independent items of work, like the channels of a codec, on a small
+ * pool of realtime threads. The caller works on the items as well and
+ * pw_work_pool_run() returns when all items are done, so the work of one
+ * cycle is joined before the cycle ends. */
+
+#define PW_WORK_POOL_MAX_THREADS	16
+
+typedef void (*pw_work_pool_func_t) (void *data, uint32_t index);
+
+struct pw_work_pool {
+	uint32_t n_threads;
+	struct spa_thread *threads[PW_WORK_POOL_MAX_THREADS];
+	sem_t start;
+	sem_t done;
+	int running;
+
+	pw_work_pool_func_t func;
+	void *data;
+	uint32_t n_items;
+	uint32_t next;
+};
+
+static inline void pw_work_pool_do_items(struct pw_work_pool *p)
+{
+	uint32_t index;
+	while ((index = SPA_ATOMIC_INC(p->next) - 1) < p->n_items)
+		p->func(p->data, index);
+}
+
+static inline void pw_work_pool_wait(sem_t *sem)
+{
+	while (sem_wait(sem) < 0 && errno == EINTR);
+}
+
+static inline void *pw_work_pool_thread(void *data)
+{
+	struct pw_work_pool *p = data;
+
+	while (true) {
+		pw_work_pool_wait(&p->start);
+		if (!SPA_ATOMIC_LOAD(p->running))
+			break;
+		pw_work_pool_do_items(p);
+		sem_post(&p->done);
+	}
+	return NULL;
+}
+
+static inline void pw_work_pool_clear(struct pw_work_pool *p)
+{
+	uint32_t i;
+
+	if (p->n_threads == 0)
+		return;
+
+	SPA_ATOMIC_STORE(p->running, 0);
+	for (i = 0; i < p->n_threads; i++)
+		sem_post(&p->start);
+	for (i = 0; i < p->n_threads; i++)
+		pw_thread_utils_join(p->threads[i], NULL);
+	sem_destroy(&p->start);
+	sem_destroy(&p->done);
+	spa_zero(*p);
+}
+
+/* start n_threads threads next to the caller, 0 runs all work in the caller */
+static inline int pw_work_pool_init(struct pw_work_pool *p, uint32_t n_threads)
+{
+	int res;
+
+	spa_zero(*p);
+	n_threads = SPA_MIN(n_threads, (uint32_t)PW_WORK_POOL_MAX_THREADS);
+	if (n_threads == 0)
+		return 0;
+
+	if (sem_init(&p->start, 0, 0) < 0 || sem_init(&p->done, 0, 0) < 0)
+		return -errno;
+
+	p->running = 1;
+	for (p->n_threads = 0; p->n_threads < n_threads; p->n_threads++) {
+		struct spa_thread *t;
+		if ((t = pw_thread_utils_create(NULL, pw_work_pool_thread, p)) == NULL) {
+			res = -errno;
+			pw_work_pool_clear(p);
+			return res;
+		}
+		/* the caller is usually a realtime thread */
+		pw_thread_utils_acquire_rt(t, -1);
+		p->threads[p->n_threads] = t;
+	}
+	return 0;
+}
+
+/* call func for all items from 0 to n_items and wait until they are done */
+static inline void pw_work_pool_run(struct pw_work_pool *p, uint32_t n_items,
+		pw_work_pool_func_t func, void *data)
+{
+	uint32_t i, n_wake;
+
+	if (p->n_threads == 0 || n_items < 2) {
+		for (i = 0; i < n_items; i++)
+			func(data, i);
+		return;
+	}
+	p->func = func;
+	p->data = data;
+	p->n_items = n_items;
+	SPA_ATOMIC_STORE(p->next, 0);
+
+	n_wake = SPA_MIN(p->n_threads, n_items - 1);
+	for (i = 0; i < n_wake; i++)
+		sem_post(&p->start);
+
+	pw_work_pool_do_items(p);
+
+	for (i = 0; i < n_wake; i++)
+		pw_work_pool_wait(&p->done);
+}
+
+#endif /* WORK_POOL_H */
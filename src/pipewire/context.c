@@ -9,6 +9,7 @@
 #include <regex.h>
 #include <limits.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
 
 #include <pipewire/log.h>
 
@@ -42,8 +43,10 @@ struct impl {
 	struct spa_plugin_loader plugin_loader;
 	unsigned int recalc:1;
 	unsigned int recalc_pending:1;
+	unsigned int mem_stats_pending:1;
 
 	struct pw_data_loop *data_loop_impl;
+	struct spa_hook pool_listener;
 };
 
 
@@ -161,9 +164,62 @@ static int do_data_loop_setup(struct spa_loop *loop, bool async, uint32_t seq,
 		pw_log_info("setting zero denormals: %s", str);
 		spa_cpu_zero_denormals(cpu, spa_atob(str));
 	}
+#ifdef SYS_getcpu
+	if ((str = pw_properties_get(this->properties, "mem.numa-node")) != NULL &&
+	    spa_streq(str, "auto")) {
+		unsigned int cpu_id, node;
+		/* place the buffers on the node the data thread is running on */
+		if (syscall(SYS_getcpu, &cpu_id, &node, NULL) == 0)
+			pw_mempool_set_numa_node(this->pool, node);
+		else
+			pw_log_warn("%p: can't get NUMA node of data loop: %m", this);
+	}
+#endif
 	return 0;
 }
 
+static void do_update_mem_stats(void *obj, void *data, int res, uint32_t id)
+{
+	struct impl *impl = obj;
+	struct pw_context *this = &impl->this;
+	struct pw_mempool_stats stats;
+	struct spa_dict_item items[5];
+	char val[5][32];
+
+	impl->mem_stats_pending = false;
+	pw_mempool_get_stats(this->pool, &stats);
+
+	snprintf(val[0], sizeof(val[0]), "%"PRIu64, stats.n_alloc);
+	snprintf(val[1], sizeof(val[1]), "%"PRIu64, stats.n_hugetlb);
+	snprintf(val[2], sizeof(val[2]), "%"PRIu64, stats.n_thp);
+	snprintf(val[3], sizeof(val[3]), "%"PRIu64, stats.n_numa);
+	snprintf(val[4], sizeof(val[4]), "%"PRIu64, stats.n_fallback);
+	items[0] = SPA_DICT_ITEM_INIT("mem.stats.alloc", val[0]);
+	items[1] = SPA_DICT_ITEM_INIT("mem.stats.hugetlb", val[1]);
+	items[2] = SPA_DICT_ITEM_INIT("mem.stats.thp", val[2]);
+	items[3] = SPA_DICT_ITEM_INIT("mem.stats.numa", val[3]);
+	items[4] = SPA_DICT_ITEM_INIT("mem.stats.fallback", val[4]);
+
+	pw_impl_core_update_properties(this->core, &SPA_DICT_INIT_ARRAY(items));
+}
+
+/* publish the counters of the pool on the core once per main loop
+ * iteration, buffers are allocated in bursts */
+static void pool_added(void *data, struct pw_memblock *block)
+{
+	struct impl *impl = data;
+
+	if (impl->mem_stats_pending)
+		return;
+	impl->mem_stats_pending = true;
+	pw_work_queue_add(impl->this.work_queue, impl, 0, do_update_mem_stats, NULL);
+}
+
+static const struct pw_mempool_events pool_events = {
+	PW_VERSION_MEMPOOL_EVENTS,
+	.added = pool_added,
+};
+
 /** Create a new context object
  *
  * \param main_loop the main loop to use
@@ -290,9 +346,23 @@ struct pw_context *pw_context_new(struct pw_loop *main_loop,
 		goto error_free;
 	}
 
-	this->pool = pw_mempool_new(NULL);
+	pr = pw_properties_new(NULL, NULL);
+	if (pr == NULL) {
+		res = -errno;
+		goto error_free;
+	}
+	pw_properties_set(pr, "mem.hugepages",
+			pw_properties_get(properties, "mem.hugepages"));
+	pw_properties_set(pr, "mem.hugepages.min-size",
+			pw_properties_get(properties, "mem.hugepages.min-size"));
+	if ((str = pw_properties_get(properties, "mem.numa-node")) != NULL &&
+	    !spa_streq(str, "auto"))
+		pw_properties_set(pr, "mem.numa-node", str);
+
+	this->pool = pw_mempool_new(pr);
 	if (this->pool == NULL) {
 		res = -errno;
+		pw_properties_free(pr);
 		goto error_free;
 	}
 
@@ -344,6 +414,12 @@ struct pw_context *pw_context_new(struct pw_loop *main_loop,
 	}
 	pw_impl_core_register(this->core, NULL);
 
+	if (((str = pw_properties_get(properties, "mem.hugepages")) != NULL &&
+	    !spa_streq(str, "false")) ||
+	    ((str = pw_properties_get(properties, "mem.numa-node")) != NULL &&
+	    !spa_streq(str, "-1")))
+		pw_mempool_add_listener(this->pool, &impl->pool_listener, &pool_events, impl);
+
 	fill_properties(this);
 
 	if ((res = pw_context_parse_conf_section(this, conf, "context.spa-libs")) < 0)
@@ -430,6 +506,10 @@ void pw_context_destroy(struct pw_context *context)
 	spa_list_consume(metadata, &context->metadata_list, link)
 		pw_impl_metadata_destroy(metadata);
 
+	spa_hook_remove(&impl->pool_listener);
+	if (impl->mem_stats_pending)
+		pw_work_queue_cancel(context->work_queue, impl, SPA_ID_INVALID);
+
 	spa_list_consume(core_impl, &context->core_impl_list, link)
 		pw_impl_core_destroy(core_impl);
 
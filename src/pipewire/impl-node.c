@@ -1043,6 +1043,13 @@ static void check_properties(struct pw_impl_node *node)
 		recalc_reason = "sync changed";
 	}
 
+	value = pw_properties_get_uint32(node->properties, PW_KEY_NODE_CYCLE_DIVIDER, 1);
+	value = SPA_MAX(value, 1u);
+	if (value != node->rt.cycle_divider) {
+		pw_log_info("%p: cycle divider %u -> %u", node, node->rt.cycle_divider, value);
+		node->rt.cycle_divider = value;
+	}
+
 	transport = pw_properties_get_bool(node->properties, PW_KEY_NODE_TRANSPORT, false);
 	if (transport != node->transport) {
 		pw_log_info("%p: transport %d -> %d", node, node->transport, transport);
@@ -1209,6 +1216,28 @@ static inline uint64_t get_time_ns(struct spa_system *system)
 	return SPA_TIMESPEC_TO_NSEC(&ts);
 }
 
+static inline void trigger_target(struct pw_node_target *t, uint64_t nsec);
+
+/* called from data-loop when a node is not woken up in this cycle because
+ * the server did the work of the client. The node is marked as finished
+ * without processing so that the driver does not see an xrun and the
+ * targets of the node are triggered. */
+static inline void skip_target(struct pw_node_target *t, uint64_t nsec)
+{
+	struct pw_node_activation *a = t->activation;
+	struct pw_node_target *nt;
+
+	pw_log_trace_fp("%p: (%s-%u) skip cycle", t->node, t->name, t->id);
+
+	a->status = PW_NODE_ACTIVATION_FINISHED;
+	a->signal_time = nsec;
+	a->awake_time = nsec;
+	a->finish_time = nsec;
+
+	spa_list_for_each(nt, &t->node->rt.target_list, link)
+		trigger_target(nt, nsec);
+}
+
 /* called from data-loop decrement the dependency counter of the target and when
  * there are no more dependencies, trigger the node. */
 static inline void trigger_target(struct pw_node_target *t, uint64_t nsec)
@@ -1337,6 +1366,15 @@ int pw_impl_node_trigger(struct pw_impl_node *node)
 	return 0;
 }
 
+/* called from the data loop of the server when a triggered remote node does
+ * not need to be woken up in this cycle, see skip_target() */
+int pw_impl_node_skip(struct pw_impl_node *node)
+{
+	uint64_t nsec = get_time_ns(node->data_system);
+	skip_target(&node->rt.target, nsec);
+	return 0;
+}
+
 static void node_on_fd_events(struct spa_source *source)
 {
 	struct pw_impl_node *this = source->data;
@@ -1486,6 +1524,7 @@ struct pw_impl_node *pw_context_create_node(struct pw_context *context,
 
 	this->rt.rate_limit.interval = 2 * SPA_NSEC_PER_SEC;
 	this->rt.rate_limit.burst = 1;
+	this->rt.cycle_divider = 1;
 
 	check_properties(this);
 
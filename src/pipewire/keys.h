@@ -190,6 +190,10 @@ extern "C" {
 #define PW_KEY_NODE_TRIGGER		"node.trigger"		/**< the node is not scheduled automatically
 								  *   based on the dependencies in the graph
 								  *   but it will be triggered explicitly. */
+#define PW_KEY_NODE_CYCLE_DIVIDER	"node.cycle-divider"	/**< wake up an input stream in ring mode
+								  *  every Nth cycle of the driver, the
+								  *  server keeps the data of the other
+								  *  cycles in the ring. Since 1.1.0 */
 #define PW_KEY_NODE_CHANNELNAMES		"node.channel-names"		/**< names of node's
 									*   channels (unrelated to positions) */
 #define PW_KEY_NODE_DEVICE_PORT_NAME_PREFIX			"node.device-port-name-prefix"		/** override
@@ -15,12 +15,16 @@
 #include <sys/syscall.h>
 #include <sys/stat.h>
 
+#include <spa/utils/atomic.h>
 #include <spa/utils/list.h>
+#include <spa/utils/result.h>
+#include <spa/utils/string.h>
 #include <spa/buffer/buffer.h>
 
 #include <pipewire/log.h>
 #include <pipewire/map.h>
 #include <pipewire/mem.h>
+#include <pipewire/private.h>
 
 PW_LOG_TOPIC_EXTERN(log_mem);
 #define PW_LOG_TOPIC_DEFAULT log_mem
@@ -99,6 +103,27 @@ static int pw_memfd_create(const char *name, unsigned int flags)
 #define F_SEAL_WRITE    0x0008	/* prevent writes */
 #endif
 
+/* mbind(2) policy */
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+#define DEFAULT_HUGEPAGES_MIN_SIZE	(2u * 1024u * 1024u)
+
+enum hugepages_mode {
+	HUGEPAGES_NONE,		/* regular pages */
+	HUGEPAGES_THP,		/* advise transparent huge pages */
+	HUGEPAGES_HUGETLB,	/* hugetlbfs backed memfd, fall back to THP */
+};
+
+/* /sys/kernel/mm/transparent_hugepage/shmem_enabled */
+enum thp_shmem {
+	THP_SHMEM_NEVER,	/* never or deny, no huge pages for memfds */
+	THP_SHMEM_ADVISE,	/* only in mappings advised with MADV_HUGEPAGE */
+	THP_SHMEM_ALWAYS,	/* always, within_size or force */
+};
+
 #define pw_mempool_emit(p,m,v,...) spa_hook_list_call(&p->listener_list, struct pw_mempool_events, m, v, ##__VA_ARGS__)
 #define pw_mempool_emit_destroy(p)	pw_mempool_emit(p, destroy, 0)
 #define pw_mempool_emit_added(p,b)	pw_mempool_emit(p, added, 0, b)
@@ -115,6 +140,13 @@ struct mempool {
 	struct pw_map map;		/* map memblock to id */
 	struct spa_list blocks;		/* list of memblock */
 	uint32_t pagesize;
+
+	enum hugepages_mode hugepages;
+	size_t hugepages_min_size;	/* only use huge pages from this size */
+	int numa_node;			/* preferred NUMA node or -1, atomic */
+	enum thp_shmem thp_shmem;
+
+	struct pw_mempool_stats stats;
 };
 
 struct memblock {
@@ -125,6 +157,8 @@ struct memblock {
 	struct memblock *owner;		/* owner of fd, if another memblock */
 	struct spa_hook owner_listener;	/* listen for fd owner memblock events */
 	struct spa_hook_list listener_list;
+	unsigned int thp:1;		/* use transparent huge pages */
+	unsigned int thp_advised:1;	/* a mapping was advised */
 };
 
 struct memblock_events {
@@ -151,6 +185,36 @@ struct memmap {
 	struct spa_list link;
 };
 
+static enum thp_shmem get_thp_shmem(void)
+{
+	char buf[128], *start, *end;
+	ssize_t len;
+	int fd;
+
+	/* the active value is in brackets, like "always [advise] never" */
+	fd = open("/sys/kernel/mm/transparent_hugepage/shmem_enabled", O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return THP_SHMEM_NEVER;
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0)
+		return THP_SHMEM_NEVER;
+	buf[len] = '\0';
+
+	if ((start = strchr(buf, '[')) == NULL ||
+	    (end = strchr(start, ']')) == NULL)
+		return THP_SHMEM_NEVER;
+	*end = '\0';
+	start++;
+
+	if (spa_streq(start, "advise"))
+		return THP_SHMEM_ADVISE;
+	if (spa_streq(start, "always") || spa_streq(start, "within_size") ||
+	    spa_streq(start, "force"))
+		return THP_SHMEM_ALWAYS;
+	return THP_SHMEM_NEVER;
+}
+
 SPA_EXPORT
 struct pw_mempool *pw_mempool_new(struct pw_properties *props)
 {
@@ -165,8 +229,34 @@ struct pw_mempool *pw_mempool_new(struct pw_properties *props)
 	this->props = props;
 
 	impl->pagesize = sysconf(_SC_PAGESIZE);
+	impl->numa_node = -1;
+	impl->hugepages_min_size = DEFAULT_HUGEPAGES_MIN_SIZE;
+
+	if (props != NULL) {
+		const char *str;
+
+		if ((str = pw_properties_get(props, "mem.hugepages")) != NULL) {
+			if (spa_streq(str, "thp") || spa_atob(str))
+				impl->hugepages = HUGEPAGES_THP;
+			else if (spa_streq(str, "hugetlb"))
+				impl->hugepages = HUGEPAGES_HUGETLB;
+		}
+		impl->hugepages_min_size = pw_properties_get_uint64(props,
+				"mem.hugepages.min-size", impl->hugepages_min_size);
+		impl->numa_node = pw_properties_get_int32(props,
+				"mem.numa-node", impl->numa_node);
+	}
 
-	pw_log_debug("%p: new", this);
+	if (impl->hugepages != HUGEPAGES_NONE) {
+		impl->thp_shmem = get_thp_shmem();
+		if (impl->thp_shmem == THP_SHMEM_NEVER)
+			pw_log_info("%p: transparent huge pages are disabled for shared memory",
+					this);
+	}
+
+	pw_log_debug("%p: new hugepages:%d min-size:%zu numa-node:%d thp-shmem:%d", this,
+			impl->hugepages, impl->hugepages_min_size, impl->numa_node,
+			impl->thp_shmem);
 
 	spa_hook_list_init(&impl->listener_list);
 	pw_map_init(&impl->map, 64, 64);
@@ -206,6 +296,22 @@ void pw_mempool_destroy(struct pw_mempool *pool)
 	free(impl);
 }
 
+void pw_mempool_set_numa_node(struct pw_mempool *pool, int node)
+{
+	struct mempool *impl = SPA_CONTAINER_OF(pool, struct mempool, this);
+	pw_log_info("%p: allocating on NUMA node %d", pool, node);
+	/* called from the data loop while the main thread allocates */
+	SPA_ATOMIC_STORE(impl->numa_node, node);
+}
+
+SPA_EXPORT
+int pw_mempool_get_stats(struct pw_mempool *pool, struct pw_mempool_stats *stats)
+{
+	struct mempool *impl = SPA_CONTAINER_OF(pool, struct mempool, this);
+	*stats = impl->stats;
+	return 0;
+}
+
 SPA_EXPORT
 void pw_mempool_add_listener(struct pw_mempool *pool,
 			     struct spa_hook *listener,
@@ -341,6 +447,18 @@ static struct mapping * memblock_map(struct memblock *b,
 		munmap(ptr, size);
 		return NULL;
 	}
+#ifdef MADV_HUGEPAGE
+	/* the advice is kept in the mapping, the huge pages are allocated
+	 * in the memfd when the advised mapping touches them first */
+	if (b->thp && p->thp_shmem == THP_SHMEM_ADVISE) {
+		if (madvise(ptr, size, MADV_HUGEPAGE) < 0) {
+			pw_log_debug("%p: block %p madvise HUGEPAGE failed: %m", p, b);
+		} else if (!b->thp_advised) {
+			b->thp_advised = true;
+			p->stats.n_thp++;
+		}
+	}
+#endif
 	m->ptr = ptr;
 	m->do_unmap = true;
 	m->block = b;
@@ -389,6 +507,7 @@ struct pw_memmap * pw_memblock_map(struct pw_memblock *block,
 	struct memmap *mm;
 	struct pw_map_range range;
 	struct stat sb;
+	uint32_t pagesize;
 
 	if (b->this.fd == -1) {
 		pw_log_error("%p: block:%p cannot map memory with stale fd", p, block);
@@ -412,7 +531,14 @@ struct pw_memmap * pw_memblock_map(struct pw_memblock *block,
 		return NULL;
 	}
 
-	pw_map_range_init(&range, offset, size, p->pagesize);
+	/* hugetlbfs memfds can only be mapped at huge page boundaries and
+	 * report the huge page size as their block size */
+	pagesize = p->pagesize;
+	if (block->type == SPA_DATA_MemFd && sb.st_blksize > (blksize_t) pagesize &&
+	    (sb.st_blksize & (sb.st_blksize - 1)) == 0)
+		pagesize = sb.st_blksize;
+
+	pw_map_range_init(&range, offset, size, pagesize);
 
 	m = memblock_find_mapping(b, flags, offset, size);
 	if (m == NULL)
@@ -505,6 +631,139 @@ static inline enum pw_memmap_flags block_flags_to_mem(enum pw_memblock_flags fla
 	return fl;
 }
 
+#ifdef HAVE_MEMFD_CREATE
+static int memfd_create_hugetlb(struct mempool *impl, const char *name, size_t *size)
+{
+	struct stat sb;
+	size_t sz;
+	void *ptr;
+	int fd, res;
+
+	fd = pw_memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING |
+			MFD_NOEXEC_SEAL | MFD_HUGETLB);
+	if (fd == -1)
+		return -errno;
+
+	if (fstat(fd, &sb) < 0)
+		goto error_close;
+
+	sz = SPA_ROUND_UP_N(*size, (size_t)sb.st_blksize);
+	if (sz > UINT32_MAX) {
+		errno = EFBIG;
+		goto error_close;
+	}
+	if (ftruncate(fd, sz) < 0)
+		goto error_close;
+
+	/* shared mappings reserve the huge pages in the file, fail now
+	 * instead of in the mmap of the clients when there are not enough */
+	ptr = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (ptr == MAP_FAILED)
+		goto error_close;
+	munmap(ptr, sz);
+
+	pw_log_debug("%p: hugetlb fd:%d size:%zu->%zu page:%lu", impl, fd,
+			*size, sz, (unsigned long)sb.st_blksize);
+	*size = sz;
+	return fd;
+
+error_close:
+	res = -errno;
+	close(fd);
+	return res;
+}
+#endif
+
+static void memblock_set_thp(struct mempool *impl, struct memblock *b, bool hugetlb)
+{
+	if (impl->hugepages == HUGEPAGES_NONE || hugetlb ||
+	    b->this.size < impl->hugepages_min_size)
+		return;
+
+	switch (impl->thp_shmem) {
+	case THP_SHMEM_NEVER:
+		impl->stats.n_fallback++;
+		break;
+	case THP_SHMEM_ADVISE:
+		/* counted when a mapping is advised */
+		b->thp = true;
+		break;
+	case THP_SHMEM_ALWAYS:
+		/* the kernel uses huge pages for all mappings */
+		b->thp = true;
+		impl->stats.n_thp++;
+		break;
+	}
+}
+
+/* fault in all pages of a mapping */
+static void memblock_populate(struct mempool *impl, struct memblock *b, void *ptr)
+{
+	volatile uint8_t *p = ptr;
+	size_t i;
+
+#ifdef MADV_POPULATE_WRITE
+	if (madvise(ptr, b->this.size, MADV_POPULATE_WRITE) == 0)
+		return;
+#endif
+	for (i = 0; i < b->this.size; i += impl->pagesize)
+		p[i] = 0;
+}
+
+static void memblock_set_numa(struct mempool *impl, struct memblock *b, bool hugetlb)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+	int node = SPA_ATOMIC_LOAD(impl->numa_node);
+	unsigned long mask[1024 / (8 * sizeof(unsigned long))];
+	bool writable = b->this.flags & PW_MEMBLOCK_FLAG_WRITABLE;
+	void *ptr;
+	int res;
+
+	if (node < 0)
+		return;
+	if ((size_t)node >= sizeof(mask) * 8) {
+		pw_log_warn("%p: NUMA node %d out of range", impl, node);
+		impl->stats.n_fallback++;
+		return;
+	}
+
+	/* the policy of a shared mapping is stored in the shm object, we can
+	 * set it with a temporary mapping when we don't keep a mapping around.
+	 * hugetlbfs only keeps the policy in the mapping, we fault in the
+	 * pages through a writable mapping while the policy is set, the pages
+	 * then stay on the node when the clients map the block. */
+	if (b->this.map != NULL && (!hugetlb || writable)) {
+		ptr = b->this.map->ptr;
+	} else {
+		ptr = mmap(NULL, b->this.size, hugetlb ? PROT_READ | PROT_WRITE : PROT_READ,
+				MAP_SHARED, b->this.fd, 0);
+		if (ptr == MAP_FAILED) {
+			pw_log_warn("%p: can't map block %p for policy: %m", impl, b);
+			impl->stats.n_fallback++;
+			return;
+		}
+	}
+
+	spa_zero(mask);
+	mask[node / (8 * sizeof(unsigned long))] =
+		1UL << (node % (8 * sizeof(unsigned long)));
+
+	res = syscall(SYS_mbind, ptr, (unsigned long)b->this.size, MPOL_PREFERRED,
+			mask, (unsigned long)node + 2, 0);
+	if (res < 0) {
+		pw_log_debug("%p: block %p mbind node %d failed: %m", impl, b, node);
+		impl->stats.n_fallback++;
+	} else {
+		if (hugetlb)
+			memblock_populate(impl, b, ptr);
+		impl->stats.n_numa++;
+	}
+
+	if (b->this.map == NULL || ptr != b->this.map->ptr)
+		munmap(ptr, b->this.size);
+#endif
+}
+
 /** Create a new memblock
  * \param pool the pool to use
  * \param flags memblock flags
@@ -518,6 +777,7 @@ struct pw_memblock * pw_mempool_alloc(struct pw_mempool *pool, enum pw_memblock_
 {
 	struct mempool *impl = SPA_CONTAINER_OF(pool, struct mempool, this);
 	struct memblock *b;
+	bool hugetlb = false;
 	int res;
 
 	b = calloc(1, sizeof(struct memblock));
@@ -539,7 +799,21 @@ struct pw_memblock * pw_mempool_alloc(struct pw_mempool *pool, enum pw_memblock_
 		 "pipewire-memfd:flags=0x%08x,type=%" PRIu32 ",size=%zu",
 		 (unsigned int) flags, type, size);
 
-	b->this.fd = pw_memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING | MFD_NOEXEC_SEAL);
+	b->this.fd = -1;
+	if (impl->hugepages == HUGEPAGES_HUGETLB && size >= impl->hugepages_min_size) {
+		if ((res = memfd_create_hugetlb(impl, name, &size)) >= 0) {
+			b->this.fd = res;
+			b->this.size = size;
+			hugetlb = true;
+			impl->stats.n_hugetlb++;
+		} else {
+			pw_log_info("%p: hugetlb allocation of %zu bytes failed, "
+					"falling back: %s", pool, size, spa_strerror(res));
+			impl->stats.n_fallback++;
+		}
+	}
+	if (b->this.fd == -1)
+		b->this.fd = pw_memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING | MFD_NOEXEC_SEAL);
 	if (b->this.fd == -1) {
 		res = -errno;
 		pw_log_error("%p: Failed to create memfd: %m", pool);
@@ -581,6 +855,9 @@ struct pw_memblock * pw_mempool_alloc(struct pw_mempool *pool, enum pw_memblock_
 		}
 	}
 #endif
+	if (size > 0)
+		memblock_set_thp(impl, b, hugetlb);
+
 	if (flags & PW_MEMBLOCK_FLAG_MAP && size > 0) {
 		b->this.map = pw_memblock_map(&b->this,
 				block_flags_to_mem(flags), 0, size, NULL);
@@ -591,6 +868,10 @@ struct pw_memblock * pw_mempool_alloc(struct pw_mempool *pool, enum pw_memblock_
 		}
 		b->this.ref--;
 	}
+	if (size > 0)
+		memblock_set_numa(impl, b, hugetlb);
+
+	impl->stats.n_alloc++;
 
 	b->this.id = pw_map_insert_new(&impl->map, b);
 	spa_list_append(&impl->blocks, &b->link);
@@ -90,7 +90,25 @@ struct pw_mempool_events {
 	void (*removed) (void *data, struct pw_memblock *block);
 };
 
-/** Create a new memory pool */
+/** Memory pool allocation counters, see \ref pw_mempool_get_stats() */
+struct pw_mempool_stats {
+	uint64_t n_alloc;		/**< number of allocated blocks */
+	uint64_t n_hugetlb;		/**< blocks backed by hugetlbfs pages */
+	uint64_t n_thp;			/**< blocks in huge page shmem or with an advised mapping */
+	uint64_t n_numa;		/**< blocks placed on the preferred NUMA node */
+	uint64_t n_fallback;		/**< huge page or NUMA requests that failed */
+};
+
+/** Create a new memory pool
+ *
+ * The following properties configure the allocation policy:
+ *
+ *  - mem.hugepages: false, thp (or true) to advise transparent huge pages
+ *    or hugetlb to allocate from hugetlbfs, falling back to regular memory
+ *  - mem.hugepages.min-size: only use huge pages for blocks of at least
+ *    this many bytes, default 2MB
+ *  - mem.numa-node: the preferred NUMA node for the memory, default -1
+ */
 struct pw_mempool *pw_mempool_new(struct pw_properties *props);
 
 /** Listen for events */
@@ -99,6 +117,9 @@ void pw_mempool_add_listener(struct pw_mempool *pool,
                             const struct pw_mempool_events *events,
                             void *data);
 
+/** Get the allocation counters of the pool \since 1.1.0 */
+int pw_mempool_get_stats(struct pw_mempool *pool, struct pw_mempool_stats *stats);
+
 /** Clear a pool */
 void pw_mempool_clear(struct pw_mempool *pool);
 
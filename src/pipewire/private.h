@@ -21,6 +21,7 @@ extern "C" {
 #include <spa/param/latency-utils.h>
 #include <spa/utils/atomic.h>
 #include <spa/utils/ratelimit.h>
+#include <spa/utils/ringbuffer.h>
 #include <spa/utils/result.h>
 #include <spa/utils/type-info.h>
 
@@ -607,6 +608,137 @@ struct pw_node_activation {
 							 * to update wins */
 };
 
+/* The ring of an input stream with PW_STREAM_FLAG_RING. It is allocated by
+ * the server and given to the stream with SPA_IO_Memory on the node. The
+ * server writes the captured data in it and only wakes up the client when
+ * the wakeup level is reached. When the server can't get to the data, the
+ * client writes it itself.
+ *
+ * The header is followed by n_planes areas of size bytes, one for each data
+ * plane of the buffers. The same read and write index is used for all
+ * planes. */
+struct pw_node_ring {
+	struct spa_ringbuffer ring;
+	uint32_t size;			/* size of a plane, power of 2 */
+	uint32_t n_planes;
+	uint32_t wakeup;		/* wake up the reader with this many bytes */
+#define PW_NODE_RING_IDLE	0
+#define PW_NODE_RING_WAKEUP	1	/* the reader needs to be woken up */
+#define PW_NODE_RING_WOKEN	2	/* the reader was woken up */
+	int32_t pending;		/* back to idle when the reader reads */
+	uint64_t overruns;		/* writes dropped because the ring was full */
+};
+
+#define PW_NODE_RING_HEADER	64u
+#define PW_NODE_RING_MAX_PLANES	64u
+
+static inline size_t pw_node_ring_get_size(uint32_t size, uint32_t n_planes)
+{
+	return PW_NODE_RING_HEADER + (size_t)size * n_planes;
+}
+
+static inline void *pw_node_ring_plane(struct pw_node_ring *r, uint32_t size, uint32_t plane)
+{
+	return SPA_PTROFF(r, PW_NODE_RING_HEADER + (size_t)size * plane, void);
+}
+
+static inline void pw_node_ring_init(struct pw_node_ring *r, uint32_t size,
+		uint32_t n_planes, uint32_t wakeup)
+{
+	spa_zero(*r);
+	spa_ringbuffer_init(&r->ring);
+	r->size = size;
+	r->n_planes = n_planes;
+	r->wakeup = SPA_MIN(wakeup, size);
+}
+
+/* check a ring that was mapped from another process */
+static inline bool pw_node_ring_check(struct pw_node_ring *r, size_t size)
+{
+	return size >= PW_NODE_RING_HEADER &&
+		r->size > 0 && (r->size & (r->size - 1)) == 0 &&
+		r->n_planes > 0 && r->n_planes <= PW_NODE_RING_MAX_PLANES &&
+		size >= pw_node_ring_get_size(r->size, r->n_planes);
+}
+
+/* Append the chunks of the data planes of buf. The reader can change the
+ * header of the ring, so the writer passes the size, planes and wakeup level
+ * it made the ring with and only the indexes are used from the header.
+ * Returns < 0 when the data is not mapped, 1 when the reader needs to be
+ * woken up and 0 otherwise. */
+static inline int pw_node_ring_write(struct pw_node_ring *r, uint32_t ring_size,
+		uint32_t ring_planes, uint32_t wakeup, struct spa_buffer *buf)
+{
+	uint32_t i, index, offs, size = UINT32_MAX;
+	uint32_t n_planes = SPA_MIN(buf->n_datas, ring_planes);
+	int32_t filled;
+
+	if (n_planes == 0)
+		return -EINVAL;
+
+	/* planar data has the same size in all planes */
+	for (i = 0; i < n_planes; i++) {
+		struct spa_data *d = &buf->datas[i];
+		if (d->data == NULL || d->chunk == NULL)
+			return -EINVAL;
+		offs = SPA_MIN(d->chunk->offset, d->maxsize);
+		size = SPA_MIN(size, SPA_MIN(d->chunk->size, d->maxsize - offs));
+	}
+
+	/* the read index is set by the reader, filled can be anything */
+	filled = spa_ringbuffer_get_write_index(&r->ring, &index);
+	if (filled < 0 || (uint32_t)filled > ring_size ||
+	    size > ring_size - (uint32_t)filled) {
+		/* the reader is too slow, drop the new data */
+		SPA_ATOMIC_INC(r->overruns);
+	} else if (size > 0) {
+		for (i = 0; i < n_planes; i++) {
+			struct spa_data *d = &buf->datas[i];
+			offs = SPA_MIN(d->chunk->offset, d->maxsize);
+			spa_ringbuffer_write_data(&r->ring,
+					pw_node_ring_plane(r, ring_size, i), ring_size,
+					index & (ring_size - 1),
+					SPA_PTROFF(d->data, offs, void), size);
+		}
+		spa_ringbuffer_write_update(&r->ring, index + size);
+		filled += size;
+	}
+	/* batch the wakeups, only wake up once enough data is available and
+	 * not again until the ring was read */
+	return (uint32_t)SPA_MAX(filled, 0) >= SPA_MIN(wakeup, ring_size) &&
+		SPA_ATOMIC_CAS(r->pending, PW_NODE_RING_IDLE, PW_NODE_RING_WAKEUP);
+}
+
+/* Read up to size bytes of each plane into data, planes without a pointer
+ * are skipped. With data NULL, only return the available bytes. */
+static inline int32_t pw_node_ring_read(struct pw_node_ring *r, void **data,
+		uint32_t n_data, uint32_t size)
+{
+	uint32_t i, index;
+	int32_t avail;
+
+	avail = spa_ringbuffer_get_read_index(&r->ring, &index);
+	if (avail < 0)
+		return -EPIPE;
+	if (data == NULL)
+		return avail;
+
+	size = SPA_MIN(size, (uint32_t)avail);
+	if (size > 0) {
+		for (i = 0; i < SPA_MIN(n_data, r->n_planes); i++) {
+			if (data[i] == NULL)
+				continue;
+			spa_ringbuffer_read_data(&r->ring,
+					pw_node_ring_plane(r, r->size, i), r->size,
+					index & (r->size - 1), data[i], size);
+		}
+		spa_ringbuffer_read_update(&r->ring, index + size);
+	}
+	/* allow the next wakeup */
+	SPA_ATOMIC_STORE(r->pending, PW_NODE_RING_IDLE);
+	return size;
+}
+
 #define pw_impl_node_emit(o,m,v,...) spa_hook_list_call(&o->listener_list, struct pw_impl_node_events, m, v, ##__VA_ARGS__)
 #define pw_impl_node_emit_destroy(n)			pw_impl_node_emit(n, destroy, 0)
 #define pw_impl_node_emit_free(n)			pw_impl_node_emit(n, free, 0)
@@ -735,6 +867,9 @@ struct pw_impl_node {
 		struct spa_list driver_link;		/* our link in driver */
 
 		struct spa_ratelimit rate_limit;
+
+		uint32_t cycle_divider;			/* wake up the client of a ring
+							 * every Nth cycle */
 	} rt;
 	struct spa_fraction target_rate;
 	uint64_t target_quantum;
@@ -1248,6 +1383,8 @@ int pw_impl_node_set_driver(struct pw_impl_node *node, struct pw_impl_node *driv
 
 int pw_impl_node_trigger(struct pw_impl_node *node);
 
+int pw_impl_node_skip(struct pw_impl_node *node);
+
 /** Prepare a link
   * Starts the negotiation of formats and buffers on \a link */
 int pw_impl_link_prepare(struct pw_impl_link *link);
@@ -1302,6 +1439,8 @@ void pw_settings_clean(struct pw_context *context);
 
 bool pw_should_dlclose(void);
 
+void pw_mempool_set_numa_node(struct pw_mempool *pool, int node);
+
 void pw_log_topic_register_enum(const struct spa_log_topic_enum *e);
 void pw_log_topic_unregister_enum(const struct spa_log_topic_enum *e);
 
@@ -5,6 +5,7 @@
 #include <errno.h>
 #include <stdio.h>
 #include <math.h>
+#include <pthread.h>
 #include <sys/mman.h>
 #include <time.h>
 
@@ -32,6 +33,8 @@ PW_LOG_TOPIC_EXTERN(log_stream);
 
 #define MASK_BUFFERS	(MAX_BUFFERS-1)
 
+#define DEFAULT_RING_SIZE	(1u << 20)
+
 static bool mlock_warned = false;
 
 static uint32_t mappable_dataTypes = (1<<SPA_DATA_MemFd);
@@ -148,6 +151,10 @@ struct stream {
 
 	struct spa_callbacks rt_callbacks;
 
+	pthread_mutex_t ring_lock;	/* protects ring for the reader */
+	struct pw_node_ring *ring;	/* shared with the server, SPA_IO_Memory */
+	struct pw_node_ring *rt_ring;	/* used in the data loop */
+
 	unsigned int disconnecting:1;
 	unsigned int disconnect_core:1;
 	unsigned int draining:1;
@@ -160,6 +167,7 @@ struct stream {
 	unsigned int trigger:1;
 	unsigned int early_process:1;
 	unsigned int trigger_done_rt:1;
+	unsigned int use_ring:1;
 	int in_set_param;
 	int in_emit_param_changed;
 };
@@ -518,6 +526,15 @@ do_set_position(struct spa_loop *loop,
 	return 0;
 }
 
+static int
+do_set_ring(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct stream *impl = user_data;
+	impl->rt_ring = impl->ring;
+	return 0;
+}
+
 static int impl_set_io(void *object, uint32_t id, void *data, size_t size)
 {
 	struct stream *impl = object;
@@ -542,6 +559,19 @@ static int impl_set_io(void *object, uint32_t id, void *data, size_t size)
 		pw_loop_invoke(impl->data_loop,
 				do_set_position, 1, NULL, 0, true, impl);
 		break;
+	case SPA_IO_Memory:
+		if (!impl->use_ring)
+			break;
+		if (data && !pw_node_ring_check(data, size)) {
+			pw_log_warn("%p: invalid ring %p %zd", impl, data, size);
+			data = NULL;
+		}
+		pthread_mutex_lock(&impl->ring_lock);
+		impl->ring = data;
+		pthread_mutex_unlock(&impl->ring_lock);
+		pw_loop_invoke(impl->data_loop,
+				do_set_ring, 1, NULL, 0, true, impl);
+		break;
 	default:
 		break;
 	}
@@ -1046,6 +1076,41 @@ static int impl_port_reuse_buffer(void *object, uint32_t port_id, uint32_t buffe
 	return 0;
 }
 
+static int process_input_ring(struct stream *impl, struct spa_io_buffers *io)
+{
+	struct pw_stream *stream = &impl->this;
+	struct pw_node_ring *r = impl->rt_ring;
+	struct buffer *b;
+	uint32_t index;
+	int32_t avail;
+
+	if (SPA_UNLIKELY(r == NULL))
+		goto done;
+
+	/* the server did not write the data in the ring, because there are
+	 * more links or because it can't access the buffers, do it here */
+	if (io->status == SPA_STATUS_HAVE_DATA &&
+	    (b = get_buffer(stream, io->buffer_id)) != NULL &&
+	    pw_node_ring_write(r, r->size, r->n_planes, r->wakeup, b->this.buffer) < 0)
+		pw_log_trace_fp("%p: can't write buffer %d in ring", stream, b->id);
+
+	/* the writer asked for a wakeup, we are it */
+	if (SPA_ATOMIC_CAS(r->pending, PW_NODE_RING_WAKEUP, PW_NODE_RING_WOKEN)) {
+		/* queued is the number of bytes in the ring */
+		avail = spa_ringbuffer_get_read_index(&r->ring, &index);
+		copy_position(impl, SPA_MAX(avail, 0));
+		call_process(impl);
+	}
+done:
+	/* the data is in the ring, recycle the buffer right away */
+	io->status = SPA_STATUS_NEED_DATA;
+
+	if (impl->driving && impl->using_trigger)
+		call_trigger_done(impl);
+
+	return SPA_STATUS_NEED_DATA | SPA_STATUS_HAVE_DATA;
+}
+
 static int impl_node_process_input(void *object)
 {
 	struct stream *impl = object;
@@ -1056,6 +1121,9 @@ static int impl_node_process_input(void *object)
 	if (io == NULL)
 		return -EIO;
 
+	if (impl->use_ring)
+		return process_input_ring(impl, io);
+
 	pw_log_trace_fp("%p: process in status:%d id:%d ticks:%"PRIu64" delay:%"PRIi64,
 			stream, io->status, io->buffer_id, impl->time.ticks, impl->time.delay);
 
@@ -1558,6 +1626,7 @@ stream_new(struct pw_context *context, const char *name,
 	spa_ringbuffer_init(&impl->dequeued.ring);
 	spa_ringbuffer_init(&impl->queued.ring);
 	spa_list_init(&impl->param_list);
+	pthread_mutex_init(&impl->ring_lock, NULL);
 
 	spa_hook_list_init(&this->listener_list);
 	spa_list_init(&this->controls);
@@ -1737,6 +1806,7 @@ void pw_stream_destroy(struct pw_stream *stream)
 		pw_context_destroy(impl->data.context);
 
 	pw_properties_free(impl->port_props);
+	pthread_mutex_destroy(&impl->ring_lock);
 	free(impl);
 }
 
@@ -1927,6 +1997,12 @@ pw_stream_connect(struct pw_stream *stream,
 
 	impl->direction =
 	    direction == PW_DIRECTION_INPUT ? SPA_DIRECTION_INPUT : SPA_DIRECTION_OUTPUT;
+	impl->use_ring = SPA_FLAG_IS_SET(flags, PW_STREAM_FLAG_RING) &&
+		impl->direction == SPA_DIRECTION_INPUT;
+	if (impl->use_ring)
+		flags |= PW_STREAM_FLAG_MAP_BUFFERS;
+	else if (SPA_FLAG_IS_SET(flags, PW_STREAM_FLAG_RING))
+		pw_log_warn("%p: ring is only supported for input streams", stream);
 	impl->flags = flags;
 	impl->node_methods = impl_node;
 
@@ -2074,6 +2150,14 @@ pw_stream_connect(struct pw_stream *stream,
 	if ((str = pw_properties_get(stream->properties, "mem.allow-mlock")) != NULL)
 		impl->allow_mlock = pw_properties_parse_bool(str);
 
+	if (impl->use_ring) {
+		/* the server allocates the ring and writes into it */
+		pw_properties_set(stream->properties, "stream.ring", "true");
+		pw_properties_setf(stream->properties, "stream.ring.size", "%u",
+				pw_properties_get_uint32(stream->properties,
+					"stream.ring.size", DEFAULT_RING_SIZE));
+	}
+
 	impl->port_info.props = &impl->port_props->dict;
 
 	if (stream->core == NULL) {
@@ -2378,9 +2462,11 @@ int pw_stream_get_time_n(struct pw_stream *stream, struct pw_time *time, size_t
 		seq2 = SPA_SEQ_READ(impl->seq);
 	} while (!SPA_SEQ_READ_SUCCESS(seq1, seq2));
 
-	if (impl->direction == SPA_DIRECTION_INPUT)
-		time->queued = (int64_t)(time->queued - impl->dequeued.outcount);
-	else
+	if (impl->direction == SPA_DIRECTION_INPUT) {
+		/* with a ring, queued is the number of bytes in the ring */
+		if (!impl->use_ring)
+			time->queued = (int64_t)(time->queued - impl->dequeued.outcount);
+	} else
 		time->queued = (int64_t)(impl->queued.incount - time->queued);
 
 	time->delay += ((impl->latency.min_quantum + impl->latency.max_quantum) / 2) * quantum;
@@ -2454,6 +2540,51 @@ struct pw_buffer *pw_stream_dequeue_buffer(struct pw_stream *stream)
 	return &b->this;
 }
 
+SPA_EXPORT
+struct pw_buffer *pw_stream_dequeue_latest_buffer(struct pw_stream *stream)
+{
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	struct buffer *b;
+	uint32_t index, qindex, id, i, n_old;
+	int32_t avail;
+
+	if (impl->direction != SPA_DIRECTION_INPUT)
+		return pw_stream_dequeue_buffer(stream);
+
+	avail = spa_ringbuffer_get_read_index(&impl->dequeued.ring, &index);
+	if (avail < 1) {
+		pw_log_trace_fp("%p: no more buffers", stream);
+		errno = EPIPE;
+		return NULL;
+	}
+	n_old = avail - 1;
+	if (n_old > 0) {
+		/* recycle all older buffers with one update of the queued ring,
+		 * they stay marked as queued */
+		spa_ringbuffer_get_write_index(&impl->queued.ring, &qindex);
+		for (i = 0; i < n_old; i++) {
+			id = impl->dequeued.ids[(index + i) & MASK_BUFFERS];
+			b = &impl->buffers[id];
+			if (b->busy)
+				SPA_ATOMIC_DEC(b->busy->count);
+			impl->dequeued.outcount += b->this.size;
+			impl->queued.incount += b->this.size;
+			impl->queued.ids[(qindex + i) & MASK_BUFFERS] = id;
+		}
+		spa_ringbuffer_write_update(&impl->queued.ring, qindex + n_old);
+	}
+	id = impl->dequeued.ids[(index + n_old) & MASK_BUFFERS];
+	spa_ringbuffer_read_update(&impl->dequeued.ring, index + avail);
+
+	b = &impl->buffers[id];
+	impl->dequeued.outcount += b->this.size;
+	SPA_FLAG_CLEAR(b->flags, BUFFER_FLAG_QUEUED);
+
+	pw_log_trace_fp("%p: dequeue latest buffer %d, recycled %u", stream, b->id, n_old);
+
+	return &b->this;
+}
+
 SPA_EXPORT
 int pw_stream_queue_buffer(struct pw_stream *stream, struct pw_buffer *buffer)
 {
@@ -2478,6 +2609,37 @@ int pw_stream_queue_buffer(struct pw_stream *stream, struct pw_buffer *buffer)
 	return res;
 }
 
+SPA_EXPORT
+int pw_stream_ring_read(struct pw_stream *stream, void **data, uint32_t n_data, uint32_t size)
+{
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	int res = 0;
+
+	if (!impl->use_ring)
+		return -ENOTSUP;
+
+	pthread_mutex_lock(&impl->ring_lock);
+	if (impl->ring != NULL)
+		res = pw_node_ring_read(impl->ring, data, n_data, size);
+	pthread_mutex_unlock(&impl->ring_lock);
+
+	return res;
+}
+
+SPA_EXPORT
+uint64_t pw_stream_ring_get_overruns(struct pw_stream *stream)
+{
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	uint64_t res = 0;
+
+	pthread_mutex_lock(&impl->ring_lock);
+	if (impl->ring != NULL)
+		res = SPA_ATOMIC_LOAD(impl->ring->overruns);
+	pthread_mutex_unlock(&impl->ring_lock);
+
+	return res;
+}
+
 static int
 do_flush(struct spa_loop *loop,
                  bool async, uint32_t seq, const void *data, size_t size, void *user_data)
@@ -427,6 +427,15 @@ enum pw_stream_flags {
 	PW_STREAM_FLAG_RT_TRIGGER_DONE	= (1 << 12),	/**< Call trigger_done from the realtime
 							  *  thread. You MUST use RT safe functions
 							  *  in the trigger_done callback. Since 1.1.0 */
+	PW_STREAM_FLAG_RING		= (1 << 13),	/**< The server copies the captured data
+							  *  into a ringbuffer shared with the client
+							  *  and recycles the buffers immediately. The
+							  *  client is only woken up and process is
+							  *  only called when stream.ring.wakeup bytes
+							  *  are available, the data should be read
+							  *  with pw_stream_ring_read(). All data
+							  *  planes are kept. Only for input streams.
+							  *  Since 1.1.0 */
 };
 
 /** Create a new unconneced \ref pw_stream
@@ -535,9 +544,30 @@ int pw_stream_get_time(struct pw_stream *stream, struct pw_time *time);
  * for capture streams. */
 struct pw_buffer *pw_stream_dequeue_buffer(struct pw_stream *stream);
 
+/** Get the most recent buffer of a capture stream and recycle all older
+ * buffers in one step. This is the same as calling pw_stream_dequeue_buffer()
+ * until no more buffers are available and queueing all but the last one but
+ * with fewer queue operations. For playback streams this is the same as
+ * pw_stream_dequeue_buffer(). Since 1.1.0 */
+struct pw_buffer *pw_stream_dequeue_latest_buffer(struct pw_stream *stream);
+
 /** Submit a buffer for playback or recycle a buffer for capture. */
 int pw_stream_queue_buffer(struct pw_stream *stream, struct pw_buffer *buffer);
 
+/** Read up to \a size bytes of each data plane from the ringbuffer of a
+ * stream connected with PW_STREAM_FLAG_RING into the \a n_data pointers in
+ * \a data, a NULL pointer skips the plane. Data that is not read by the
+ * time the ring is full is dropped. This can be called from any thread but
+ * only from one thread at a time. When \a data is NULL, the available bytes
+ * are returned without consuming them.
+ * \return the number of bytes read from each plane, 0 when the ring is not
+ * set up yet or < 0 on error. Since 1.1.0 */
+int pw_stream_ring_read(struct pw_stream *stream, void **data, uint32_t n_data, uint32_t size);
+
+/** Get the number of cycles that could not be written into the
+ * ringbuffer because it was full. Since 1.1.0 */
+uint64_t pw_stream_ring_get_overruns(struct pw_stream *stream);
+
 /** Activate or deactivate the stream */
 int pw_stream_set_active(struct pw_stream *stream, bool active);
 
@@ -0,0 +1,149 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <stdio.h>
+#include <time.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/impl.h>
+#include <pipewire/main-loop.h>
+#include <pipewire/stream.h>
+
+#include <spa/param/video/format-utils.h>
+
+/* Compare the cost of taking the newest buffer of a capture stream with a
+ * deep queue: dequeue all buffers and requeue all but the last one against
+ * pw_stream_dequeue_latest_buffer(). The stream node is driven directly,
+ * like the graph would do it. */
+
+#define MAX_BUFFERS	32
+#define MAX_CYCLES	20000
+
+static struct spa_node *exported_node;
+
+static struct pw_proxy *export_node(struct pw_core *core, const char *type,
+		const struct spa_dict *props, void *object, size_t user_data_size)
+{
+	exported_node = pw_impl_node_get_implementation(object);
+	return pw_proxy_new((struct pw_proxy*)core, type, PW_VERSION_NODE, user_data_size);
+}
+
+static struct pw_export_type export_type = {
+	.type = PW_TYPE_INTERFACE_Node,
+	.func = export_node,
+};
+
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void fill_queue(struct spa_node *node, struct spa_io_buffers *io, uint32_t n_buffers)
+{
+	uint32_t i;
+	for (i = 0; i < n_buffers; i++) {
+		io->status = SPA_STATUS_HAVE_DATA;
+		io->buffer_id = i;
+		spa_node_process(node);
+	}
+}
+
+static void recycle_queue(struct spa_node *node, struct spa_io_buffers *io, uint32_t n_buffers)
+{
+	uint32_t i;
+	for (i = 0; i < n_buffers; i++) {
+		io->status = SPA_STATUS_NEED_DATA;
+		io->buffer_id = SPA_ID_INVALID;
+		spa_node_process(node);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+	struct pw_core *core;
+	struct pw_stream *stream;
+	struct spa_node *node;
+	struct spa_io_buffers io = SPA_IO_BUFFERS_INIT;
+	struct spa_buffer *buffers[MAX_BUFFERS], bufs[MAX_BUFFERS];
+	const struct spa_pod *params[1];
+	struct pw_buffer *b, *t;
+	uint8_t buffer[1024];
+	struct spa_pod_builder pb = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	uint64_t t1, t2, t3;
+	uint32_t i;
+
+	pw_init(&argc, &argv);
+
+	loop = pw_main_loop_new(NULL);
+	context = pw_context_new(pw_main_loop_get_loop(loop),
+			pw_properties_new(PW_KEY_CONFIG_NAME, "null", NULL), 0);
+	if (context == NULL ||
+	    pw_context_load_module(context, "libpipewire-module-protocol-native", NULL, NULL) == NULL ||
+	    pw_context_register_export_type(context, &export_type) < 0 ||
+	    (core = pw_context_connect_self(context, NULL, 0)) == NULL) {
+		fprintf(stderr, "can't make local context: %m\n");
+		return 77;
+	}
+	stream = pw_stream_new(core, "benchmark", NULL);
+
+	params[0] = spa_format_video_raw_build(&pb, SPA_PARAM_EnumFormat,
+			&SPA_VIDEO_INFO_RAW_INIT(
+				.format = SPA_VIDEO_FORMAT_RGBA,
+				.size = SPA_RECTANGLE(320, 240),
+				.framerate = SPA_FRACTION(25, 1)));
+	if (stream == NULL ||
+	    pw_stream_connect(stream, PW_DIRECTION_INPUT, PW_ID_ANY,
+			PW_STREAM_FLAG_INACTIVE, params, 1) < 0 ||
+	    (node = exported_node) == NULL) {
+		fprintf(stderr, "can't connect stream: %m\n");
+		return 1;
+	}
+
+	spa_node_port_set_io(node, SPA_DIRECTION_INPUT, 0, SPA_IO_Buffers, &io, sizeof(io));
+	for (i = 0; i < MAX_BUFFERS; i++) {
+		bufs[i] = (struct spa_buffer) { 0, };
+		buffers[i] = &bufs[i];
+	}
+	spa_node_port_use_buffers(node, SPA_DIRECTION_INPUT, 0, 0, buffers, MAX_BUFFERS);
+
+	t1 = get_time_ns();
+	for (i = 0; i < MAX_CYCLES; i++) {
+		fill_queue(node, &io, MAX_BUFFERS);
+		b = NULL;
+		while ((t = pw_stream_dequeue_buffer(stream)) != NULL) {
+			if (b)
+				pw_stream_queue_buffer(stream, b);
+			b = t;
+		}
+		pw_stream_queue_buffer(stream, b);
+		recycle_queue(node, &io, MAX_BUFFERS);
+	}
+	t2 = get_time_ns();
+	for (i = 0; i < MAX_CYCLES; i++) {
+		fill_queue(node, &io, MAX_BUFFERS);
+		b = pw_stream_dequeue_latest_buffer(stream);
+		pw_stream_queue_buffer(stream, b);
+		recycle_queue(node, &io, MAX_BUFFERS);
+	}
+	t3 = get_time_ns();
+
+	fprintf(stdout, "%d buffers, %d cycles: dequeue loop %"PRIu64" ns/cycle, "
+			"dequeue latest %"PRIu64" ns/cycle\n",
+			MAX_BUFFERS, MAX_CYCLES,
+			(t2 - t1) / MAX_CYCLES, (t3 - t2) / MAX_CYCLES);
+
+	spa_node_port_use_buffers(node, SPA_DIRECTION_INPUT, 0, 0, NULL, 0);
+
+	pw_stream_destroy(stream);
+	pw_context_destroy(context);
+	pw_main_loop_destroy(loop);
+
+	pw_deinit();
+
+	return 0;
+}
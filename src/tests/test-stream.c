@@ -3,10 +3,13 @@
 /* SPDX-License-Identifier: MIT */
 
 #include <pipewire/pipewire.h>
+#include <pipewire/impl.h>
 #include <pipewire/main-loop.h>
 #include <pipewire/stream.h>
+#include <pipewire/private.h>
 
 #include <spa/utils/string.h>
+#include <spa/param/video/format-utils.h>
 
 #define TEST_FUNC(a,b,func)	\
 do {				\
@@ -162,6 +165,10 @@ static void test_create(void)
 
 	spa_assert_se(pw_stream_dequeue_buffer(stream) == NULL);
 
+	/* no ring when not connected with PW_STREAM_FLAG_RING */
+	spa_assert_se(pw_stream_ring_read(stream, NULL, 0, 0) == -ENOTSUP);
+	spa_assert_se(pw_stream_ring_get_overruns(stream) == 0);
+
 	/* check destroy */
 	destroy_count = 0;
 	stream_events.destroy = stream_destroy_count;
@@ -223,6 +230,290 @@ static void test_properties(void)
 	pw_main_loop_destroy(loop);
 }
 
+#define LATEST_BUFFERS	8
+
+static int process_count = 0;
+static void stream_process_count(void *data)
+{
+	process_count++;
+}
+
+/* The node of the stream is exported with this function instead of the
+ * client-node of the server, the test then drives it like the graph. */
+static struct spa_node *exported_node;
+
+static struct pw_proxy *export_node(struct pw_core *core, const char *type,
+		const struct spa_dict *props, void *object, size_t user_data_size)
+{
+	exported_node = pw_impl_node_get_implementation(object);
+	return pw_proxy_new((struct pw_proxy*)core, type, PW_VERSION_NODE, user_data_size);
+}
+
+static struct pw_export_type export_type = {
+	.type = PW_TYPE_INTERFACE_Node,
+	.func = export_node,
+};
+
+static struct pw_context *local_context_new(struct pw_main_loop *loop)
+{
+	struct pw_context *context;
+
+	context = pw_context_new(pw_main_loop_get_loop(loop),
+			pw_properties_new(PW_KEY_CONFIG_NAME, "null", NULL), 0);
+	spa_assert_se(context != NULL);
+	spa_assert_se(pw_context_load_module(context,
+			"libpipewire-module-protocol-native", NULL, NULL) != NULL);
+	spa_assert_se(pw_context_register_export_type(context, &export_type) == 0);
+	return context;
+}
+
+static void fill_queue(struct spa_node *node, struct spa_io_buffers *io, uint32_t n_buffers)
+{
+	uint32_t i;
+	for (i = 0; i < n_buffers; i++) {
+		io->status = SPA_STATUS_HAVE_DATA;
+		io->buffer_id = i;
+		spa_node_process(node);
+	}
+}
+
+static void recycle_queue(struct spa_node *node, struct spa_io_buffers *io, uint32_t n_buffers)
+{
+	uint32_t i;
+	for (i = 0; i < n_buffers; i++) {
+		io->status = SPA_STATUS_NEED_DATA;
+		io->buffer_id = SPA_ID_INVALID;
+		spa_node_process(node);
+	}
+}
+
+static void test_dequeue_latest(void)
+{
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+	struct pw_core *core;
+	struct pw_stream *stream;
+	struct spa_node *node;
+	struct spa_io_buffers io = SPA_IO_BUFFERS_INIT;
+	struct spa_buffer *buffers[LATEST_BUFFERS], bufs[LATEST_BUFFERS];
+	const struct spa_pod *params[1];
+	struct pw_buffer *b;
+	uint8_t buffer[1024];
+	struct spa_pod_builder pb = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	uint32_t i;
+
+	loop = pw_main_loop_new(NULL);
+	context = local_context_new(loop);
+	core = pw_context_connect_self(context, NULL, 0);
+	spa_assert_se(core != NULL);
+	stream = pw_stream_new(core, "test", NULL);
+	spa_assert_se(stream != NULL);
+
+	params[0] = spa_format_video_raw_build(&pb, SPA_PARAM_EnumFormat,
+			&SPA_VIDEO_INFO_RAW_INIT(
+				.format = SPA_VIDEO_FORMAT_RGBA,
+				.size = SPA_RECTANGLE(320, 240),
+				.framerate = SPA_FRACTION(25, 1)));
+	exported_node = NULL;
+	spa_assert_se(pw_stream_connect(stream, PW_DIRECTION_INPUT, PW_ID_ANY,
+			PW_STREAM_FLAG_INACTIVE, params, 1) == 0);
+
+	/* drive the stream node directly, as the graph would */
+	node = exported_node;
+	spa_assert_se(node != NULL);
+	spa_assert_se(spa_node_port_set_io(node, SPA_DIRECTION_INPUT, 0,
+			SPA_IO_Buffers, &io, sizeof(io)) == 0);
+	for (i = 0; i < LATEST_BUFFERS; i++) {
+		bufs[i] = (struct spa_buffer) { 0, };
+		buffers[i] = &bufs[i];
+	}
+	spa_assert_se(spa_node_port_use_buffers(node, SPA_DIRECTION_INPUT, 0, 0,
+			buffers, LATEST_BUFFERS) == 0);
+
+	/* nothing queued */
+	spa_assert_se(pw_stream_dequeue_latest_buffer(stream) == NULL);
+
+	/* the newest buffer is returned, all others are recycled */
+	fill_queue(node, &io, LATEST_BUFFERS);
+	b = pw_stream_dequeue_latest_buffer(stream);
+	spa_assert_se(b != NULL);
+	spa_assert_se(b->buffer == buffers[LATEST_BUFFERS - 1]);
+	spa_assert_se(pw_stream_dequeue_buffer(stream) == NULL);
+
+	/* the older buffers go back to the graph in order, the newest one
+	 * only after it was queued */
+	for (i = 0; i < LATEST_BUFFERS - 1; i++) {
+		recycle_queue(node, &io, 1);
+		spa_assert_se(io.buffer_id == i);
+	}
+	recycle_queue(node, &io, 1);
+	spa_assert_se(io.buffer_id == SPA_ID_INVALID);
+	spa_assert_se(pw_stream_queue_buffer(stream, b) == 0);
+	recycle_queue(node, &io, 1);
+	spa_assert_se(io.buffer_id == LATEST_BUFFERS - 1);
+
+	/* with one buffer queued, that buffer is returned */
+	fill_queue(node, &io, 1);
+	b = pw_stream_dequeue_latest_buffer(stream);
+	spa_assert_se(b != NULL);
+	spa_assert_se(b->buffer == buffers[0]);
+	spa_assert_se(pw_stream_queue_buffer(stream, b) == 0);
+	spa_assert_se(pw_stream_dequeue_latest_buffer(stream) == NULL);
+
+	spa_node_port_use_buffers(node, SPA_DIRECTION_INPUT, 0, 0, NULL, 0);
+
+	pw_stream_destroy(stream);
+	pw_context_destroy(context);
+	pw_main_loop_destroy(loop);
+}
+
+#define RING_SIZE	4096
+#define RING_WAKEUP	1024
+#define RING_CHUNK	512
+
+static void test_ring(void)
+{
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+	struct pw_core *core;
+	struct pw_stream *stream;
+	struct pw_stream_events stream_events = { PW_VERSION_STREAM_EVENTS, };
+	struct spa_hook listener = { 0, };
+	struct spa_node *node;
+	struct spa_io_buffers io = SPA_IO_BUFFERS_INIT;
+	struct spa_buffer *buffers[2], bufs[2];
+	struct spa_data datas[2][2];
+	struct spa_chunk chunks[2][2];
+	static uint8_t mem[2][2][RING_CHUNK], out[2][RING_SIZE];
+	void *planes[2] = { out[0], out[1] };
+	struct pw_node_ring *ring;
+	const struct spa_pod *params[1];
+	uint8_t buffer[1024];
+	struct spa_pod_builder pb = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	size_t ring_size;
+	uint32_t i, j;
+
+	loop = pw_main_loop_new(NULL);
+	context = local_context_new(loop);
+	core = pw_context_connect_self(context, NULL, 0);
+	spa_assert_se(core != NULL);
+	stream = pw_stream_new(core, "test", NULL);
+	spa_assert_se(stream != NULL);
+	stream_events.process = stream_process_count;
+	pw_stream_add_listener(stream, &listener, &stream_events, stream);
+
+	params[0] = spa_format_video_raw_build(&pb, SPA_PARAM_EnumFormat,
+			&SPA_VIDEO_INFO_RAW_INIT(
+				.format = SPA_VIDEO_FORMAT_I420,
+				.size = SPA_RECTANGLE(320, 240),
+				.framerate = SPA_FRACTION(25, 1)));
+	exported_node = NULL;
+	spa_assert_se(pw_stream_connect(stream, PW_DIRECTION_INPUT, PW_ID_ANY,
+			PW_STREAM_FLAG_INACTIVE |
+			PW_STREAM_FLAG_RING |
+			PW_STREAM_FLAG_RT_PROCESS, params, 1) == 0);
+	/* the server is asked to make the ring */
+	spa_assert_se(spa_atob(pw_properties_get(pw_stream_get_properties(stream),
+					"stream.ring")));
+
+	/* no ring until the server gives it */
+	spa_assert_se(pw_stream_ring_read(stream, NULL, 0, 0) == 0);
+
+	ring_size = pw_node_ring_get_size(RING_SIZE, 2);
+	ring = calloc(1, ring_size);
+	spa_assert_se(ring != NULL);
+	pw_node_ring_init(ring, RING_SIZE, 2, RING_WAKEUP);
+	spa_assert_se(pw_node_ring_check(ring, ring_size));
+	spa_assert_se(!pw_node_ring_check(ring, ring_size - 1));
+
+	node = exported_node;
+	spa_assert_se(node != NULL);
+	spa_assert_se(spa_node_set_io(node, SPA_IO_Memory, ring, ring_size) == 0);
+	spa_assert_se(spa_node_port_set_io(node, SPA_DIRECTION_INPUT, 0,
+			SPA_IO_Buffers, &io, sizeof(io)) == 0);
+
+	/* two buffers with two planes, every plane has its own pattern */
+	for (i = 0; i < 2; i++) {
+		for (j = 0; j < 2; j++) {
+			memset(mem[i][j], 0x10 * (i + 1) + j, RING_CHUNK);
+			chunks[i][j] = (struct spa_chunk) { .offset = 0, .size = RING_CHUNK, };
+			datas[i][j] = (struct spa_data) {
+				.type = SPA_DATA_MemPtr,
+				.maxsize = RING_CHUNK,
+				.data = mem[i][j],
+				.chunk = &chunks[i][j], };
+		}
+		bufs[i] = (struct spa_buffer) { .n_datas = 2, .datas = datas[i], };
+		buffers[i] = &bufs[i];
+	}
+	spa_assert_se(spa_node_port_use_buffers(node, SPA_DIRECTION_INPUT, 0, 0,
+			buffers, 2) == 0);
+
+	/* the server did not write the ring, the stream writes it and only
+	 * calls process once when the wakeup level is reached */
+	process_count = 0;
+	fill_queue(node, &io, 1);
+	spa_assert_se(io.status == SPA_STATUS_NEED_DATA);
+	spa_assert_se(process_count == 0);
+	fill_queue(node, &io, 2);
+	spa_assert_se(process_count == 1);
+	spa_assert_se(pw_stream_ring_read(stream, NULL, 0, 0) == 3 * RING_CHUNK);
+
+	/* all planes are kept in order */
+	spa_assert_se(pw_stream_ring_read(stream, planes, 2, RING_SIZE) == 3 * RING_CHUNK);
+	for (i = 0; i < 3 * RING_CHUNK; i++) {
+		uint32_t b = i < 2 * RING_CHUNK ? 0 : 1;
+		spa_assert_se(out[0][i] == 0x10 * (b + 1));
+		spa_assert_se(out[1][i] == 0x10 * (b + 1) + 1);
+	}
+	spa_assert_se(pw_stream_ring_read(stream, NULL, 0, 0) == 0);
+
+	/* the server wrote the ring and asked for a wakeup, the stream only
+	 * calls process and does not write again */
+	spa_assert_se(pw_node_ring_write(ring, RING_SIZE, 2, RING_WAKEUP, buffers[0]) == 0);
+	spa_assert_se(pw_node_ring_write(ring, RING_SIZE, 2, RING_WAKEUP, buffers[1]) == 1);
+	spa_assert_se(pw_node_ring_write(ring, RING_SIZE, 2, RING_WAKEUP, buffers[0]) == 0);
+	recycle_queue(node, &io, 1);
+	spa_assert_se(process_count == 2);
+	recycle_queue(node, &io, 1);
+	spa_assert_se(process_count == 2);
+	spa_assert_se(pw_stream_ring_read(stream, NULL, 0, 0) == 3 * RING_CHUNK);
+
+	/* data that does not fit is dropped and counted */
+	for (i = 0; i < 5; i++)
+		spa_assert_se(pw_node_ring_write(ring, RING_SIZE, 2, RING_WAKEUP, buffers[0]) == 0);
+	spa_assert_se(pw_stream_ring_get_overruns(stream) == 0);
+	spa_assert_se(pw_node_ring_write(ring, RING_SIZE, 2, RING_WAKEUP, buffers[0]) == 0);
+	spa_assert_se(pw_stream_ring_get_overruns(stream) == 1);
+	spa_assert_se(pw_stream_ring_read(stream, NULL, 0, 0) == RING_SIZE);
+
+	/* reading allows the next wakeup */
+	spa_assert_se(pw_stream_ring_read(stream, planes, 1, RING_SIZE) == RING_SIZE);
+	spa_assert_se(pw_node_ring_write(ring, RING_SIZE, 2, RING_WAKEUP, buffers[0]) == 0);
+	spa_assert_se(pw_node_ring_write(ring, RING_SIZE, 2, RING_WAKEUP, buffers[0]) == 1);
+
+	/* the writer does not use the header that the reader can change and
+	 * drops the data when the read index is bogus */
+	ring->size = RING_SIZE * 4;
+	ring->n_planes = PW_NODE_RING_MAX_PLANES;
+	ring->ring.readindex = ring->ring.writeindex + RING_SIZE;
+	spa_assert_se(pw_node_ring_write(ring, RING_SIZE, 2, RING_WAKEUP, buffers[0]) == 0);
+	ring->ring.readindex = ring->ring.writeindex - RING_SIZE * 2;
+	spa_assert_se(pw_node_ring_write(ring, RING_SIZE, 2, RING_WAKEUP, buffers[0]) == 0);
+	spa_assert_se(pw_stream_ring_get_overruns(stream) == 3);
+
+	spa_assert_se(spa_node_set_io(node, SPA_IO_Memory, NULL, 0) == 0);
+	spa_assert_se(pw_stream_ring_read(stream, NULL, 0, 0) == 0);
+	spa_assert_se(pw_stream_ring_get_overruns(stream) == 0);
+
+	spa_node_port_use_buffers(node, SPA_DIRECTION_INPUT, 0, 0, NULL, 0);
+
+	pw_stream_destroy(stream);
+	pw_context_destroy(context);
+	pw_main_loop_destroy(loop);
+	free(ring);
+}
+
 int main(int argc, char *argv[])
 {
 	pw_init(&argc, &argv);
@@ -230,6 +521,8 @@ int main(int argc, char *argv[])
 	test_abi();
 	test_create();
 	test_properties();
+	test_dequeue_latest();
+	test_ring();
 
 	pw_deinit();
 
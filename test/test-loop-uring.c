@@ -0,0 +1,177 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pwtest.h"
+
+#include <pipewire/pipewire.h>
+#include <pipewire/thread-loop.h>
+
+/* Run the loop on the io_uring system of support/libspa-uring. The tests
+ * are skipped when the plugin is not built or the kernel can't make a ring. */
+
+#define N_EVENTS	1000
+
+struct data {
+	struct pw_loop *l;
+	struct pw_thread_loop *tl;
+	int io_count;
+	int timer_count;
+	int event_count;
+	int invoke_count;
+};
+
+static struct pw_loop *uring_loop_new(void)
+{
+	struct spa_dict_item items[] = {
+		{ PW_KEY_LIBRARY_NAME_SYSTEM, "support/libspa-uring" },
+	};
+	return pw_loop_new(&SPA_DICT_INIT_ARRAY(items));
+}
+
+static void on_io(void *data, int fd, uint32_t mask)
+{
+	struct data *d = data;
+	char c;
+
+	pwtest_int_eq(read(fd, &c, 1), 1);
+	d->io_count++;
+}
+
+static void on_timer(void *data, uint64_t expirations)
+{
+	struct data *d = data;
+	d->timer_count += expirations;
+}
+
+PWTEST(uring_io_and_timer)
+{
+	struct data data;
+	struct spa_source *io, *timer;
+	struct timespec value = { 0, 1000000 }, interval = { 0, 1000000 };
+	int fds[2], i;
+
+	pw_init(0, NULL);
+
+	spa_zero(data);
+	if ((data.l = uring_loop_new()) == NULL) {
+		pw_deinit();
+		return PWTEST_SKIP;
+	}
+	pwtest_errno_ok(pipe(fds));
+	pwtest_int_eq(write(fds[1], "abc", 3), 3);
+
+	io = pw_loop_add_io(data.l, fds[0], SPA_IO_IN, false, on_io, &data);
+	timer = pw_loop_add_timer(data.l, on_timer, &data);
+	pw_loop_update_timer(data.l, timer, &value, &interval, false);
+
+	/* the io source is level triggered, it fires until the pipe is empty */
+	pw_loop_enter(data.l);
+	for (i = 0; i < 1000 && (data.io_count < 3 || data.timer_count < 5); i++)
+		pw_loop_iterate(data.l, 100);
+	pwtest_int_eq(data.io_count, 3);
+	pwtest_int_ge(data.timer_count, 5);
+
+	/* a disabled timer does not fire again */
+	pw_loop_update_timer(data.l, timer, NULL, NULL, false);
+	data.timer_count = 0;
+	for (i = 0; i < 3; i++)
+		pw_loop_iterate(data.l, 5);
+	pwtest_int_eq(data.timer_count, 0);
+	pw_loop_leave(data.l);
+
+	pw_loop_destroy_source(data.l, io);
+	pw_loop_destroy_source(data.l, timer);
+	close(fds[0]);
+	close(fds[1]);
+	pw_loop_destroy(data.l);
+
+	pw_deinit();
+
+	return PWTEST_PASS;
+}
+
+static void on_event(void *data, uint64_t count)
+{
+	struct data *d = data;
+	d->event_count += count;
+	pw_thread_loop_signal(d->tl, false);
+}
+
+static int do_invoke(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct data *d = user_data;
+	d->invoke_count++;
+	return 0;
+}
+
+PWTEST(uring_thread_wakeups)
+{
+	struct data data;
+	struct spa_source *event, *io;
+	int fds[2], i;
+
+	pw_init(0, NULL);
+
+	spa_zero(data);
+	if ((data.l = uring_loop_new()) == NULL) {
+		pw_deinit();
+		return PWTEST_SKIP;
+	}
+	data.tl = pw_thread_loop_new_full(data.l, "uring-test", NULL);
+	pwtest_ptr_notnull(data.tl);
+	pwtest_errno_ok(pipe(fds));
+
+	pw_thread_loop_lock(data.tl);
+	event = pw_loop_add_event(data.l, on_event, &data);
+	pwtest_int_eq(pw_thread_loop_start(data.tl), 0);
+
+	/* eventfd writes from another thread wake up the loop thread */
+	for (i = 0; i < N_EVENTS; i++) {
+		pw_loop_signal_event(data.l, event);
+		while (data.event_count == 0)
+			pw_thread_loop_wait(data.tl);
+		data.event_count = 0;
+	}
+
+	/* sources are added and removed from another thread while the loop
+	 * thread waits */
+	for (i = 0; i < N_EVENTS; i++) {
+		io = pw_loop_add_io(data.l, fds[0], SPA_IO_IN, false, on_io, &data);
+		pwtest_ptr_notnull(io);
+		pw_loop_destroy_source(data.l, io);
+	}
+
+	/* blocking invokes are run in the loop thread, the lock is released
+	 * while we wait for them */
+	for (i = 0; i < N_EVENTS; i++)
+		pw_loop_invoke(data.l, do_invoke, 0, NULL, 0, true, &data);
+	pwtest_int_eq(data.invoke_count, N_EVENTS);
+	pwtest_int_eq(data.io_count, 0);
+	pw_thread_loop_unlock(data.tl);
+
+	pw_thread_loop_stop(data.tl);
+	pw_loop_destroy_source(data.l, event);
+	pw_thread_loop_destroy(data.tl);
+	close(fds[0]);
+	close(fds[1]);
+	pw_loop_destroy(data.l);
+
+	pw_deinit();
+
+	return PWTEST_PASS;
+}
+
+PWTEST_SUITE(pwtest_loop_uring)
+{
+	pwtest_add(uring_io_and_timer, PWTEST_NOARG);
+	pwtest_add(uring_thread_wakeups, PWTEST_NOARG);
+
+	return PWTEST_PASS;
+}